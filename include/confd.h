@@ -23,6 +23,36 @@ enum conf_type{
 	TYPE_BOOLEAN =0xAF04,
 };
 
+// confd pipelined request
+struct confd_request{
+	enum conf_type type;
+	bool set;
+	const char*path;
+	union{
+		char*string;
+		int64_t integer;
+		bool boolean;
+	}value;
+	int code;
+};
+
+// confd local cached subtree
+struct confd_cache;
+
+// confd watch event, type is 0 when item deleted, resync is set when events
+// were dropped or the tree changed and the whole watched path must be re-read
+struct confd_event{
+	bool resync;
+	enum conf_type type;
+	char*path;
+	uid_t uid;
+	union{
+		char*string;
+		int64_t integer;
+		bool boolean;
+	}value;
+};
+
 // src/confd/client.c: open confd socket
 extern int open_confd_socket(bool quiet,char*tag,char*path);
 
@@ -61,6 +91,43 @@ extern int confd_include_file(const char*file);
 // src/confd/client.c: set default config file path
 extern int confd_set_default_config(const char*file);
 
+// src/confd/client.c: send many get/set requests before reading replies
+extern int confd_pipeline(struct confd_request*reqs,size_t cnt);
+
+// src/confd/client.c: get many values in one request
+extern int confd_get_multi(struct confd_request*reqs,size_t cnt);
+
+// src/confd/client.c: set many values in one request
+extern int confd_set_multi(struct confd_request*reqs,size_t cnt);
+
+// src/confd/client.c: fetch a whole subtree into local cache in one request
+extern struct confd_cache*confd_fetch_subtree(const char*path);
+
+// src/confd/client.c: open a dedicated connection watching changes under path
+extern int confd_watch_open(const char*sock,const char*path);
+
+// src/confd/client.c: watch one more path on a watch connection
+extern int confd_watch_add(int fd,const char*path);
+
+// src/confd/client.c: wait and read next change event from watch connection
+extern int confd_watch_read(int fd,struct confd_event*ev);
+
+// src/confd/client.c: free change event contents
+extern void confd_event_free(struct confd_event*ev);
+
+// src/confd/cache.c: free local cache
+extern void confd_cache_free(struct confd_cache*cache);
+
+#define DECLARE_CACHE_FUNC(func,ret,...) \
+	extern ret func(struct confd_cache*cache,const char*path __VA_ARGS__);\
+	extern ret func##_base(struct confd_cache*cache,const char*base,const char*path __VA_ARGS__);\
+	extern ret func##_dict(struct confd_cache*cache,const char*base,const char*key,const char*path __VA_ARGS__);
+DECLARE_CACHE_FUNC(confd_cache_get_type,    enum conf_type);
+DECLARE_CACHE_FUNC(confd_cache_ls,          char**);
+DECLARE_CACHE_FUNC(confd_cache_get_string,  char*,   ,const char*def);
+DECLARE_CACHE_FUNC(confd_cache_get_integer, int64_t, ,int64_t def);
+DECLARE_CACHE_FUNC(confd_cache_get_boolean, bool,    ,bool def);
+
 #define DECLARE_FUNC(func,ret,...) \
 	extern ret func(const char*path __VA_ARGS__); \
 	extern ret func##_base(const char*base,const char*path __VA_ARGS__);\
@@ -14,6 +14,16 @@
 
 extern int devfd;
 
+// probed block device info, empty string when the tag is not found
+struct devd_probe{
+	char dev[256];
+	char type[64];
+	char uuid[64];
+	char label[256];
+	char partuuid[64];
+	char partlabel[256];
+};
+
 // src/devd/devtmpfs.c: create all device node when no CONFIG_DEVTMPFS
 extern int init_devtmpfs(char*path);
 
@@ -50,6 +60,33 @@ extern int devd_call_modload(void);
 // src/devd/devd.c: call DEV_QUIT to terminate devd
 extern int devd_call_quit(void);
 
+// src/devd/devd.c: call DEV_PROBE to lookup a block device by path or TAG=VALUE
+extern int devd_probe_query(const char*spec,struct devd_probe*out);
+
+// src/devd/probe.c: probe superblock and partition entry of a block device in one pass
+extern int devd_probe_block(const char*dev,struct devd_probe*out);
+
+// src/devd/probe.c: init the cache locks (devd only)
+extern void devd_probe_init(void);
+
+// src/devd/probe.c: probe a block device and update the cache (devd only)
+extern int devd_probe_update(const char*dev);
+
+// src/devd/probe.c: drop a block device from the cache (devd only)
+extern void devd_probe_remove(const char*dev);
+
+// src/devd/probe.c: lookup the cache by path or TAG=VALUE (devd only)
+extern int devd_probe_lookup(const char*spec,struct devd_probe*out);
+
+// src/devd/probe.c: lookup a block device from devd, probe by self if devd is not running
+extern int devd_probe(const char*spec,struct devd_probe*out);
+
+// src/devd/probe.c: resolve path or TAG=VALUE to device path like blkid_evaluate_tag
+extern char*devd_probe_evaluate(const char*spec);
+
+// src/devd/probe.c: get a tag of a block device like blkid_get_tag_value
+extern char*devd_probe_tag(const char*dev,const char*tag);
+
 // open default devd socket
 #define open_default_devd_socket(tag) open_devd_socket(tag,DEFAULT_DEVD)
 
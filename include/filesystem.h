@@ -11,6 +11,12 @@
 #include<errno.h>
 #include<stdbool.h>
 #include<sys/types.h>
+#ifdef ENABLE_UEFI
+#define __NEED_struct_iovec
+#include<bits/alltypes.h>
+#else
+#include<sys/uio.h>
+#endif
 #include"defines.h"
 #include"url.h"
 
@@ -27,11 +33,13 @@ typedef struct fs_file_info fs_file_info;
 typedef struct fsvol_info fsvol_info;
 typedef enum fs_type fs_type;
 typedef enum fs_feature fs_feature;
+typedef enum fs_info_field fs_info_field;
 typedef enum fs_ioctl_id fs_ioctl_id;
 typedef enum fs_file_flag fs_file_flag;
 typedef enum fs_wait_flag fs_wait_flag;
 typedef enum fsvol_feature fsvol_feature;
 typedef void fs_handle_close(const char*name,fsh*f,void*data);
+typedef struct fs_aio fs_aio;
 
 enum fs_type{
 	FS_TYPE_NONE           = 0x00000000,
@@ -92,9 +100,22 @@ enum fs_feature{
 	FS_FEATURE_HAVE_PATH      = 0x0000000000000100,
 	FS_FEATURE_HAVE_TIME      = 0x0000000000000200,
 	FS_FEATURE_HAVE_FOLDER    = 0x0000000000000400,
+	FS_FEATURE_HAVE_MAP       = 0x0000000000000800,
 	_FS_FEATURE_MAX           = UINT64_MAX,
 };
 
+// fields of fs_file_info wanted by bulk readdir, name is always filled
+enum fs_info_field{
+	FS_INFO_FIELD_NONE        = 0x00,
+	FS_INFO_FIELD_TYPE        = 0x01,
+	FS_INFO_FIELD_SIZE        = 0x02,
+	FS_INFO_FIELD_TIME        = 0x04,
+	FS_INFO_FIELD_MODE        = 0x08,
+	FS_INFO_FIELD_DEVICE      = 0x10,
+	FS_INFO_FIELD_TARGET      = 0x20,
+	FS_INFO_FIELD_ALL         = 0x3F,
+};
+
 enum fs_wait_flag{
 	_FILE_WAIT_NONE      = 0x0000000000000000,
 	FILE_WAIT_READ       = 0x0000000000000001,
@@ -202,7 +223,13 @@ extern int fs_open_uri(fsh**nf,url*uri,fs_file_flag flag);
 extern int fs_read(fsh*f,void*buffer,size_t btr,size_t*br);
 extern int fs_read_alloc(fsh*f,void**buffer,size_t btr,size_t*br);
 extern int fs_readdir(fsh*f,fs_file_info*info);
+extern int fs_readdir_bulk(fsh*f,fs_file_info*infos,size_t cnt,size_t*got,fs_info_field fields);
 extern int fs_write(fsh*f,void*buffer,size_t btw,size_t*bw);
+extern int fs_preadv(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*br);
+extern int fs_pwritev(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*bw);
+extern int fs_read_async(fsh*f,void*buffer,size_t btr,size_t off,fs_aio**req);
+extern int fs_write_async(fsh*f,void*buffer,size_t btw,size_t off,fs_aio**req);
+extern int fs_wait_async(fs_aio**req,size_t*bytes,long timeout);
 extern int fs_printf(fsh*f,const char*format,...) __attribute__((format(printf,2,3)));
 extern int fs_print(fsh*f,const char*str);
 extern int fs_println(fsh*f,const char*str);
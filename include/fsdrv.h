@@ -31,8 +31,11 @@ extern int fs_flush_locked(fsh*f);
 extern int fs_exists_locked(fsh*f,const char*uri,bool*exists,bool lock);
 extern int fs_open_locked(fsh*f,fsh**nf,const char*uri,fs_file_flag flag,bool lock);
 extern int fs_readdir_locked(fsh*f,fs_file_info*info);
+extern int fs_readdir_bulk_locked(fsh*f,fs_file_info*infos,size_t cnt,size_t*got,fs_info_field fields);
 extern int fs_read_locked(fsh*f,void*buffer,size_t btr,size_t*br);
 extern int fs_write_locked(fsh*f,void*buffer,size_t btw,size_t*bw);
+extern int fs_preadv_locked(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*br);
+extern int fs_pwritev_locked(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*bw);
 extern int fs_wait_locked(fsh**gots,fsh**waits,size_t cnt,long timeout,fs_wait_flag flag,bool lock);
 extern int fs_seek_locked(fsh*f,size_t pos,int whence);
 extern int fs_tell_locked(fsh*f,size_t*pos);
@@ -61,6 +64,8 @@ extern int fs_full_read_to_locked(fsh*f,fsh*t,size_t size);
 extern int fs_full_read_to_fd_locked(fsh*f,int fd,size_t size);
 extern int fs_read_all_to_locked(fsh*f,fsh*t,size_t*size);
 extern int fs_read_all_to_fd_locked(fsh*f,int fd,size_t*size);
+extern int fs_get_fd_locked(fsh*f,int*fd);
+extern int fs_transfer_locked(fsh*f,int fd,size_t size,size_t*sent);
 extern int fs_get_features_locked(fsh*f,fs_feature*features);
 extern int fs_rename_locked(fsh*f,const char*to);
 extern int fs_rename_uri_locked(fsh*f,url*to);
@@ -72,7 +77,11 @@ extern int fs_add_on_close_locked(fsh*f,const char*name,fs_handle_close*hand,voi
 extern void fsdrv_posix_close(const fsdrv*drv,fsh*f);
 extern int fsdrv_posix_read(const fsdrv*drv,fsh*f,void*buffer,size_t btr,size_t*br);
 extern int fsdrv_posix_write(const fsdrv*drv,fsh*f,void*buffer,size_t btw,size_t*bw);
+extern int fsdrv_posix_preadv(const fsdrv*drv,fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*br);
+extern int fsdrv_posix_pwritev(const fsdrv*drv,fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*bw);
 extern int fsdrv_posix_wait(const fsdrv*drv,fsh**gots,fsh**waits,size_t cnt,long timeout,fs_wait_flag flag);
+extern int fsdrv_posix_get_fd(const fsdrv*drv,fsh*f,int*fd);
+extern int fsdrv_posix_transfer(const fsdrv*drv,fsh*f,int fd,size_t size,size_t*sent);
 extern const fsdrv*fsdrv_lookup(url*u);
 extern bool fsdrv_check(const fsdrv*drv);
 extern int fsdrv_register(fsdrv*drv);
@@ -98,6 +107,7 @@ typedef int(*fs_drv_open)(const fsdrv*drv,fsh*nf,url*uri,fs_file_flag flag);
 typedef int(*fs_drv_read)(const fsdrv*drv,fsh*f,void*buffer,size_t btr,size_t*br);
 typedef int(*fs_drv_read_all)(const fsdrv*drv,fsh*f,void**buffer,size_t*br);
 typedef int(*fs_drv_readdir)(const fsdrv*drv,fsh*f,fs_file_info*info);
+typedef int(*fs_drv_readdir_bulk)(const fsdrv*drv,fsh*f,fs_file_info*infos,size_t cnt,size_t*got,fs_info_field fields);
 typedef int(*fs_drv_write)(const fsdrv*drv,fsh*f,void*buffer,size_t btw,size_t*bw);
 typedef int(*fs_drv_seek)(const fsdrv*drv,fsh*f,size_t pos,int whence);
 typedef int(*fs_drv_tell)(const fsdrv*drv,fsh*f,size_t*pos);
@@ -112,6 +122,10 @@ typedef int(*fs_drv_resize)(const fsdrv*drv,fsh*f,size_t size);
 typedef int(*fs_drv_rename)(const fsdrv*drv,fsh*f,url*to);
 typedef int(*fs_drv_ioctl)(const fsdrv*drv,fsh*f,fs_ioctl_id id,va_list args);
 typedef int(*fs_drv_wait)(const fsdrv*drv,fsh**gots,fsh**waits,size_t cnt,long timeout,fs_wait_flag flag);
+typedef int(*fs_drv_get_fd)(const fsdrv*drv,fsh*f,int*fd);
+typedef int(*fs_drv_transfer)(const fsdrv*drv,fsh*f,int fd,size_t size,size_t*sent);
+typedef int(*fs_drv_preadv)(const fsdrv*drv,fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*br);
+typedef int(*fs_drv_pwritev)(const fsdrv*drv,fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*bw);
 typedef int(*fs_drv_uri_parse)(const fsdrv*drv,fsh*f,const char*uri,url*u);
 typedef int(*fs_drv_getcwd)(const fsdrv*drv,char*buff,size_t buff_len);
 typedef int(*fs_vol_update)(const fsvol*drv,fsvol_private_info*info);
@@ -135,6 +149,7 @@ struct fsdrv{
 	fs_drv_read read;
 	fs_drv_read_all read_all;
 	fs_drv_readdir readdir;
+	fs_drv_readdir_bulk readdir_bulk;
 	fs_drv_write write;
 	fs_drv_seek seek;
 	fs_drv_tell tell;
@@ -149,6 +164,10 @@ struct fsdrv{
 	fs_drv_rename rename;
 	fs_drv_ioctl ioctl;
 	fs_drv_wait wait;
+	fs_drv_get_fd get_fd;
+	fs_drv_transfer transfer;
+	fs_drv_preadv preadv;
+	fs_drv_pwritev pwritev;
 	fs_drv_getcwd getcwd;
 	fs_drv_uri_parse uri_parse;
 };
@@ -39,6 +39,7 @@ enum init_action{
 	ACTION_SVC_RELOAD =0xBE12,
 	ACTION_SVC_DUMP   =0xBE13,
 	ACTION_SVC_STATUS =0xBE14,
+	ACTION_TRACE_DUMP =0xBE15,
 };
 extern enum init_action action;
 
@@ -9,6 +9,7 @@
 #ifndef _LOGGER_H
 #define _LOGGER_H
 #include<time.h>
+#include<stdint.h>
 #include<stdbool.h>
 #include"pathnames.h"
 #define DEFAULT_LOGGER _PATH_RUN"/loggerd.sock"
@@ -41,17 +42,28 @@ struct log_item{
 };
 
 // log storage item
-struct log_buff{
+// log record in log ring buffer, followed by NUL terminated tag and content
+struct log_rec{
+	uint64_t seq;
+	uint32_t size;
+	uint32_t tag_len;
+	uint32_t content_len;
 	enum log_level level;
-	char*tag,*content;
-	time_t time;
 	pid_t pid;
+	time_t time;
+	char data[];
 };
+#define LOG_REC_TAG(rec)((rec)->data)
+#define LOG_REC_CONTENT(rec)((rec)->data+(rec)->tag_len+1)
 
-#ifdef _LIST_H
-// src/loggerd/buffer.c: log storage
-extern list*logbuffer;
-#endif
+// log ring buffer reader, return false to stop
+typedef bool log_rec_cb(struct log_rec*rec,void*data);
+
+// src/loggerd/buffer.c: walk log records in place from seq, return next seq to read
+extern uint64_t logger_buffer_foreach(uint64_t seq,log_rec_cb*cb,void*data);
+
+// src/loggerd/buffer.c: resize log ring buffer, keep newest records that fit
+extern int logger_buffer_set_size(size_t size);
 
 #ifndef ENABLE_UEFI
 // src/loggerd/client.c: current logfd
@@ -87,6 +99,12 @@ extern int logger_syslog(void);
 // src/loggerd/client.c: reopen all active consoles
 extern int logger_open_console(void);
 
+// src/loggerd/client.c: resize loggerd log ring buffer
+extern int logger_set_buffer_size(size_t size);
+
+// src/loggerd/client.c: set loggerd file output option
+extern int logger_set_file_option(const char*key,const char*value);
+
 // src/loggerd/client.c: launch loggerd
 extern int start_loggerd(pid_t*p);
 #else
@@ -99,6 +117,8 @@ static inline int logger_open(char*file __attribute__((unused))){return -1;}
 static inline int logger_exit(void){return -1;}
 static inline int logger_klog(void){return -1;}
 static inline int logger_syslog(void){return -1;}
+static inline int logger_set_buffer_size(size_t size){return logger_buffer_set_size(size);}
+static inline int logger_set_file_option(const char*key __attribute__((unused)),const char*value __attribute__((unused))){return -1;}
 static inline int start_loggerd(int*p __attribute__((unused))){return -1;}
 extern void logger_set_console(bool enabled);
 extern void logger_init(void);
@@ -88,10 +88,18 @@ struct service{
 	bool wait_restart;
 	bool stdio_syslog;
 	bool ignore_failed;
+	bool notify;
+	bool ready;
+	int notify_fd;
+	char*notify_status;
+	time_t ready_timeout;
+	time_t ready_deadline;
 	time_t restart_delay;
 	time_t last_update;
 	int restart_max,retry;
 	struct proc_status process;
+	int pidfd;
+	struct timespec stop_begin;
 	enum svc_work mode;
 	enum svc_status status;
 	list*depends_on;
@@ -202,9 +210,66 @@ extern int svc_set_reload_command(struct service*svc,char*path,char**args,char**
 // src/service/data.c: lookup service from storage by name
 extern struct service*svc_lookup_by_name(char*name);
 
+// src/service/dump.c: dump services chain which gated boot the longest
+extern int svc_dump_critical_path(void);
+
+// src/service/execute.c: kill service execute if it runs out of time
+extern int svc_check_exec_timeout(struct svc_exec*exec);
+
+// src/service/execute.c: check timeout of all services execute
+extern int svc_check_all_exec_timeout(void);
+
+// src/service/execute.c: get time of next execute timeout check, 0 for none
+extern time_t svc_exec_deadline(struct svc_exec*exec);
+
 // src/service/sigchld.c: service SIGCHLD handler
 extern int svc_on_sigchld(pid_t pid,int st);
 
+// src/service/graph.c: check service is ready for its dependents
+extern bool svc_is_ready(struct service*svc);
+
+// src/service/graph.c: sort service and all depends in start order, fail on loop
+extern int svc_graph_order(struct service*svc,list**order);
+
+// src/service/graph.c: wait until service leaves starting status
+extern int svc_wait_ready(struct service*svc);
+
+// src/service/graph.c: get counter of scheduler handled events
+extern unsigned long svc_state_serial(void);
+
+// src/service/graph.c: wait scheduler handle an event after serial, until deadline
+extern int svc_wait_state(unsigned long*serial,struct timespec*deadline);
+
+// src/service/notify.c: open readiness notify socket for service start
+extern int svc_notify_open(struct service*svc);
+
+// src/service/notify.c: close readiness notify socket
+extern void svc_notify_close(struct service*svc);
+
+// src/service/notify.c: build NOTIFY_SOCKET environment variable for service
+extern int svc_notify_env(struct service*svc,char*buff,size_t len);
+
+// src/service/notify.c: process pending readiness notify messages
+extern int svc_notify_read(struct service*svc);
+
+// src/service/notify.c: fail service if readiness notify timed out
+extern void svc_notify_check_timeout(struct service*svc);
+
+// src/service/process.c: open pidfd of process, ENOSYS when kernel has no pidfd
+extern int svc_pidfd_open(pid_t pid);
+
+// src/service/process.c: send signal through pidfd, or by pid without pidfd
+extern int svc_pidfd_kill(int fd,pid_t pid,int sig);
+
+// src/service/process.c: wait process exit in milliseconds, negative timeout for forever
+extern int svc_pidfd_wait(int fd,pid_t pid,long timeout);
+
+// src/service/process.c: hold pidfd of service main process, fail if it is gone
+extern int svc_track_process(struct service*svc,pid_t pid);
+
+// src/service/process.c: close pidfd of service main process
+extern void svc_untrack_process(struct service*svc);
+
 // src/service/start.c: read daemon mode pid file
 extern int svc_daemon_get_pid(struct service*svc);
 
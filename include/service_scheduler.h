@@ -8,6 +8,7 @@
 
 #ifndef SERVICE_SCHEDULER_H
 #define SERVICE_SCHEDULER_H
+#include<stdint.h>
 #include"lock.h"
 #include"pool.h"
 #include"service.h"
@@ -39,6 +40,13 @@ struct scheduler_msg{
 struct scheduler_work{
 	enum scheduler_action action;
 	struct service*service;
+	bool dispatched;
+	bool waiting;
+	bool restart;
+	size_t pending;
+	list*dependents;
+	struct service*failed_dep;
+	uint64_t begin;
 };
 
 // src/service/scheduler.c: service workers thread pool
@@ -68,4 +76,16 @@ extern int run_queue(void);
 // src/service/scheduler.c: add all stop action to queue
 extern int add_all_stop_queue(void);
 
+// src/service/graph.c: queue service and its depends as a start graph
+extern int svc_graph_start(struct service*svc);
+
+// src/service/graph.c: hand a work without pending depends to workers
+extern void svc_graph_dispatch(struct scheduler_work*w);
+
+// src/service/graph.c: release dependents of a finished start work
+extern void svc_graph_done(struct scheduler_work*w);
+
+// src/service/graph.c: finish start works which left starting status
+extern void svc_graph_update(void);
+
 #endif
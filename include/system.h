@@ -73,6 +73,26 @@ extern char*ucred2string(struct ucred*c,char*buff,size_t size,bool with_pid);
 
 // src/lib/modules.c: lookup and load module by alias
 extern int insmod(const char*alias,bool log);
+
+// src/lib/modules.c: keep kmod context and alias cache for insmod, revalidate if already opened
+extern int modules_cache_open(bool log);
+
+// src/lib/modules.c: forget a module unloaded from kernel
+extern void modules_cache_forget(const char*name);
+
+// src/lib/modules.c: release kmod context and alias cache
+extern void modules_cache_close(void);
+
+// result of insmod_batch
+struct insmod_stat{
+	size_t aliases;
+	size_t modules;
+	size_t loaded;
+	size_t failed;
+};
+
+// src/lib/modules.c: load modules of all aliases, probe them with threads
+extern int insmod_batch(char**aliases,size_t cnt,int threads,bool log,struct insmod_stat*st);
 #endif
 
 // src/lib/file.c: remove all sub folders (depth 1)
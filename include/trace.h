@@ -0,0 +1,61 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+#include<stdint.h>
+#include<stdbool.h>
+#include<sys/types.h>
+
+// max spans kept in trace buffer, later spans are dropped
+#define TRACE_MAX 1024
+
+// a timestamped span, end is 0 while it is still open
+struct trace_event{
+	uint64_t begin,end;
+	pid_t pid;
+	char cat[12];
+	char name[52];
+};
+
+// shared by init and all its forked children
+struct trace_buffer{
+	uint32_t count;
+	uint32_t dropped;
+	uint64_t base;
+	struct trace_event events[TRACE_MAX];
+};
+
+// src/lib/trace.c: trace buffer, NULL when tracing is not initialized
+extern struct trace_buffer*trace;
+
+// src/lib/trace.c: map shared trace buffer, call before fork any child
+extern int trace_init(void);
+
+// src/lib/trace.c: get monotonic time in nanoseconds
+extern uint64_t trace_now(void);
+
+// src/lib/trace.c: open a span, return span id, -1 if not recorded
+extern int trace_begin(const char*cat,const char*fmt,...) __attribute__((format(printf,2,3)));
+
+// src/lib/trace.c: close a span opened by trace_begin
+extern void trace_end(int id);
+
+// src/lib/trace.c: record a finished span
+extern int trace_span(uint64_t begin,uint64_t end,const char*cat,const char*fmt,...) __attribute__((format(printf,4,5)));
+
+// src/lib/trace.c: find the last span by category and name
+extern struct trace_event*trace_lookup(const char*cat,const char*name);
+
+// src/lib/trace.c: dump all spans to loggerd
+extern void trace_dump(void);
+
+// src/lib/trace.c: write spans as chrome trace event json
+extern int trace_export_chrome(int fd);
+
+#endif
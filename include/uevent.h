@@ -8,8 +8,12 @@
 
 #ifndef UEVENT_H
 #define UEVENT_H
+#include<stddef.h>
 #include"keyval.h"
 
+// max environs kept in a parsed uevent view
+#define UEVENT_ENVS 64
+
 // uevent action (from kernel)
 enum uevent_action{
 	ACTION_UNKNOWN,
@@ -36,6 +40,9 @@ struct uevent{
 	char*modalias;
 	long seqnum;
 	keyval**environs;
+	// KEY=VALUE strings in the parsed buffer, used when environs is NULL
+	char*envs[UEVENT_ENVS];
+	size_t envc;
 };
 typedef struct uevent uevent;
 
@@ -48,6 +55,12 @@ extern uevent*uevent_parse_x(char**envs,uevent*data);
 // src/devd/uevent.c: convert environ string to struct uevent
 extern uevent*uevent_parse(char*envs,uevent*data);
 
+// src/devd/uevent.c: parse environ buffer in place, strings point into buff
+extern uevent*uevent_parse_view(char*buff,size_t len,uevent*data);
+
+// src/devd/uevent.c: get a environ value of uevent
+extern char*uevent_get(uevent*data,const char*key);
+
 // src/devd/uevent.c: convert string to uevent_action
 extern enum uevent_action uevent_chars2action(char* act);
 
@@ -15,17 +15,17 @@
 #include<sys/stat.h>
 #include<sys/ioctl.h>
 #include<linux/loop.h>
-#include<blkid/blkid.h>
 #include"str.h"
 #include"boot.h"
 #include"confd.h"
+#include"devd.h"
 #include"logger.h"
 #include"system.h"
 #include"defines.h"
+#include"trace.h"
 #include"init_internal.h"
 #define TAG "switchroot"
 #define EGOTO(_num){e=(_num);goto fail;}
-static blkid_cache cache=NULL;
 
 static char*get_block(char*path,int wait){
 	struct stat st;
@@ -41,7 +41,7 @@ static char*get_block(char*path,int wait){
 
 	// resolve root block tag
 	if(block[0]!='/'){
-		char*x=blkid_evaluate_tag(block,NULL,NULL);
+		char*x=devd_probe_evaluate(block);
 		free(block);
 		if(!x){
 			telog_error("resolve tag %s",path);
@@ -76,8 +76,7 @@ static char*get_fstype(boot_config*boot,const char*path,char*key,char*buf,size_t
 
 	// fstype not set, auto detect
 	errno=0;
-	if(!cache)blkid_get_cache(&cache,NULL);
-	if((t2=blkid_get_tag_value(cache,"TYPE",path)))goto success;
+	if((t2=devd_probe_tag(path,"TYPE")))goto success;
 	else telog_warn("cannot determine fstype in %s",path);
 
 	EPRET(ENOTSUP);
@@ -270,7 +269,7 @@ int run_boot_root(boot_config*boot){
 	if(boot->mode!=BOOT_SWITCHROOT)ERET(ENOTSUP);
 
 	bool ro=true;
-	int e,wait=5;
+	int e,wait=5,t=trace_begin("boot","boot root");
 	char*definit,*init,*path=NULL,*b;
 	char flags[PATH_MAX],point[256],type[64];
 	ro=confd_get_integer_base(boot->key,"rw",0)==0;
@@ -327,8 +326,8 @@ int run_boot_root(boot_config*boot){
 	e=response.data.status.ret;
 
 	done:
+	trace_end(t);
 	if(path)free(path);
-	if(cache)blkid_put_cache(cache);
 	return e;
 	fail:
 	if(errno==0)errno=e==0?ENOTSUP:0;
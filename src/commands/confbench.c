@@ -0,0 +1,204 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<time.h>
+#include<errno.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/wait.h>
+#include"getopt.h"
+#include"output.h"
+#include"confd.h"
+#include"defines.h"
+
+#define BASE "confbench"
+#define READ_OPS 20000
+#define READERS_MAX 64
+
+static int usage(int e){
+	return return_printf(
+		e,e==0?STDOUT_FILENO:STDERR_FILENO,
+		"Usage: confbench [OPTIONS]\n"
+		"Measure config daemon get, set and ls latency as sibling keys grow.\n"
+		"Options:\n"
+		"\t-s, --socket <SOCKET>  use custom control socket (default is %s)\n"
+		"\t-n, --keys <COUNT>     max keys under one parent (default 100000)\n"
+		"\t-r, --readers <MAX>    read stress with 1 to MAX concurrent readers\n"
+		"\t-h, --help             show this help\n",
+		DEFAULT_CONFD
+	);
+}
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void report(const char*name,int r,size_t cnt,size_t ops,double t){
+	if(r!=0)printf("%-14s failed: %s\n",name,strerror(r));
+	else printf(
+		"%-14s %8zu keys %9.2f us/op\n",name,cnt,
+		ops>0?t*1e6/ops:0
+	);
+}
+
+// set cnt integer keys under one parent
+static int bench_set(size_t cnt){
+	int r;
+	char key[64];
+	for(size_t i=0;i<cnt;i++){
+		snprintf(key,sizeof(key),BASE".k%zu",i);
+		errno=0;
+		if((r=confd_set_integer(key,(int64_t)i))!=0)return r<0?-r:r;
+	}
+	return 0;
+}
+
+// get keys in a scrambled order, so they are not walked in list order
+static int bench_get(size_t cnt,size_t ops,size_t off){
+	char key[64];
+	size_t x;
+	for(size_t i=0;i<ops;i++){
+		x=((i+off)*2654435761u)%cnt;
+		snprintf(key,sizeof(key),BASE".k%zu",x);
+		errno=0;
+		if(confd_get_integer(key,-1)!=(int64_t)x)return errno?errno:ENOENT;
+	}
+	return 0;
+}
+
+// list the whole parent ops times, each call returns all cnt keys
+static int bench_ls(size_t cnt,size_t ops){
+	size_t n;
+	char**ls;
+	for(size_t i=0;i<ops;i++){
+		errno=0;
+		if(!(ls=confd_ls(BASE)))return errno?errno:ENOENT;
+		for(n=0;ls[n];n++);
+		if(ls[0])free(ls[0]);
+		free(ls);
+		if(n!=cnt)return EIO;
+	}
+	return 0;
+}
+
+// fork n readers, each with its own connection so confd serves them on
+// different pool workers, then release them at once and wait for all
+static int bench_readers(char*socket,size_t cnt,int n,double*t){
+	char c;
+	int r=0,st,got=0,ready[2],go[2];
+	pid_t pids[READERS_MAX];
+	if(pipe(ready)<0)return errno;
+	if(pipe(go)<0){
+		r=errno;
+		close(ready[0]);
+		close(ready[1]);
+		return r;
+	}
+	for(int i=0;i<n;i++){
+		if((pids[i]=fork())<0){
+			r=errno,n=i;
+			break;
+		}else if(pids[i]>0)continue;
+		close(ready[0]);
+		close(go[1]);
+		if(open_confd_socket(true,"confbench",socket)<0)_exit(ECONNREFUSED);
+		if(write(ready[1],"",1)!=1||read(go[0],&c,1)<0)_exit(EIO);
+		_exit(bench_get(cnt,READ_OPS,(size_t)i*READ_OPS));
+	}
+	close(ready[1]);
+	close(go[0]);
+	while(got<n&&read(ready[0],&c,1)==1)got++;
+	*t=now();
+	close(go[1]);
+	for(int i=0;i<n;i++){
+		if(waitpid(pids[i],&st,0)<0||r!=0)continue;
+		if(!WIFEXITED(st))r=EINTR;
+		else r=WEXITSTATUS(st);
+	}
+	*t=now()-*t;
+	close(ready[0]);
+	return r;
+}
+
+// populate cnt keys, then double the readers up to max
+static void bench_stress(char*socket,size_t cnt,int max){
+	int r;
+	double t;
+	size_t ops;
+	confd_delete(BASE);
+	t=now(),r=bench_set(cnt);
+	report("set",r,cnt,cnt,now()-t);
+	if(r==0)for(int n=1;;n=MIN(n*2,max)){
+		r=bench_readers(socket,cnt,n,&t);
+		ops=(size_t)n*READ_OPS;
+		if(r!=0)printf("readers %-6d failed: %s\n",n,strerror(r));
+		else printf(
+			"readers %-6d %8zu keys %9.2f us/op %10.0f ops/s\n",
+			n,cnt,t*1e6/ops,ops/t
+		);
+		if(r!=0||n>=max)break;
+	}
+	confd_delete(BASE);
+}
+
+int confbench_main(int argc,char**argv){
+	static const struct option lo[]={
+		{"socket", required_argument, NULL,'s'},
+		{"keys",   required_argument, NULL,'n'},
+		{"readers",required_argument, NULL,'r'},
+		{"help",   no_argument,       NULL,'h'},
+		{NULL,0,NULL,0}
+	};
+	int o,r,readers=0;
+	double t;
+	size_t max=100000,ops;
+	char*socket=DEFAULT_CONFD;
+	while((o=b_getlopt(argc,argv,"s:n:r:h",lo,NULL))>0)switch(o){
+		case 's':socket=b_optarg;break;
+		case 'n':
+			if((max=strtoul(b_optarg,NULL,10))==0)
+				return re_printf(1,"confbench: invalid count %s\n",b_optarg);
+		break;
+		case 'r':
+			readers=atoi(b_optarg);
+			if(readers<=0||readers>READERS_MAX)
+				return re_printf(1,"confbench: invalid readers %s\n",b_optarg);
+		break;
+		case 'h':return usage(0);
+		default:return usage(1);
+	}
+	if(open_confd_socket(false,"confbench",socket)<0)return 2;
+	if(readers>0){
+		bench_stress(socket,max,readers);
+		close_confd_socket();
+		return 0;
+	}
+	for(size_t cnt=MIN((size_t)100,max);;cnt=MIN(cnt*10,max)){
+		confd_delete(BASE);
+		t=now(),r=bench_set(cnt);
+		report("set",r,cnt,cnt,now()-t);
+		if(r==0){
+			t=now(),r=bench_get(cnt,cnt,0);
+			report("get",r,cnt,cnt,now()-t);
+		}
+		if(r==0){
+			ops=MIN(cnt,(size_t)100);
+			t=now(),r=bench_ls(cnt,ops);
+			report("ls",r,cnt,ops,now()-t);
+		}
+		if(cnt>=max)break;
+	}
+	confd_delete(BASE);
+	close_confd_socket();
+	return 0;
+}
@@ -35,6 +35,7 @@ enum ctl_oper{
 	OPER_GETGRP,
 	OPER_GETMOD,
 	OPER_RENAME,
+	OPER_WATCH,
 };
 
 static int usage(int e){
@@ -56,6 +57,7 @@ static int usage(int e){
 		"\t-S, --save <PATH>      Save config to a file\n"
 		"\t-x, --path <PATH>      Set default config path\n"
 		"\t-r, --rename           Rename config item\n"
+		"\t-w, --watch <KEY>      Print changes under key until interrupted\n"
 		"\t-q, --quit             Terminate confd\n"
 		"\t-D, --dump             Dump config store\n"
 		"\t-h, --help             Display this help and exit\n",
@@ -126,6 +128,27 @@ int confctl_do_set(char*key,char*value){
 	return r;
 }
 
+static int do_watch(char*socket,char*key){
+	int fd,r;
+	struct confd_event ev;
+	if((fd=confd_watch_open(socket,key))<0)
+		return re_err(1,"watch conf key '%s' failed",key);
+	while((r=confd_watch_read(fd,&ev))>0){
+		if(ev.resync)printf("resync %s\n",ev.path);
+		else switch(ev.type){
+			case TYPE_KEY:printf("key %s\n",ev.path);break;
+			case TYPE_STRING:printf("set %s %s\n",ev.path,ev.value.string);break;
+			case TYPE_INTEGER:printf("set %s %ld\n",ev.path,ev.value.integer);break;
+			case TYPE_BOOLEAN:printf("set %s %s\n",ev.path,BOOL2STR(ev.value.boolean));break;
+			default:printf("delete %s\n",ev.path);
+		}
+		fflush(stdout);
+		confd_event_free(&ev);
+	}
+	close(fd);
+	return r<0?re_err(1,"read conf events failed"):0;
+}
+
 static int do_get_set(char*key,char*value){
 	return value?confctl_do_set(key,value):confctl_do_get(key);
 }
@@ -200,12 +223,13 @@ int confctl_main(int argc,char**argv){
 		{"getgrp",  no_argument,       NULL,'g'},
 		{"getmod",  no_argument,       NULL,'m'},
 		{"rename",  no_argument,       NULL,'r'},
+		{"watch",   required_argument, NULL,'w'},
 		{NULL,0,NULL,0}
 	};
 	char*socket=NULL,*key=NULL;
 	enum ctl_oper op=OPER_NONE;
 	int o;
-	while((o=b_getlopt(argc,argv,"hqDS:L:p:d:l:s:OGMogmr",lo,NULL))>0)switch(o){
+	while((o=b_getlopt(argc,argv,"hqDS:L:p:d:l:s:OGMogmrw:",lo,NULL))>0)switch(o){
 		case 'h':return usage(0);
 		case 'q':
 			if(op!=OPER_NONE)goto conflict;
@@ -263,6 +287,10 @@ int confctl_main(int argc,char**argv){
 			if(op!=OPER_NONE)goto conflict;
 			op=OPER_RENAME;
 		break;
+		case 'w':
+			if(op!=OPER_NONE)goto conflict;
+			op=OPER_WATCH,key=b_optarg;
+		break;
 		case 's':
 			if(socket)goto conflict;
 			socket=b_optarg;
@@ -323,6 +351,9 @@ int confctl_main(int argc,char**argv){
 			r=confd_rename(av[0],av[1]);
 			if(errno>0)perror(_("rename config item failed"));
 		break;
+		case OPER_WATCH:
+			r=do_watch(socket,key);
+		break;
 		case OPER_NONE:{
 			if(ac<=0)return usage(1);
 			if(ac>2)return re_printf(2,"too many arguments\n");
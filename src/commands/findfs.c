@@ -8,9 +8,9 @@
 
 #include<stdio.h>
 #include<stdlib.h>
-#include<blkid/blkid.h>
 #include"getopt.h"
 #include"output.h"
+#include"devd.h"
 
 static int usage(int e){
 	return return_printf(
@@ -31,7 +31,7 @@ int findfs_main(int argc,char**argv){
 		case 'h':return usage(0);
 		default:return -1;
 	}
-	char*dev=blkid_evaluate_tag(argv[1],NULL,NULL);
+	char*dev=devd_probe_evaluate(argv[1]);
 	if(!dev)return re_printf(1,"findfs: unable to resolve '%s'\n",argv[1]);
 	puts(dev);
 	free(dev);
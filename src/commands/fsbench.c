@@ -0,0 +1,232 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<time.h>
+#include<fcntl.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<pthread.h>
+#include"getopt.h"
+#include"output.h"
+#include"defines.h"
+#include"filesystem.h"
+
+#define MiB (1024*1024)
+// requests in flight for async read
+#define QUEUE 4
+
+static int usage(int e){
+	return return_printf(
+		e,e==0?STDOUT_FILENO:STDERR_FILENO,
+		"Usage: fsbench [OPTIONS] [DIR]\n"
+		"Measure stream transfer throughput between file system drivers.\n"
+		"Options:\n"
+		"\t-s, --size <MiB>     size of test file (default 64)\n"
+		"\t-h, --help           show this help\n"
+	);
+}
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void report(const char*name,int r,size_t size,double t){
+	if(r!=0)printf("%-14s failed: %s\n",name,strerror(r));
+	else printf(
+		"%-14s %9.1f MiB/s %8.3fs\n",name,
+		t>0?(double)size/MiB/t:0,t
+	);
+}
+
+static int create_source(const char*path,size_t size){
+	int r;
+	fsh*f=NULL;
+	char*buf;
+	if(!(buf=malloc(MiB)))return ENOMEM;
+	for(size_t i=0;i<MiB;i++)buf[i]=(char)(i*31+7);
+	if((r=fs_open(NULL,&f,path,
+		FILE_FLAG_WRITE|FILE_FLAG_CREATE|FILE_FLAG_TRUNCATE|0644
+	))==0){
+		for(size_t i=0;r==0&&i<size;i+=MiB)
+			r=fs_full_write(f,buf,MIN(size-i,(size_t)MiB));
+		fs_close(&f);
+	}
+	free(buf);
+	return r;
+}
+
+// fs_read_all_to between two handles, file to file
+static int bench_file(const char*src,const char*dst,size_t*len){
+	int r;
+	fsh*f=NULL,*t=NULL;
+	if((r=fs_open(NULL,&f,src,FILE_FLAG_READ))!=0)return r;
+	if((r=fs_open(NULL,&t,dst,
+		FILE_FLAG_WRITE|FILE_FLAG_CREATE|FILE_FLAG_TRUNCATE|0644
+	))==0){
+		r=fs_read_all_to(f,t,len);
+		fs_close(&t);
+	}
+	fs_close(&f);
+	return r;
+}
+
+// fs_read_all_to_fd to a raw fd
+static int bench_fd(const char*src,int fd,size_t*len){
+	int r;
+	fsh*f=NULL;
+	if((r=fs_open(NULL,&f,src,FILE_FLAG_READ))!=0)return r;
+	r=fs_read_all_to_fd(f,fd,len);
+	fs_close(&f);
+	return r;
+}
+
+// old way, fs_read and fs_write with a small buffer
+static int bench_loop(const char*src,const char*dst,size_t*len){
+	int r;
+	size_t br,bw;
+	char buf[4096];
+	fsh*f=NULL,*t=NULL;
+	*len=0;
+	if((r=fs_open(NULL,&f,src,FILE_FLAG_READ))!=0)return r;
+	if((r=fs_open(NULL,&t,dst,
+		FILE_FLAG_WRITE|FILE_FLAG_CREATE|FILE_FLAG_TRUNCATE|0644
+	))==0){
+		while((r=fs_read(f,buf,sizeof(buf),&br))==0&&br>0){
+			if((r=fs_write(t,buf,br,&bw))!=0)break;
+			*len+=br;
+		}
+		fs_close(&t);
+	}
+	fs_close(&f);
+	return r;
+}
+
+// fs_read with 1M chunks
+static int bench_read(const char*src,size_t*len){
+	int r;
+	size_t br;
+	char*buf;
+	fsh*f=NULL;
+	*len=0;
+	if(!(buf=malloc(MiB)))return ENOMEM;
+	if((r=fs_open(NULL,&f,src,FILE_FLAG_READ))==0){
+		while((r=fs_read(f,buf,MiB,&br))==0&&br>0)*len+=br;
+		fs_close(&f);
+	}
+	free(buf);
+	return r;
+}
+
+// fs_read_async with QUEUE chunks in flight
+static int bench_async(const char*src,size_t*len){
+	int r,e,i,active=0;
+	size_t b,off=0;
+	char*buf;
+	fsh*f=NULL;
+	fs_aio*req[QUEUE];
+	*len=0;
+	memset(req,0,sizeof(req));
+	if(!(buf=malloc(QUEUE*MiB)))return ENOMEM;
+	if((r=fs_open(NULL,&f,src,FILE_FLAG_READ))!=0){
+		free(buf);
+		return r;
+	}
+	for(i=0;r==0&&i<QUEUE;i++,off+=MiB)
+		if((r=fs_read_async(f,buf+i*MiB,MiB,off,&req[i]))==0)active++;
+	for(i=0;active>0;i=(i+1)%QUEUE){
+		if(!req[i])continue;
+		e=fs_wait_async(&req[i],&b,-1),active--;
+		if(e!=0&&r==0)r=e;
+		if(e!=0||r!=0||b==0)continue;
+		*len+=b;
+		if((r=fs_read_async(f,buf+i*MiB,MiB,off,&req[i]))==0)active++,off+=MiB;
+	}
+	fs_close(&f);
+	free(buf);
+	return r;
+}
+
+static void*drain_pipe(void*d){
+	char buf[65536];
+	while(read(*(int*)d,buf,sizeof(buf))>0);
+	return NULL;
+}
+
+// fs_read_all_to_fd to a pipe, drained by another thread
+static int bench_pipe(const char*src,size_t*len){
+	int r,fds[2];
+	pthread_t t;
+	if(pipe(fds)<0)return errno;
+	if((r=pthread_create(&t,NULL,drain_pipe,&fds[0]))!=0){
+		close(fds[0]);
+		close(fds[1]);
+		return r;
+	}
+	r=bench_fd(src,fds[1],len);
+	close(fds[1]);
+	pthread_join(t,NULL);
+	close(fds[0]);
+	return r;
+}
+
+int fsbench_main(int argc,char**argv){
+	static const struct option lo[]={
+		{"size", required_argument, NULL,'s'},
+		{"help", no_argument,       NULL,'h'},
+		{NULL,0,NULL,0}
+	};
+	int o,r,fd;
+	double t;
+	size_t size=64*MiB,len;
+	const char*dir="/tmp";
+	char src[PATH_MAX],dst[PATH_MAX];
+	while((o=b_getlopt(argc,argv,"s:h",lo,NULL))>0)switch(o){
+		case 's':
+			if((size=strtoul(b_optarg,NULL,10)*MiB)==0)
+				return re_printf(1,"fsbench: invalid size %s\n",b_optarg);
+		break;
+		case 'h':return usage(0);
+		default:return usage(1);
+	}
+	if(b_optind<argc)dir=argv[b_optind];
+	snprintf(src,sizeof(src),"%s/fsbench.src",dir);
+	snprintf(dst,sizeof(dst),"%s/fsbench.dst",dir);
+	if((r=create_source(src,size))!=0)
+		return re_printf(1,"fsbench: create %s failed: %s\n",src,strerror(r));
+	printf("transfer %zu MiB in %s\n",size/MiB,dir);
+
+	t=now(),r=bench_loop(src,dst,&len);
+	report("4K loop",r,len,now()-t);
+
+	t=now(),r=bench_read(src,&len);
+	report("read",r,len,now()-t);
+
+	t=now(),r=bench_async(src,&len);
+	report("async read",r,len,now()-t);
+
+	t=now(),r=bench_file(src,dst,&len);
+	report("file -> file",r,len,now()-t);
+
+	if((fd=open("/dev/null",O_WRONLY|O_CLOEXEC))>=0){
+		t=now(),r=bench_fd(src,fd,&len);
+		report("file -> fd",r,len,now()-t);
+		close(fd);
+	}
+
+	t=now(),r=bench_pipe(src,&len);
+	report("file -> pipe",r,len,now()-t);
+
+	unlink(dst);
+	unlink(src);
+	return 0;
+}
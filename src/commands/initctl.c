@@ -9,6 +9,8 @@
 #include<errno.h>
 #include<stdio.h>
 #include<string.h>
+#include<limits.h>
+#include<unistd.h>
 #include"output.h"
 #include"logger.h"
 #include"getopt.h"
@@ -32,6 +34,8 @@ static int usage(int e){
 		"\trestart <SERVICE>         Re-Start service\n"
 		"\treload <SERVICE>          Re-Load service\n"
 		"\tdump                      Dump all service to loggerd\n"
+		"\ttimeline [FILE]           Dump boot timeline to loggerd,\n"
+		"\t                          and chrome trace json to FILE\n"
 		"Options:\n"
 		"\t-s, --socket <SOCKET>     Use custom initd socket\n"
 		"\t-h, --help                Display this help and exit\n"
@@ -158,6 +162,24 @@ static int cmd_service_dump(int argc,char**argv){
 	return cmd_wrapper(&msg,argv[0]);
 }
 
+static int cmd_timeline(int argc,char**argv){
+	if(argc>2)return re_printf(2,"too many arguments\n");
+	struct init_msg msg;
+	size_t ss=sizeof(msg.data.data);
+	init_initialize_msg(&msg,ACTION_TRACE_DUMP);
+	if(argc==2){
+		// init has another working directory
+		char cwd[PATH_MAX]={0};
+		if(argv[1][0]!='/'&&!getcwd(cwd,sizeof(cwd)))
+			return re_printf(2,"get current directory failed\n");
+		if(snprintf(
+			msg.data.data,ss,"%s%s%s",cwd,
+			cwd[0]?"/":"",argv[1]
+		)>=(int)ss)return re_printf(2,"arguments too long\n");
+	}
+	return cmd_wrapper(&msg,argv[0]);
+}
+
 struct{
 	char*name;
 	int(*cmd_handle)(int,char**);
@@ -178,6 +200,7 @@ struct{
 	{"restart",       cmd_service},
 	{"reload",        cmd_service},
 	{"dump",          cmd_service_dump},
+	{"timeline",      cmd_timeline},
 	{NULL,NULL}
 };
 
@@ -0,0 +1,204 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<stdlib.h>
+#include<string.h>
+#include"defines.h"
+#include"confd_internal.h"
+
+int confd_buffer_put(struct confd_buffer*buf,const void*data,size_t len){
+	if(!buf||(!data&&len>0))ERET(EINVAL);
+	if(buf->len+len>buf->size||!buf->data){
+		size_t size=buf->size;
+		do{size+=4096;}while(buf->len+len>size);
+		void*n=realloc(buf->data,size);
+		if(!n)ERET(ENOMEM);
+		buf->data=n,buf->size=size;
+	}
+	if(len>0)memcpy(buf->data+buf->len,data,len);
+	buf->len+=len;
+	return 0;
+}
+
+int confd_item_encode(
+	struct confd_buffer*buf,
+	struct confd_item*item,
+	const char*path,
+	const char*value
+){
+	if(!buf||!item||!path)ERET(EINVAL);
+	size_t pl=strlen(path),vl=value?strlen(value):0;
+	if(pl>UINT16_MAX||vl>UINT32_MAX)ERET(E2BIG);
+	item->path_len=pl,item->value_len=vl;
+	if(confd_buffer_put(buf,item,sizeof(struct confd_item))!=0)return -errno;
+	if(confd_buffer_put(buf,path,pl)!=0)return -errno;
+	if(confd_buffer_put(buf,value,vl)!=0)return -errno;
+	return 0;
+}
+
+int confd_item_decode(
+	const char*data,size_t len,size_t*off,
+	struct confd_item*item,
+	const char**path,
+	const char**value
+){
+	if(!off||!item||!path||!value)ERET(EINVAL);
+	if(*off>=len)return 0;
+	if(!data)ERET(EINVAL);
+	if(len-*off<sizeof(struct confd_item))ERET(EBADMSG);
+	memcpy(item,data+*off,sizeof(struct confd_item));
+	*off+=sizeof(struct confd_item);
+	if(len-*off<(size_t)item->path_len+item->value_len)ERET(EBADMSG);
+	*path=data+*off,*off+=item->path_len;
+	*value=data+*off,*off+=item->value_len;
+	return 1;
+}
+
+static int cache_cmp(const void*a,const void*b){
+	return strcmp(
+		(*(struct confd_cache_item**)a)->path,
+		(*(struct confd_cache_item**)b)->path
+	);
+}
+
+void confd_cache_free(struct confd_cache*cache){
+	if(!cache)return;
+	if(cache->items)for(size_t i=0;i<cache->count;i++){
+		if(cache->items[i].path)free(cache->items[i].path);
+		if(cache->items[i].string)free(cache->items[i].string);
+	}
+	if(cache->items)free(cache->items);
+	if(cache->index)free(cache->index);
+	free(cache);
+}
+
+struct confd_cache*confd_cache_parse(const char*data,size_t len){
+	int r;
+	size_t off=0,cnt=0;
+	const char*path,*value;
+	struct confd_item item;
+	struct confd_cache*cache;
+	while((r=confd_item_decode(data,len,&off,&item,&path,&value))>0)cnt++;
+	if(r<0)return NULL;
+	if(!(cache=malloc(sizeof(struct confd_cache))))EPRET(ENOMEM);
+	memset(cache,0,sizeof(struct confd_cache));
+	if(cnt>0){
+		cache->items=malloc(sizeof(struct confd_cache_item)*cnt);
+		cache->index=malloc(sizeof(struct confd_cache_item*)*cnt);
+		if(!cache->items||!cache->index)goto fail;
+		memset(cache->items,0,sizeof(struct confd_cache_item)*cnt);
+	}
+	for(off=0;cache->count<cnt;cache->count++){
+		struct confd_cache_item*c=&cache->items[cache->count];
+		confd_item_decode(data,len,&off,&item,&path,&value);
+		if(!(c->path=strndup(path,item.path_len)))goto fail;
+		c->pos=cache->count;
+		c->type=item.type,c->user=item.user,c->group=item.group;
+		c->mode=item.mode,c->save=item.save,c->integer=item.integer;
+		if(item.type==TYPE_STRING&&!(c->string=strndup(value,item.value_len)))goto fail;
+		cache->index[cache->count]=c;
+	}
+	if(cnt>0)qsort(cache->index,cnt,sizeof(struct confd_cache_item*),cache_cmp);
+	return cache;
+	fail:
+	confd_cache_free(cache);
+	EPRET(ENOMEM);
+}
+
+static struct confd_cache_item*cache_find(struct confd_cache*cache,const char*path){
+	struct confd_cache_item key={.path=(char*)path},*k=&key,**r;
+	if(!cache||!path||cache->count<=0)return NULL;
+	r=bsearch(&k,cache->index,cache->count,sizeof(struct confd_cache_item*),cache_cmp);
+	return r?*r:NULL;
+}
+
+enum conf_type confd_cache_get_type(struct confd_cache*cache,const char*path){
+	struct confd_cache_item*c;
+	errno=0;
+	if(!cache||!path)errno=EINVAL;
+	else if(!path[0])return TYPE_KEY;
+	else if(!(c=cache_find(cache,path)))errno=ENOENT;
+	else return c->type;
+	return (enum conf_type)-1;
+}
+
+char**confd_cache_ls(struct confd_cache*cache,const char*path){
+	char**ls,*buf;
+	const char*n;
+	size_t i,start=0,pl,cnt=0,size=0,p=0;
+	struct confd_cache_item*c;
+	if(!cache||!path)EPRET(EINVAL);
+	if((pl=strlen(path))>0){
+		if(!(c=cache_find(cache,path)))EPRET(ENOENT);
+		if(c->type!=TYPE_KEY)EPRET(ENOTDIR);
+		start=c->pos+1;
+	}
+	#define FOREACH_CHILD(expr) for(i=start;i<cache->count;i++){\
+		n=cache->items[i].path;\
+		if(pl>0){\
+			if(strncmp(n,path,pl)!=0||n[pl]!='.')break;\
+			n+=pl+1;\
+		}\
+		if(strchr(n,'.'))continue;\
+		expr;\
+	}
+	FOREACH_CHILD(cnt++;size+=strlen(n)+1);
+	if(cnt<=0)return NULL;
+	if(!(ls=malloc(sizeof(char*)*(cnt+1))))EPRET(ENOMEM);
+	if(!(buf=malloc(size))){
+		free(ls);
+		EPRET(ENOMEM);
+	}
+	FOREACH_CHILD(strcpy(buf,n);ls[p++]=buf;buf+=strlen(n)+1);
+	#undef FOREACH_CHILD
+	ls[p]=NULL;
+	return ls;
+}
+
+char*confd_cache_get_string(struct confd_cache*cache,const char*path,const char*def){
+	struct confd_cache_item*c=cache_find(cache,path);
+	const char*v=c&&c->type==TYPE_STRING?c->string:def;
+	return v?strdup(v):NULL;
+}
+
+int64_t confd_cache_get_integer(struct confd_cache*cache,const char*path,int64_t def){
+	struct confd_cache_item*c=cache_find(cache,path);
+	return c&&c->type==TYPE_INTEGER?c->integer:def;
+}
+
+bool confd_cache_get_boolean(struct confd_cache*cache,const char*path,bool def){
+	struct confd_cache_item*c=cache_find(cache,path);
+	return c&&c->type==TYPE_BOOLEAN?c->integer!=0:def;
+}
+
+#define CACHE_EXT_BASE(ret,func,call,...) \
+ret func##_base(struct confd_cache*cache,const char*base,const char*path __VA_ARGS__){\
+	char xpath[PATH_MAX]={0};\
+	if(!base||!base[0])strncpy(xpath,path,PATH_MAX-1);\
+	else snprintf(xpath,PATH_MAX-1,"%s.%s",base,path);\
+	return call;\
+}
+
+#define CACHE_EXT_DICT(ret,func,call,...) \
+ret func##_dict(struct confd_cache*cache,const char*base,const char*key,const char*path __VA_ARGS__){\
+	char xpath[PATH_MAX]={0};\
+	if(!base||!base[0])snprintf(xpath,PATH_MAX-1,"%s.%s",key,path);\
+	else snprintf(xpath,PATH_MAX-1,"%s.%s.%s",base,key,path);\
+	return call;\
+}
+
+#define CACHE_EXT(ret,func,call,...) \
+	CACHE_EXT_BASE(ret,func,call,__VA_ARGS__) \
+	CACHE_EXT_DICT(ret,func,call,__VA_ARGS__)
+
+CACHE_EXT(enum conf_type,confd_cache_get_type,confd_cache_get_type(cache,xpath))
+CACHE_EXT(char**,confd_cache_ls,confd_cache_ls(cache,xpath))
+CACHE_EXT(char*,confd_cache_get_string,confd_cache_get_string(cache,xpath,def),,const char*def)
+CACHE_EXT(int64_t,confd_cache_get_integer,confd_cache_get_integer(cache,xpath,def),,int64_t def)
+CACHE_EXT(bool,confd_cache_get_boolean,confd_cache_get_boolean(cache,xpath,def),,bool def)
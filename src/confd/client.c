@@ -13,11 +13,18 @@
 #include<sys/socket.h>
 #include"lock.h"
 #include"logger.h"
+#include"system.h"
 #include"confd_internal.h"
 
 int confd=-1;
 static mutex_t lock;
 static bool lock_initialized=false;
+static uint32_t seq=0;
+
+static int confd_send(struct confd_msg*msg){
+	struct confd_frame frame={.version=2,.id=++seq};
+	return confd_internal_send_frame(confd,msg,&frame);
+}
 
 int open_confd_socket(bool quiet,char*tag,char*path){
 	if(!lock_initialized){
@@ -72,7 +79,7 @@ int confd_delete(const char*path){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_DELETE);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -88,7 +95,7 @@ int confd_add_key(const char*path){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_ADD_KEY);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -105,7 +112,7 @@ int confd_set_integer(const char*path,int64_t data){
 	confd_internal_init_msg(&msg,CONF_SET_INTEGER);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.integer=data;
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -123,7 +130,7 @@ int confd_set_string(const char*path,char*data){
 	confd_internal_init_msg(&msg,CONF_SET_STRING);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	if(data)msg.data.data_len=size=strlen(data);
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(data&&(size_t)write(confd,data,size)!=size)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
@@ -141,7 +148,7 @@ int confd_set_boolean(const char*path,bool data){
 	confd_internal_init_msg(&msg,CONF_SET_BOOLEAN);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.boolean=data;
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -157,7 +164,7 @@ int64_t confd_count(const char*path){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_COUNT);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -174,7 +181,7 @@ char**confd_ls(const char*path){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_LIST);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	size_t s=res.data.data_len;
 	if(res.data.data_len==0)goto done;
@@ -186,8 +193,8 @@ char**confd_ls(const char*path){
 	}
 	memset(ret,0,s);
 	if(
-		(size_t)read(confd,&i,sizeof(i))!=sizeof(i)||
-		(size_t)read(confd,ret,s)!=s||
+		confd_internal_read_data(confd,&i,sizeof(i))!=0||
+		confd_internal_read_data(confd,ret,s)!=0||
 		!(ls=malloc((i+1)*sizeof(char*)))
 	){
 		free(ret);
@@ -209,7 +216,7 @@ enum conf_type confd_get_type(const char*path){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_GET_TYPE);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto fail;
+	if(confd_send(&msg)<0)goto fail;
 	if(confd_internal_read_msg(confd,&res)<0)goto fail;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -227,7 +234,7 @@ char*confd_get_string(const char*path,char*def){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_GET_STRING);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	size_t s=res.data.data_len;
 	if(res.data.data_len==0)goto done;
@@ -266,7 +273,7 @@ int64_t confd_get_integer(const char*path,int64_t def){
 	confd_internal_init_msg(&msg,CONF_GET_INTEGER);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.integer=def;
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -284,7 +291,7 @@ bool confd_get_boolean(const char*path,bool def){
 	confd_internal_init_msg(&msg,CONF_GET_BOOLEAN);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.boolean=def;
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -301,7 +308,7 @@ static int _confd_file(const char*file,enum confd_action act){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,act);
 	if(file)realpath(file,msg.path);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -334,7 +341,7 @@ int confd_rename(const char*path,const char*name){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_RENAME);
 	snprintf(msg.path,sizeof(msg.path)-1,"%s:%s",path,name);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -351,7 +358,7 @@ int confd_set_save(const char*path,bool save){
 	confd_internal_init_msg(&msg,CONF_SET_SAVE);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.boolean=save;
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -367,7 +374,7 @@ bool confd_get_save(const char*path){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_GET_SAVE);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -383,7 +390,7 @@ int confd_get_own(const char*path,uid_t*own){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_GET_OWNER);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	*own=res.data.uid;
@@ -400,7 +407,7 @@ int confd_get_grp(const char*path,uid_t*grp){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_GET_GROUP);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	*grp=res.data.gid;
@@ -417,7 +424,7 @@ int confd_get_mod(const char*path,mode_t*mod){
 	MUTEX_LOCK(lock);
 	confd_internal_init_msg(&msg,CONF_GET_MODE);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	*mod=res.data.mode;
@@ -435,7 +442,7 @@ int confd_set_own(const char*path,uid_t own){
 	confd_internal_init_msg(&msg,CONF_SET_OWNER);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.uid=own;
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -452,7 +459,7 @@ int confd_set_grp(const char*path,uid_t grp){
 	confd_internal_init_msg(&msg,CONF_SET_GROUP);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.gid=grp;
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -469,7 +476,7 @@ int confd_set_mod(const char*path,mode_t mod){
 	confd_internal_init_msg(&msg,CONF_SET_MODE);
 	strncpy(msg.path,path,sizeof(msg.path)-1);
 	msg.data.mode=mod;
-	if(confd_internal_send(confd,&msg)<0)goto done;
+	if(confd_send(&msg)<0)goto done;
 	if(confd_internal_read_msg(confd,&res)<0)goto done;
 	if(res.code>0)errno=res.code;
 	success=true;
@@ -477,6 +484,289 @@ int confd_set_mod(const char*path,mode_t mod){
 	return success?(int)res.code:-1;
 }
 
+static enum confd_action request_action(struct confd_request*req){
+	switch(req->type){
+		case TYPE_STRING:return req->set?CONF_SET_STRING:CONF_GET_STRING;
+		case TYPE_INTEGER:return req->set?CONF_SET_INTEGER:CONF_GET_INTEGER;
+		case TYPE_BOOLEAN:return req->set?CONF_SET_BOOLEAN:CONF_GET_BOOLEAN;
+		default:return CONF_FAIL;
+	}
+}
+
+static int pipeline_send(struct confd_request*reqs,size_t cnt,uint32_t id){
+	int r=-1;
+	char*buff,*p;
+	size_t i,len=0,s;
+	struct confd_msg msg;
+	for(i=0;i<cnt;i++){
+		if(!reqs[i].path||request_action(&reqs[i])==CONF_FAIL)ERET(EINVAL);
+		len+=sizeof(struct confd_msg_v2)+strnlen(reqs[i].path,sizeof(msg.path)-1);
+		if(reqs[i].type==TYPE_STRING&&reqs[i].set&&reqs[i].value.string)
+			len+=strlen(reqs[i].value.string);
+	}
+	if(!(p=buff=malloc(len)))ERET(ENOMEM);
+	for(i=0;i<cnt;i++){
+		confd_internal_init_msg(&msg,request_action(&reqs[i]));
+		strncpy(msg.path,reqs[i].path,sizeof(msg.path)-1);
+		switch(reqs[i].type){
+			case TYPE_STRING:
+				if(reqs[i].set&&reqs[i].value.string)
+					msg.data.data_len=strlen(reqs[i].value.string);
+			break;
+			case TYPE_INTEGER:msg.data.integer=reqs[i].value.integer;break;
+			case TYPE_BOOLEAN:msg.data.boolean=reqs[i].value.boolean;break;
+			default:;
+		}
+		if((s=confd_internal_encode_v2(p,len-(p-buff),&msg,id+i))==0)goto done;
+		p+=s;
+		if(reqs[i].type==TYPE_STRING&&reqs[i].set&&msg.data.data_len>0){
+			memcpy(p,reqs[i].value.string,msg.data.data_len);
+			p+=msg.data.data_len;
+		}
+	}
+	if(full_write(confd,buff,p-buff)==(ssize_t)(p-buff))r=0;
+	done:
+	free(buff);
+	return r;
+}
+
+static int pipeline_recv(struct confd_request*reqs,size_t cnt,uint32_t id){
+	char*str;
+	size_t s;
+	struct confd_msg res;
+	struct confd_frame frame;
+	for(size_t i=0;i<cnt;i++){
+		struct confd_request*req=&reqs[i];
+		if(confd_internal_read_frame(confd,&res,&frame)<=0)ERET(EIO);
+		if(frame.version!=2||frame.id!=id+i)ERET(EPROTO);
+		req->code=(int)res.code;
+		if(req->set)continue;
+		switch(req->type){
+			case TYPE_STRING:
+				str=req->value.string;
+				if((s=res.data.data_len)>0){
+					if(!(str=malloc(s+1)))ERET(ENOMEM);
+					memset(str,0,s+1);
+					if(confd_internal_read_data(confd,str,s)!=0){
+						free(str);
+						ERET(EIO);
+					}
+				}else if(str&&!(str=strdup(str)))ERET(ENOMEM);
+				req->value.string=str;
+			break;
+			case TYPE_INTEGER:req->value.integer=res.data.integer;break;
+			case TYPE_BOOLEAN:req->value.boolean=res.data.boolean;break;
+			default:;
+		}
+	}
+	return 0;
+}
+
+int confd_pipeline(struct confd_request*reqs,size_t cnt){
+	int r=0;
+	size_t n;
+	uint32_t id;
+	if(!reqs)ERET(EINVAL);
+	if(confd<0)ERET(ENOTCONN);
+	MUTEX_LOCK(lock);
+	for(size_t i=0;i<cnt&&r==0;i+=n){
+		n=MIN(cnt-i,CONFD_PIPELINE_WINDOW);
+		id=seq+1,seq+=n;
+		if((r=pipeline_send(reqs+i,n,id))==0)
+			r=pipeline_recv(reqs+i,n,id);
+	}
+	MUTEX_UNLOCK(lock);
+	return r;
+}
+
+static int items_request(
+	enum confd_action action,
+	const char*path,
+	struct confd_buffer*in,
+	struct confd_buffer*out
+){
+	int r=-1;
+	size_t s;
+	struct confd_msg msg,res;
+	if(confd<0)ERET(ENOTCONN);
+	confd_internal_init_msg(&msg,action);
+	if(path)strncpy(msg.path,path,sizeof(msg.path)-1);
+	if(in)msg.data.data_len=in->len;
+	MUTEX_LOCK(lock);
+	if(confd_send(&msg)<0)goto done;
+	if(in&&in->len>0&&full_write(confd,in->data,in->len)!=(ssize_t)in->len)goto done;
+	if(confd_internal_read_msg(confd,&res)<=0)EDONE(errno=EIO);
+	if((s=res.data.data_len)>0){
+		if(!out||s>CONFD_PAYLOAD_MAX)EDONE(errno=EPROTO);
+		if(!(out->data=malloc(s)))EDONE(errno=ENOMEM);
+		out->len=out->size=s;
+		if(confd_internal_read_data(confd,out->data,s)!=0){
+			free(out->data);
+			out->data=NULL,out->len=out->size=0;
+			EDONE(errno=EIO);
+		}
+	}
+	r=0;
+	if(res.code>0)errno=res.code,r=-(int)res.code;
+	done:MUTEX_UNLOCK(lock);
+	return r;
+}
+
+int confd_get_multi(struct confd_request*reqs,size_t cnt){
+	int r;
+	size_t off=0,i;
+	const char*p,*v;
+	struct confd_item item;
+	struct confd_buffer in={NULL,0,0},out={NULL,0,0};
+	if(!reqs)ERET(EINVAL);
+	for(i=0;i<cnt;i++)if(!reqs[i].path||confd_buffer_put(
+		&in,reqs[i].path,strlen(reqs[i].path)+1
+	)!=0)EDONE(r=-(errno?errno:EINVAL));
+	if((r=items_request(CONF_GET_MULTI,NULL,&in,&out))!=0)goto done;
+	for(i=0;i<cnt;i++){
+		struct confd_request*req=&reqs[i];
+		if((r=confd_item_decode(out.data,out.len,&off,&item,&p,&v))<=0)
+			EDONE(r=-(errno=EPROTO));
+		req->code=item.type==req->type?0:ENOENT;
+		switch(req->type){
+			case TYPE_STRING:
+				if(req->code==0)req->value.string=strndup(v,item.value_len);
+				else if(req->value.string)req->value.string=strdup(req->value.string);
+			break;
+			case TYPE_INTEGER:if(req->code==0)req->value.integer=item.integer;break;
+			case TYPE_BOOLEAN:if(req->code==0)req->value.boolean=item.integer!=0;break;
+			default:req->code=EINVAL;
+		}
+	}
+	r=0;
+	done:
+	if(in.data)free(in.data);
+	if(out.data)free(out.data);
+	return r;
+}
+
+int confd_set_multi(struct confd_request*reqs,size_t cnt){
+	int r=0;
+	struct confd_item item;
+	struct confd_buffer in={NULL,0,0};
+	if(!reqs)ERET(EINVAL);
+	for(size_t i=0;i<cnt&&r==0;i++){
+		if(!reqs[i].path)EDONE(r=-(errno=EINVAL));
+		memset(&item,0,sizeof(item));
+		item.type=reqs[i].type;
+		switch(reqs[i].type){
+			case TYPE_INTEGER:item.integer=reqs[i].value.integer;break;
+			case TYPE_BOOLEAN:item.integer=reqs[i].value.boolean;break;
+			default:;
+		}
+		r=confd_item_encode(
+			&in,&item,reqs[i].path,
+			reqs[i].type==TYPE_STRING?reqs[i].value.string:NULL
+		);
+	}
+	if(r==0)r=items_request(CONF_SET_MULTI,NULL,&in,NULL);
+	for(size_t i=0;i<cnt;i++)reqs[i].code=-r;
+	done:
+	if(in.data)free(in.data);
+	return r;
+}
+
+struct confd_cache*confd_fetch_subtree(const char*path){
+	struct confd_cache*cache;
+	struct confd_buffer out={NULL,0,0};
+	if(!path)EPRET(EINVAL);
+	if(items_request(CONF_GET_SUBTREE,path,NULL,&out)!=0)return NULL;
+	cache=confd_cache_parse(out.data,out.len);
+	if(out.data)free(out.data);
+	return cache;
+}
+
+static int watch_send(int fd,const char*path){
+	struct confd_msg msg;
+	struct confd_frame frame={.version=2,.id=0};
+	confd_internal_init_msg(&msg,CONF_WATCH);
+	strncpy(msg.path,path,sizeof(msg.path)-1);
+	return confd_internal_send_frame(fd,&msg,&frame)<0?-1:0;
+}
+
+int confd_watch_open(const char*sock,const char*path){
+	int fd;
+	struct confd_msg res;
+	struct sockaddr_un n={.sun_family=AF_UNIX};
+	if(!path)ERET(EINVAL);
+	strncpy(n.sun_path,sock?sock:DEFAULT_CONFD,sizeof(n.sun_path)-1);
+	if((fd=socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0))<0)return -1;
+	if(connect(fd,(struct sockaddr*)&n,sizeof(n))<0)goto fail;
+	if(watch_send(fd,path)!=0)goto fail;
+	if(confd_internal_read_msg(fd,&res)<=0)EGO(errno=EIO,fail);
+	if(res.code!=0)EGO(errno=res.code,fail);
+	return fd;
+	fail:
+	close(fd);
+	return -1;
+}
+
+int confd_watch_add(int fd,const char*path){
+	if(fd<0||!path)ERET(EINVAL);
+	return watch_send(fd,path);
+}
+
+void confd_event_free(struct confd_event*ev){
+	if(!ev)return;
+	if(ev->path)free(ev->path);
+	if(ev->type==TYPE_STRING&&ev->value.string)free(ev->value.string);
+	memset(ev,0,sizeof(struct confd_event));
+}
+
+int confd_watch_read(int fd,struct confd_event*ev){
+	int r;
+	char*data;
+	size_t off=0;
+	const char*p,*v;
+	struct confd_item item;
+	struct confd_msg res;
+	if(fd<0||!ev)ERET(EINVAL);
+	memset(ev,0,sizeof(struct confd_event));
+	for(;;){
+		if((r=confd_internal_read_msg(fd,&res))<=0)return r==EOF?0:-1;
+		switch(res.action){
+			case CONF_WATCH_RESYNC:
+				ev->resync=true;
+				if(!(ev->path=strdup(res.path)))ERET(ENOMEM);
+			return 1;
+			case CONF_WATCH_EVENT:break;
+			// replies of confd_watch_add
+			default:continue;
+		}
+		if(res.data.data_len>CONFD_PAYLOAD_MAX)ERET(EPROTO);
+		if(!(data=malloc(res.data.data_len+1)))ERET(ENOMEM);
+		if(confd_internal_read_data(fd,data,res.data.data_len)!=0){
+			free(data);
+			ERET(EIO);
+		}
+		if(confd_item_decode(data,res.data.data_len,&off,&item,&p,&v)!=1){
+			free(data);
+			ERET(EPROTO);
+		}
+		ev->type=item.type,ev->uid=(uid_t)res.code;
+		if(!(ev->path=strndup(p,item.path_len)))r=-1;
+		else switch(item.type){
+			case TYPE_STRING:
+				if(!(ev->value.string=strndup(v,item.value_len)))r=-1;
+			break;
+			case TYPE_INTEGER:ev->value.integer=item.integer;break;
+			case TYPE_BOOLEAN:ev->value.boolean=item.integer!=0;break;
+			default:;
+		}
+		free(data);
+		if(r<0){
+			confd_event_free(ev);
+			ERET(ENOMEM);
+		}
+		return 1;
+	}
+}
+
 #define _EXT_BASE(ret,func,ret_func,...) \
 ret func##_base(const char*base,const char*path __VA_ARGS__){\
 	char xpath[PATH_MAX]={0};\
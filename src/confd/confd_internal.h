@@ -17,7 +17,15 @@
 
 #define CONFD_MAGIC0 0xEF
 #define CONFD_MAGIC1 0x66
+#define CONFD_MAGIC1_V2 0x67
+#define CONFD_PIPELINE_WINDOW 64
+#define CONFD_PAYLOAD_MAX 0x1000000
+#define CONFD_WATCH_PENDING 256
+#define CONFD_JOURNAL_MAGIC 0x4A444643
+#define CONF_SNAP_MAGIC "SICONFB"
+#define CONF_SNAP_VERSION 1
 #define CONF_KEY_CHARS LETTER NUMBER "-_."
+#define CONF_NAME_MAX 256
 
 // initconfd remote action
 enum confd_action{
@@ -31,6 +39,12 @@ enum confd_action{
 	CONF_ADD_KEY      =0xAC07,
 	CONF_COUNT        =0xAC08,
 	CONF_RENAME       =0xAC09,
+	CONF_GET_SUBTREE  =0xAC0A,
+	CONF_GET_MULTI    =0xAC0B,
+	CONF_SET_MULTI    =0xAC0C,
+	CONF_WATCH        =0xAC0D,
+	CONF_WATCH_EVENT  =0xAC0E,
+	CONF_WATCH_RESYNC =0xAC0F,
 	CONF_GET_STRING   =0xAC21,
 	CONF_GET_INTEGER  =0xAC22,
 	CONF_GET_BOOLEAN  =0xAC23,
@@ -51,33 +65,69 @@ enum confd_action{
 	CONF_GET_MODE     =0xACB6,
 };
 
-// initconfd message
+// initconfd message data
+union confd_data{
+	size_t data_len;
+	enum conf_type type;
+	int64_t integer;
+	bool boolean;
+	uid_t uid;
+	gid_t gid;
+	mode_t mode;
+};
+
+// initconfd message (v1, fixed size)
 struct confd_msg{
 	unsigned char magic0,magic1;
 	enum confd_action action;
 	char path[4096-(sizeof(void*)*3)];
 	uint64_t code;
-	union{
-		size_t data_len;
-		enum conf_type type;
-		int64_t integer;
-		bool boolean;
-		uid_t uid;
-		gid_t gid;
-		mode_t mode;
-	}data;
+	union confd_data data;
+};
+
+// initconfd compact message header (v2), followed by path_len bytes path
+struct confd_msg_v2{
+	unsigned char magic0,magic1;
+	uint16_t path_len;
+	uint32_t id;
+	enum confd_action action;
+	uint32_t reserved;
+	uint64_t code;
+	union confd_data data;
+};
+
+// initconfd message framing
+struct confd_frame{
+	int version;
+	uint32_t id;
+};
+
+struct conf;
+
+// config children hash index
+struct conf_index{
+	size_t size;
+	size_t count;
+	list*last;
+	struct conf*buckets[];
 };
 
 // config struct
 struct conf{
-	char name[256];
+	char*name;
+	uint32_t hash;
 	struct conf*parent;
+	struct conf*hash_next;
+	struct conf_index*index;
 	enum conf_type type;
 	uid_t user;
 	gid_t group;
 	mode_t mode;
 	bool save;
 	bool include;
+	bool mapped;
+	bool name_alloc;
+	bool value_mapped;
 	union{
 		list*keys;
 		union{
@@ -88,6 +138,46 @@ struct conf{
 	};
 };
 
+// serialized config item header, followed by path_len bytes path
+// and value_len bytes string value
+struct confd_item{
+	enum conf_type type;
+	uid_t user;
+	gid_t group;
+	mode_t mode;
+	bool save;
+	uint16_t path_len;
+	uint32_t value_len;
+	int64_t integer;
+};
+
+// serialized config items buffer
+struct confd_buffer{
+	char*data;
+	size_t len;
+	size_t size;
+};
+
+// decoded config item in local cache
+struct confd_cache_item{
+	char*path;
+	size_t pos;
+	enum conf_type type;
+	uid_t user;
+	gid_t group;
+	mode_t mode;
+	bool save;
+	char*string;
+	int64_t integer;
+};
+
+// config subtree local cache
+struct confd_cache{
+	size_t count;
+	struct confd_cache_item*items;
+	struct confd_cache_item**index;
+};
+
 struct conf_file_hand;
 typedef int(*file_process_func)(struct conf_file_hand*hand);
 typedef ssize_t(*file_io_func)(struct conf_file_hand*hand,char*buff,size_t len);
@@ -98,6 +188,8 @@ struct conf_file_hand{
 	mutex_t lock;
 	bool initialized;
 	bool include;
+	bool map;
+	bool mapped;
 	int depth;
 	char*path;
 	char*buff;
@@ -111,8 +203,54 @@ struct conf_file_hand{
 	file_io_func write;
 };
 
+// binary config snapshot header, offsets are relative to file start
+struct conf_snap_head{
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint32_t nodes;
+	uint32_t strings;
+	uint32_t strings_len;
+	uint32_t sum;
+};
+
+// binary config snapshot node, nodes are stored in tree order and node 0
+// is root, name and string value are offsets into the string table
+struct conf_snap_node{
+	uint32_t parent;
+	uint32_t name;
+	uint32_t type;
+	uint32_t user;
+	uint32_t group;
+	uint32_t mode;
+	int64_t value;
+};
+
+// config change journal file header
+struct conf_journal_head{
+	uint32_t magic;
+	uint32_t base;
+};
+
+// config change journal record, followed by len bytes serialized item
+struct conf_journal_rec{
+	uint32_t magic;
+	uint32_t len;
+	uint32_t sum;
+};
+
+// config store change hook, path and conf are NULL when structure changed
+typedef void(*conf_journal_func)(const char*path,struct conf*c);
+
+// config store change watch hook, u is the uid of who changed it
+typedef void(*conf_watch_func)(const char*path,struct conf*c,uid_t u);
+
 extern bool conf_store_changed;
 
+extern conf_journal_func conf_journal_hook;
+
+extern conf_watch_func conf_watch_hook;
+
 extern struct conf_file_hand*conf_hands[];
 
 // src/confd/client.c: current confd fd
@@ -133,15 +271,51 @@ extern int confd_internal_send_code(int fd,enum confd_action action,int code);
 // src/confd/internal.c: read message
 extern int confd_internal_read_msg(int fd,struct confd_msg*buff);
 
+// src/confd/internal.c: send message with specified framing
+extern int confd_internal_send_frame(int fd,struct confd_msg*msg,struct confd_frame*frame);
+
+// src/confd/internal.c: read message in any framing
+extern int confd_internal_read_frame(int fd,struct confd_msg*buff,struct confd_frame*frame);
+
+// src/confd/internal.c: read message payload
+extern int confd_internal_read_data(int fd,void*buff,size_t len);
+
+// src/confd/internal.c: encode message as v2 frame into buffer
+extern size_t confd_internal_encode_v2(void*buff,size_t len,struct confd_msg*msg,uint32_t id);
+
 // src/confd/internal.c: convert action to string
 extern const char*confd_action2name(enum confd_action action);
 
 // src/confd/dump.c: dump config store to loggerd
 extern int conf_dump_store(enum log_level level);
 
+// src/confd/store.c: hash config name or data
+extern uint32_t conf_hash(const char*name,size_t len);
+
 // src/confd/store.c: get config store root struct
 extern struct conf*conf_get_store(void);
 
+// src/confd/store.c: lock config store for tree walking
+extern void conf_store_rdlock(void);
+
+// src/confd/store.c: lock config store for modifying nodes directly
+extern void conf_store_wrlock(void);
+
+// src/confd/store.c: unlock config store
+extern void conf_store_unlock(void);
+
+// src/confd/store.c: record a config store change, store must be write locked
+extern void conf_journal(const char*path,struct conf*c,uid_t u);
+
+// src/confd/store.c: check node is readable by user, store must be locked
+extern bool conf_node_readable(struct conf*c,uid_t u,gid_t g);
+
+// src/confd/store.c: get child node by name, store must be locked
+extern struct conf*conf_node_get(struct conf*conf,const char*name);
+
+// src/confd/store.c: append a prepared node to key, store must be write locked
+extern int conf_node_link(struct conf*conf,struct conf*n);
+
 // src/confd/store.c: convert config item type to string
 extern const char*conf_type2string(enum conf_type type);
 
@@ -193,6 +367,43 @@ extern int conf_set_mod(const char*path,mode_t mod,uid_t u,gid_t g);
 // src/confd/store.c: calculate conf store memory size
 extern size_t conf_calc_size(struct conf*c);
 
+// src/confd/store.c: get a copy of config string value
+extern char*conf_get_string_dup(const char*path,const char*def,uid_t u,gid_t g);
+
+// src/confd/store.c: serialize all items under path
+extern int conf_get_subtree(const char*path,struct confd_buffer*buf,uid_t u,gid_t g);
+
+// src/confd/store.c: serialize items of NUL separated paths
+extern int conf_get_multi(const char*paths,size_t len,struct confd_buffer*buf,uid_t u,gid_t g);
+
+// src/confd/store.c: set all serialized items
+extern int conf_set_multi(const char*data,size_t len,uid_t u,gid_t g);
+
+// src/confd/cache.c: append raw data to buffer
+extern int confd_buffer_put(struct confd_buffer*buf,const void*data,size_t len);
+
+// src/confd/cache.c: append a serialized item to buffer
+extern int confd_item_encode(
+	struct confd_buffer*buf,
+	struct confd_item*item,
+	const char*path,
+	const char*value
+);
+
+// src/confd/cache.c: decode next serialized item from data
+extern int confd_item_decode(
+	const char*data,size_t len,size_t*off,
+	struct confd_item*item,
+	const char**path,
+	const char**value
+);
+
+// src/confd/cache.c: build local cache from serialized items
+extern struct confd_cache*confd_cache_parse(const char*data,size_t len);
+
+// src/confd/file_bin.c: drop the snapshot reference of a mapped node or value
+extern void conf_snap_release(const void*ptr);
+
 // src/confd/file.c: load config file to config store
 extern int conf_load_file(fsh*parent,const char*path);
 
@@ -205,6 +416,36 @@ extern int conf_include_file_depth(fsh*parent,const char*file,int depth);
 // src/confd/file.c: save config store to config file
 extern int conf_save_file(fsh*parent,const char*path);
 
+// src/confd/file.c: atomically save config store, mark runs before store unlocked
+extern int conf_checkpoint_file(fsh*parent,const char*file,uint32_t*sum,void(*mark)(void));
+
+// src/confd/journal.c: replay journal of config file and start recording
+extern int conf_journal_open(const char*file);
+
+// src/confd/journal.c: stop recording journal
+extern void conf_journal_close(void);
+
+// src/confd/journal.c: check journal is recording
+extern bool conf_journal_opened(void);
+
+// src/confd/journal.c: wait until config store changed
+extern void conf_journal_wait(void);
+
+// src/confd/journal.c: write pending changes into journal
+extern int conf_journal_flush(void);
+
+// src/confd/journal.c: save whole config file and reset journal
+extern int conf_journal_checkpoint(void);
+
+// src/confd/watch.c: subscribe connection to changes under path and reply
+extern int conf_watch_add(int fd,struct confd_frame*frame,const char*path,uid_t u,gid_t g);
+
+// src/confd/watch.c: check connection is a watch connection
+extern bool conf_watch_fd(int fd);
+
+// src/confd/watch.c: drop all subscriptions of connection
+extern void conf_watch_del(int fd);
+
 // src/confd/file.c: get all supported config file exts
 extern char**conf_get_supported_exts();
 
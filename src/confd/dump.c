@@ -91,8 +91,10 @@ int conf_dump_store(enum log_level level){
 	char buf[64];
 	struct conf*c=conf_get_store();
 	logger_print(level,TAG,"dump configuration store:");
+	conf_store_rdlock();
 	if(dump(level,c,0)!=0)r=-1;
 	size_t size=conf_calc_size(c);
+	conf_store_unlock();
 	logger_printf(
 		level,TAG,
 		"used memory size: %zu bytes (%s)",size,
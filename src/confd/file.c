@@ -15,8 +15,10 @@
 extern struct conf_file_hand conf_hand_conf;
 extern struct conf_file_hand conf_hand_json;
 extern struct conf_file_hand conf_hand_xml;
+extern struct conf_file_hand conf_hand_bin;
 struct conf_file_hand*conf_hands[]={
 	&conf_hand_conf,
+	&conf_hand_bin,
 	#ifdef ENABLE_JSONC
 	&conf_hand_json,
 	#endif
@@ -52,47 +54,80 @@ static struct conf_file_hand*find_hand_by_file(const char*file){
 	return find_hand(file_get_ext(file));
 }
 
-static int do_close(struct conf_file_hand*hand,bool save){
-	int r=0;
-	if(save&&hand->off>0){
-		fs_seek(hand->file,0,SEEK_SET);
-		r=fs_full_write(hand->file,hand->buff,hand->off);
-		if(r!=0)tlog_warn("write config failed: %s",strerror(r));
+static void do_close(struct conf_file_hand*hand){
+	if(hand->buff){
+		if(!hand->mapped)free(hand->buff);
+		else fs_unmap(hand->file,hand->buff,hand->len);
 	}
 	if(hand->file)fs_close(&hand->file);
-	if(hand->buff)free(hand->buff);
 	hand->file=NULL,hand->buff=NULL,hand->len=0,hand->off=0;
-	return r;
+	hand->mapped=false;
 }
 
 static int do_load(struct conf_file_hand*hand){
 	int r=0;
-	do_close(hand,false);
+	do_close(hand);
 	hand->file=NULL,hand->len=0;
 	r=fs_open(hand->parent,&hand->file,hand->path,FILE_FLAG_READ);
 	if(r!=0)EDONE(if(r!=ENOENT)tlog_warn("open config '%s' failed: %s",hand->path,strerror(r)));
 	r=fs_get_size(hand->file,&hand->len);
 	if(hand->len>0x400000)EDONE(tlog_warn("config '%s' too large",hand->path));
 	if(hand->len<=0)EDONE(tlog_warn("config '%s' too small",hand->path));
+	if(hand->map&&fs_map(
+		hand->file,(void**)&hand->buff,0,&hand->len,
+		FILE_FLAG_READ|FILE_FLAG_PRIVATE
+	)==0){
+		hand->mapped=true;
+		return 0;
+	}
+	hand->buff=NULL;
 	r=fs_read_all(hand->file,(void**)&hand->buff,&hand->len);
 	if(r<0)EDONE(telog_warn("read '%s' failed",hand->path));
 	return 0;
-	done:do_close(hand,false);
+	done:do_close(hand);
 	return errno<0?-(errno):-1;
 }
 
-static int do_save(struct conf_file_hand*hand){
+static int do_save(struct conf_file_hand*hand,const char*tmp){
 	int r=0;
-	do_close(hand,false);
-	r=fs_open(hand->parent,&hand->file,hand->path,FILE_FLAG_WRITE|FILE_FLAG_CREATE|0644);
-	if(r!=0)EDONE(telog_warn("open config '%s' failed: %s",hand->path,strerror(r)));
+	do_close(hand);
+	#ifndef ENABLE_UEFI
+	r=fs_open(hand->parent,&hand->file,tmp,FILE_FLAG_WRITE|FILE_FLAG_CREATE|0644);
+	#else
+	r=fs_open(hand->parent,&hand->file,tmp,FILE_FLAG_WRITE|FILE_FLAG_CREATE|FILE_FLAG_TRUNCATE|0644);
+	#endif
+	if(r!=0)EDONE(telog_warn("open config '%s' failed: %s",tmp,strerror(r)));
 	fs_seek(hand->file,0,SEEK_SET);
 	fs_set_size(hand->file,0);
 	return 0;
-	done:do_close(hand,false);
+	done:do_close(hand);
 	return errno<0?-(errno):-1;
 }
 
+static int do_commit(struct conf_file_hand*hand,uint32_t*sum){
+	int r=0;
+	if(hand->off>0)r=fs_full_write(hand->file,hand->buff,hand->off);
+	if(r==0&&(r=fs_flush(hand->file))==ENOSYS)r=0;
+	#ifndef ENABLE_UEFI
+	if(r==0)r=fs_rename(hand->file,hand->path);
+	#else
+	size_t len=hand->off,size=0;
+	fsh*f=NULL;
+	#endif
+	if(r!=0)tlog_warn("write config '%s' failed: %s",hand->path,strerror(r));
+	else if(sum)*sum=hand->off>0?conf_hash(hand->buff,hand->off):0;
+	do_close(hand);
+	#ifdef ENABLE_UEFI
+	// config is rewritten in place, check a fresh handle sees exactly the new one
+	if(r==0&&(r=fs_open(hand->parent,&f,hand->path,FILE_FLAG_READ))==0){
+		if((r=fs_get_size(f,&size))==0&&size!=len)r=EIO;
+		fs_close(&f);
+		if(r!=0)tlog_warn("verify config '%s' failed: %s",hand->path,strerror(r));
+	}
+	#endif
+	return r;
+}
+
 static ssize_t conf_read(struct conf_file_hand*hand,char*buff,size_t len){
 	if(!hand||!buff||len<=0)return -1;
 	memset(buff,0,len);
@@ -144,7 +179,7 @@ static int _conf_load_file(fsh*parent,const char*file,bool inc,int depth){
 	r=do_load(hand);
 	if(r==0){
 		r=hand->load(hand);
-		do_close(hand,false);
+		do_close(hand);
 		if(r==0)errno=0;
 	}else r=-1;
 	hand->include=false;
@@ -183,9 +218,9 @@ int conf_include_file_depth(fsh*parent,const char*file,int depth){
 	return _conf_load_file(parent,file,true,depth);
 }
 
-int conf_save_file(fsh*parent,const char*file){
+static int _conf_save_file(fsh*parent,const char*file,uint32_t*sum,void(*mark)(void)){
 	int r=0;
-	static char xpath[PATH_MAX];
+	static char xpath[PATH_MAX],tmp[PATH_MAX+8];
 	if(!file)ERET(EINVAL);
 	struct conf_file_hand*hand=find_hand_by_file(file);
 	if(!hand)ERET(EINVAL);
@@ -197,14 +232,25 @@ int conf_save_file(fsh*parent,const char*file){
 	MUTEX_LOCK(hand->lock);
 	memset(xpath,0,sizeof(xpath));
 	strncpy(xpath,file,sizeof(xpath)-1);
+	#ifndef ENABLE_UEFI
+	snprintf(tmp,sizeof(tmp),"%s.new",xpath);
+	#else
+	// uefi rename can not replace an existing file, truncate and write in place
+	strncpy(tmp,xpath,sizeof(tmp)-1);
+	#endif
 	hand->parent=parent;
 	hand->write=conf_write;
 	hand->read=NULL;
 	hand->path=xpath;
-	r=do_save(hand);
+	r=do_save(hand,tmp);
 	if(r==0){
+		// serialize into memory, file is written after store unlocked
+		conf_store_rdlock();
 		r=hand->save(hand);
-		do_close(hand,true);
+		if(r==0&&mark)mark();
+		conf_store_unlock();
+		if(r!=0)do_close(hand);
+		else if((r=do_commit(hand,sum))!=0)errno=r,r=-1;
 		if(r==0)errno=0;
 	}else{
 		tlog_warn("save failed");
@@ -218,3 +264,11 @@ int conf_save_file(fsh*parent,const char*file){
 	MUTEX_UNLOCK(hand->lock);
 	return r;
 }
+
+int conf_save_file(fsh*parent,const char*file){
+	return _conf_save_file(parent,file,NULL,NULL);
+}
+
+int conf_checkpoint_file(fsh*parent,const char*file,uint32_t*sum,void(*mark)(void)){
+	return _conf_save_file(parent,file,sum,mark);
+}
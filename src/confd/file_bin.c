@@ -0,0 +1,273 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include"logger.h"
+#include"confd_internal.h"
+#define TAG "config"
+
+struct snap_ctx{
+	uint32_t count;
+	uint32_t*table;
+	size_t size,used;
+	struct confd_buffer nodes;
+	struct confd_buffer strings;
+};
+
+// a loaded snapshot, alive while any node or value still points into it
+struct snap_map{
+	struct snap_map*next;
+	size_t refs;
+	bool mapped;
+	char*buff;
+	size_t len;
+	fsh*file;
+	struct conf*bulk;
+	uint32_t count;
+};
+
+// protected by store_lock
+static struct snap_map*snap_maps=NULL;
+
+static bool snap_map_has(struct snap_map*m,const void*ptr){
+	uintptr_t p=(uintptr_t)ptr;
+	if(p>=(uintptr_t)m->buff&&p<(uintptr_t)m->buff+m->len)return true;
+	return p>=(uintptr_t)m->bulk&&p<(uintptr_t)(m->bulk+m->count);
+}
+
+// caller must hold store_lock for write
+void conf_snap_release(const void*ptr){
+	struct snap_map**p,*m;
+	if(!ptr)return;
+	for(p=&snap_maps;(m=*p);p=&m->next){
+		if(!snap_map_has(m,ptr))continue;
+		if(--m->refs>0)return;
+		*p=m->next;
+		if(!m->mapped)free(m->buff);
+		else fs_unmap(m->file,m->buff,m->len);
+		if(m->file)fs_close(&m->file);
+		free(m->bulk);
+		free(m);
+		return;
+	}
+}
+
+static int snap_table_grow(struct snap_ctx*ctx){
+	const char*str;
+	uint32_t*table,i;
+	size_t size=ctx->size?ctx->size*2:1024;
+	if(!(table=malloc(sizeof(uint32_t)*size)))ERET(ENOMEM);
+	memset(table,0,sizeof(uint32_t)*size);
+	for(size_t x=0;x<ctx->size;x++)if(ctx->table[x]){
+		str=ctx->strings.data+ctx->table[x];
+		i=conf_hash(str,strlen(str))&(size-1);
+		while(table[i])i=(i+1)&(size-1);
+		table[i]=ctx->table[x];
+	}
+	if(ctx->table)free(ctx->table);
+	ctx->table=table,ctx->size=size;
+	return 0;
+}
+
+// offset 0 is always the empty string, so it marks a free table slot
+static int snap_string(struct snap_ctx*ctx,const char*str,uint32_t*off){
+	uint32_t i;
+	size_t len;
+	if(!str||!*str){
+		*off=0;
+		return 0;
+	}
+	if(ctx->used*2>=ctx->size&&snap_table_grow(ctx)!=0)return -1;
+	len=strlen(str);
+	for(
+		i=conf_hash(str,len)&(ctx->size-1);
+		ctx->table[i];
+		i=(i+1)&(ctx->size-1)
+	)if(strcmp(ctx->strings.data+ctx->table[i],str)==0){
+		*off=ctx->table[i];
+		return 0;
+	}
+	*off=ctx->table[i]=ctx->strings.len;
+	ctx->used++;
+	return confd_buffer_put(&ctx->strings,str,len+1);
+}
+
+static int snap_put(struct snap_ctx*ctx,struct conf*c,uint32_t parent){
+	list*p;
+	uint32_t idx=ctx->count,off;
+	struct conf_snap_node n;
+	if(!c->save||(c->type!=TYPE_KEY&&c->include))return 0;
+	memset(&n,0,sizeof(n));
+	n.parent=parent,n.type=c->type;
+	n.user=c->user,n.group=c->group,n.mode=c->mode;
+	if(snap_string(ctx,c->name,&n.name)!=0)return -1;
+	switch(c->type){
+		case TYPE_KEY:break;
+		case TYPE_STRING:
+			if(snap_string(ctx,VALUE_STRING(c),&off)!=0)return -1;
+			n.value=off;
+		break;
+		case TYPE_INTEGER:n.value=VALUE_INTEGER(c);break;
+		case TYPE_BOOLEAN:n.value=VALUE_BOOLEAN(c);break;
+		default:return 0;
+	}
+	if(confd_buffer_put(&ctx->nodes,&n,sizeof(n))!=0)return -1;
+	ctx->count++;
+	if(c->type==TYPE_KEY&&(p=list_first(c->keys)))do{
+		if(snap_put(ctx,LIST_DATA(p,struct conf*),idx)!=0)return -1;
+	}while((p=p->next));
+	return 0;
+}
+
+static int bin_save(struct conf_file_hand*hand){
+	int r=-1;
+	struct conf_snap_head head;
+	struct snap_ctx ctx;
+	struct confd_buffer out={NULL,0,0};
+	memset(&ctx,0,sizeof(ctx));
+	memset(&head,0,sizeof(head));
+	if(confd_buffer_put(&ctx.strings,"",1)!=0)goto done;
+	if(snap_put(&ctx,conf_get_store(),0)!=0)goto done;
+	memcpy(head.magic,CONF_SNAP_MAGIC,sizeof(head.magic));
+	head.version=CONF_SNAP_VERSION;
+	head.count=ctx.count;
+	head.nodes=sizeof(head);
+	head.strings=head.nodes+ctx.nodes.len;
+	head.strings_len=ctx.strings.len;
+	if(
+		confd_buffer_put(&out,&head,sizeof(head))!=0||
+		confd_buffer_put(&out,ctx.nodes.data,ctx.nodes.len)!=0||
+		confd_buffer_put(&out,ctx.strings.data,ctx.strings.len)!=0
+	)goto done;
+	head.sum=conf_hash(out.data+head.nodes,out.len-head.nodes);
+	memcpy(out.data,&head,sizeof(head));
+	r=hand->write(hand,out.data,out.len)==(ssize_t)out.len?0:-1;
+	done:
+	if(r!=0)tlog_warn("build config snapshot failed");
+	if(ctx.table)free(ctx.table);
+	if(ctx.nodes.data)free(ctx.nodes.data);
+	if(ctx.strings.data)free(ctx.strings.data);
+	if(out.data)free(out.data);
+	return r;
+}
+
+static bool snap_check(struct conf_file_hand*hand,struct conf_snap_head*head){
+	if(hand->len<sizeof(*head))return false;
+	memcpy(head,hand->buff,sizeof(*head));
+	if(memcmp(head->magic,CONF_SNAP_MAGIC,sizeof(head->magic))!=0)return false;
+	if(head->version!=CONF_SNAP_VERSION||head->count<1)return false;
+	if(head->nodes!=sizeof(*head))return false;
+	if(head->count>(hand->len-head->nodes)/sizeof(struct conf_snap_node))return false;
+	if(head->strings!=head->nodes+head->count*sizeof(struct conf_snap_node))return false;
+	if(head->strings_len<1||head->strings_len!=hand->len-head->strings)return false;
+	if(hand->buff[hand->len-1]!=0)return false;
+	return conf_hash(hand->buff+head->nodes,hand->len-head->nodes)==head->sum;
+}
+
+// caller must hold store_lock for write
+static bool snap_value(struct conf*c,const struct conf_snap_node*n,const char*strings){
+	switch(c->type){
+		case TYPE_KEY:return false;
+		case TYPE_STRING:
+			if(c->value_mapped)conf_snap_release(VALUE_STRING(c));
+			else if(VALUE_STRING(c))free(VALUE_STRING(c));
+			VALUE_STRING(c)=(char*)strings+n->value;
+			c->value_mapped=true;
+		return true;
+		case TYPE_INTEGER:VALUE_INTEGER(c)=n->value;break;
+		case TYPE_BOOLEAN:VALUE_BOOLEAN(c)=n->value!=0;break;
+		default:;
+	}
+	return false;
+}
+
+static int bin_load(struct conf_file_hand*hand){
+	size_t used=0;
+	const char*strings,*name;
+	const struct conf_snap_node*nodes,*n;
+	struct conf_snap_head head;
+	struct snap_map*m;
+	struct conf*bulk=NULL,**map=NULL,*p,*c;
+	if(!snap_check(hand,&head)){
+		tlog_warn("invalid config snapshot %s",hand->path);
+		ERET(EBADMSG);
+	}
+	nodes=(const struct conf_snap_node*)(hand->buff+head.nodes);
+	strings=hand->buff+head.strings;
+	if(
+		!(m=malloc(sizeof(struct snap_map)))||
+		!(bulk=malloc(sizeof(struct conf)*head.count))||
+		!(map=malloc(sizeof(struct conf*)*head.count))
+	){
+		if(bulk)free(bulk);
+		if(m)free(m);
+		ERET(ENOMEM);
+	}
+	conf_store_wrlock();
+	map[0]=conf_get_store();
+	for(uint32_t i=1;i<head.count;i++){
+		n=&nodes[i],map[i]=NULL;
+		if(n->parent>=i||!(p=map[n->parent])||p->type!=TYPE_KEY)continue;
+		if(n->name>=head.strings_len)continue;
+		switch(n->type){
+			case TYPE_KEY:case TYPE_INTEGER:case TYPE_BOOLEAN:break;
+			case TYPE_STRING:
+				if(n->value<0||n->value>=head.strings_len)continue;
+			break;
+			default:continue;
+		}
+		name=strings+n->name;
+		if(!*name||strchr(name,'.')||strlen(name)>=CONF_NAME_MAX)continue;
+		if((c=conf_node_get(p,name))){
+			if(c->type!=n->type)continue;
+			if(snap_value(c,n,strings))used++;
+			if(c->type!=TYPE_KEY)c->include=hand->include;
+			map[i]=c;
+			continue;
+		}
+		c=&bulk[i];
+		memset(c,0,sizeof(struct conf));
+		c->name=(char*)name;
+		c->hash=conf_hash(name,strlen(name));
+		c->type=n->type,c->user=n->user;
+		c->group=n->group,c->mode=n->mode;
+		c->save=p->save,c->include=hand->include;
+		c->mapped=true;
+		if(conf_node_link(p,c)!=0)continue;
+		if(snap_value(c,n,strings))used++;
+		map[i]=c,used++;
+	}
+	// every mapped node and value holds a reference
+	if(used>0){
+		memset(m,0,sizeof(struct snap_map));
+		m->refs=used,m->mapped=hand->mapped;
+		m->buff=hand->buff,m->len=hand->len;
+		m->bulk=bulk,m->count=head.count;
+		if(hand->mapped)m->file=hand->file,hand->file=NULL;
+		m->next=snap_maps,snap_maps=m;
+		hand->buff=NULL,hand->mapped=false;
+	}
+	conf_journal(NULL,NULL,0);
+	conf_store_unlock();
+	free(map);
+	if(used==0){
+		free(bulk);
+		free(m);
+	}
+	return 0;
+}
+
+struct conf_file_hand conf_hand_bin={
+	.ext=(char*[]){"bin","confb",NULL},
+	.map=true,
+	.load=bin_load,
+	.save=bin_save,
+};
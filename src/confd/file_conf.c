@@ -93,10 +93,8 @@ static int conf_save(struct conf_file_hand*hand){
 
 static void line_set_string(struct conf_file_hand*hand,char*key,char*value,size_t len){
 	value[len-1]=0,value++;
-	char*old=conf_get_string(key,NULL,0,0);
 	char*val=str_unescape(value);
 	if(!val)return;
-	if(old)free(old);
 	conf_set_string_inc(key,val,0,0,hand->include);
 }
 
@@ -9,6 +9,7 @@
 #include<stdbool.h>
 #include<string.h>
 #include<errno.h>
+#include<poll.h>
 #include"system.h"
 #include"defines.h"
 #include"confd_internal.h"
@@ -39,24 +40,93 @@ int confd_internal_send_code(int fd,enum confd_action action,int code){
 	return confd_internal_send(fd,&msg);
 }
 
-int confd_internal_read_msg(int fd,struct confd_msg*buff){
-	if(!buff||fd<0)ERET(EINVAL);
-	size_t size=sizeof(struct confd_msg),s,len=0;
-	memset(buff,0,size);
-	errno=0;
-	do{
+static int read_exact(int fd,void*buff,size_t size,bool first){
+	ssize_t s;
+	size_t len=0;
+	struct pollfd p={.fd=fd,.events=POLLIN};
+	while(len<size){
 		errno=0;
-		s=read(fd,buff+len,size-len);
-		if(s==0)break;
+		s=read(fd,(char*)buff+len,size-len);
+		if(s==0)return (first&&len==0)?EOF:-2;
 		else if(s>0)len+=s;
 		else switch(errno){
 			case EINTR:continue;
-			case EAGAIN:return 0;
+			case EAGAIN:
+				if(first&&len==0)return 0;
+				if(poll(&p,1,1000)<=0)return -2;
+			continue;
 			default:return -2;
 		}
-	}while(len<size);
-	if(s==0)return EOF;
-	return (s!=size||!(confd_internal_check_magic(buff)))?-2:1;
+	}
+	return 1;
+}
+
+size_t confd_internal_encode_v2(void*buff,size_t len,struct confd_msg*msg,uint32_t id){
+	struct confd_msg_v2*hdr=buff;
+	size_t pl=strnlen(msg->path,sizeof(msg->path)-1);
+	if(!buff||len<sizeof(struct confd_msg_v2)+pl)return 0;
+	memset(hdr,0,sizeof(struct confd_msg_v2));
+	hdr->magic0=CONFD_MAGIC0;
+	hdr->magic1=CONFD_MAGIC1_V2;
+	hdr->path_len=(uint16_t)pl;
+	hdr->id=id;
+	hdr->action=msg->action;
+	hdr->code=msg->code;
+	hdr->data=msg->data;
+	memcpy(hdr+1,msg->path,pl);
+	return sizeof(struct confd_msg_v2)+pl;
+}
+
+int confd_internal_send_frame(int fd,struct confd_msg*msg,struct confd_frame*frame){
+	char buff[sizeof(struct confd_msg_v2)+sizeof(msg->path)];
+	if(fd<0)ERET(EINVAL);
+	if(!frame||frame->version<2)return confd_internal_send(fd,msg);
+	size_t len=confd_internal_encode_v2(buff,sizeof(buff),msg,frame->id);
+	if(len==0)ERET(EINVAL);
+	return (int)full_write(fd,buff,len);
+}
+
+int confd_internal_read_frame(int fd,struct confd_msg*buff,struct confd_frame*frame){
+	int r;
+	struct confd_msg_v2 hdr;
+	if(!buff||fd<0)ERET(EINVAL);
+	memset(buff,0,sizeof(struct confd_msg));
+	memset(&hdr,0,sizeof(hdr));
+	if((r=read_exact(fd,&hdr,2,true))!=1)return r;
+	if(hdr.magic0!=CONFD_MAGIC0)return -2;
+	switch(hdr.magic1){
+		case CONFD_MAGIC1:
+			buff->magic0=hdr.magic0,buff->magic1=hdr.magic1;
+			r=read_exact(fd,(char*)buff+2,sizeof(struct confd_msg)-2,false);
+			if(r!=1)return r;
+			if(frame)frame->version=1,frame->id=0;
+		break;
+		case CONFD_MAGIC1_V2:
+			r=read_exact(fd,(char*)&hdr+2,sizeof(hdr)-2,false);
+			if(r!=1)return r;
+			if(hdr.path_len>=sizeof(buff->path))return -2;
+			if(hdr.path_len>0){
+				r=read_exact(fd,buff->path,hdr.path_len,false);
+				if(r!=1)return r;
+			}
+			buff->magic0=CONFD_MAGIC0,buff->magic1=CONFD_MAGIC1;
+			buff->action=hdr.action;
+			buff->code=hdr.code;
+			buff->data=hdr.data;
+			if(frame)frame->version=2,frame->id=hdr.id;
+		break;
+		default:return -2;
+	}
+	return 1;
+}
+
+int confd_internal_read_msg(int fd,struct confd_msg*buff){
+	return confd_internal_read_frame(fd,buff,NULL);
+}
+
+int confd_internal_read_data(int fd,void*buff,size_t len){
+	if(!buff||fd<0)ERET(EINVAL);
+	return len>0&&read_exact(fd,buff,len,false)!=1?-1:0;
 }
 
 const char*confd_action2name(enum confd_action action){
@@ -88,6 +158,12 @@ const char*confd_action2name(enum confd_action action){
 		case CONF_LOAD:        return "Load Config";
 		case CONF_SAVE:        return "Save Config";
 		case CONF_COUNT:       return "Count Values";
+		case CONF_GET_SUBTREE: return "Get Subtree";
+		case CONF_GET_MULTI:   return "Get Multiple";
+		case CONF_SET_MULTI:   return "Set Multiple";
+		case CONF_WATCH:       return "Watch";
+		case CONF_WATCH_EVENT: return "Watch Event";
+		case CONF_WATCH_RESYNC:return "Watch Resync";
 		default:               return "Unknown";
 	}
 }
@@ -0,0 +1,266 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<errno.h>
+#include<stdlib.h>
+#include<string.h>
+#include<pthread.h>
+#include"logger.h"
+#include"confd_internal.h"
+#define TAG "journal"
+
+static mutex_t lock,io_lock;
+// journal.c is never built for UEFI, so mutex_t is a pthread mutex for the cond
+static pthread_cond_t changed=PTHREAD_COND_INITIALIZER;
+static pthread_once_t lock_once=PTHREAD_ONCE_INIT;
+static void lock_init(void){MUTEX_INIT(lock);MUTEX_INIT(io_lock);}
+#define JOURNAL_LOCK(l) do{pthread_once(&lock_once,lock_init);MUTEX_LOCK(l);}while(0)
+static struct confd_buffer pending={NULL,0,0};
+static bool dirty=false,full=false;
+static fsh*journal=NULL;
+static size_t journal_size=0,snap_mark=0;
+static char file[PATH_MAX],jfile[PATH_MAX+16];
+
+// called with store_lock held for write
+static void journal_record(const char*path,struct conf*c){
+	size_t off;
+	struct confd_item item;
+	struct conf_journal_rec rec;
+	JOURNAL_LOCK(lock);
+	dirty=true;
+	if(!journal||!path)full=true;
+	else if(!full&&(!c||(c->save&&!c->include))){
+		memset(&rec,0,sizeof(rec));
+		memset(&item,0,sizeof(item));
+		rec.magic=CONFD_JOURNAL_MAGIC;
+		if(c)switch((item.type=c->type)){
+			case TYPE_INTEGER:item.integer=VALUE_INTEGER(c);break;
+			case TYPE_BOOLEAN:item.integer=VALUE_BOOLEAN(c);break;
+			default:;
+		}
+		off=pending.len;
+		if(
+			confd_buffer_put(&pending,&rec,sizeof(rec))!=0||
+			confd_item_encode(&pending,&item,path,
+				c&&c->type==TYPE_STRING?VALUE_STRING(c):NULL
+			)!=0
+		)pending.len=off,full=true;
+		else{
+			rec.len=pending.len-off-sizeof(rec);
+			rec.sum=conf_hash(pending.data+off+sizeof(rec),rec.len);
+			memcpy(pending.data+off,&rec,sizeof(rec));
+		}
+	}
+	pthread_cond_signal(&changed);
+	MUTEX_UNLOCK(lock);
+}
+
+static void journal_apply(struct confd_item*item,const char*path,const char*value){
+	int r;
+	char*p,*s;
+	if(!(p=strndup(path,item->path_len)))return;
+	switch((int)item->type){
+		case 0:r=conf_del(p,0,0);break;
+		case TYPE_KEY:r=conf_add_key(p,0,0)?0:-errno;break;
+		case TYPE_INTEGER:r=conf_set_integer(p,item->integer,0,0);break;
+		case TYPE_BOOLEAN:r=conf_set_boolean(p,item->integer!=0,0,0);break;
+		case TYPE_STRING:
+			if(!(s=strndup(value,item->value_len)))r=-ENOMEM;
+			else if((r=conf_set_string(p,s,0,0))!=0)free(s);
+		break;
+		default:r=-EINVAL;
+	}
+	if(r!=0)tlog_debug("replay %s failed: %s",p,strerror(r<0?-r:errno));
+	free(p);
+}
+
+static ssize_t journal_replay(const char*data,size_t len,uint32_t base,bool*clean){
+	ssize_t cnt=0;
+	const char*p,*v;
+	struct confd_item item;
+	struct conf_journal_rec rec;
+	struct conf_journal_head head;
+	size_t off=sizeof(head),o;
+	*clean=false;
+	if(!data||len<sizeof(head))return -1;
+	memcpy(&head,data,sizeof(head));
+	if(head.magic!=CONFD_JOURNAL_MAGIC||head.base!=base)return -1;
+	while(len-off>=sizeof(rec)){
+		memcpy(&rec,data+off,sizeof(rec));
+		if(rec.magic!=CONFD_JOURNAL_MAGIC||rec.len>len-off-sizeof(rec))break;
+		if(conf_hash(data+off+sizeof(rec),rec.len)!=rec.sum)break;
+		o=0;
+		if(confd_item_decode(data+off+sizeof(rec),rec.len,&o,&item,&p,&v)!=1)break;
+		journal_apply(&item,p,v);
+		off+=sizeof(rec)+rec.len,cnt++;
+	}
+	*clean=off==len;
+	return cnt;
+}
+
+static uint32_t file_sum(const char*path){
+	void*data=NULL;
+	size_t len=0;
+	uint32_t sum=0;
+	if(fs_read_whole_file(NULL,path,&data,&len)==0&&data&&len>0)
+		sum=conf_hash(data,len);
+	if(data)free(data);
+	return sum;
+}
+
+// called with io_lock held, new journal is returned in out
+static int journal_create(uint32_t base,fsh**out){
+	int r;
+	fsh*f=NULL,*j=NULL;
+	char tmp[sizeof(jfile)+8];
+	struct conf_journal_head head={
+		.magic=CONFD_JOURNAL_MAGIC,
+		.base=base,
+	};
+	snprintf(tmp,sizeof(tmp),"%s.new",jfile);
+	r=fs_open(NULL,&f,tmp,FILE_FLAG_WRITE|FILE_FLAG_CREATE|FILE_FLAG_TRUNCATE|0644);
+	if(r==0)r=fs_full_write(f,&head,sizeof(head));
+	if(r==0&&(r=fs_flush(f))==ENOSYS)r=0;
+	if(r==0)r=fs_rename(f,jfile);
+	if(f)fs_close(&f);
+	if(r==0)r=fs_open(NULL,&j,jfile,FILE_FLAG_WRITE);
+	if(r==0)r=fs_seek(j,0,SEEK_END);
+	if(r!=0){
+		if(j)fs_close(&j);
+		return trlog_warn(-r,"create journal %s failed: %s",jfile,strerror(r));
+	}
+	*out=j;
+	return 0;
+}
+
+int conf_journal_open(const char*path){
+	int r=0;
+	bool clean=false,fold=false;
+	ssize_t cnt=-1;
+	void*data=NULL;
+	size_t len=0;
+	uint32_t base;
+	if(!path||!*path)ERET(EINVAL);
+	conf_journal_close();
+	JOURNAL_LOCK(io_lock);
+	memset(file,0,sizeof(file));
+	strncpy(file,path,sizeof(file)-1);
+	snprintf(jfile,sizeof(jfile),"%s.journal",file);
+	base=file_sum(file);
+	if(fs_read_whole_file(NULL,jfile,&data,&len)==0)
+		cnt=journal_replay(data,len,base,&clean);
+	if(data)free(data);
+	JOURNAL_LOCK(lock);
+	conf_journal_hook=journal_record;
+	pending.len=0,dirty=false,full=false;
+	if(cnt<0){
+		if((r=journal_create(base,&journal))==0)
+			journal_size=sizeof(struct conf_journal_head);
+	}else if(
+		cnt==0&&clean&&
+		fs_open(NULL,&journal,jfile,FILE_FLAG_WRITE)==0&&
+		fs_seek(journal,0,SEEK_END)==0
+	)journal_size=len;
+	else fold=true;
+	MUTEX_UNLOCK(lock);
+	MUTEX_UNLOCK(io_lock);
+	if(cnt>0)tlog_info("replayed %zd changes from %s",cnt,jfile);
+	return fold?conf_journal_checkpoint():r;
+}
+
+void conf_journal_close(void){
+	JOURNAL_LOCK(io_lock);
+	JOURNAL_LOCK(lock);
+	if(journal)fs_close(&journal);
+	journal=NULL,journal_size=0;
+	if(pending.len>0)full=true;
+	pending.len=0;
+	memset(file,0,sizeof(file));
+	MUTEX_UNLOCK(lock);
+	MUTEX_UNLOCK(io_lock);
+}
+
+bool conf_journal_opened(void){
+	JOURNAL_LOCK(lock);
+	bool r=file[0]!=0;
+	MUTEX_UNLOCK(lock);
+	return r;
+}
+
+void conf_journal_wait(void){
+	JOURNAL_LOCK(lock);
+	while(!dirty)pthread_cond_wait(&changed,&lock);
+	dirty=false;
+	MUTEX_UNLOCK(lock);
+}
+
+int conf_journal_flush(void){
+	int r=0;
+	bool cp;
+	struct confd_buffer buf={NULL,0,0};
+	size_t max=conf_get_integer("confd.journal_max",0x10000,0,0);
+	JOURNAL_LOCK(io_lock);
+	JOURNAL_LOCK(lock);
+	if(!file[0])r=-ENOENT,cp=false;
+	else if(!(cp=full||!journal||journal_size+pending.len>max))
+		buf=pending,pending=(struct confd_buffer){NULL,0,0};
+	MUTEX_UNLOCK(lock);
+	if(buf.len>0){
+		r=fs_full_write(journal,buf.data,buf.len);
+		if(r==0&&(r=fs_flush(journal))==ENOSYS)r=0;
+		if(r==0)journal_size+=buf.len;
+		else{
+			tlog_warn("write journal %s failed: %s",jfile,strerror(r));
+			JOURNAL_LOCK(lock);
+			full=true,cp=true;
+			MUTEX_UNLOCK(lock);
+		}
+	}
+	if(buf.data)free(buf.data);
+	MUTEX_UNLOCK(io_lock);
+	if(r<0)ERET(-r);
+	return cp?conf_journal_checkpoint():0;
+}
+
+// called with store_lock held, changes after this are not in snapshot
+static void checkpoint_mark(void){
+	JOURNAL_LOCK(lock);
+	snap_mark=pending.len,full=false;
+	MUTEX_UNLOCK(lock);
+}
+
+int conf_journal_checkpoint(void){
+	int r;
+	uint32_t sum=0;
+	fsh*j=NULL,*old=NULL;
+	JOURNAL_LOCK(io_lock);
+	if(!conf_journal_opened()){
+		MUTEX_UNLOCK(io_lock);
+		ERET(ENOENT);
+	}
+	// store is only locked while serializing into memory
+	if((r=conf_checkpoint_file(NULL,file,&sum,checkpoint_mark))!=0)r=-errno;
+	if(r==0)r=journal_create(sum,&j);
+	JOURNAL_LOCK(lock);
+	if(r==0){
+		old=journal,journal=j;
+		journal_size=sizeof(struct conf_journal_head);
+		// keep changes made after snapshot for new journal
+		if(snap_mark>0)memmove(pending.data,pending.data+snap_mark,pending.len-snap_mark);
+		if((pending.len-=snap_mark)>0){
+			dirty=true;
+			pthread_cond_signal(&changed);
+		}
+	}else full=true,dirty=true;
+	MUTEX_UNLOCK(lock);
+	if(old)fs_close(&old);
+	MUTEX_UNLOCK(io_lock);
+	if(r!=0)ERET(-r);
+	return 0;
+}
@@ -25,17 +25,26 @@
 #include"output.h"
 #include"confd_internal.h"
 #include"proctitle.h"
+#include"pool.h"
 #define TAG "confd"
 
 static pthread_t save_thread;
 static char*def_path=NULL;
+static mutex_t def_lock;
 static char*sock=DEFAULT_CONFD;
 static bool clean=false,protect=false;
-static int efd=-1;
-
-static void ctl_fd(int op,int fd){
-	static struct epoll_event ev;
-	ev.events=EPOLLIN,ev.data.fd=fd;
+static int efd=-1,quit_fds[2]={-1,-1};
+static struct pool*workers=NULL;
+
+// replies of one client may come from a pool worker and an async load/save
+// thread at once, a client always hashes to the same lock
+#define SEND_LOCKS 64
+static mutex_t send_locks[SEND_LOCKS];
+#define SEND_LOCK(fd) send_locks[(fd)%SEND_LOCKS]
+
+static void ctl_fd(int op,int fd,bool oneshot){
+	struct epoll_event ev;
+	ev.events=EPOLLIN|(oneshot?EPOLLONESHOT:0),ev.data.fd=fd;
 	epoll_ctl(efd,op,fd,&ev);
 	if(op==EPOLL_CTL_DEL)close(fd);
 }
@@ -53,7 +62,25 @@ static void signal_handler(int s,siginfo_t*info,void*c __attribute__((unused))){
 	exit(0);
 }
 
-static void do_ls(int fd,struct confd_msg*msg,struct confd_msg*ret,struct ucred*cred){
+static int send_frame(int fd,struct confd_msg*msg,struct confd_frame*frame){
+	int r;
+	if(fd<0)ERET(EINVAL);
+	MUTEX_LOCK(SEND_LOCK(fd));
+	r=confd_internal_send_frame(fd,msg,frame);
+	MUTEX_UNLOCK(SEND_LOCK(fd));
+	return r;
+}
+
+// default path may be replaced by CONF_SET_DEFAULT at any time, use a copy
+static char*dup_def_path(void){
+	char*p;
+	MUTEX_LOCK(def_lock);
+	p=def_path?strdup(def_path):NULL;
+	MUTEX_UNLOCK(def_lock);
+	return p;
+}
+
+static void do_ls(int fd,struct confd_frame*frame,struct confd_msg*msg,struct confd_msg*ret,struct ucred*cred){
 	size_t s=0,i;
 	char**ls=NULL,*l=NULL,*p=NULL;
 	if(!(ls=(char**)conf_ls(msg->path,cred->uid,cred->pid)))goto fail;
@@ -65,9 +92,11 @@ static void do_ls(int fd,struct confd_msg*msg,struct confd_msg*ret,struct ucred*
 		p+=c+1;
 	}
 	ret->data.data_len=s;
-	confd_internal_send(fd,ret);
-	write(fd,&i,sizeof(i));
-	write(fd,l,s);
+	MUTEX_LOCK(SEND_LOCK(fd));
+	confd_internal_send_frame(fd,ret,frame);
+	full_write(fd,&i,sizeof(i));
+	full_write(fd,l,s);
+	MUTEX_UNLOCK(SEND_LOCK(fd));
 	free(ls);
 	free(l);
 	return;
@@ -75,36 +104,75 @@ static void do_ls(int fd,struct confd_msg*msg,struct confd_msg*ret,struct ucred*
 	if(ls)free(ls);
 	if(l)free(l);
 	ret->data.data_len=0;
-	confd_internal_send(fd,ret);
+	send_frame(fd,ret,frame);
 }
 
-static void do_get_string(int fd,struct confd_msg*msg,struct confd_msg*ret,struct ucred*cred){
-	char*re=conf_get_string(msg->path,NULL,cred->uid,cred->gid);
+static void do_get_string(int fd,struct confd_frame*frame,struct confd_msg*msg,struct confd_msg*ret,struct ucred*cred){
+	char*re=conf_get_string_dup(msg->path,NULL,cred->uid,cred->gid);
 	ret->data.data_len=re?strlen(re):0;
-	confd_internal_send(fd,ret);
+	MUTEX_LOCK(SEND_LOCK(fd));
+	confd_internal_send_frame(fd,ret,frame);
 	if(re)full_write(fd,re,ret->data.data_len);
+	MUTEX_UNLOCK(SEND_LOCK(fd));
+	if(re)free(re);
 }
 
 static int do_set_string(int fd,struct confd_msg*msg,struct ucred*cred){
-	size_t s=msg->data.data_len,r;
-	char*data=malloc(s+1);
-	if(!data){
-		if(s>0)lseek(fd,s,SEEK_CUR);
-		return 0;
-	}
+	char*data;
+	size_t s=msg->data.data_len;
+	if(s>CONFD_PAYLOAD_MAX)return EINVAL;
+	if(!(data=malloc(s+1)))return ENOMEM;
 	memset(data,0,s+1);
-	do{errno=0;r=(size_t)read(fd,data,s);}while(errno==EAGAIN);
-	if(r!=s){
+	// payload may arrive in pieces on nonblocking socket
+	if(confd_internal_read_data(fd,data,s)!=0){
 		free(data);
-		return 0;
+		return EIO;
 	}
-	char*old=conf_get_string(msg->path,NULL,cred->uid,cred->gid);
-	if(old)free(old);
 	int retdata=-conf_set_string(msg->path,data,cred->uid,cred->gid);
 	if(retdata!=0)free(data);
 	return retdata;
 }
 
+static char*read_payload(int fd,size_t len){
+	char*data;
+	if(len<=0||len>CONFD_PAYLOAD_MAX)EPRET(EINVAL);
+	if(!(data=malloc(len+1)))EPRET(ENOMEM);
+	memset(data,0,len+1);
+	if(confd_internal_read_data(fd,data,len)!=0){
+		free(data);
+		EPRET(EIO);
+	}
+	return data;
+}
+
+static void do_get_items(int fd,struct confd_frame*frame,struct confd_msg*msg,struct confd_msg*ret,struct ucred*cred){
+	int r;
+	char*paths=NULL;
+	struct confd_buffer buf={NULL,0,0};
+	if(msg->action==CONF_GET_MULTI){
+		if(!(paths=read_payload(fd,msg->data.data_len)))r=-errno;
+		else r=conf_get_multi(paths,msg->data.data_len,&buf,cred->uid,cred->gid);
+	}else r=conf_get_subtree(msg->path,&buf,cred->uid,cred->gid);
+	if(r!=0)buf.len=0;
+	ret->code=-r;
+	ret->data.data_len=buf.len;
+	MUTEX_LOCK(SEND_LOCK(fd));
+	confd_internal_send_frame(fd,ret,frame);
+	if(buf.len>0)full_write(fd,buf.data,buf.len);
+	MUTEX_UNLOCK(SEND_LOCK(fd));
+	if(buf.data)free(buf.data);
+	if(paths)free(paths);
+}
+
+static int do_set_multi(int fd,struct confd_msg*msg,struct ucred*cred){
+	int r;
+	char*data=read_payload(fd,msg->data.data_len);
+	if(!data)return errno;
+	r=-conf_set_multi(data,msg->data.data_len,cred->uid,cred->gid);
+	free(data);
+	return r;
+}
+
 static int do_rename(int fd,struct confd_msg*msg,struct ucred*cred){
 	char*n=strchr(msg->path,':');
 	if(!n)ERET(EINVAL);
@@ -115,8 +183,8 @@ static int do_rename(int fd,struct confd_msg*msg,struct ucred*cred){
 
 struct async_load_save_data{
 	int fd;
+	struct confd_frame frame;
 	char path[PATH_MAX];
-	pthread_t tid;
 	bool include;
 };
 
@@ -124,13 +192,19 @@ static void*_async_load_thread(void*d){
 	if(!d)return NULL;
 	struct async_load_save_data*data=d;
 	struct confd_msg ret;
+	char*dp=dup_def_path();
+	const char*path=data->path[0]?data->path:dp;
+	bool def=!data->include&&path&&dp&&strcmp(path,dp)==0;
 	confd_internal_init_msg(&ret,CONF_OK);
+	if(def)conf_journal_close();
 	ret.code=-(data->include?
-		conf_include_file(NULL,data->path[0]?data->path:def_path):
-		conf_load_file(NULL,data->path[0]?data->path:def_path)
+		conf_include_file(NULL,path):
+		conf_load_file(NULL,path)
 	);
 	if(ret.code==0&&errno!=0)ret.code=errno;
-	confd_internal_send(data->fd,&ret);
+	if(def)conf_journal_open(dp);
+	send_frame(data->fd,&ret,&data->frame);
+	if(dp)free(dp);
 	free(data);
 	return NULL;
 }
@@ -139,37 +213,53 @@ static void*_async_save_thread(void*d){
 	if(!d)return NULL;
 	struct async_load_save_data*data=d;
 	struct confd_msg ret;
+	char*dp=NULL;
 	confd_internal_init_msg(&ret,CONF_OK);
-	ret.code=-conf_save_file(NULL,data->path[0]?data->path:def_path);
+	if(!data->path[0]&&conf_journal_opened()){
+		ret.code=-conf_journal_checkpoint();
+		if(ret.code==0)errno=0;
+	}else{
+		if(!data->path[0])dp=dup_def_path();
+		ret.code=-conf_save_file(NULL,data->path[0]?data->path:dp);
+	}
 	if(ret.code==0){
 		if(errno!=0)ret.code=errno;
 		else if(!data->path[0])conf_store_changed=false;
 	}
-	confd_internal_send(data->fd,&ret);
+	send_frame(data->fd,&ret,&data->frame);
+	if(dp)free(dp);
 	free(data);
 	return NULL;
 }
 
-static int do_async_load(int fd,const char*path,bool inc){
+static int do_async_load(int fd,struct confd_frame*frame,const char*path,bool inc){
 	if(!path)return -1;
 	struct async_load_save_data*d=malloc(sizeof(struct async_load_save_data));
 	if(!d)return -1;
 	d->fd=fd;
+	d->frame=*frame;
 	d->include=inc;
 	strcpy(d->path,path);
-	int r=pthread_create(&d->tid,NULL,_async_load_thread,d);
+	// the thread frees d, never touch it after create
+	pthread_t tid;
+	int r=pthread_create(&tid,NULL,_async_load_thread,d);
 	if(r!=0)free(d);
+	else pthread_detach(tid);
 	return r;
 }
 
-static int do_async_save(int fd,const char*path){
+static int do_async_save(int fd,struct confd_frame*frame,const char*path){
 	if(!path)return -1;
 	struct async_load_save_data*d=malloc(sizeof(struct async_load_save_data));
 	if(!d)return -1;
 	d->fd=fd;
+	d->frame=*frame;
 	strcpy(d->path,path);
-	int r=pthread_create(&d->tid,NULL,_async_save_thread,d);
+	// the thread frees d, never touch it after create
+	pthread_t tid;
+	int r=pthread_create(&tid,NULL,_async_save_thread,d);
 	if(r!=0)free(d);
+	else pthread_detach(tid);
 	return r;
 }
 
@@ -177,12 +267,14 @@ static int confd_read(int fd){
 	if(fd<0)ERET(EINVAL);
 	errno=0;
 	struct confd_msg msg;
-	int e=confd_internal_read_msg(fd,&msg);
+	struct confd_frame frame;
+	int e=confd_internal_read_frame(fd,&msg,&frame);
 	if(e<0)return e;
 	else if(e==0)return 0;
 	struct confd_msg ret;
 	confd_internal_init_msg(&ret,CONF_OK);
 	int retdata=0;
+	char*p;
 	socklen_t len=sizeof(struct ucred);
 	struct ucred cred;
 	if(getsockopt(fd,SOL_SOCKET,SO_PEERCRED,&cred,&len)<0)goto fail;
@@ -190,6 +282,8 @@ static int confd_read(int fd){
 		errno=EIO;
 		goto fail;
 	}
+	// watch connections only push events after subscribed
+	if(msg.action!=CONF_WATCH&&conf_watch_fd(fd))return EOF;
 	switch(msg.action){
 		// command response
 		case CONF_OK:case CONF_FAIL:break;
@@ -266,9 +360,25 @@ static int confd_read(int fd){
 
 		// list items in key
 		case CONF_LIST:
-			do_ls(fd,&msg,&ret,&cred);
+			do_ls(fd,&frame,&msg,&ret,&cred);
+		return e;
+
+		// get whole subtree or many items
+		case CONF_GET_SUBTREE:
+		case CONF_GET_MULTI:
+			do_get_items(fd,&frame,&msg,&ret,&cred);
 		return e;
 
+		// set many items
+		case CONF_SET_MULTI:
+			retdata=do_set_multi(fd,&msg,&cred);
+		break;
+
+		// subscribe changes under path
+		case CONF_WATCH:
+			if(conf_watch_add(fd,&frame,msg.path,cred.uid,cred.gid)==0)return e;
+		break;
+
 		// get item type
 		case CONF_GET_TYPE:
 			ret.data.type=conf_get_type(msg.path,cred.uid,cred.gid);
@@ -276,7 +386,7 @@ static int confd_read(int fd){
 
 		// get item as string
 		case CONF_GET_STRING:
-			do_get_string(fd,&msg,&ret,&cred);
+			do_get_string(fd,&frame,&msg,&ret,&cred);
 		return e;
 
 		// get item as integer
@@ -320,27 +430,33 @@ static int confd_read(int fd){
 				errno=EINVAL;
 				break;
 			}
+			if(!(p=strdup(msg.path))){
+				errno=ENOMEM;
+				break;
+			}
+			conf_journal_close();
+			MUTEX_LOCK(def_lock);
 			if(def_path)free(def_path);
-			def_path=strdup(msg.path);
-			if(!def_path)errno=ENOMEM;
+			def_path=p;
+			MUTEX_UNLOCK(def_lock);
 		break;
 
 		// load config
 		case CONF_LOAD:
 			if(cred.uid!=0||cred.gid!=0)errno=EACCES;
-			else if(do_async_load(fd,msg.path,false)==0)return e;
+			else if(do_async_load(fd,&frame,msg.path,false)==0)return e;
 			break;
 
 		// load config
 		case CONF_INCLUDE:
 			if(cred.uid!=0||cred.gid!=0)errno=EACCES;
-			else if(do_async_load(fd,msg.path,true)==0)return e;
+			else if(do_async_load(fd,&frame,msg.path,true)==0)return e;
 		break;
 
 		// save config
 		case CONF_SAVE:
 			if(cred.uid!=0||cred.gid!=0)errno=EACCES;
-			else if(do_async_save(fd,msg.path)==0)return e;
+			else if(do_async_save(fd,&frame,msg.path)==0)return e;
 		break;
 
 		// unknown
@@ -352,7 +468,7 @@ static int confd_read(int fd){
 	fail:
 	if(retdata==0&&errno!=0)retdata=errno;
 	ret.code=retdata;
-	confd_internal_send(fd,&ret);
+	send_frame(fd,&ret,&frame);
 	return e;
 }
 
@@ -383,18 +499,34 @@ static int listen_confd_socket(){
 }
 
 static void*confd_save_thread(void*d __attribute__((unused))){
+	char*dp;
 	for(;;){
-		sleep(conf_get_integer("confd.save_interval",10,0,0));
-		if(!def_path)continue;
-		if(conf_store_changed){
-			int r=confd_save_file(def_path);
-			if(r==0&&errno==0)conf_store_changed=false;
-			sync();
+		conf_journal_wait();
+		usleep(conf_get_integer("confd.save_delay",500,0,0)*1000);
+		if(conf_journal_opened()){
+			if(conf_journal_flush()==0)conf_store_changed=false;
+		}else if(conf_store_changed&&(dp=dup_def_path())){
+			if(conf_save_file(NULL,dp)==0)conf_store_changed=false;
+			free(dp);
 		}
 	}
 	return NULL;
 }
 
+static void*confd_worker(void*d){
+	int x,f=(int)(intptr_t)d;
+	do{x=confd_read(f);}while(x==1);
+	if(x==EOF){
+		conf_watch_del(f);
+		ctl_fd(EPOLL_CTL_DEL,f,true);
+	}
+	else if(x==-4){
+		// let main loop shutdown, not in a pool thread
+		if(write(quit_fds[1],"",1)<0)telog_warn("request exit failed");
+	}else ctl_fd(EPOLL_CTL_MOD,f,true);
+	return NULL;
+}
+
 int confd_thread(int cfd){
 	static size_t es=sizeof(struct epoll_event);
 	int r,e=0,fd;
@@ -408,15 +540,28 @@ int confd_thread(int cfd){
 		(int[]){SIGINT,SIGHUP,SIGQUIT,SIGTERM},
 		4,signal_handler
 	);
+	MUTEX_INIT(def_lock);
+	for(int i=0;i<SEND_LOCKS;i++)MUTEX_INIT(send_locks[i]);
 	if((efd=epoll_create(64))<0)
 		return terlog_error(-errno,"epoll_create failed");
+	if(pipe2(quit_fds,O_CLOEXEC|O_NONBLOCK)<0){
+		telog_error("create quit pipe failed");
+		e=-errno;
+		goto ex;
+	}
 	if(!(evs=malloc(es*64))){
 		telog_error("malloc failed");
 		e=-errno;
 		goto ex;
 	}
 	memset(evs,0,es*64);
-	ctl_fd(EPOLL_CTL_ADD,fd);
+	if(!(workers=pool_init_cpus(8192))){
+		telog_error("init thread pool failed");
+		e=-errno;
+		goto ex;
+	}
+	ctl_fd(EPOLL_CTL_ADD,fd,false);
+	ctl_fd(EPOLL_CTL_ADD,quit_fds[0],false);
 	if(cfd>=0){
 		confd_internal_send_code(cfd,CONF_OK,0);
 		close(cfd);
@@ -432,19 +577,18 @@ int confd_thread(int cfd){
 		}else if(r==0)continue;
 		else for(int i=0;i<r;i++){
 			int f=evs[i].data.fd;
-			if(f==fd){
+			if(f==quit_fds[0]){
+				tlog_info("initconfd exiting");
+				goto ex;
+			}else if(f==fd){
 				int n=accept(f,NULL,NULL);
 				if(n<0){
-					ctl_fd(EPOLL_CTL_DEL,fd);
+					ctl_fd(EPOLL_CTL_DEL,fd,false);
 					continue;
 				}
 				fcntl(n,F_SETFL,O_RDWR|O_NONBLOCK);
-				ctl_fd(EPOLL_CTL_ADD,n);
-			}else{
-				int x=confd_read(f);
-				if(x==EOF)ctl_fd(EPOLL_CTL_DEL,f);
-				else if(x==-4)goto ex;
-			}
+				ctl_fd(EPOLL_CTL_ADD,n,true);
+			}else pool_add(workers,confd_worker,(void*)(intptr_t)f);
 		}
 	}
 	ex:
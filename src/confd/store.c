@@ -17,10 +17,13 @@
 #include"lock.h"
 #define KEY_MODE 0755
 #define VAL_MODE 0644
-static mutex_t store_lock;
+static rwlock_t store_lock;
 
 bool conf_store_changed=false;
+conf_journal_func conf_journal_hook=NULL;
+conf_watch_func conf_watch_hook=NULL;
 static struct conf conf_store={
+	.name="",
 	.type=TYPE_KEY,
 	.save=true,
 	.user=0,
@@ -30,18 +33,75 @@ static struct conf conf_store={
 
 struct conf*conf_get_store(){return &conf_store;}
 
-static bool conf_cmp(list*l,void*d){
-	LIST_DATA_DECLARE(x,l,struct conf*);
-	return x&&d&&strcmp(x->name,(char*)d)==0;
+// caller must hold store_lock for write
+void conf_journal(const char*path,struct conf*c,uid_t u){
+	conf_store_changed=true;
+	if(conf_journal_hook)conf_journal_hook(path,c);
+	if(conf_watch_hook)conf_watch_hook(path,c,u);
+}
+
+#define INDEX_MIN_SIZE 16
+
+uint32_t conf_hash(const char*name,size_t len){
+	uint32_t h=0x811C9DC5;
+	for(size_t i=0;i<len;i++)h=(h^(unsigned char)name[i])*0x01000193;
+	return h;
+}
+
+static bool conf_name_eq(struct conf*c,const char*name,size_t len){
+	return strncmp(c->name,name,len)==0&&!c->name[len];
+}
+
+static struct conf_index*conf_index_resize(struct conf*conf,size_t size){
+	struct conf*c,*n;
+	struct conf_index*o=conf->index,*x;
+	size_t s=sizeof(struct conf_index)+sizeof(struct conf*)*size;
+	if(!(x=malloc(s)))return NULL;
+	memset(x,0,s);
+	x->size=size;
+	if(o){
+		x->count=o->count,x->last=o->last;
+		for(size_t i=0;i<o->size;i++)for(c=o->buckets[i];c;c=n){
+			n=c->hash_next;
+			c->hash_next=x->buckets[c->hash&(size-1)];
+			x->buckets[c->hash&(size-1)]=c;
+		}
+		free(o);
+	}
+	return conf->index=x;
 }
 
-static struct conf*conf_get(struct conf*conf,const char*name){
+static int conf_index_add(struct conf*conf,struct conf*c){
+	struct conf_index*idx=conf->index;
+	if(!idx&&!(idx=conf_index_resize(conf,INDEX_MIN_SIZE)))return -1;
+	if(idx->count>=idx->size&&!(idx=conf_index_resize(conf,idx->size*2)))return -1;
+	c->hash_next=idx->buckets[c->hash&(idx->size-1)];
+	idx->buckets[c->hash&(idx->size-1)]=c;
+	idx->count++;
+	return 0;
+}
+
+static void conf_index_del(struct conf*conf,struct conf*c){
+	struct conf**p;
+	if(!conf->index)return;
+	p=&conf->index->buckets[c->hash&(conf->index->size-1)];
+	for(;*p;p=&(*p)->hash_next)if(*p==c){
+		*p=c->hash_next,c->hash_next=NULL;
+		conf->index->count--;
+		break;
+	}
+}
+
+static struct conf*conf_get(struct conf*conf,const char*name,size_t len){
 	errno=0;
 	if(!conf)return NULL;
 	if(conf->type!=TYPE_KEY)EPRET(ENOTDIR);
-	list*l=list_search_one(conf->keys,conf_cmp,(char*)name);
-	if(!l)EPRET(ENOENT);
-	return LIST_DATA(l,struct conf*);
+	if(!conf->index)EPRET(ENOENT);
+	uint32_t h=conf_hash(name,len);
+	struct conf*c=conf->index->buckets[h&(conf->index->size-1)];
+	for(;c;c=c->hash_next)
+		if(c->hash==h&&conf_name_eq(c,name,len))return c;
+	EPRET(ENOENT);
 }
 
 static bool check_perm_read(struct conf*conf,uid_t u,gid_t g){
@@ -60,77 +120,84 @@ static bool check_perm_write(struct conf*conf,uid_t u,gid_t g){
 	else return false;
 }
 
-static struct conf*conf_create(struct conf*conf,const char*name,uid_t u,gid_t g){
+bool conf_node_readable(struct conf*c,uid_t u,gid_t g){
+	return check_perm_read(c,u,g);
+}
+
+// caller must hold store_lock for write
+int conf_node_link(struct conf*conf,struct conf*n){
+	list*item;
+	if(!(item=list_new(n)))ERET(ENOMEM);
+	if(conf_index_add(conf,n)!=0){
+		free(item);
+		ERET(ENOMEM);
+	}
+	if(conf->index->last)list_add(conf->index->last,item);
+	else list_obj_add(&conf->keys,item);
+	conf->index->last=item;
+	n->parent=conf;
+	return 0;
+}
+
+// caller must hold store_lock
+struct conf*conf_node_get(struct conf*conf,const char*name){
+	return conf_get(conf,name,strlen(name));
+}
+
+static struct conf*conf_create(struct conf*conf,const char*name,size_t len,uid_t u,gid_t g){
 	errno=0;
 	if(!conf)return NULL;
 	if(conf->type!=TYPE_KEY)EPRET(ENOTDIR);
 	if(!check_perm_read(conf,u,g))EPRET(EACCES);
-	if(list_search_one(conf->keys,conf_cmp,(char*)name))EPRET(EEXIST);
+	if(conf_get(conf,name,len))EPRET(EEXIST);
 	if(!check_perm_write(conf,u,g))EPRET(EACCES);
-	struct conf*n=malloc(sizeof(struct conf));
+	if(len>=CONF_NAME_MAX)EPRET(ENAMETOOLONG);
+	struct conf*n=malloc(sizeof(struct conf)+len+1);
 	if(!n)EPRET(ENOMEM);
-	memset(n,0,sizeof(struct conf));
-	strcpy(n->name,name);
-	n->parent=conf,n->save=conf->save,n->user=u,n->group=g;
-	list_obj_add_new_notnull(&conf->keys,n);
+	memset(n,0,sizeof(struct conf)+len+1);
+	n->name=(char*)(n+1);
+	memcpy(n->name,name,len);
+	n->hash=conf_hash(name,len);
+	n->save=conf->save,n->user=u,n->group=g;
+	if(conf_node_link(conf,n)!=0){
+		free(n);
+		return NULL;
+	}
+	errno=0;
 	return n;
 }
 
+void conf_store_rdlock(void){RWLOCK_RDLOCK(store_lock);}
+void conf_store_wrlock(void){RWLOCK_WRLOCK(store_lock);}
+void conf_store_unlock(void){RWLOCK_UNLOCK(store_lock);}
+
+// caller must hold store_lock, for write when create is true
 static struct conf*conf_lookup(const char*path,bool create,enum conf_type type,uid_t u,gid_t g){
 	errno=0;
 	struct conf*cur=&conf_store,*x;
-	char*xpath,*p,*key;
+	const char*key=path,*p;
+	size_t len;
 	if(!check_perm_read(&conf_store,u,g))EPRET(EACCES);
 	if(strcmp(path,"/")==0&&type==0)return &conf_store;
 	if(!path[0]&&type==0)return &conf_store;
-	if(!(xpath=strdup(path)))EPRET(ENOMEM);
-	p=xpath,key=xpath;
-	MUTEX_LOCK(store_lock);
-	if(p)do{
-		if(*p!='.')continue;
-		*p=0;
-		if(!(x=conf_get(cur,key))){
-			if(!create){
-				MUTEX_UNLOCK(store_lock);
-				free(xpath);
-				EPRET(ENOENT);
-			}
-			if(!(x=conf_create(cur,key,u,g))){
-				MUTEX_UNLOCK(store_lock);
-				free(xpath);
-				return NULL;
-			}
+	while((p=strchr(key,'.'))){
+		len=p-key;
+		if(!(x=conf_get(cur,key,len))){
+			if(!create)EPRET(ENOENT);
+			if(!(x=conf_create(cur,key,len,u,g)))return NULL;
 			x->type=TYPE_KEY;
 			x->mode=KEY_MODE;
 		}
-		if(!check_perm_read(x,u,g)){
-			MUTEX_UNLOCK(store_lock);
-			free(xpath);
-			EPRET(EACCES);
-		}
-		cur=x,key=++p;
-	}while(*p++);
-	if(!key[0]){
-		MUTEX_UNLOCK(store_lock);
-		free(xpath);
-		EPRET(EINVAL);
+		if(!check_perm_read(x,u,g))EPRET(EACCES);
+		cur=x,key=p+1;
 	}
-	if(!(x=conf_get(cur,key))){
-		if(!create){
-			MUTEX_UNLOCK(store_lock);
-			free(xpath);
-			EPRET(ENOENT);
-		}
-		if(!(x=conf_create(cur,key,u,g))){
-			MUTEX_UNLOCK(store_lock);
-			free(xpath);
-			return NULL;
-		}
+	if(!(len=strlen(key)))EPRET(EINVAL);
+	if(!(x=conf_get(cur,key,len))){
+		if(!create)EPRET(ENOENT);
+		if(!(x=conf_create(cur,key,len,u,g)))return NULL;
 		x->type=type;
 		x->mode=type==TYPE_KEY?KEY_MODE:VAL_MODE;
 	}
-	MUTEX_UNLOCK(store_lock);
-	free(xpath);
 	if(!check_perm_read(x,u,g))EPRET(EACCES);
 	if(x->type==0)EPRET(EBADMSG);
 	if(type!=0&&type!=x->type)EPRET(ENOENT);
@@ -138,8 +205,11 @@ static struct conf*conf_lookup(const char*path,bool create,enum conf_type type,u
 }
 
 enum conf_type conf_get_type(const char*path,uid_t u,gid_t g){
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
-	return c?c->type:(enum conf_type)-1;
+	enum conf_type t=c?c->type:(enum conf_type)-1;
+	RWLOCK_UNLOCK(store_lock);
+	return t;
 }
 
 const char*conf_type2string(enum conf_type type){
@@ -158,162 +228,228 @@ const char*conf_get_type_string(const char*path,uid_t u,gid_t g){
 }
 
 const char**conf_ls(const char*path,uid_t u,gid_t g){
+	list*p;
+	int e=0;
+	char*n;
+	size_t i=0,x=0,s;
+	const char**r=NULL;
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
-	if(!c)return NULL;
-	if(c->type!=TYPE_KEY)EPRET(ENOTDIR);
-	MUTEX_LOCK(store_lock);
-	int i=list_count(c->keys),x=0;
-	if(i<0)i=0;
-	size_t s=sizeof(char*)*(i+1);
-	const char**r=malloc(s);
-	if(!r){
-		MUTEX_UNLOCK(store_lock);
-		EPRET(ENOMEM);
-	}
+	if(!c)EDONE(e=errno);
+	if(c->type!=TYPE_KEY)EDONE(e=ENOTDIR);
+	s=sizeof(char*);
+	if((p=list_first(c->keys)))do{
+		LIST_DATA_DECLARE(d,p,struct conf*);
+		s+=sizeof(char*)+strlen(d->name)+1,i++;
+	}while((p=p->next));
+	if(!(r=malloc(s)))EDONE(e=ENOMEM);
 	memset(r,0,s);
-	list*p=list_first(c->keys);
-	if(p)do{
+	n=(char*)(r+i+1);
+	if((p=list_first(c->keys)))do{
 		LIST_DATA_DECLARE(d,p,struct conf*);
-		r[x++]=d->name;
+		strcpy(n,d->name);
+		r[x++]=n,n+=strlen(n)+1;
 	}while((p=p->next));
-	MUTEX_UNLOCK(store_lock);
+	done:
+	RWLOCK_UNLOCK(store_lock);
+	if(e!=0)errno=e;
 	return r;
 }
 
 int conf_count(const char*path,uid_t u,gid_t g){
+	int i=-1,e=0;
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
-	if(!c)return -1;
-	if(c->type!=TYPE_KEY)ERET(ENOTDIR);
-	MUTEX_LOCK(store_lock);
-	int i=list_count(c->keys);
-	if(i<0)i=0;
-	MUTEX_UNLOCK(store_lock);
+	if(!c)e=errno;
+	else if(c->type!=TYPE_KEY)e=ENOTDIR;
+	else i=c->index?(int)c->index->count:0;
+	RWLOCK_UNLOCK(store_lock);
+	if(e!=0)ERET(e);
 	return i;
 }
 
+// caller must hold store_lock for write
 static int conf_del_obj(struct conf*c){
 	if(!c)return -1;
 	if(!c->parent)ERET(EINVAL);
-	MUTEX_LOCK(store_lock);
 	list*p;
 	if(c->type==TYPE_KEY){
 		list*x;
 		if((p=list_first(c->keys)))do{
 			x=p->next;
-			MUTEX_UNLOCK(store_lock);
 			conf_del_obj(LIST_DATA(p,struct conf*));
-			MUTEX_LOCK(store_lock);
 		}while((p=x));
 		if(c->keys)free(c->keys);
-		c->keys=NULL;
-	}else if(c->type==TYPE_STRING&&c->value.string)free(c->value.string);
+		if(c->index)free(c->index);
+		c->keys=NULL,c->index=NULL;
+	}else if(c->type==TYPE_STRING&&c->value_mapped)
+		conf_snap_release(c->value.string);
+	else if(c->type==TYPE_STRING&&c->value.string)
+		free(c->value.string);
+	conf_index_del(c->parent,c);
 	if((p=list_first(c->parent->keys)))do{
 		LIST_DATA_DECLARE(d,p,struct conf*);
 		if(d!=c)continue;
+		if(c->parent->index&&c->parent->index->last==p)
+			c->parent->index->last=p->prev;
 		list_obj_del(&c->parent->keys,p,NULL);
 		break;
 	}while((p=p->next));
-	free(c);
+	if(c->name_alloc)free(c->name);
 	conf_store_changed=true;
-	MUTEX_UNLOCK(store_lock);
+	if(c->mapped)conf_snap_release(c);
+	else free(c);
 	return 0;
 }
 
 int conf_del(const char*path,uid_t u,gid_t g){
+	int r;
+	RWLOCK_WRLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
-	return c?conf_del_obj(c):-(errno);
+	r=c?conf_del_obj(c):-(errno);
+	if(r==0)conf_journal(path,NULL,u);
+	RWLOCK_UNLOCK(store_lock);
+	return r;
 }
 
 int conf_rename(const char*path,const char*name,uid_t u,gid_t g){
-	struct conf*c=conf_lookup(path,false,0,u,g);
-	if(!c)return -(errno);
+	int e=0;
+	bool oa;
+	uint32_t oh;
+	char*n,*o;
 	if(!name||!*name||strchr(name,'.'))ERET(EINVAL);
-	if(strlen(name)>=sizeof(c->name)-1)ERET(EINVAL);
-	if(!c->parent||!c->name[0])ERET(EACCES);
-	if(strcmp(c->name,name)==0)return 0;
-	if(!check_perm_read(c->parent,u,g))ERET(EACCES);
-	if(list_search_one(c->parent->keys,conf_cmp,(char*)name))ERET(EEXIST);
-	if(!check_perm_write(c,u,g))ERET(EACCES);
-	memset(c->name,0,sizeof(c->name));
-	strncpy(c->name,name,sizeof(c->name)-1);
+	RWLOCK_WRLOCK(store_lock);
+	struct conf*c=conf_lookup(path,false,0,u,g);
+	if(!c)EDONE(e=errno);
+	if(strlen(name)>=CONF_NAME_MAX-1)EDONE(e=EINVAL);
+	if(!c->parent||!c->name[0])EDONE(e=EACCES);
+	if(strcmp(c->name,name)==0)goto done;
+	if(!check_perm_read(c->parent,u,g))EDONE(e=EACCES);
+	if(conf_get(c->parent,name,strlen(name)))EDONE(e=EEXIST);
+	if(!check_perm_write(c,u,g))EDONE(e=EACCES);
+	if(!(n=strdup(name)))EDONE(e=ENOMEM);
+	conf_index_del(c->parent,c);
+	o=c->name,oa=c->name_alloc,oh=c->hash;
+	c->name=n,c->name_alloc=true;
+	c->hash=conf_hash(c->name,strlen(c->name));
+	if(conf_index_add(c->parent,c)!=0){
+		// the old name had a slot before, put it back
+		e=errno?errno:ENOMEM;
+		c->name=o,c->name_alloc=oa,c->hash=oh;
+		conf_index_add(c->parent,c);
+		free(n);
+		goto done;
+	}
+	if(oa)free(o);
+	conf_journal(NULL,NULL,u);
+	done:
+	RWLOCK_UNLOCK(store_lock);
+	if(e!=0)ERET(e);
 	return 0;
 }
 
 int conf_add_key(const char*path,uid_t u,gid_t g){
-	return conf_lookup(path,true,TYPE_KEY,u,g)!=NULL;
+	RWLOCK_WRLOCK(store_lock);
+	struct conf*c=conf_lookup(path,true,TYPE_KEY,u,g);
+	if(c)conf_journal(path,c,u);
+	RWLOCK_UNLOCK(store_lock);
+	return c!=NULL;
 }
 
-static int _conf_set_save(bool lock,struct conf*c,bool save,uid_t u,gid_t g){
+// caller must hold store_lock for write
+static int _conf_set_save(struct conf*c,bool save,uid_t u,gid_t g){
 	list*p;
 	int r=0;
 	if(!c)ERET(EINVAL);
-	if(lock)MUTEX_LOCK(store_lock);
 	if(c->type==TYPE_KEY&&(p=list_first(c->keys)))do{
 		LIST_DATA_DECLARE(d,p,struct conf*);
 		if(!check_perm_write(d,u,g))r=EPERM;
-		else if(_conf_set_save(false,d,save,u,g)!=0)r=-errno;
+		else if(_conf_set_save(d,save,u,g)!=0)r=-errno;
 	}while((p=p->next));
 	if(!check_perm_write(c,u,g))r=EPERM;
 	else c->save=save;
-	if(lock)MUTEX_UNLOCK(store_lock);
 	return r;
 }
 
 int conf_set_save(const char*path,bool save,uid_t u,gid_t g){
-	return _conf_set_save(true,conf_lookup(path,false,0,u,g),save,u,g);
+	RWLOCK_WRLOCK(store_lock);
+	int r=_conf_set_save(conf_lookup(path,false,0,u,g),save,u,g);
+	conf_journal(NULL,NULL,u);
+	RWLOCK_UNLOCK(store_lock);
+	return r;
 }
 
 bool conf_get_save(const char*path,uid_t u,gid_t g){
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
-	return c?c->save:false;
+	bool r=c?c->save:false;
+	RWLOCK_UNLOCK(store_lock);
+	return r;
 }
 
 int conf_get_own(const char*path,uid_t*own,uid_t u,gid_t g){
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
 	if(c&&own)*own=c->user;
+	RWLOCK_UNLOCK(store_lock);
 	return c&&own;
 }
 
 int conf_get_grp(const char*path,gid_t*grp,uid_t u,gid_t g){
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
 	if(c&&grp)*grp=c->group;
+	RWLOCK_UNLOCK(store_lock);
 	return c&&grp;
 }
 
 int conf_get_mod(const char*path,mode_t*mod,uid_t u,gid_t g){
+	RWLOCK_RDLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
 	if(c&&mod)*mod=c->mode;
+	RWLOCK_UNLOCK(store_lock);
 	return c&&mod;
 }
 
 int conf_set_own(const char*path,uid_t own,uid_t u,gid_t g){
 	if(u!=0&&g!=0)ERET(EPERM);
+	RWLOCK_WRLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
 	if(c)c->user=own;
+	RWLOCK_UNLOCK(store_lock);
 	return c!=NULL;
 }
 
 int conf_set_grp(const char*path,gid_t grp,uid_t u,gid_t g){
 	if(u!=0&&g!=0)ERET(EPERM);
+	RWLOCK_WRLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
 	if(c)c->group=grp;
+	RWLOCK_UNLOCK(store_lock);
 	return c!=NULL;
 }
 
 int conf_set_mod(const char*path,mode_t mod,uid_t u,gid_t g){
+	int r=0;
+	RWLOCK_WRLOCK(store_lock);
 	struct conf*c=conf_lookup(path,false,0,u,g);
-	if(!c)return -1;
-	if(u!=0&&u!=c->user)ERET(EPERM);
-	c->mode=mod;
-	return 0;
+	if(!c)r=-1;
+	else if(u!=0&&u!=c->user)errno=EPERM,r=-EPERM;
+	else c->mode=mod;
+	RWLOCK_UNLOCK(store_lock);
+	return r;
 }
 
+// caller must hold store_lock
 size_t conf_calc_size(struct conf*c){
 	if(!c)return 0;
 	list*p;
 	size_t size=sizeof(struct conf);
+	if(c->name_alloc||!c->mapped)size+=strlen(c->name)+1;
 	switch(c->type){
 		case TYPE_KEY:
+			if(c->index)size+=sizeof(struct conf_index)+
+				sizeof(struct conf*)*c->index->size;
 			if((p=list_first(c->keys)))do{
 				LIST_DATA_DECLARE(l,p,struct conf*);
 				size+=sizeof(list);
@@ -321,36 +457,162 @@ size_t conf_calc_size(struct conf*c){
 			}while((p=p->next));
 		break;
 		case TYPE_STRING:
-			if(c->value.string)size+=strlen(c->value.string)+1;
+			if(c->value.string&&!c->value_mapped)
+				size+=strlen(c->value.string)+1;
 		break;
 		default:;
 	}
 	return size;
 }
 
-#define FUNCTION_CONF_GET_SET(_tag,_type,_func) \
+char*conf_get_string_dup(const char*path,const char*def,uid_t u,gid_t g){
+	char*r;
+	RWLOCK_RDLOCK(store_lock);
+	struct conf*c=conf_lookup(path,false,TYPE_STRING,u,g);
+	const char*v=c?VALUE_STRING(c):def;
+	r=v?strdup(v):NULL;
+	RWLOCK_UNLOCK(store_lock);
+	return r;
+}
+
+// caller must hold store_lock
+static int conf_put_item(struct confd_buffer*buf,struct conf*c,const char*path){
+	struct confd_item item;
+	memset(&item,0,sizeof(item));
+	if(c){
+		item.type=c->type,item.save=c->save;
+		item.user=c->user,item.group=c->group,item.mode=c->mode;
+		switch(c->type){
+			case TYPE_INTEGER:item.integer=VALUE_INTEGER(c);break;
+			case TYPE_BOOLEAN:item.integer=VALUE_BOOLEAN(c);break;
+			default:;
+		}
+	}
+	return confd_item_encode(
+		buf,&item,path,
+		c&&c->type==TYPE_STRING?VALUE_STRING(c):NULL
+	);
+}
+
+// caller must hold store_lock
+static int conf_put_tree(struct confd_buffer*buf,struct conf*c,char*path,size_t len,uid_t u,gid_t g){
+	list*p;
+	int r=0;
+	size_t pl=strlen(path),nl;
+	if(c->type!=TYPE_KEY||!(p=list_first(c->keys)))return 0;
+	do{
+		LIST_DATA_DECLARE(d,p,struct conf*);
+		if(!check_perm_read(d,u,g))continue;
+		nl=strlen(d->name);
+		if(pl+nl+2>len)ERET(ENAMETOOLONG);
+		if(pl>0)path[pl]='.',strcpy(path+pl+1,d->name);
+		else strcpy(path,d->name);
+		if((r=conf_put_item(buf,d,path))!=0)break;
+		if((r=conf_put_tree(buf,d,path,len,u,g))!=0)break;
+	}while((p=p->next));
+	path[pl]=0;
+	return r;
+}
+
+int conf_get_subtree(const char*path,struct confd_buffer*buf,uid_t u,gid_t g){
+	int r;
+	char xpath[PATH_MAX];
+	if(!path||!buf)ERET(EINVAL);
+	memset(xpath,0,sizeof(xpath));
+	RWLOCK_RDLOCK(store_lock);
+	struct conf*c=conf_lookup(path,false,0,u,g);
+	if(!c)r=-errno;
+	else if(c->type!=TYPE_KEY)r=-ENOTDIR;
+	else r=conf_put_tree(buf,c,xpath,sizeof(xpath),u,g);
+	RWLOCK_UNLOCK(store_lock);
+	if(r!=0)errno=-r;
+	return r;
+}
+
+int conf_get_multi(const char*paths,size_t len,struct confd_buffer*buf,uid_t u,gid_t g){
+	int r=0;
+	size_t l;
+	if(!paths||!buf)ERET(EINVAL);
+	RWLOCK_RDLOCK(store_lock);
+	for(const char*p=paths;p<paths+len&&r==0;p+=l+1){
+		l=strnlen(p,paths+len-p);
+		if(l==0)continue;
+		char*x=strndup(p,l);
+		if(!x){
+			r=-ENOMEM;
+			break;
+		}
+		r=conf_put_item(buf,conf_lookup(x,false,0,u,g),x);
+		free(x);
+	}
+	RWLOCK_UNLOCK(store_lock);
+	if(r!=0)errno=-r;
+	return r;
+}
+
+int conf_set_multi(const char*data,size_t len,uid_t u,gid_t g){
+	int r,ret=0;
+	char*path,*str;
+	size_t off=0;
+	const char*p,*v;
+	struct confd_item item;
+	while((r=confd_item_decode(data,len,&off,&item,&p,&v))>0){
+		if(!(path=strndup(p,item.path_len)))ERET(ENOMEM);
+		switch(item.type){
+			case TYPE_KEY:r=conf_add_key(path,u,g)?0:-errno;break;
+			case TYPE_INTEGER:r=conf_set_integer(path,item.integer,u,g);break;
+			case TYPE_BOOLEAN:r=conf_set_boolean(path,item.integer!=0,u,g);break;
+			case TYPE_STRING:
+				if(!(str=strndup(v,item.value_len))){
+					r=-ENOMEM;
+					break;
+				}
+				if((r=conf_set_string(path,str,u,g))!=0)free(str);
+			break;
+			default:r=-EINVAL;
+		}
+		if(r!=0&&ret==0)ret=r;
+		free(path);
+	}
+	if(r<0&&ret==0)ret=r;
+	if(ret!=0)errno=-ret;
+	return ret;
+}
+
+#define FUNCTION_CONF_GET_SET(_tag,_type,_func,_release) \
 	int conf_set_##_func##_inc(const char*path,_type data,uid_t u,gid_t g,bool inc){\
+		RWLOCK_WRLOCK(store_lock);\
 		struct conf*c=conf_lookup(path,true,TYPE_##_tag,u,g);\
-		if(!c)return -errno;\
-		MUTEX_LOCK(store_lock);\
+		if(!c){\
+			RWLOCK_UNLOCK(store_lock);\
+			return -errno;\
+		}\
 		if(c->type!=TYPE_##_tag){\
-			MUTEX_UNLOCK(store_lock);\
+			RWLOCK_UNLOCK(store_lock);\
 			ERET(EBADMSG);\
 		}\
-                c->include=inc;\
+		_release;\
+		c->include=inc;\
 		VALUE_##_tag(c)=data;\
-		conf_store_changed=true;\
-		MUTEX_UNLOCK(store_lock);\
+		conf_journal(path,c,u);\
+		RWLOCK_UNLOCK(store_lock);\
 		return 0;\
 	}\
 	int conf_set_##_func(const char*path,_type data,uid_t u,gid_t g){\
 		return conf_set_##_func##_inc(path,data,u,g,false);\
 	}\
 	_type conf_get_##_func(const char*path,_type def,uid_t u,gid_t g){\
+		RWLOCK_RDLOCK(store_lock);\
 		struct conf*c=conf_lookup(path,false,TYPE_##_tag,u,g);\
-		return c?VALUE_##_tag(c):def;\
+		_type r=c?VALUE_##_tag(c):def;\
+		RWLOCK_UNLOCK(store_lock);\
+		return r;\
 	}
 
-FUNCTION_CONF_GET_SET(STRING,char*,string)
-FUNCTION_CONF_GET_SET(INTEGER,int64_t,integer)
-FUNCTION_CONF_GET_SET(BOOLEAN,bool,boolean)
+FUNCTION_CONF_GET_SET(STRING,char*,string,
+	if(VALUE_STRING(c)!=data&&c->value_mapped)conf_snap_release(VALUE_STRING(c));
+	else if(VALUE_STRING(c)!=data)free(VALUE_STRING(c));
+	c->value_mapped=false
+)
+FUNCTION_CONF_GET_SET(INTEGER,int64_t,integer,)
+FUNCTION_CONF_GET_SET(BOOLEAN,bool,boolean,)
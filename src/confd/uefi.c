@@ -154,8 +154,6 @@ int confd_set_integer(const char*path,int64_t data){
 int confd_set_string(const char*path,char*data){
 	char*s=strdup(data);
 	if(!s)ERET(ENOMEM);
-	char*c=conf_get_string(path,NULL,0,0);
-	if(c)free(c);
 	return conf_set_string(path,s,0,0);
 }
 
@@ -270,6 +268,58 @@ int confd_add_key(const char*path){
 	return conf_add_key(path,0,0);
 }
 
+static int local_request(struct confd_request*req){
+	char*s;
+	switch(req->type){
+		case TYPE_STRING:
+			if(!req->set){
+				s=conf_get_string(req->path,NULL,0,0);
+				req->code=s?0:errno;
+				s=s?s:req->value.string;
+				req->value.string=s?strdup(s):NULL;
+			}else req->code=-confd_set_string(req->path,req->value.string);
+		break;
+		case TYPE_INTEGER:
+			if(!req->set)req->value.integer=conf_get_integer(req->path,req->value.integer,0,0);
+			else req->code=-conf_set_integer(req->path,req->value.integer,0,0);
+		break;
+		case TYPE_BOOLEAN:
+			if(!req->set)req->value.boolean=conf_get_boolean(req->path,req->value.boolean,0,0);
+			else req->code=-conf_set_boolean(req->path,req->value.boolean,0,0);
+		break;
+		default:ERET(EINVAL);
+	}
+	return 0;
+}
+
+int confd_pipeline(struct confd_request*reqs,size_t cnt){
+	if(!reqs)ERET(EINVAL);
+	for(size_t i=0;i<cnt;i++)if(local_request(&reqs[i])!=0)return -errno;
+	return 0;
+}
+
+int confd_get_multi(struct confd_request*reqs,size_t cnt){
+	if(!reqs)ERET(EINVAL);
+	for(size_t i=0;i<cnt;i++)reqs[i].set=false;
+	return confd_pipeline(reqs,cnt);
+}
+
+int confd_set_multi(struct confd_request*reqs,size_t cnt){
+	if(!reqs)ERET(EINVAL);
+	for(size_t i=0;i<cnt;i++)reqs[i].set=true;
+	return confd_pipeline(reqs,cnt);
+}
+
+struct confd_cache*confd_fetch_subtree(const char*path){
+	struct confd_cache*cache;
+	struct confd_buffer buf={NULL,0,0};
+	if(!path)EPRET(EINVAL);
+	if(conf_get_subtree(path,&buf,0,0)!=0)return NULL;
+	cache=confd_cache_parse(buf.data,buf.len);
+	if(buf.data)free(buf.data);
+	return cache;
+}
+
 #define _EXT_BASE(ret,func,ret_func,...) \
 ret func##_base(const char*base,const char*path __VA_ARGS__){\
 	char xpath[PATH_MAX];\
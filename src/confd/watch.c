@@ -0,0 +1,296 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<time.h>
+#include<errno.h>
+#include<stdlib.h>
+#include<string.h>
+#include<pthread.h>
+#include<sys/socket.h>
+#include"list.h"
+#include"logger.h"
+#include"confd_internal.h"
+#define TAG "watch"
+
+// a coalesced change, only the newest change of a path is kept
+struct watch_event{
+	char*path;
+	uint32_t hash;
+	uid_t uid;
+	struct confd_item item;
+	char*value;
+};
+
+struct watcher{
+	int fd;
+	uid_t uid;
+	gid_t gid;
+	bool dead;
+	bool resync;
+	list*paths;
+	size_t count;
+	struct watch_event pending[CONFD_WATCH_PENDING];
+	struct confd_buffer out;
+	size_t sent;
+};
+
+static mutex_t lock;
+// watch.c is never built for UEFI, so mutex_t is a pthread mutex for the cond
+static pthread_cond_t kick=PTHREAD_COND_INITIALIZER;
+static pthread_once_t lock_once=PTHREAD_ONCE_INIT;
+static void lock_init(void){MUTEX_INIT(lock);}
+#define WATCH_LOCK() do{pthread_once(&lock_once,lock_init);MUTEX_LOCK(lock);}while(0)
+static bool started=false,kicked=false;
+static pthread_t notifier;
+static list*watchers=NULL;
+
+static bool watch_match(struct watcher*w,const char*path){
+	list*p;
+	const char*x;
+	size_t wl,pl=strlen(path);
+	if((p=list_first(w->paths)))do{
+		x=LIST_DATA(p,const char*);
+		if((wl=strlen(x))==0)return true;
+		if(pl>=wl){
+			if(strncmp(path,x,wl)==0&&(pl==wl||path[wl]=='.'))return true;
+		}else if(strncmp(x,path,pl)==0&&x[pl]=='.')return true;
+	}while((p=p->next));
+	return false;
+}
+
+static void watch_drop(struct watcher*w){
+	for(size_t i=0;i<w->count;i++){
+		if(w->pending[i].path)free(w->pending[i].path);
+		if(w->pending[i].value)free(w->pending[i].value);
+	}
+	w->count=0;
+}
+
+// called with lock held
+static void watch_queue(struct watcher*w,const char*path,struct conf*c,uid_t u){
+	size_t i;
+	uint32_t hash;
+	struct watch_event*e;
+	if(w->dead||w->resync)return;
+	if(!path)goto resync;
+	if(c&&!conf_node_readable(c,w->uid,w->gid))return;
+	hash=conf_hash(path,strlen(path));
+	for(i=0;i<w->count;i++){
+		e=&w->pending[i];
+		if(e->hash!=hash||strcmp(e->path,path)!=0)continue;
+		free(e->path);
+		if(e->value)free(e->value);
+		memmove(e,e+1,sizeof(struct watch_event)*(w->count-i-1));
+		w->count--;
+		break;
+	}
+	if(w->count>=CONFD_WATCH_PENDING)goto resync;
+	e=&w->pending[w->count];
+	memset(e,0,sizeof(struct watch_event));
+	if(!(e->path=strdup(path)))goto resync;
+	e->hash=hash,e->uid=u;
+	if(c){
+		e->item.type=c->type;
+		e->item.user=c->user;
+		e->item.group=c->group;
+		e->item.mode=c->mode;
+		e->item.save=c->save;
+		switch(c->type){
+			case TYPE_INTEGER:e->item.integer=VALUE_INTEGER(c);break;
+			case TYPE_BOOLEAN:e->item.integer=VALUE_BOOLEAN(c);break;
+			case TYPE_STRING:
+				if(VALUE_STRING(c)&&!(e->value=strdup(VALUE_STRING(c)))){
+					free(e->path);
+					goto resync;
+				}
+			break;
+			default:;
+		}
+	}
+	w->count++;
+	return;
+	resync:
+	watch_drop(w);
+	w->resync=true;
+}
+
+static int watch_put_frame(struct watcher*w,struct confd_msg*msg,uint32_t id){
+	size_t len;
+	char buff[sizeof(struct confd_msg_v2)+sizeof(msg->path)];
+	if((len=confd_internal_encode_v2(buff,sizeof(buff),msg,id))==0)ERET(EINVAL);
+	return confd_buffer_put(&w->out,buff,len);
+}
+
+static void watch_encode(struct watcher*w){
+	list*p;
+	struct confd_msg msg;
+	struct watch_event*e;
+	struct confd_buffer item={NULL,0,0};
+	if(w->resync&&(p=list_first(w->paths)))do{
+		confd_internal_init_msg(&msg,CONF_WATCH_RESYNC);
+		strncpy(msg.path,LIST_DATA(p,const char*),sizeof(msg.path)-1);
+		watch_put_frame(w,&msg,0);
+	}while((p=p->next));
+	w->resync=false;
+	for(size_t i=0;i<w->count;i++){
+		e=&w->pending[i],item.len=0;
+		if(confd_item_encode(&item,&e->item,e->path,e->value)!=0)continue;
+		confd_internal_init_msg(&msg,CONF_WATCH_EVENT);
+		msg.code=e->uid;
+		msg.data.data_len=item.len;
+		if(watch_put_frame(w,&msg,0)==0)
+			confd_buffer_put(&w->out,item.data,item.len);
+	}
+	watch_drop(w);
+	if(item.data)free(item.data);
+}
+
+// called with lock held, never blocks on a slow client
+static void watch_flush(struct watcher*w){
+	ssize_t s;
+	if(w->dead)return;
+	if(w->sent>=w->out.len){
+		w->out.len=w->sent=0;
+		watch_encode(w);
+	}
+	while(w->sent<w->out.len){
+		s=send(w->fd,w->out.data+w->sent,w->out.len-w->sent,MSG_NOSIGNAL|MSG_DONTWAIT);
+		if(s>0)w->sent+=s;
+		else if(s<0&&errno==EINTR)continue;
+		else{
+			if(s==0||(errno!=EAGAIN&&errno!=EWOULDBLOCK))w->dead=true;
+			break;
+		}
+	}
+}
+
+static void*watch_thread(void*d __attribute__((unused))){
+	list*p;
+	bool backlog;
+	struct watcher*w;
+	struct timespec ts;
+	WATCH_LOCK();
+	for(;;){
+		backlog=false;
+		if((p=list_first(watchers)))do{
+			w=LIST_DATA(p,struct watcher*);
+			watch_flush(w);
+			if(!w->dead&&w->sent<w->out.len)backlog=true;
+		}while((p=p->next));
+		if(!kicked){
+			if(backlog){
+				clock_gettime(CLOCK_REALTIME,&ts);
+				if((ts.tv_nsec+=20000000)>=1000000000)
+					ts.tv_sec++,ts.tv_nsec-=1000000000;
+				pthread_cond_timedwait(&kick,&lock,&ts);
+			}else pthread_cond_wait(&kick,&lock);
+		}
+		kicked=false;
+	}
+	return NULL;
+}
+
+// called with store_lock held for write
+static void watch_notify(const char*path,struct conf*c,uid_t u){
+	list*p;
+	bool any=false;
+	struct watcher*w;
+	WATCH_LOCK();
+	if((p=list_first(watchers)))do{
+		w=LIST_DATA(p,struct watcher*);
+		if(path&&!watch_match(w,path))continue;
+		watch_queue(w,path,c,u);
+		any=true;
+	}while((p=p->next));
+	if(any){
+		kicked=true;
+		pthread_cond_signal(&kick);
+	}
+	MUTEX_UNLOCK(lock);
+}
+
+static struct watcher*watch_lookup(int fd){
+	list*p;
+	if((p=list_first(watchers)))do{
+		if(LIST_DATA(p,struct watcher*)->fd==fd)
+			return LIST_DATA(p,struct watcher*);
+	}while((p=p->next));
+	return NULL;
+}
+
+static int watch_free(void*d){
+	struct watcher*w=d;
+	if(!w)return 0;
+	watch_drop(w);
+	if(w->paths)list_free_all(w->paths,list_default_free);
+	if(w->out.data)free(w->out.data);
+	free(w);
+	return 0;
+}
+
+int conf_watch_add(int fd,struct confd_frame*frame,const char*path,uid_t u,gid_t g){
+	int r=0;
+	char*p;
+	struct watcher*w;
+	struct confd_msg ret;
+	if(fd<0||!frame||!path)ERET(EINVAL);
+	if(path[0]&&conf_get_type(path,u,g)==(enum conf_type)-1&&errno!=ENOENT)r=errno;
+	if(!conf_watch_hook){
+		conf_store_wrlock();
+		conf_watch_hook=watch_notify;
+		conf_store_unlock();
+	}
+	WATCH_LOCK();
+	if(!started){
+		if(pthread_create(&notifier,NULL,watch_thread,NULL)!=0){
+			MUTEX_UNLOCK(lock);
+			ERET(EAGAIN);
+		}
+		started=true;
+	}
+	if(!(w=watch_lookup(fd))){
+		if(!(w=malloc(sizeof(struct watcher)))){
+			MUTEX_UNLOCK(lock);
+			ERET(ENOMEM);
+		}
+		memset(w,0,sizeof(struct watcher));
+		w->fd=fd,w->uid=u,w->gid=g;
+		if(list_obj_add_new(&watchers,w)!=0){
+			free(w);
+			MUTEX_UNLOCK(lock);
+			ERET(ENOMEM);
+		}
+	}
+	if(r==0&&!list_search_string(w->paths,path)){
+		if(!(p=strdup(path)))r=ENOMEM;
+		else if(list_obj_add_new(&w->paths,p)!=0)free(p),r=ENOMEM;
+	}
+	confd_internal_init_msg(&ret,r==0?CONF_OK:CONF_FAIL);
+	ret.code=r;
+	watch_put_frame(w,&ret,frame->id);
+	kicked=true;
+	pthread_cond_signal(&kick);
+	MUTEX_UNLOCK(lock);
+	return 0;
+}
+
+bool conf_watch_fd(int fd){
+	if(!started)return false;
+	WATCH_LOCK();
+	bool r=watch_lookup(fd)!=NULL;
+	MUTEX_UNLOCK(lock);
+	return r;
+}
+
+void conf_watch_del(int fd){
+	struct watcher*w;
+	WATCH_LOCK();
+	if((w=watch_lookup(fd)))list_obj_del_data(&watchers,w,watch_free);
+	MUTEX_UNLOCK(lock);
+}
@@ -0,0 +1,156 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<errno.h>
+#include<fcntl.h>
+#include<dirent.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/sysinfo.h>
+#include"lock.h"
+#include"trace.h"
+#include"system.h"
+#include"defines.h"
+#include"devd_internal.h"
+#define TAG "coldplug"
+
+// a directory to scan or an entry to call back, path is absolute
+struct coldplug_work{
+	struct coldplug_work*next;
+	bool entry;
+	unsigned char type;
+	char path[];
+};
+
+struct coldplug{
+	mutex_t lock;
+	pthread_cond_t cond;
+	struct coldplug_work*queue;
+	int idle,busy;
+	bool recursive;
+	coldplug_cb*cb;
+	void*data;
+	struct coldplug_stat st;
+};
+
+int coldplug_threads(){
+	return MAX(get_nprocs(),1);
+}
+
+static int coldplug_push(struct coldplug*cp,const char*path,bool entry,unsigned char type){
+	struct coldplug_work*w;
+	size_t l=strlen(path)+1;
+	if(!(w=malloc(sizeof(struct coldplug_work)+l)))ERET(ENOMEM);
+	w->entry=entry,w->type=type;
+	memcpy(w->path,path,l);
+	MUTEX_LOCK(cp->lock);
+	w->next=cp->queue,cp->queue=w;
+	pthread_cond_signal(&cp->cond);
+	MUTEX_UNLOCK(cp->lock);
+	return 0;
+}
+
+// hand work to an idle thread, the caller does it by itself if all threads are busy
+static bool coldplug_share(struct coldplug*cp,const char*path,bool entry,unsigned char type){
+	if(__atomic_load_n(&cp->idle,__ATOMIC_RELAXED)<=0)return false;
+	return coldplug_push(cp,path,entry,type)==0;
+}
+
+static void coldplug_call(struct coldplug*cp,int dir,const char*name,unsigned char type){
+	int r=cp->cb(cp->data,dir,name,type);
+	__atomic_fetch_add(&cp->st.entries,1,__ATOMIC_RELAXED);
+	if(r>0)__atomic_fetch_add(&cp->st.done,1,__ATOMIC_RELAXED);
+	else if(r<0)__atomic_fetch_add(&cp->st.failed,1,__ATOMIC_RELAXED);
+}
+
+// path is a PATH_MAX buffer, restored before return
+static void coldplug_scan(struct coldplug*cp,int fd,char*path){
+	int f;
+	DIR*d;
+	struct dirent*e;
+	size_t l=strlen(path),s;
+	if(!(d=fdopendir(fd))){
+		close(fd);
+		return;
+	}
+	__atomic_fetch_add(&cp->st.dirs,1,__ATOMIC_RELAXED);
+	while((e=readdir(d))){
+		if(is_virt_dir(e))continue;
+		if(l+(s=strlen(e->d_name))+2>PATH_MAX)continue;
+		path[l]='/';
+		memcpy(path+l+1,e->d_name,s+1);
+		if(e->d_type==DT_DIR&&cp->recursive){
+			if(!coldplug_share(cp,path,false,e->d_type)&&(f=openat(fd,e->d_name,O_DIR))>=0)
+				coldplug_scan(cp,f,path);
+		}else if(cp->recursive||!coldplug_share(cp,path,true,e->d_type))
+			coldplug_call(cp,fd,e->d_name,e->d_type);
+		path[l]=0;
+	}
+	closedir(d);
+}
+
+static void*coldplug_worker(void*d){
+	int fd;
+	char path[PATH_MAX];
+	struct coldplug_work*w;
+	struct coldplug*cp=d;
+	MUTEX_LOCK(cp->lock);
+	for(;;){
+		if(!(w=cp->queue)){
+			if(cp->busy==0)break;
+			__atomic_add_fetch(&cp->idle,1,__ATOMIC_RELAXED);
+			pthread_cond_wait(&cp->cond,&cp->lock);
+			__atomic_sub_fetch(&cp->idle,1,__ATOMIC_RELAXED);
+			continue;
+		}
+		cp->queue=w->next,cp->busy++;
+		MUTEX_UNLOCK(cp->lock);
+		if(w->entry)coldplug_call(cp,AT_FDCWD,w->path,w->type);
+		else if((fd=open(w->path,O_DIR))>=0){
+			strcpy(path,w->path);
+			coldplug_scan(cp,fd,path);
+		}
+		free(w);
+		MUTEX_LOCK(cp->lock);
+		if(--cp->busy==0&&!cp->queue)pthread_cond_broadcast(&cp->cond);
+	}
+	pthread_cond_broadcast(&cp->cond);
+	MUTEX_UNLOCK(cp->lock);
+	return NULL;
+}
+
+int coldplug_walk(const char*path,bool recursive,coldplug_cb*cb,void*data,struct coldplug_stat*st){
+	int fd,n,i=0;
+	pthread_t*tids;
+	struct coldplug cp;
+	uint64_t begin=trace_now();
+	if(!path||!cb||strlen(path)>=PATH_MAX)ERET(EINVAL);
+	if((fd=open(path,O_DIR))<0)return -errno;
+	close(fd);
+	memset(&cp,0,sizeof(cp));
+	cp.recursive=recursive,cp.cb=cb,cp.data=data;
+	MUTEX_INIT(cp.lock);
+	pthread_cond_init(&cp.cond,NULL);
+	if(coldplug_push(&cp,path,false,DT_DIR)!=0)goto done;
+	n=coldplug_threads()-1;
+	if(n>0&&(tids=malloc(sizeof(pthread_t)*n))){
+		for(i=0;i<n;i++)if(pthread_create(&tids[i],NULL,coldplug_worker,&cp)!=0)break;
+		coldplug_worker(&cp);
+		while(i>0)pthread_join(tids[--i],NULL);
+		free(tids);
+	}else coldplug_worker(&cp);
+	done:
+	pthread_cond_destroy(&cp.cond);
+	MUTEX_DESTROY(cp.lock);
+	cp.st.time=trace_now()-begin;
+	if(st)memcpy(st,&cp.st,sizeof(struct coldplug_stat));
+	return 0;
+}
@@ -7,7 +7,10 @@
  */
 
 #define _GNU_SOURCE
+#include<stdio.h>
 #include<errno.h>
+#include<limits.h>
+#include<stdlib.h>
 #include<unistd.h>
 #include<string.h>
 #include<sys/un.h>
@@ -16,6 +19,8 @@
 #include"logger.h"
 #include"uevent.h"
 #include"system.h"
+#include"pathnames.h"
+#include"devd.h"
 #include"devd_internal.h"
 #define TAG "devd"
 
@@ -58,12 +63,52 @@ int devd_call_quit(){
 	return devd_command(DEV_QUIT);
 }
 
+int devd_probe_query(const char*spec,struct devd_probe*out){
+	int fd,r=-1;
+	char*data;
+	struct devd_msg msg;
+	struct sockaddr_un n={.sun_family=AF_UNIX,.sun_path=DEFAULT_DEVD};
+	if(!spec||!out)ERET(EINVAL);
+
+	// own connection, callers may run in any thread
+	if((fd=socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0))<0)return -1;
+	if(connect(fd,(struct sockaddr*)&n,sizeof(n))<0){
+		close(fd);
+		ERET(ENOTCONN);
+	}
+	if(devd_internal_send_msg(fd,DEV_PROBE,(void*)spec,strlen(spec))<0)errno=ENOTCONN;
+	else if(devd_internal_read_msg(fd,&msg)<0)errno=ENOTCONN;
+	else if(msg.oper!=DEV_OK||msg.size!=sizeof(struct devd_probe))errno=ENOENT;
+	else if((data=devd_read_data(fd,&msg))){
+		memcpy(out,data,sizeof(struct devd_probe));
+		free(data);
+		r=0;
+	}else errno=EIO;
+	close(fd);
+	return r;
+}
+
+static void process_block(uevent*event){
+	char path[PATH_MAX];
+	if(!event->devname)return;
+	snprintf(path,sizeof(path),_PATH_DEV"/%s",event->devname);
+	switch(event->action){
+		case ACTION_ADD:
+		case ACTION_CHANGE:devd_probe_update(path);break;
+		case ACTION_REMOVE:devd_probe_remove(path);break;
+		default:break;
+	}
+}
+
 int process_module(uevent*event){
 	if(!event->devpath)return -1;
 	char*mod=strchr(event->devpath+1,'/')+1;
 	switch(event->action){
 		case ACTION_ADD:tlog_debug("loaded module '%s'",mod);break;
-		case ACTION_REMOVE:tlog_debug("unloaded module '%s'",mod);break;
+		case ACTION_REMOVE:
+			tlog_debug("unloaded module '%s'",mod);
+			modules_cache_forget(mod);
+		break;
 		default:break;
 	}
 	return 0;
@@ -88,6 +133,7 @@ int process_uevent(uevent*event){
 		if(strcmp(event->subsystem,"module")==0)process_module(event);
 	}
 	if(event->major>=0&&event->minor>=0)process_new_node(0,event);
+	if(event->subsystem&&strcmp(event->subsystem,"block")==0)process_block(event);
 	if(event->modalias)insmod(event->modalias,false);
 	return 0;
 }
@@ -8,8 +8,11 @@
 
 #ifndef DEVD_INTERNAL_H
 #define DEVD_INTERNAL_H
+#include<stdint.h>
 #include<stdbool.h>
 #include"devd.h"
+#include"pool.h"
+#include"uevent.h"
 
 // devd packet magic
 #define DEVD_MAGIC0 0xEF
@@ -24,6 +27,7 @@ enum devd_oper{
 	DEV_INIT     =0xAD04,
 	DEV_MODALIAS =0xAD05,
 	DEV_MODLOAD  =0xAD06,
+	DEV_PROBE    =0xAD07,
 };
 
 // devd message packet
@@ -39,7 +43,7 @@ extern void devd_internal_init_msg(struct devd_msg*msg,enum devd_oper oper,size_
 // src/devd/internal.c: check devd packaet magic
 extern bool devd_internal_check_magic(struct devd_msg*msg);
 
-// src/devd/internal.c: read extra data
+// src/devd/internal.c: read extra data, wait for the rest on a nonblock socket
 extern char*devd_read_data(int fd,struct devd_msg*msg);
 
 // src/devd/internal.c: send a devd packaet
@@ -51,8 +55,31 @@ extern int devd_internal_read_msg(int fd,struct devd_msg*buff);
 // src/devd/internal.c: send a string devd packet
 extern int devd_internal_send_msg_string(int fd,enum devd_oper oper,char*data);
 
-// src/devd/netlink.c: kobject uevent netlink listen thread
-extern int uevent_netlink_thread(void);
+// a received uevent, event strings point into buff
+struct uevent_work{
+	struct uevent_work*next;
+	uevent event;
+	size_t size;
+	char buff[];
+};
+
+// src/devd/netlink.c: open kobject uevent netlink socket
+extern int uevent_netlink_open(void);
+
+// src/devd/netlink.c: receive all pending uevents and dispatch them
+extern int uevent_netlink_receive(int fd);
+
+// src/devd/netlink.c: close netlink socket and fallback to hotplug helper
+extern void uevent_netlink_close(int fd);
+
+// src/devd/queue.c: init per device uevent queues
+extern void uevent_queue_init(struct pool*pool);
+
+// src/devd/queue.c: allocate a uevent work with size bytes buffer
+extern struct uevent_work*uevent_work_new(size_t size);
+
+// src/devd/queue.c: parse uevent from buff+off and queue it to its device, take w
+extern int uevent_dispatch(struct uevent_work*w,size_t off);
 
 // src/devd/internal.c: send devd command
 extern int devd_command_with_data(enum devd_oper oper,void*data,size_t size);
@@ -60,4 +87,23 @@ extern int devd_command_with_data(enum devd_oper oper,void*data,size_t size);
 // src/devd/internal.c: send devd command without data
 extern int devd_command(enum devd_oper oper);
 
+// coldplug entry callback, called from any walker thread
+// return >0 if entry was handled, 0 if skipped, <0 if failed
+typedef int coldplug_cb(void*data,int dir,const char*name,unsigned char type);
+
+// counters of a coldplug walk, time in nanoseconds
+struct coldplug_stat{
+	size_t dirs;
+	size_t entries;
+	size_t done;
+	size_t failed;
+	uint64_t time;
+};
+
+// src/devd/coldplug.c: number of coldplug walker threads
+extern int coldplug_threads(void);
+
+// src/devd/coldplug.c: walk sysfs with threads and call cb for all non directory entries
+extern int coldplug_walk(const char*path,bool recursive,coldplug_cb*cb,void*data,struct coldplug_stat*st);
+
 #endif
\ No newline at end of file
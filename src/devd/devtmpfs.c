@@ -20,104 +20,98 @@
 #include<sys/sysmacros.h>
 #define TAG "devtmpfs"
 #include"str.h"
-#include"devd.h"
+#include"trace.h"
+#include"devd_internal.h"
 #include"system.h"
 #include"logger.h"
 #include"defines.h"
 
 static int do_mknod(char*path,int dir,int type){
 	int major=-1,minor=-1,uevent;
-	char*name=NULL,*t,kb[PATH_MAX],vb[PATH_MAX],buff[PATH_MAX];
-	size_t idx,xi=0;
+	char*name=NULL,*t,*line,*next,*val;
+	char kb[PATH_MAX],vb[PATH_MAX],node[PATH_MAX],buff[PATH_MAX];
 	ssize_t r;
-	bool expr=false;
-	memset(&kb,0,sizeof(kb));
-	memset(&vb,0,sizeof(vb));
-	memset(&buff,0,sizeof(buff));
 	if((uevent=openat(dir,"uevent",O_RDONLY))<0)return -errno;
-	while((r=read(uevent,&buff,PATH_MAX))>0){
-		for(idx=0;idx<=(size_t)r;idx++){
-			char c=buff[idx];
-			if(c=='='){
-				kb[xi]=0;
-				expr=true;
-				xi=0;
-			}else if(c=='\n'||c=='\r'){
-				vb[xi]=0;
-				if(xi>0&&expr){
-					if(strcmp(kb,"DEVNAME")==0&&!name)name=strdup(vb);
-					if(strcmp(kb,"MAJOR")==0&&major<0)major=parse_int(vb,-1);
-					if(strcmp(kb,"MINOR")==0&&minor<0)minor=parse_int(vb,-1);
-				}
-				xi=0;
-				kb[xi]=0;
-				vb[xi]=0;
-				expr=false;
-			}else if(expr)vb[xi++]=c;
-			else kb[xi++]=c;
-		}
-		memset(&buff,0,PATH_MAX);
-	}
+	r=read(uevent,buff,sizeof(buff)-1);
 	close(uevent);
-	if(!name||major<0||minor<0){
-		if(name)free(name);
-		ERET(EINVAL);
+	if(r<0)return -errno;
+	buff[r]=0;
+
+	// parse KEY=VALUE lines in place
+	for(line=buff;line&&*line;line=next){
+		if((next=strpbrk(line,"\r\n")))*next++=0;
+		if(!(val=strchr(line,'='))||!*(val+1))continue;
+		*val++=0;
+		if(strcmp(line,"DEVNAME")==0&&!name)name=val;
+		else if(strcmp(line,"MAJOR")==0&&major<0)major=parse_int(val,-1);
+		else if(strcmp(line,"MINOR")==0&&minor<0)minor=parse_int(val,-1);
 	}
-	memset(buff,0,sizeof(buff));
-	snprintf(buff,sizeof(buff)-1,"%s/%s",path,name);
+	if(!name||major<0||minor<0)ERET(EINVAL);
+	memset(node,0,sizeof(node));
+	snprintf(node,sizeof(node)-1,"%s/%s",path,name);
 	switch(type){
 		case S_IFCHR:t="char";break;
 		case S_IFBLK:t="block";break;
 		default:t="unknown";break;
 	}
-	if(access(buff,F_OK)!=0){
-		if(errno!=ENOENT)goto fail;
-		mkdir_res(buff);
-		mknod(buff,type|0600,makedev(major,minor));
-		tlog_debug("create %s device(%d:%d) %s",t,major,minor,buff);
+	if(access(node,F_OK)!=0){
+		if(errno!=ENOENT)return -1;
+		mkdir_res(node);
+		mknod(node,type|0600,makedev(major,minor));
+		tlog_debug("create %s device(%d:%d) %s",t,major,minor,node);
 	}
 	memset(vb,0,sizeof(vb));
 	memset(kb,0,sizeof(kb));
 	snprintf(vb,sizeof(vb)-1,"../%s",name);
 	snprintf(kb,sizeof(kb)-1,"%s/%s/%d:%d",path,t,major,minor);
 	if(access(kb,F_OK)!=0){
-		if(errno!=ENOENT)goto fail;
+		if(errno!=ENOENT)return -1;
 		mkdir_res(kb);
 		symlink(vb,kb);
 	}
-	free(name);
 	return 0;
-	fail:free(name);
-	return -1;
 }
 
-static int scan_devices(char*path,int dir,int type){
-	DIR*d=fdopendir(dir);
-	if(!d)goto er;
-	struct dirent*r=NULL;
-	while((r=readdir(d))){
-		if(is_virt_dir(r)||r->d_type!=DT_LNK)continue;
-		int f=openat(dir,r->d_name,O_RDONLY|O_DIRECTORY);
-		if(f<0)continue;
-		do_mknod(path,f,type);
-		close(f);
-	}
-	closedir(d);
+struct scan_devices{
+	char*path;
+	int type;
+};
+
+static int scan_device(void*data,int dir,const char*name,unsigned char type){
+	int f,r;
+	struct scan_devices*s=data;
+	if(type!=DT_LNK)return 0;
+	if((f=openat(dir,name,O_RDONLY|O_DIRECTORY))<0)return 0;
+	r=do_mknod(s->path,f,s->type);
+	close(f);
+	return r==0?1:r;
+}
+
+static int scan_devices(char*path,char*dir,int type){
+	int r;
+	struct coldplug_stat st;
+	struct scan_devices s={.path=path,.type=type};
+	if((r=coldplug_walk(dir,false,scan_device,&s,&st))!=0)return r;
+	tlog_debug(
+		"create %zu nodes from %s in %llums (%zu failed)",
+		st.done,dir,(unsigned long long)st.time/1000000,st.failed
+	);
 	return 0;
-	er:
-	if(dir>=0)close(dir);
-	return -1;
 }
 
 int init_devtmpfs(char*path){
-	int fd=open(_PATH_SYS_DEV,O_RDONLY|O_DIRECTORY),e=0;
+	int fd=open(_PATH_SYS_DEV,O_RDONLY|O_DIRECTORY),e,r;
 	if(fd<=0)return terlog_error(-errno,"open %s failed",_PATH_SYS_DEV);
-	e=MIN(e,scan_devices(path,openat(fd,"char",O_RDONLY|O_DIRECTORY),S_IFCHR));
-	e=MIN(e,scan_devices(path,openat(fd,"block",O_RDONLY|O_DIRECTORY),S_IFBLK));
 	close(fd);
+	int t=trace_begin("devd","init devtmpfs");
+	// MIN evaluates twice, do not scan inside it
+	e=scan_devices(path,_PATH_SYS_DEVCHAR,S_IFCHR);
+	r=scan_devices(path,_PATH_SYS_DEVBLOCK,S_IFBLK);
+	e=MIN(e,r);
 	add_link(path,"stdin",_PATH_PROC_SELF"/fd/0");
 	add_link(path,"stdout",_PATH_PROC_SELF"/fd/1");
 	add_link(path,"stderr",_PATH_PROC_SELF"/fd/2");
 	add_link(path,"fd",_PATH_PROC_SELF"/fd");
+	trace_end(t);
 	return e;
 }
@@ -93,13 +93,12 @@ int process_firmware_load(uevent*event){
 	if(
 		!event||
 		!event->devpath||
-		!event->environs||
 		!event->subsystem||
 		event->action!=ACTION_ADD||
 		strcmp(event->subsystem,"firmware")!=0
 	)return -1;
 	int cfd;
-	char*firm=kvarr_get(event->environs,"FIRMWARE",NULL);
+	char*firm=uevent_get(event,"FIRMWARE");
 	char cpath[PATH_MAX],fpath[PATH_MAX];
 	if(!firm)return -1;
 	tlog_debug("kernel request firmware %s",firm);
@@ -7,6 +7,7 @@
  */
 
 #include<errno.h>
+#include<poll.h>
 #include<stdio.h>
 #include<string.h>
 #include<sys/uio.h>
@@ -15,6 +16,9 @@
 #include"defines.h"
 #include"devd_internal.h"
 
+// max wait for the rest of a message in ms
+#define DEVD_DATA_TIMEOUT 1000
+
 void devd_internal_init_msg(struct devd_msg*msg,enum devd_oper oper,size_t size){
 	if(!msg)return;
 	memset(msg,0,sizeof(struct devd_msg));
@@ -29,11 +33,19 @@ bool devd_internal_check_magic(struct devd_msg*msg){
 }
 
 char*devd_read_data(int fd,struct devd_msg*msg){
+	ssize_t r;
+	size_t off=0;
+	struct pollfd p={.fd=fd,.events=POLLIN};
 	if(!msg||msg->size<=0)return NULL;
 	char*data=malloc(msg->size);
-	if(data&&(size_t)read(fd,data,msg->size)!=msg->size){
-		free(data);
-		return NULL;
+	if(data)while(off<msg->size){
+		if((r=read(fd,data+off,msg->size-off))>0)off+=r;
+		else if(r<0&&errno==EINTR)continue;
+		else if(r<0&&errno==EAGAIN&&poll(&p,1,DEVD_DATA_TIMEOUT)>0)continue;
+		else{
+			free(data);
+			return NULL;
+		}
 	}
 	return data;
 }
@@ -7,73 +7,89 @@
  */
 
 #define _GNU_SOURCE
-#include<dirent.h>
+#include<errno.h>
 #include<unistd.h>
 #include<fcntl.h>
+#include<stdlib.h>
 #include<string.h>
 #include"pathnames.h"
+#include"devd_internal.h"
 #include"defines.h"
 #include"system.h"
 #include"logger.h"
+#include"lock.h"
 #include"str.h"
+#include"trace.h"
 #define TAG "modalias"
 
-static int scan_modalias(int dir);
+struct modalias_batch{
+	mutex_t lock;
+	char**aliases;
+	size_t cnt,size;
+};
 
-static int scan_modalias_dir(int dir,char*name){
-	if(!name||dir<0)return -1;
-	int f,e;
-	if((f=openat(dir,name,O_DIR))>=0){
-		e=scan_modalias(f);
-		close(f);
-	}else e=-errno;
-	return e;
-}
-
-static int scan_modalias_file(int dir,char*name){
-	if(!name||dir<0)return -1;
-	int f,e;
-	char buff[PATH_MAX]={0};
-	if(strcmp(name,"modalias")!=0)return 0;
-	if((f=openat(dir,name,O_RDONLY))>=0){
-		ssize_t r=read(f,buff,PATH_MAX-1);
-		if(r>0){
-			trim(buff);
-			e=insmod(buff,false);
-		}else e=-errno;
-		close(f);
-	}else e=-errno;
-	return e;
+static int modalias_add(struct modalias_batch*b,char*alias){
+	char**x;
+	size_t size;
+	MUTEX_LOCK(b->lock);
+	if(b->cnt>=b->size){
+		size=b->size?b->size*2:256;
+		if(!(x=realloc(b->aliases,sizeof(char*)*size))){
+			MUTEX_UNLOCK(b->lock);
+			ERET(ENOMEM);
+		}
+		b->aliases=x,b->size=size;
+	}
+	b->aliases[b->cnt++]=alias;
+	MUTEX_UNLOCK(b->lock);
+	return 0;
 }
 
-static int scan_modalias_dirent(int dir,struct dirent*r){
-	if(!r||dir<0)return -1;
-	if(is_virt_dir(r))return 0;
-	int e=0;
-	switch(r->d_type){
-		case DT_DIR:e+=scan_modalias_dir(dir,r->d_name);break;
-		case DT_REG:e+=scan_modalias_file(dir,r->d_name);break;
+static int scan_modalias_file(void*data,int dir,const char*name,unsigned char type){
+	int f,e=0;
+	ssize_t r;
+	char*a,buff[PATH_MAX]={0};
+	if(type!=DT_REG||strcmp(name,"modalias")!=0)return 0;
+	if((f=openat(dir,name,O_RDONLY))<0)return -errno;
+	if((r=read(f,buff,PATH_MAX-1))<0)e=-errno;
+	close(f);
+	if(r<=0)return e;
+	trim(buff);
+	if(!buff[0])return 0;
+	if(!(a=strdup(buff)))return -errno;
+	if(modalias_add(data,a)!=0){
+		free(a);
+		return -errno;
 	}
-	return e;
+	return 1;
 }
 
-static int scan_modalias(int dir){
-	DIR*d=fdopendir(dir);
-	if(!d)goto er;
-	int e=0;
-	struct dirent*r=NULL;
-	while((r=readdir(d)))e+=scan_modalias_dirent(dir,r);
-	closedir(d);
-	return e;
-	er:
-	if(dir>=0)close(dir);
-	ERET(ENOMEM);
-}
+#define MS(t) (unsigned long long)((t)/1000000)
 
 int load_modalias(){
-	int dfd=open(_PATH_SYS_DEVICES,O_DIR);
-	if(dfd<0)return -errno;
-	int r=scan_modalias(dfd);
-	close(dfd);
+	int r,t;
+	uint64_t begin;
+	struct coldplug_stat cs;
+	struct insmod_stat is;
+	struct modalias_batch b;
+	memset(&b,0,sizeof(b));
+	MUTEX_INIT(b.lock);
+	t=trace_begin("devd","load modalias");
+
+	// collect all modalias first, walk does not wait for module loading
+	if((r=coldplug_walk(_PATH_SYS_DEVICES,true,scan_modalias_file,&b,&cs))==0){
+		begin=trace_now();
+		r=insmod_batch(b.aliases,b.cnt,coldplug_threads(),false,&is);
+		if(r==0)tlog_info(
+			"found %zu modalias in %zu dirs in %llums, "
+			"probed %zu modules (%zu loaded, %zu failed) in %llums",
+			cs.done,cs.dirs,MS(cs.time),
+			is.modules,is.loaded,is.failed,MS(trace_now()-begin)
+		);
+	}
+	trace_end(t);
+	for(size_t i=0;i<b.cnt;i++)free(b.aliases[i]);
+	if(b.aliases)free(b.aliases);
+	MUTEX_DESTROY(b.lock);
 	return r;
 }
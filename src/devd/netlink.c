@@ -6,95 +6,145 @@
  *
  */
 
+#define _GNU_SOURCE
 #include<errno.h>
 #include<stdio.h>
+#include<stdint.h>
 #include<stdlib.h>
 #include<string.h>
 #include<unistd.h>
-#include<sys/epoll.h>
-#include<sys/prctl.h>
 #include<sys/socket.h>
 #include<linux/netlink.h>
 #include"system.h"
 #include"logger.h"
 #include"pathnames.h"
-#include"proctitle.h"
 #include"devd_internal.h"
-#define TAG "kobject"
+#define TAG "uevent"
 
-static int init_hotplug_sock(){
-	int s;
+// events received by one recvmmsg
+#define UEVENT_RECV 32
+// size of a kernel uevent buffer
+#define UEVENT_BUFFER 8192
+// netlink receive buffer, enough for a hotplug storm
+#define UEVENT_RCVBUF (16*1024*1024)
+
+static struct{
+	uint64_t seqnum;
+	unsigned long long processed,dropped,overflows;
+}counter;
+
+// receive buffers, a buffer becomes the work of its event
+static struct uevent_work*works[UEVENT_RECV];
+
+int uevent_netlink_open(){
+	int s,size=UEVENT_RCVBUF;
 	struct sockaddr_nl n={
 		.nl_family=AF_NETLINK,
 		.nl_groups=1
 	};
 	n.nl_pid=getpid();
-	if((s=socket(AF_NETLINK,SOCK_DGRAM,NETLINK_KOBJECT_UEVENT))<0)
+	if((s=socket(AF_NETLINK,SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK,NETLINK_KOBJECT_UEVENT))<0)
 		return terlog_error(-errno,"cannot create socket");
+	if(
+		setsockopt(s,SOL_SOCKET,SO_RCVBUFFORCE,&size,sizeof(size))<0&&
+		setsockopt(s,SOL_SOCKET,SO_RCVBUF,&size,sizeof(size))<0
+	)telog_warn("cannot set netlink receive buffer size");
 	if(bind(s,(struct sockaddr*)&n,sizeof(n))<0){
 		telog_error("cannot bind netlink uevent socket");
 		close(s);
 		return -1;
 	}
+	tlog_info("kobject uevent listen started");
 	return s;
 }
 
-int uevent_netlink_thread(){
-	static size_t es=sizeof(struct epoll_event),ms=sizeof(struct devd_msg);
-	close_all_fd(NULL,0);
-	open_socket_logfd_default();
-	tlog_info("kobject uevent forwarder start with pid %d",getpid());
-	setproctitle("uevent");
-	prctl(PR_SET_NAME,"UEvent Forward",0,0,0);
-	char buf[8192],*v;
-	size_t vs;
-	ssize_t s;
-	bool run=true;
-	struct devd_msg msg;
-	struct epoll_event ev,*evs=NULL;
-	int hs,ds=-1,efd=-1,e=-1,r;
-	if((hs=init_hotplug_sock())<0)goto fail;
-	if((ds=open_default_devd_socket(TAG))<0)goto fail;
-	if((efd=epoll_create(2))<0)return terlog_error(-errno,"epoll_create failed");
-	if(!(evs=malloc(es*2)))goto fail;
-	ev.events=EPOLLIN;
-	ev.data.fd=hs;epoll_ctl(efd,EPOLL_CTL_ADD,hs,&ev);
-	ev.data.fd=ds;epoll_ctl(efd,EPOLL_CTL_ADD,ds,&ev);
-	while(run){
-		e=-2;
-		r=epoll_wait(efd,evs,2,-1);
-		if(r==-1){
+void uevent_netlink_close(int fd){
+	if(fd<0)return;
+	tlog_info(
+		"received %llu uevents, %llu lost, %llu overflows",
+		counter.processed,counter.dropped,counter.overflows
+	);
+	close(fd);
+	for(int i=0;i<UEVENT_RECV;i++)if(works[i]){
+		free(works[i]);
+		works[i]=NULL;
+	}
+	simple_file_write(_PATH_PROC_SYS"/kernel/hotplug",_PATH_USR_BIN"/hotplug");
+}
+
+static void uevent_seqnum(const char*v,const char*end){
+	uint64_t seq=0;
+	for(;v<end;v+=strlen(v)+1)
+		if(strncmp(v,"SEQNUM=",7)==0)
+			seq=strtoull(v+7,NULL,10);
+	if(seq<=0)return;
+	if(counter.seqnum>0&&seq>counter.seqnum+1){
+		counter.dropped+=seq-counter.seqnum-1;
+		tlog_warn(
+			"uevent seqnum jump from %llu to %llu, %llu events lost",
+			(unsigned long long)counter.seqnum,(unsigned long long)seq,
+			(unsigned long long)(seq-counter.seqnum-1)
+		);
+	}
+	if(seq>counter.seqnum)counter.seqnum=seq;
+}
+
+// take w, skip "action@devpath" header and queue the event
+static void uevent_received(struct uevent_work*w,size_t len,struct msghdr*h){
+	char*v;
+	size_t off;
+	struct uevent_work*x;
+	struct sockaddr_nl*addr=h->msg_name;
+	if(h->msg_flags&MSG_TRUNC){
+		counter.dropped++;
+		tlog_warn("drop truncated uevent");
+		goto drop;
+	}
+	if(h->msg_namelen<sizeof(struct sockaddr_nl)||addr->nl_pid!=0)goto drop;
+	if(!(v=memchr(w->buff,0,len))||++v>=w->buff+len)goto drop;
+	w->buff[len]=0;
+	uevent_seqnum(v,w->buff+len);
+	// give back the unused part of receive buffer
+	off=v-w->buff;
+	if((x=realloc(w,sizeof(struct uevent_work)+len+1)))w=x;
+	w->size=len;
+	counter.processed++;
+	uevent_dispatch(w,off);
+	return;
+	drop:free(w);
+}
+
+int uevent_netlink_receive(int fd){
+	int n;
+	struct mmsghdr msgs[UEVENT_RECV];
+	struct iovec iov[UEVENT_RECV];
+	struct sockaddr_nl addr[UEVENT_RECV];
+	for(;;){
+		memset(msgs,0,sizeof(msgs));
+		for(int i=0;i<UEVENT_RECV;i++){
+			if(!works[i]&&!(works[i]=uevent_work_new(UEVENT_BUFFER)))return -1;
+			iov[i].iov_base=works[i]->buff;
+			iov[i].iov_len=UEVENT_BUFFER;
+			msgs[i].msg_hdr.msg_iov=&iov[i];
+			msgs[i].msg_hdr.msg_iovlen=1;
+			msgs[i].msg_hdr.msg_name=&addr[i];
+			msgs[i].msg_hdr.msg_namelen=sizeof(struct sockaddr_nl);
+		}
+		if((n=recvmmsg(fd,msgs,UEVENT_RECV,MSG_DONTWAIT,NULL))<0){
 			if(errno==EINTR)continue;
-			telog_error("epoll failed");
-			goto fail;
-		}else for(int i=0;i<r;i++){
-			int f=evs[i].data.fd;
-			if(f==hs){
-				memset(buf,0,8192);
-				if((s=recv(hs,&buf,8191,0))<0)break;
-				for(ssize_t x=0;x<s;x++)if(buf[x]==0)buf[x]='\n';
-				if(!(v=strchr(buf,'\n')))continue;
-				v++,vs=s-(v-(char*)buf)+1;
-				memset(&msg,0,ms);
-				devd_internal_send_msg(ds,DEV_ADD,v,vs);
-				do{if(devd_internal_read_msg(ds,&msg)<0)goto fail;}
-				while(msg.oper!=DEV_OK&&msg.oper!=DEV_FAIL);
-			}else if(f==ds){
-				if(devd_internal_read_msg(ds,&msg)<0)goto fail;
-				if(msg.size>0)lseek(ds,(size_t)msg.size,SEEK_CUR);
-				if(msg.oper==DEV_QUIT){
-					run=false;
-					break;
-				}
+			if(errno==EAGAIN||errno==EWOULDBLOCK)break;
+			if(errno==ENOBUFS){
+				counter.overflows++;
+				tlog_warn("uevent socket overflow, some events lost");
+				continue;
 			}
+			return terlog_error(-errno,"receive uevent failed");
 		}
+		for(int i=0;i<n;i++){
+			uevent_received(works[i],msgs[i].msg_len,&msgs[i].msg_hdr);
+			works[i]=NULL;
+		}
+		if(n<UEVENT_RECV)break;
 	}
-	e=0;
-	fail:
-	simple_file_write(_PATH_PROC_SYS"/kernel/hotplug",_PATH_USR_BIN"/hotplug");
-	if(hs>=0)close(hs);
-	if(ds>=0)close(ds);
-	if(efd>=0)close(efd);
-	if(evs)free(evs);
-	return e;
+	return 0;
 }
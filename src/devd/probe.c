@@ -0,0 +1,264 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<errno.h>
+#include<fcntl.h>
+#include<stdio.h>
+#include<dirent.h>
+#include<limits.h>
+#include<stddef.h>
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include<libblkid/blkid.h>
+#include"lock.h"
+#include"array.h"
+#include"devd.h"
+#include"system.h"
+#include"logger.h"
+#include"defines.h"
+#include"pathnames.h"
+#define TAG "probe"
+
+#define PROBE_BUCKETS 256
+
+// a probed block device
+struct probe_entry{
+	struct probe_entry*next;
+	struct devd_probe info;
+};
+
+// index key, device path or TAG=VALUE
+struct probe_key{
+	struct probe_key*next;
+	struct probe_entry*entry;
+	uint32_t hash;
+	char key[];
+};
+
+static rwlock_t probe_lock;
+static mutex_t scan_lock;
+static struct probe_key*index_keys[PROBE_BUCKETS];
+static struct probe_entry*entries=NULL;
+static bool populated=false;
+
+static const struct probe_tag{
+	const char*tag,*probe;
+	size_t offset,size;
+}probe_tags[]={
+	#define PROBE_TAG(_tag,_probe,_field){\
+		.tag=(_tag),.probe=(_probe),\
+		.offset=offsetof(struct devd_probe,_field),\
+		.size=sizeof(((struct devd_probe*)0)->_field)\
+	}
+	PROBE_TAG("TYPE",      "TYPE",            type),
+	PROBE_TAG("UUID",      "UUID",            uuid),
+	PROBE_TAG("LABEL",     "LABEL",           label),
+	PROBE_TAG("PARTUUID",  "PART_ENTRY_UUID", partuuid),
+	PROBE_TAG("PARTLABEL", "PART_ENTRY_NAME", partlabel),
+	#undef PROBE_TAG
+};
+
+#define TAG_FIELD(info,t) ((char*)(info)+(t)->offset)
+
+static uint32_t probe_hash(const char*str){
+	uint32_t h=0x811C9DC5;
+	for(;*str;str++)h=(h^(unsigned char)*str)*0x01000193;
+	return h;
+}
+
+int devd_probe_block(const char*dev,struct devd_probe*out){
+	int r;
+	const char*v;
+	blkid_probe pr;
+	if(!dev||!out)ERET(EINVAL);
+	memset(out,0,sizeof(struct devd_probe));
+	strncpy(out->dev,dev,sizeof(out->dev)-1);
+	if(!(pr=blkid_new_probe_from_filename(dev)))return errno>0?-errno:-1;
+
+	// probe all chains in one pass
+	blkid_probe_enable_superblocks(pr,1);
+	blkid_probe_set_superblocks_flags(pr,
+		BLKID_SUBLKS_LABEL|BLKID_SUBLKS_UUID|BLKID_SUBLKS_TYPE
+	);
+	blkid_probe_enable_partitions(pr,1);
+	blkid_probe_set_partitions_flags(pr,BLKID_PARTS_ENTRY_DETAILS);
+	if((r=blkid_do_safeprobe(pr))<0){
+		blkid_free_probe(pr);
+		ERET(EIO);
+	}
+	for(size_t i=0;i<ARRLEN(probe_tags);i++)if(blkid_probe_lookup_value(
+		pr,probe_tags[i].probe,&v,NULL
+	)==0&&v)strncpy(
+		TAG_FIELD(out,&probe_tags[i]),v,
+		probe_tags[i].size-1
+	);
+	blkid_free_probe(pr);
+	return 0;
+}
+
+// called with probe_lock held
+static struct probe_entry*index_lookup(const char*key){
+	uint32_t h=probe_hash(key);
+	for(struct probe_key*k=index_keys[h%PROBE_BUCKETS];k;k=k->next)
+		if(k->hash==h&&strcmp(k->key,key)==0)return k->entry;
+	return NULL;
+}
+
+// called with probe_lock held
+static void index_add(struct probe_entry*e,const char*tag,const char*value){
+	size_t l;
+	struct probe_key*k;
+	if(!value||!*value)return;
+	l=(tag?strlen(tag)+1:0)+strlen(value)+1;
+	if(!(k=malloc(sizeof(struct probe_key)+l)))return;
+	if(tag)snprintf(k->key,l,"%s=%s",tag,value);
+	else strcpy(k->key,value);
+	k->entry=e,k->hash=probe_hash(k->key);
+	k->next=index_keys[k->hash%PROBE_BUCKETS];
+	index_keys[k->hash%PROBE_BUCKETS]=k;
+}
+
+// called with probe_lock held
+static void entry_remove(struct probe_entry*e){
+	struct probe_key**k,*x;
+	struct probe_entry**p;
+	for(size_t i=0;i<PROBE_BUCKETS;i++)for(k=&index_keys[i];*k;){
+		if((*k)->entry!=e){
+			k=&(*k)->next;
+			continue;
+		}
+		x=*k,*k=x->next;
+		free(x);
+	}
+	for(p=&entries;*p;p=&(*p)->next)if(*p==e){
+		*p=e->next;
+		break;
+	}
+	free(e);
+}
+
+void devd_probe_init(void){
+	RWLOCK_INIT(probe_lock);
+	MUTEX_INIT(scan_lock);
+}
+
+int devd_probe_update(const char*dev){
+	struct probe_entry*e,*o;
+	if(!dev)ERET(EINVAL);
+	if(!(e=malloc(sizeof(struct probe_entry))))ERET(ENOMEM);
+	memset(e,0,sizeof(struct probe_entry));
+	if(devd_probe_block(dev,&e->info)!=0){
+		free(e);
+		devd_probe_remove(dev);
+		return -1;
+	}
+	RWLOCK_WRLOCK(probe_lock);
+	if((o=index_lookup(dev)))entry_remove(o);
+	e->next=entries,entries=e;
+	index_add(e,NULL,e->info.dev);
+	for(size_t i=0;i<ARRLEN(probe_tags);i++)
+		index_add(e,probe_tags[i].tag,TAG_FIELD(&e->info,&probe_tags[i]));
+	RWLOCK_UNLOCK(probe_lock);
+	tlog_debug(
+		"probe %s type %s uuid %s",e->info.dev,
+		e->info.type[0]?e->info.type:"(none)",
+		e->info.uuid[0]?e->info.uuid:"(none)"
+	);
+	return 0;
+}
+
+void devd_probe_remove(const char*dev){
+	struct probe_entry*e;
+	if(!dev)return;
+	RWLOCK_WRLOCK(probe_lock);
+	if((e=index_lookup(dev)))entry_remove(e);
+	RWLOCK_UNLOCK(probe_lock);
+}
+
+// probe all block devices in sysfs once, later changes come from uevents
+static void probe_scan_all(){
+	DIR*d;
+	struct dirent*e;
+	char path[PATH_MAX];
+	MUTEX_LOCK(scan_lock);
+	if(populated||!(d=opendir(_PATH_SYS_CLASS"/block"))){
+		MUTEX_UNLOCK(scan_lock);
+		return;
+	}
+	while((e=readdir(d))){
+		if(is_virt_dir(e))continue;
+		snprintf(path,sizeof(path),_PATH_DEV"/%s",e->d_name);
+		for(char*p=path;*p;p++)if(*p=='!')*p='/';
+		devd_probe_update(path);
+	}
+	closedir(d);
+	populated=true;
+	MUTEX_UNLOCK(scan_lock);
+}
+
+int devd_probe_lookup(const char*spec,struct devd_probe*out){
+	struct stat st;
+	struct probe_entry*e;
+	if(!spec||!out)ERET(EINVAL);
+
+	// only block devices get uevents, do not cache image files
+	if(spec[0]=='/'&&(stat(spec,&st)!=0||!S_ISBLK(st.st_mode)))
+		return devd_probe_block(spec,out);
+	for(int i=0;i<2;i++){
+		RWLOCK_RDLOCK(probe_lock);
+		if((e=index_lookup(spec)))memcpy(out,&e->info,sizeof(struct devd_probe));
+		RWLOCK_UNLOCK(probe_lock);
+		if(e)return 0;
+		if(i>0)break;
+		if(spec[0]=='/'){
+			if(devd_probe_update(spec)!=0)return -1;
+		}else probe_scan_all();
+	}
+	ERET(ENOENT);
+}
+
+int devd_probe(const char*spec,struct devd_probe*out){
+	int r;
+	char*dev;
+	if(!spec||!out)ERET(EINVAL);
+	if(devd_probe_query(spec,out)==0)return 0;
+	if(errno!=ENOTCONN)return -1;
+
+	// devd is not running, probe by self
+	if(spec[0]=='/')return devd_probe_block(spec,out);
+	if(!(dev=blkid_evaluate_tag(spec,NULL,NULL)))ERET(ENOENT);
+	r=devd_probe_block(dev,out);
+	free(dev);
+	return r;
+}
+
+char*devd_probe_evaluate(const char*spec){
+	struct devd_probe p;
+	if(!spec)EPRET(EINVAL);
+	if(spec[0]=='/')return strdup(spec);
+	if(devd_probe(spec,&p)!=0)return NULL;
+	return strdup(p.dev);
+}
+
+char*devd_probe_tag(const char*dev,const char*tag){
+	char*v;
+	struct devd_probe p;
+	if(!dev||!tag)EPRET(EINVAL);
+	for(size_t i=0;i<ARRLEN(probe_tags);i++){
+		if(strcmp(tag,probe_tags[i].tag)!=0)continue;
+		if(devd_probe(dev,&p)!=0)return NULL;
+		v=TAG_FIELD(&p,&probe_tags[i]);
+		if(!*v)EPRET(ENOENT);
+		return strdup(v);
+	}
+	EPRET(ENOTSUP);
+}
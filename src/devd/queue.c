@@ -0,0 +1,113 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<errno.h>
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include"lock.h"
+#include"pool.h"
+#include"logger.h"
+#include"defines.h"
+#include"devd_internal.h"
+#define TAG "devd"
+
+#define QUEUE_BUCKETS 256
+
+// events of one device, exists only while it has pending events
+struct devpath_queue{
+	struct devpath_queue*next;
+	struct uevent_work*first,*last;
+	uint32_t hash;
+	char devpath[];
+};
+
+static mutex_t queue_lock;
+static struct pool*queue_pool=NULL;
+static struct devpath_queue*buckets[QUEUE_BUCKETS];
+
+static uint32_t devpath_hash(const char*str){
+	uint32_t h=0x811C9DC5;
+	for(;*str;str++)h=(h^(unsigned char)*str)*0x01000193;
+	return h;
+}
+
+void uevent_queue_init(struct pool*pool){
+	MUTEX_INIT(queue_lock);
+	memset(buckets,0,sizeof(buckets));
+	queue_pool=pool;
+}
+
+struct uevent_work*uevent_work_new(size_t size){
+	struct uevent_work*w;
+	if(!(w=malloc(sizeof(struct uevent_work)+size+1)))EPRET(ENOMEM);
+	memset(w,0,sizeof(struct uevent_work));
+	w->size=size;
+	return w;
+}
+
+// run events of a device one by one, drop the queue when drained
+static void*queue_thread(void*d){
+	struct devpath_queue*q=d,**p;
+	struct uevent_work*w;
+	for(;;){
+		MUTEX_LOCK(queue_lock);
+		if(!(w=q->first)){
+			for(p=&buckets[q->hash%QUEUE_BUCKETS];*p!=q;p=&(*p)->next);
+			*p=q->next;
+			MUTEX_UNLOCK(queue_lock);
+			free(q);
+			break;
+		}
+		if(!(q->first=w->next))q->last=NULL;
+		MUTEX_UNLOCK(queue_lock);
+		process_uevent(&w->event);
+		free(w);
+	}
+	return NULL;
+}
+
+int uevent_dispatch(struct uevent_work*w,size_t off){
+	size_t l;
+	uint32_t h;
+	struct devpath_queue*q;
+	if(!w)ERET(EINVAL);
+	if(
+		off>w->size||
+		!uevent_parse_view(w->buff+off,w->size-off,&w->event)||
+		!w->event.devpath
+	){
+		free(w);
+		ERET(EINVAL);
+	}
+	h=devpath_hash(w->event.devpath);
+	MUTEX_LOCK(queue_lock);
+	for(q=buckets[h%QUEUE_BUCKETS];q;q=q->next)
+		if(q->hash==h&&strcmp(q->devpath,w->event.devpath)==0)break;
+	if(q){
+		if(q->last)q->last->next=w;
+		else q->first=w;
+		q->last=w;
+		MUTEX_UNLOCK(queue_lock);
+		return 0;
+	}
+	l=strlen(w->event.devpath)+1;
+	if(!(q=malloc(sizeof(struct devpath_queue)+l))){
+		MUTEX_UNLOCK(queue_lock);
+		free(w);
+		ERET(ENOMEM);
+	}
+	memcpy(q->devpath,w->event.devpath,l);
+	q->hash=h,q->first=q->last=w;
+	q->next=buckets[h%QUEUE_BUCKETS];
+	buckets[h%QUEUE_BUCKETS]=q;
+	MUTEX_UNLOCK(queue_lock);
+	if(!queue_pool||pool_add(queue_pool,queue_thread,q)!=0)queue_thread(q);
+	return 0;
+}
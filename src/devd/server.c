@@ -8,6 +8,7 @@
 
 #define _GNU_SOURCE
 #include<fcntl.h>
+#include<limits.h>
 #include<stdlib.h>
 #include<signal.h>
 #include<unistd.h>
@@ -67,11 +68,26 @@ static void signal_handler(int s,siginfo_t *info,void*c __attribute__((unused)))
 	devd_cleanup(s);
 }
 
-static void process_add(char*data){
-	uevent event;
-	uevent_parse(data,&event);
-	process_uevent(&event);
-	kvarr_free(event.environs);
+// copy uevent from hotplug helper and queue it
+static void process_add(char*data,size_t size){
+	struct uevent_work*w;
+	if(!(w=uevent_work_new(size)))return;
+	memcpy(w->buff,data,size);
+	uevent_dispatch(w,0);
+}
+
+// lookup probe cache and reply with struct devd_probe
+static void process_probe(int fd,char*data,size_t size){
+	char spec[PATH_MAX];
+	struct devd_probe p;
+	if(!data||size<=0||size>=sizeof(spec)){
+		devd_internal_send_msg(fd,DEV_FAIL,NULL,0);
+		return;
+	}
+	memcpy(spec,data,size);
+	spec[size]=0;
+	if(devd_probe_lookup(spec,&p)!=0)devd_internal_send_msg(fd,DEV_FAIL,NULL,0);
+	else devd_internal_send_msg(fd,DEV_OK,&p,sizeof(p));
 }
 
 static struct pool*pool;
@@ -80,6 +96,7 @@ struct save_data{
 	struct devd_msg msg;
 	char*data;
 };
+
 static void*process_thread(void*d){
 	if(!d)EPRET(EINVAL);
 	struct save_data*s=(struct save_data*)d;
@@ -88,7 +105,7 @@ static void*process_thread(void*d){
 
 		// process kobject uevent
 		case DEV_ADD:
-			if(s->data)process_add(s->data);
+			if(s->data)process_add(s->data,s->msg.size);
 		break;
 
 		// scan /sys/dev and init /dev (create all nodes)
@@ -100,27 +117,30 @@ static void*process_thread(void*d){
 		// scan /sys/devices and load all modalias
 		case DEV_MODALIAS:
 			tlog_debug("receive modalias request");
+			modules_cache_open(false);
 			if(load_modalias()<0)telog_warn("load_modalias failed");
 		break;
 
 		case DEV_MODLOAD:
 			tlog_debug("receive modules load request");
+			modules_cache_open(false);
 			mods_conf_parse();
 		break;
 
+		// lookup block device probe cache, has its own reply
+		case DEV_PROBE:
+			process_probe(s->fd,s->data,s->msg.size);
+		break;
+
 		// terminate devd
 		case DEV_QUIT:run=false;break;
 	}
 	if(s->data)free(s->data);
-	devd_internal_send_msg(s->fd,DEV_OK,NULL,0);
+	if(s->msg.oper!=DEV_PROBE)devd_internal_send_msg(s->fd,DEV_OK,NULL,0);
 	free(s);
 	return NULL;
 }
 
-static int _start_uevent_thread(void*d __attribute__((unused))){
-	return uevent_netlink_thread();
-}
-
 static void ctl_fd(int efd,int oper,int fd){
 	struct epoll_event ev;
 	ev.events=EPOLLIN,ev.data.fd=fd;
@@ -133,13 +153,12 @@ static int devd_thread(int cfd){
 		ss=sizeof(struct save_data),
 		ds=sizeof(struct devd_msg),
 		es=sizeof(struct epoll_event);
-	int e=0,r,fd,efd;
+	int e=0,r,fd,efd,nfd=-1;
 	struct epoll_event*evs;
 	open_socket_logfd_default();
 	open_default_confd_socket(false,TAG);
 	if((fd=listen_devd_socket())<0)return fd;
 	tlog_info("devd start with pid %d",getpid());
-	fork_run("netlink",false,NULL,NULL,_start_uevent_thread);
 	signal(SIGCHLD,SIG_IGN);
 	handle_signals((int[]){SIGUSR1,SIGUSR2,SIGCHLD},3,SIG_IGN);
 	action_signals((int[]){SIGINT,SIGHUP,SIGTERM,SIGQUIT},4,signal_handler);
@@ -155,9 +174,14 @@ static int devd_thread(int cfd){
 		e=-errno;
 		goto ex;
 	}
+	modules_cache_open(false);
+	devd_probe_init();
+	uevent_queue_init(pool);
+	if((nfd=uevent_netlink_open())<0)telog_warn("listen uevent failed");
 	setproctitle("initdevd");
 	prctl(PR_SET_NAME,"Device Daemon",0,0,0);
 	ctl_fd(efd,EPOLL_CTL_ADD,fd);
+	if(nfd>=0)ctl_fd(efd,EPOLL_CTL_ADD,nfd);
 	if(cfd>=0){
 		devd_internal_send_msg(cfd,DEV_OK,NULL,0);
 		close(cfd);
@@ -171,7 +195,9 @@ static int devd_thread(int cfd){
 			goto ex;
 		}else for(int i=0;i<r;i++){
 			int f=evs[i].data.fd;
-			if(f==fd){
+			if(f==nfd){
+				uevent_netlink_receive(nfd);
+			}else if(f==fd){
 				int n=accept(f,NULL,NULL);
 				if(n<0)continue;
 				fcntl(n,F_SETFL,O_RDWR|O_NONBLOCK);
@@ -213,6 +239,8 @@ static int devd_thread(int cfd){
 	if(efd>=0)close(efd);
 	if(evs)free(evs);
 	devd_cleanup(0);
+	uevent_netlink_close(nfd);
+	modules_cache_close();
 	return e;
 }
 
@@ -34,30 +34,57 @@ const char*uevent_action2char(enum uevent_action act){
 	return uevent_actions[act<0||act>=ARRLEN(uevent_actions)?ACTION_UNKNOWN:act];
 }
 
+char*uevent_get(uevent*data,const char*key){
+	size_t l;
+	if(!data||!key)return NULL;
+	if(data->environs)return kvarr_get(data->environs,(char*)key,NULL);
+	l=strlen(key);
+	for(size_t i=0;i<data->envc;i++)
+		if(strncmp(data->envs[i],key,l)==0&&data->envs[i][l]=='=')
+			return data->envs[i]+l+1;
+	return NULL;
+}
+
 uevent*uevent_fill_summary(uevent*data){
-	if(!data||!data->environs)return NULL;
-	keyval**kvs=data->environs;
-	data->action=uevent_chars2action(kvarr_get(kvs,"ACTION",NULL));
-	data->devpath=kvarr_get(kvs,"DEVPATH",NULL);
-	data->subsystem=kvarr_get(kvs,"SUBSYSTEM",NULL);
-	data->major=parse_int(kvarr_get(kvs,"MAJOR",NULL),-1);
-	data->minor=parse_int(kvarr_get(kvs,"MINOR",NULL),-1);
-	data->devname=kvarr_get(kvs,"DEVNAME",NULL);
-	data->devtype=kvarr_get(kvs,"DEVTYPE",NULL);
-	data->driver=kvarr_get(kvs,"DRIVER",NULL);
-	data->modalias=kvarr_get(kvs,"MODALIAS",NULL);
-	data->seqnum=parse_long(kvarr_get(kvs,"SEQNUM",NULL),-1);
+	if(!data||(!data->environs&&data->envc<=0))return NULL;
+	data->action=uevent_chars2action(uevent_get(data,"ACTION"));
+	data->devpath=uevent_get(data,"DEVPATH");
+	data->subsystem=uevent_get(data,"SUBSYSTEM");
+	data->major=parse_int(uevent_get(data,"MAJOR"),-1);
+	data->minor=parse_int(uevent_get(data,"MINOR"),-1);
+	data->devname=uevent_get(data,"DEVNAME");
+	data->devtype=uevent_get(data,"DEVTYPE");
+	data->driver=uevent_get(data,"DRIVER");
+	data->modalias=uevent_get(data,"MODALIAS");
+	data->seqnum=parse_long(uevent_get(data,"SEQNUM"),-1);
 	return data;
 }
 
 uevent*uevent_parse_x(char**envs,uevent*data){
 	if(!envs||!data)return NULL;
+	data->envc=0;
 	if(!(data->environs=kvarr_new_parse_arr(envs,'=')))return NULL;
 	return uevent_fill_summary(data);
 }
 
 uevent*uevent_parse(char*envs,uevent*data){
 	if(!envs||!data)return NULL;
+	data->envc=0;
 	if(!(data->environs=kvarr_new_parse(envs,'\n','=')))return NULL;
 	return uevent_fill_summary(data);
 }
+
+// buff[len] must be writable, lines are split by NUL or newline
+uevent*uevent_parse_view(char*buff,size_t len,uevent*data){
+	size_t l;
+	char*end;
+	if(!buff||!data)return NULL;
+	memset(data,0,sizeof(uevent));
+	buff[len]=0,end=buff+len;
+	for(char*p=buff;p<end&&data->envc<UEVENT_ENVS;p+=l+1){
+		for(l=0;p[l]&&p[l]!='\n';l++);
+		p[l]=0;
+		if(l>0&&strchr(p,'='))data->envs[data->envc++]=p;
+	}
+	return uevent_fill_summary(data);
+}
@@ -0,0 +1,294 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#include"fs_internal.h"
+#ifndef ENABLE_UEFI
+#include<time.h>
+#include<stdint.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include"pool.h"
+#if defined(SYS_io_uring_setup)&&defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include<linux/io_uring.h>
+#define AIO_URING
+#endif
+#endif
+#endif
+
+// max requests in flight on io_uring, and queued on fallback pool
+#define AIO_DEPTH 64
+#define AIO_THREADS 4
+
+struct fs_aio{
+	fsh*f;
+	bool write,done;
+	int err;
+	size_t off,bytes;
+	struct iovec iov;
+	#ifndef ENABLE_UEFI
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	#endif
+};
+
+static void aio_run(fs_aio*req){
+	req->bytes=0;
+	req->err=req->write?
+		fs_pwritev(req->f,&req->iov,1,req->off,&req->bytes):
+		fs_preadv(req->f,&req->iov,1,req->off,&req->bytes);
+}
+
+#ifndef ENABLE_UEFI
+static struct pool*aio_pool=NULL;
+static pthread_once_t aio_once=PTHREAD_ONCE_INIT;
+
+static void aio_complete(fs_aio*req,int err,size_t bytes){
+	pthread_mutex_lock(&req->lock);
+	req->err=err,req->bytes=bytes,req->done=true;
+	pthread_cond_broadcast(&req->cond);
+	pthread_mutex_unlock(&req->lock);
+}
+
+static void*aio_worker(void*d){
+	fs_aio*req=d;
+	aio_run(req);
+	aio_complete(req,req->err,req->bytes);
+	return NULL;
+}
+
+#ifdef AIO_URING
+static struct{
+	int fd;
+	bool broken;
+	unsigned entries,inflight;
+	unsigned*sq_tail,*sq_mask,*sq_array;
+	unsigned*cq_head,*cq_tail,*cq_mask;
+	struct io_uring_sqe*sqes;
+	struct io_uring_cqe*cqes;
+	mutex_t lock;
+}ring={.fd=-1};
+
+// the only consumer of completion ring
+static void*uring_reaper(void*d){
+	unsigned head,cnt;
+	struct io_uring_cqe*cqe;
+	(void)d;
+	for(;;){
+		if(syscall(
+			SYS_io_uring_enter,ring.fd,
+			0,1,IORING_ENTER_GETEVENTS,NULL,0
+		)<0&&errno!=EINTR){
+			telog_error("wait io_uring completion failed");
+			MUTEX_LOCK(ring.lock);
+			ring.broken=true;
+			MUTEX_UNLOCK(ring.lock);
+			break;
+		}
+		head=*ring.cq_head,cnt=0;
+		for(;head!=__atomic_load_n(ring.cq_tail,__ATOMIC_ACQUIRE);head++,cnt++){
+			cqe=&ring.cqes[head&*ring.cq_mask];
+			aio_complete(
+				(fs_aio*)(uintptr_t)cqe->user_data,
+				cqe->res<0?-cqe->res:0,
+				cqe->res<0?0:(size_t)cqe->res
+			);
+		}
+		__atomic_store_n(ring.cq_head,head,__ATOMIC_RELEASE);
+		MUTEX_LOCK(ring.lock);
+		ring.inflight-=MIN(cnt,ring.inflight);
+		MUTEX_UNLOCK(ring.lock);
+	}
+	return NULL;
+}
+
+static void uring_init(void){
+	int fd;
+	size_t sl,cl,el;
+	pthread_t t;
+	struct io_uring_params p;
+	void*sq=MAP_FAILED,*cq=MAP_FAILED,*sqe=MAP_FAILED;
+	MUTEX_INIT(ring.lock);
+	memset(&p,0,sizeof(p));
+	if((fd=syscall(SYS_io_uring_setup,AIO_DEPTH,&p))<0){
+		telog_debug("io_uring is not available, use thread pool");
+		return;
+	}
+	sl=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+	cl=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+	el=p.sq_entries*sizeof(struct io_uring_sqe);
+	if(p.features&IORING_FEAT_SINGLE_MMAP)sl=cl=MAX(sl,cl);
+	sq=mmap(
+		NULL,sl,PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQ_RING
+	);
+	if(sq==MAP_FAILED)goto fail;
+	cq=(p.features&IORING_FEAT_SINGLE_MMAP)?sq:mmap(
+		NULL,cl,PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_CQ_RING
+	);
+	if(cq==MAP_FAILED)goto fail;
+	sqe=mmap(
+		NULL,el,PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQES
+	);
+	if(sqe==MAP_FAILED)goto fail;
+	ring.entries=p.sq_entries;
+	ring.sq_tail=sq+p.sq_off.tail;
+	ring.sq_mask=sq+p.sq_off.ring_mask;
+	ring.sq_array=sq+p.sq_off.array;
+	ring.cq_head=cq+p.cq_off.head;
+	ring.cq_tail=cq+p.cq_off.tail;
+	ring.cq_mask=cq+p.cq_off.ring_mask;
+	ring.cqes=cq+p.cq_off.cqes;
+	ring.sqes=sqe;
+	ring.fd=fd;
+	if(pthread_create(&t,NULL,uring_reaper,NULL)!=0){
+		ring.fd=-1;
+		goto fail;
+	}
+	pthread_detach(t);
+	tlog_debug("io_uring ready with %u entries",ring.entries);
+	return;
+	fail:
+	telog_warn("setup io_uring failed");
+	if(sqe!=MAP_FAILED)munmap(sqe,el);
+	if(cq!=MAP_FAILED&&cq!=sq)munmap(cq,cl);
+	if(sq!=MAP_FAILED)munmap(sq,sl);
+	close(fd);
+}
+
+// only for regular files and block devices, others go to thread pool
+static int uring_submit(fs_aio*req){
+	int fd=-1,r;
+	long x;
+	unsigned tail,idx;
+	struct stat st;
+	struct io_uring_sqe*sqe;
+	if(ring.fd<0)return ENOSYS;
+	MUTEX_LOCK(req->f->lock);
+	r=fs_get_fd_locked(req->f,&fd);
+	MUTEX_UNLOCK(req->f->lock);
+	if(r!=0||fstat(fd,&st)!=0)return ENOSYS;
+	if(!S_ISREG(st.st_mode)&&!S_ISBLK(st.st_mode))return ENOSYS;
+	MUTEX_LOCK(ring.lock);
+	// keep completions inside completion ring
+	if(ring.broken||ring.inflight>=ring.entries){
+		MUTEX_UNLOCK(ring.lock);
+		return EAGAIN;
+	}
+	tail=*ring.sq_tail,idx=tail&*ring.sq_mask;
+	sqe=&ring.sqes[idx];
+	memset(sqe,0,sizeof(struct io_uring_sqe));
+	sqe->opcode=req->write?IORING_OP_WRITEV:IORING_OP_READV;
+	sqe->fd=fd,sqe->off=req->off,sqe->len=1;
+	sqe->addr=(uintptr_t)&req->iov;
+	sqe->user_data=(uintptr_t)req;
+	ring.sq_array[idx]=idx;
+	__atomic_store_n(ring.sq_tail,tail+1,__ATOMIC_RELEASE);
+	do{x=syscall(SYS_io_uring_enter,ring.fd,1,0,0,NULL,0);}
+	while(x<0&&errno==EINTR);
+	// not consumed by kernel, take the entry back
+	if(x!=1){
+		__atomic_store_n(ring.sq_tail,tail,__ATOMIC_RELEASE);
+		r=x<0?errno:EAGAIN;
+	}else ring.inflight++,r=0;
+	MUTEX_UNLOCK(ring.lock);
+	return r;
+}
+#endif
+
+static void aio_init(void){
+	#ifdef AIO_URING
+	uring_init();
+	#endif
+	if(!(aio_pool=pool_init(AIO_THREADS,AIO_DEPTH)))
+		telog_warn("create async io pool failed");
+}
+#endif
+
+static int aio_submit(
+	fsh*f,
+	void*buffer,
+	size_t len,
+	size_t off,
+	fs_aio**req,
+	bool write
+){
+	fs_aio*a;
+	if(!req||(!buffer&&len>0))RET(EINVAL);
+	*req=NULL;
+	if(!fsh_check(f))RET(EBADF);
+	if(!fs_has_flag(f->flags,write?FILE_FLAG_WRITE:FILE_FLAG_READ))RET(EPERM);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
+	if(!(a=malloc(sizeof(fs_aio))))RET(ENOMEM);
+	memset(a,0,sizeof(fs_aio));
+	a->f=f,a->write=write,a->off=off;
+	a->iov=IOVEC(buffer,len);
+	#ifndef ENABLE_UEFI
+	pthread_mutex_init(&a->lock,NULL);
+	pthread_cond_init(&a->cond,NULL);
+	pthread_once(&aio_once,aio_init);
+	#ifdef AIO_URING
+	if(uring_submit(a)==0){
+		*req=a;
+		RET(0);
+	}
+	#endif
+	// no worker to take it, finish in caller
+	if(!aio_pool||pool_add(aio_pool,aio_worker,a)!=0)aio_worker(a);
+	#else
+	aio_run(a);
+	a->done=true;
+	#endif
+	*req=a;
+	RET(0);
+}
+
+int fs_read_async(fsh*f,void*buffer,size_t btr,size_t off,fs_aio**req){
+	return aio_submit(f,buffer,btr,off,req,false);
+}
+
+int fs_write_async(fsh*f,void*buffer,size_t btw,size_t off,fs_aio**req){
+	return aio_submit(f,buffer,btw,off,req,true);
+}
+
+int fs_wait_async(fs_aio**req,size_t*bytes,long timeout){
+	int r;
+	fs_aio*a;
+	if(!req||!(a=*req))RET(EINVAL);
+	#ifndef ENABLE_UEFI
+	bool done;
+	struct timespec ts;
+	if(timeout>=0){
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_sec+=timeout/1000;
+		ts.tv_nsec+=(timeout%1000)*1000000;
+		if(ts.tv_nsec>=1000000000)ts.tv_sec++,ts.tv_nsec-=1000000000;
+	}
+	pthread_mutex_lock(&a->lock);
+	for(r=0;!a->done&&r==0;)r=timeout>=0?
+		pthread_cond_timedwait(&a->cond,&a->lock,&ts):
+		pthread_cond_wait(&a->cond,&a->lock);
+	done=a->done;
+	pthread_mutex_unlock(&a->lock);
+	if(!done)RET(ETIMEDOUT);
+	pthread_cond_destroy(&a->cond);
+	pthread_mutex_destroy(&a->lock);
+	#else
+	(void)timeout;
+	#endif
+	r=a->err;
+	if(bytes)*bytes=a->bytes;
+	free(a);
+	*req=NULL;
+	RET(r);
+}
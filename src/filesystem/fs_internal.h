@@ -18,6 +18,11 @@
 #include"str.h"
 #define TAG "fs"
 #define FS_BUF_SIZE 4096
+// first and largest buffer for stream transfer without zero copy
+#define FS_XFER_MIN (FS_BUF_SIZE*16)
+#define FS_XFER_MAX (1024*1024)
+// largest source mapped at once by stream transfer
+#define FS_MAP_MAX ((size_t)1024*1024*1024)
 #define fsh_new(drv,uri,data,flag)\
 	fsh_get_new(drv,uri,(void**)&(data),sizeof(*(data)),flag)
 #define RET(e) return (errno=(e))
@@ -209,17 +209,17 @@ static int fsdrv_map(
 ){
 	struct fsd*d;
 	if(!f||!(d=f->data))RET(EINVAL);
-	if(!buffer||!*size)RET(EINVAL);
+	if(!buffer||!size)RET(EINVAL);
 	if(!drv||f->driver!=drv)RET(EINVAL);
 	if(fs_has_flag(flag,FILE_FLAG_WRITE))RET(EROFS);
-	if(!(fs_has_flag(f->flags,FILE_FLAG_FOLDER)))RET(ENOTDIR);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
 	if(d->type!=FS_TYPE_FILE_REG)RET(EISDIR);
-	if(*size==0&&fs_get_size(f,size)!=0)EXRET(EINVAL);
-	if(!d->file||*size==0)RET(EBADF);
-	if(off+*size>=d->file->length)RET(EFAULT);
+	if(!d->file)RET(EBADF);
+	if(*size==0&&off<d->file->length)*size=d->file->length-off;
+	if(*size==0)RET(EBADF);
+	if(off+*size>d->file->length)RET(EFAULT);
 	if(!d->file->content)RET(EFAULT);
 	*buffer=d->file->content+off;
-	*size=d->file->length;
 	RET(0);
 }
 
@@ -232,10 +232,13 @@ static int fsdrv_unmap(
 	struct fsd*d;
 	if(!f||!(d=f->data)||size<=0)RET(EINVAL);
 	if(!drv||f->driver!=drv)RET(EINVAL);
-	if(!(fs_has_flag(f->flags,FILE_FLAG_FOLDER)))RET(ENOTDIR);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
 	if(d->type!=FS_TYPE_FILE_REG)RET(EISDIR);
 	if(!d->file)RET(EBADF);
-	if(buffer!=d->file->content)RET(EFAULT);
+	if(
+		(char*)buffer<d->file->content||
+		(char*)buffer+size>d->file->content+d->file->length
+	)RET(EFAULT);
 	RET(0);
 }
 
@@ -333,7 +336,8 @@ static fsdrv fsdrv_assets={
 		FS_FEATURE_HAVE_SIZE|
 		FS_FEATURE_HAVE_PATH|
 		FS_FEATURE_HAVE_TIME|
-		FS_FEATURE_HAVE_FOLDER,
+		FS_FEATURE_HAVE_FOLDER|
+		FS_FEATURE_HAVE_MAP,
 	.open=fsdrv_open,
 	.read=fsdrv_read,
 	.readdir=fsdrv_readdir,
@@ -63,6 +63,18 @@ static int fsdrv_readdir(
 	RET(fs_readdir(f->data,info));
 }
 
+static int fsdrv_readdir_bulk(
+	const fsdrv*drv,
+	fsh*f,
+	fs_file_info*infos,
+	size_t cnt,
+	size_t*got,
+	fs_info_field fields
+){
+	if(!f||!drv||f->driver!=drv)RET(EINVAL);
+	RET(fs_readdir_bulk(f->data,infos,cnt,got,fields));
+}
+
 static int fsdrv_write(
 	const fsdrv*drv,
 	fsh*f,
@@ -74,6 +86,40 @@ static int fsdrv_write(
 	RET(fs_write(f->data,buffer,btw,bw));
 }
 
+static int fsdrv_preadv(
+	const fsdrv*drv,
+	fsh*f,
+	const struct iovec*iov,
+	int cnt,
+	size_t off,
+	size_t*br
+){
+	if(!f||!drv||f->driver!=drv)RET(EINVAL);
+	RET(fs_preadv(f->data,iov,cnt,off,br));
+}
+
+static int fsdrv_pwritev(
+	const fsdrv*drv,
+	fsh*f,
+	const struct iovec*iov,
+	int cnt,
+	size_t off,
+	size_t*bw
+){
+	if(!f||!drv||f->driver!=drv)RET(EINVAL);
+	RET(fs_pwritev(f->data,iov,cnt,off,bw));
+}
+
+static int fsdrv_get_fd(const fsdrv*drv,fsh*f,int*fd){
+	int r;
+	fsh*b;
+	if(!f||!drv||f->driver!=drv||!(b=f->data))RET(EINVAL);
+	MUTEX_LOCK(b->lock);
+	r=fs_get_fd_locked(b,fd);
+	MUTEX_UNLOCK(b->lock);
+	RET(r);
+}
+
 static int fsdrv_wait(
 	const fsdrv*drv,
 	fsh**gots,
@@ -212,6 +258,7 @@ static fsdrv fsdrv_overlay={
 	.read=fsdrv_read,
 	.read_all=fsdrv_read_all,
 	.readdir=fsdrv_readdir,
+	.readdir_bulk=fsdrv_readdir_bulk,
 	.write=fsdrv_write,
 	.seek=fsdrv_seek,
 	.tell=fsdrv_tell,
@@ -224,6 +271,9 @@ static fsdrv fsdrv_overlay={
 	.get_features=fsdrv_get_features,
 	.resize=fsdrv_resize,
 	.wait=fsdrv_wait,
+	.get_fd=fsdrv_get_fd,
+	.preadv=fsdrv_preadv,
+	.pwritev=fsdrv_pwritev,
 	.getcwd=fsdrv_getcwd,
 };
 
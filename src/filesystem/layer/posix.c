@@ -6,19 +6,41 @@
  *
  */
 
+#define _GNU_SOURCE
+#include<poll.h>
+#include<fcntl.h>
+#include<stdint.h>
+#include<unistd.h>
 #include<sys/mman.h>
 #include<sys/stat.h>
+#include<sys/syscall.h>
+#include<sys/sysmacros.h>
+#include<sys/sendfile.h>
 #include<dirent.h>
 #include"str.h"
 #include"system.h"
 #include"../fs_internal.h"
 
+// buffer size for one getdents64 call
+#define DENTS_SIZE (64*1024)
+
 static fsdrv fsdrv_posix;
 struct fsd{
-	DIR*dir;
+	char*dents;
+	size_t dents_pos,dents_len;
+	off_t dents_off;
 	char name[256];
 };
 
+// record of getdents64, older libc does not export it
+struct dent64{
+	uint64_t ino;
+	int64_t off;
+	unsigned short reclen;
+	unsigned char type;
+	char name[];
+};
+
 static void init_info(fs_file_info*info){
 	memset(info,0,sizeof(fs_file_info));
 	memcpy(
@@ -28,9 +50,9 @@ static void init_info(fs_file_info*info){
 	);
 }
 
-static void dirent_to_info(struct dirent*r,fs_file_info*info){
-	strncpy(info->name,r->d_name,sizeof(info->name)-1);
-	switch(r->d_type){
+static void dirent_to_info(const char*name,unsigned char type,fs_file_info*info){
+	strncpy(info->name,name,sizeof(info->name)-1);
+	switch(type){
 		case DT_FIFO:info->type=FS_TYPE_FILE_FIFO;break;
 		case DT_CHR:info->type=FS_TYPE_FILE_CHAR;break;
 		case DT_DIR:info->type=FS_TYPE_FILE_FOLDER;break;
@@ -43,22 +65,19 @@ static void dirent_to_info(struct dirent*r,fs_file_info*info){
 	}
 }
 
+static fs_type mode_to_type(mode_t mode){
+	if(S_ISFIFO(mode))return FS_TYPE_FILE_FIFO;
+	else if(S_ISCHR(mode))return FS_TYPE_FILE_CHAR;
+	else if(S_ISDIR(mode))return FS_TYPE_FILE_FOLDER;
+	else if(S_ISBLK(mode))return FS_TYPE_FILE_BLOCK;
+	else if(S_ISREG(mode))return FS_TYPE_FILE_REG;
+	else if(S_ISLNK(mode))return FS_TYPE_FILE_LINK;
+	else if(S_ISSOCK(mode))return FS_TYPE_FILE_SOCKET;
+	else return FS_TYPE_NONE;
+}
+
 static void stat_to_info(struct stat*s,fs_file_info*info){
-	if(S_ISFIFO(s->st_mode))
-		info->type=FS_TYPE_FILE_FIFO;
-	else if(S_ISCHR(s->st_mode))
-		info->type=FS_TYPE_FILE_CHAR;
-	else if(S_ISDIR(s->st_mode))
-		info->type=FS_TYPE_FILE_FOLDER;
-	else if(S_ISBLK(s->st_mode))
-		info->type=FS_TYPE_FILE_BLOCK;
-	else if(S_ISREG(s->st_mode))
-		info->type=FS_TYPE_FILE_REG;
-	else if(S_ISLNK(s->st_mode))
-		info->type=FS_TYPE_FILE_LINK;
-	else if(S_ISSOCK(s->st_mode))
-		info->type=FS_TYPE_FILE_SOCKET;
-	else info->type=FS_TYPE_NONE;
+	info->type=mode_to_type(s->st_mode);
 	info->size=s->st_size;
 	info->mode=s->st_mode&0xFFFF;
 	info->owner=s->st_uid;
@@ -83,8 +102,9 @@ void fsdrv_posix_close(const fsdrv*drv,fsh*f){
 	errno=0;
 	if(!f||!drv||drv!=f->driver)return;
 	struct fsd*d=f->data;
-	if(d&&d->dir)closedir(d->dir);
-	else if(f->fd>0)close(f->fd);
+	if(d&&d->dents)free(d->dents);
+	if(d)d->dents=NULL;
+	if(f->fd>0)close(f->fd);
 }
 
 static int fsdrv_flush(const fsdrv*drv,fsh*f){
@@ -127,7 +147,6 @@ static int fsdrv_open(
 			if(mkdir(uri->path,mode)!=0)goto fail;
 		}
 		if((nf->fd=open(uri->path,flag))<=0)goto fail;
-		if(!(nd->dir=fdopendir(nf->fd)))goto fail;
 		if((l=strlen(nf->uri->path))<=0)goto fail;
 		if(nf->uri->path[l-1]!='/')
 			strcat(nf->uri->path,"/");
@@ -139,7 +158,8 @@ static int fsdrv_open(
 		}
 		if(fs_has_flag(flags,FILE_FLAG_CREATE))flag|=O_CREAT;
 		if(fs_has_flag(flags,FILE_FLAG_TRUNCATE))flag|=O_TRUNC;
-		if((nf->fd=open(uri->path,flag))<0)goto fail;
+		if(fs_has_flag(flags,FILE_FLAG_APPEND))flag|=O_APPEND;
+		if((nf->fd=open(uri->path,flag,flags&_FILE_FLAG_MODE_MASK))<0)goto fail;
 	}
 	RET(0);
 	fail:
@@ -165,31 +185,184 @@ int fsdrv_posix_read(
 	ERET(0);
 }
 
+int fsdrv_posix_get_fd(const fsdrv*drv,fsh*f,int*fd){
+	if(!f||!drv||!fd)RET(EINVAL);
+	if(f->driver!=drv)RET(EINVAL);
+	if(f->fd<0)RET(EBADF);
+	*fd=f->fd;
+	RET(0);
+}
+
+// one kernel side copy step, -1 with ENOSYS when this way does not fit
+static ssize_t transfer_step(int way,int in,int out,size_t len){
+	switch(way){
+		#ifdef SYS_copy_file_range
+		case 0:return syscall(SYS_copy_file_range,in,NULL,out,NULL,len,0);
+		#endif
+		case 1:return sendfile(out,in,NULL,len);
+		case 2:return splice(in,NULL,out,NULL,len,SPLICE_F_MOVE);
+		default:errno=ENOSYS;return -1;
+	}
+}
+
+// copy_file_range for file to file, sendfile from file, splice with a pipe,
+// sent is always updated, ENOSYS when no way fits the rest
+int fsdrv_posix_transfer(
+	const fsdrv*drv,
+	fsh*f,
+	int fd,
+	size_t size,
+	size_t*sent
+){
+	ssize_t r;
+	int way=0;
+	struct pollfd p[2];
+	if(!f||!drv||!sent||fd<0)RET(EINVAL);
+	if(f->driver!=drv)RET(EINVAL);
+	if(f->fd<0)RET(EBADF);
+	*sent=0;
+	while(*sent<size&&way<=2){
+		r=transfer_step(way,f->fd,fd,MIN(size-*sent,(size_t)SSIZE_MAX));
+		if(r>0)*sent+=r;
+		// copy_file_range gives 0 on some pseudo files, recheck by sendfile
+		else if(r==0&&*sent==0&&way==0)way++;
+		else if(r==0)break;
+		else if(errno==EINTR)continue;
+		else if(errno==EAGAIN){
+			p[0].fd=f->fd,p[0].events=POLLIN;
+			p[1].fd=fd,p[1].events=POLLOUT;
+			if(poll(p,2,-1)<0&&errno!=EINTR)EXRET(EIO);
+		}else switch(errno){
+			// this way does not support these fds, try next one
+			case ENOSYS:case EXDEV:case EINVAL:
+			case EBADF:case EOPNOTSUPP:case ESPIPE:
+				way++;
+			break;
+			default:EXRET(EIO);
+		}
+	}
+	// caller continues the rest with its own way
+	if(way>2)RET(ENOSYS);
+	RET(0);
+}
+
+// next entry from a large getdents64 buffer, NULL with errno 0 at end
+static struct dent64*dents_next(fsh*f,struct fsd*d){
+	ssize_t r;
+	struct dent64*e;
+	do{
+		if(d->dents_pos>=d->dents_len){
+			if(!d->dents&&!(d->dents=malloc(DENTS_SIZE)))return NULL;
+			do{r=syscall(SYS_getdents64,f->fd,d->dents,DENTS_SIZE);}
+			while(r<0&&errno==EINTR);
+			if(r<=0){
+				if(r==0)errno=0;
+				return NULL;
+			}
+			d->dents_len=r,d->dents_pos=0;
+		}
+		e=(struct dent64*)(d->dents+d->dents_pos);
+		d->dents_pos+=e->reclen,d->dents_off=e->off;
+	}while(strcmp(e->name,".")==0||strcmp(e->name,"..")==0);
+	return e;
+}
+
+#ifdef STATX_TYPE
+static void statx_to_info(struct statx*s,fs_file_info*info){
+	if(s->stx_mask&STATX_TYPE)info->type=mode_to_type(s->stx_mode);
+	if(s->stx_mask&STATX_SIZE)info->size=s->stx_size;
+	if(s->stx_mask&STATX_MODE)info->mode=s->stx_mode&0xFFFF;
+	if(s->stx_mask&STATX_UID)info->owner=s->stx_uid;
+	if(s->stx_mask&STATX_GID)info->group=s->stx_gid;
+	if(s->stx_mask&STATX_ATIME)info->atime=s->stx_atime.tv_sec;
+	if(s->stx_mask&STATX_CTIME)info->ctime=s->stx_ctime.tv_sec;
+	if(s->stx_mask&STATX_MTIME)info->mtime=s->stx_mtime.tv_sec;
+	info->device=makedev(s->stx_dev_major,s->stx_dev_minor);
+}
+#endif
+
+// stat an entry only when the wanted fields are not known from getdents64
+static void stat_entry(fsh*f,const char*name,fs_file_info*info,fs_info_field fields){
+	struct stat st;
+	if(
+		!(fields&~(FS_INFO_FIELD_TYPE|FS_INFO_FIELD_TARGET))&&
+		info->type!=FS_TYPE_NONE
+	)return;
+	if(fields==FS_INFO_FIELD_NONE)return;
+	#ifdef STATX_TYPE
+	static bool no_statx=false;
+	struct statx sx;
+	unsigned int mask=STATX_TYPE;
+	if(fields&FS_INFO_FIELD_SIZE)mask|=STATX_SIZE;
+	if(fields&FS_INFO_FIELD_TIME)mask|=STATX_ATIME|STATX_MTIME|STATX_CTIME;
+	if(fields&FS_INFO_FIELD_MODE)mask|=STATX_MODE|STATX_UID|STATX_GID;
+	if(!no_statx){
+		if(statx(
+			f->fd,name,
+			AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT|AT_STATX_DONT_SYNC,
+			mask,&sx
+		)==0){
+			statx_to_info(&sx,info);
+			return;
+		}
+		if(errno!=ENOSYS)return;
+		no_statx=true;
+	}
+	#endif
+	if(fstatat(f->fd,name,&st,AT_SYMLINK_NOFOLLOW)==0)
+		stat_to_info(&st,info);
+}
+
+static void dent_to_info(
+	const fsdrv*drv,
+	fsh*f,
+	struct dent64*e,
+	fs_file_info*info,
+	fs_info_field fields
+){
+	init_info(info);
+	dirent_to_info(e->name,e->type,info);
+	stat_entry(f,e->name,info,fields);
+	info->features=drv->features;
+	info->parent=f;
+	if(fields&FS_INFO_FIELD_TARGET)readlink_info(info);
+}
+
 static int fsdrv_readdir(
 	const fsdrv*drv,
 	fsh*f,
 	fs_file_info*info
 ){
 	struct fsd*d;
-	struct stat st;
-	struct dirent*r;
+	struct dent64*e;
 	if(!f||!drv||!(d=f->data))RET(EINVAL);
 	if(f->driver!=drv||!info)RET(EINVAL);
 	if(!fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(ENOTDIR);
-	if(!d->dir||f->fd<=0)RET(EBADF);
-	init_info(info);
+	if(f->fd<=0)RET(EBADF);
 	errno=0;
-	while((r=readdir(d->dir))){
-		if(strcmp(r->d_name,".")==0)continue;
-		if(strcmp(r->d_name,"..")==0)continue;
-		dirent_to_info(r,info);
-		if(fstatat(f->fd,r->d_name,&st,AT_SYMLINK_NOFOLLOW)==0)
-			stat_to_info(&st,info);
-		info->features=drv->features;
-		info->parent=f;
-		readlink_info(info);
-		RET(0);
-	}
+	if(!(e=dents_next(f,d)))EXRET(EOF);
+	dent_to_info(drv,f,e,info,FS_INFO_FIELD_ALL);
+	RET(0);
+}
+
+static int fsdrv_readdir_bulk(
+	const fsdrv*drv,
+	fsh*f,
+	fs_file_info*infos,
+	size_t cnt,
+	size_t*got,
+	fs_info_field fields
+){
+	struct fsd*d;
+	struct dent64*e;
+	if(!f||!drv||!(d=f->data))RET(EINVAL);
+	if(f->driver!=drv||!infos||!got)RET(EINVAL);
+	if(!fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(ENOTDIR);
+	if(f->fd<=0)RET(EBADF);
+	errno=0,*got=0;
+	while(*got<cnt&&(e=dents_next(f,d)))
+		dent_to_info(drv,f,e,&infos[(*got)++],fields);
+	if(*got>0)RET(0);
 	EXRET(EOF);
 }
 
@@ -212,6 +385,44 @@ int fsdrv_posix_write(
 	RET(0);
 }
 
+int fsdrv_posix_preadv(
+	const fsdrv*drv,
+	fsh*f,
+	const struct iovec*iov,
+	int cnt,
+	size_t off,
+	size_t*br
+){
+	ssize_t rs;
+	if(!f||!drv||!br)RET(EINVAL);
+	if(f->driver!=drv)RET(EINVAL);
+	if(f->fd<0)RET(EBADF);
+	do{rs=preadv(f->fd,iov,cnt,(off_t)off);}
+	while(rs<0&&errno==EINTR);
+	if(rs<0)EXRET(EIO);
+	*br=rs;
+	RET(0);
+}
+
+int fsdrv_posix_pwritev(
+	const fsdrv*drv,
+	fsh*f,
+	const struct iovec*iov,
+	int cnt,
+	size_t off,
+	size_t*bw
+){
+	ssize_t ws;
+	if(!f||!drv||!bw)RET(EINVAL);
+	if(f->driver!=drv)RET(EINVAL);
+	if(f->fd<0)RET(EBADF);
+	do{ws=pwritev(f->fd,iov,cnt,(off_t)off);}
+	while(ws<0&&errno==EINTR);
+	if(ws<0)EXRET(EIO);
+	*bw=ws;
+	RET(0);
+}
+
 int fsdrv_posix_wait(
 	const fsdrv*drv,
 	fsh**gots,
@@ -276,9 +487,10 @@ static int fsdrv_seek(const fsdrv*drv,fsh*f,size_t pos,int whence){
 	struct fsd*d;
 	if(!f||!(d=f->data))RET(EINVAL);
 	if(!drv||f->driver!=drv)RET(EINVAL);
-	if(f->fd>0)lseek(f->fd,pos,whence);
-	else if(d->dir&&whence==SEEK_SET)seekdir(d->dir,pos);
-	else RET(EBADF);
+	if(f->fd<=0)RET(EBADF);
+	off_t off=lseek(f->fd,pos,whence);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER)&&off>=0)
+		d->dents_pos=d->dents_len=0,d->dents_off=off;
 	return errno;
 }
 
@@ -287,7 +499,7 @@ static int fsdrv_tell(const fsdrv*drv,fsh*f,size_t*pos){
 	struct fsd*d;
 	if(!f||!drv||f->driver!=drv)RET(EINVAL);
 	if(!(d=f->data)||!pos)RET(EINVAL);
-	if(d->dir)*pos=telldir(d->dir);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))*pos=d->dents_off;
 	else if(f->fd>0)*pos=lseek(f->fd,0,SEEK_CUR);
 	else RET(EBADF);
 	return errno;
@@ -362,8 +574,7 @@ static int fsdrv_resize(const fsdrv*drv,fsh*f,size_t pos){
 	struct fsd*d;
 	if(!f||!(d=f->data))RET(EINVAL);
 	if(!drv||f->driver!=drv)RET(EINVAL);
-	if(d->dir)seekdir(d->dir,pos);
-	else if(f->fd>0)lseek(f->fd,pos,SEEK_SET);
+	if(f->fd>0)lseek(f->fd,pos,SEEK_SET);
 	else RET(EBADF);
 	return errno;
 }
@@ -410,12 +621,14 @@ static fsdrv fsdrv_posix={
 		FS_FEATURE_HAVE_SIZE|
 		FS_FEATURE_HAVE_PATH|
 		FS_FEATURE_HAVE_TIME|
-		FS_FEATURE_HAVE_FOLDER,
+		FS_FEATURE_HAVE_FOLDER|
+		FS_FEATURE_HAVE_MAP,
 	.flush=fsdrv_flush,
 	.close=fsdrv_posix_close,
 	.open=fsdrv_open,
 	.read=fsdrv_posix_read,
 	.readdir=fsdrv_readdir,
+	.readdir_bulk=fsdrv_readdir_bulk,
 	.write=fsdrv_posix_write,
 	.seek=fsdrv_seek,
 	.tell=fsdrv_tell,
@@ -425,5 +638,9 @@ static fsdrv fsdrv_posix={
 	.resize=fsdrv_resize,
 	.rename=fsdrv_rename,
 	.wait=fsdrv_posix_wait,
+	.get_fd=fsdrv_posix_get_fd,
+	.transfer=fsdrv_posix_transfer,
+	.preadv=fsdrv_posix_preadv,
+	.pwritev=fsdrv_posix_pwritev,
 	.getcwd=fsdrv_getcwd,
 };
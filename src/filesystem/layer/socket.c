@@ -243,6 +243,8 @@ static fsdrv fsdrv_socket={
 	.write=fsdrv_posix_write,
 	.get_size=fsdrv_get_size,
 	.wait=fsdrv_posix_wait,
+	.get_fd=fsdrv_posix_get_fd,
+	.transfer=fsdrv_posix_transfer,
 };
 
 void fsdrv_register_socket(bool deinit){
@@ -32,6 +32,7 @@ DECL_ONE_LOCK(println,(fsh*f,const char*str),(f,str),f)
 DECL_ONE_LOCK(set_size,(fsh*f,size_t size),(f,size),f)
 DECL_ONE_LOCK(get_type,(fsh*f,fs_type*type),(f,type),f)
 DECL_ONE_LOCK(readdir,(fsh*f,fs_file_info*info),(f,info),f)
+DECL_ONE_LOCK(readdir_bulk,(fsh*f,fs_file_info*infos,size_t cnt,size_t*got,fs_info_field fields),(f,infos,cnt,got,fields),f)
 DECL_ONE_LOCK(get_path_alloc,(fsh*f,char**buff),(f,buff),f)
 DECL_ONE_LOCK(get_info,(fsh*f,fs_file_info*info),(f,info),f)
 DECL_ONE_LOCK(del_on_close,(fsh*f,const char*name),(f,name),f)
@@ -62,6 +63,32 @@ DECL_WRAPPER(exists,(fsh*f,const char*uri,bool*exists),(f,uri,exists,true))
 DECL_WRAPPER(open,(fsh*f,fsh**nf,const char*uri,fs_file_flag flag),(f,nf,uri,flag,true))
 DECL_WRAPPER(wait,(fsh**gots,fsh**waits,size_t cnt,long timeout,fs_wait_flag flag),(gots,waits,cnt,timeout,flag,true))
 
+// positional vector io does not touch the file position,
+// only the emulation by seek needs the handle lock
+static bool has_vector(fsh*f,bool write){
+	for(const fsdrv*use=f->driver;use;use=use->base)
+		if(write?use->pwritev!=NULL:use->preadv!=NULL)return true;
+	return false;
+}
+
+int fs_preadv(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*br){
+	if(!fsh_check(f))RET(EBADF);
+	if(has_vector(f,false))return fs_preadv_locked(f,iov,cnt,off,br);
+	MUTEX_LOCK(f->lock);
+	int r=fs_preadv_locked(f,iov,cnt,off,br);
+	MUTEX_UNLOCK(f->lock);
+	return r;
+}
+
+int fs_pwritev(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*bw){
+	if(!fsh_check(f))RET(EBADF);
+	if(has_vector(f,true))return fs_pwritev_locked(f,iov,cnt,off,bw);
+	MUTEX_LOCK(f->lock);
+	int r=fs_pwritev_locked(f,iov,cnt,off,bw);
+	MUTEX_UNLOCK(f->lock);
+	return r;
+}
+
 int fs_ioctl(fsh*f,fs_ioctl_id id,...){
 	va_list args;
 	va_start(args,id);
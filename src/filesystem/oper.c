@@ -222,6 +222,28 @@ int fs_readdir_locked(fsh*f,fs_file_info*info){
 	RET(use->readdir(drv,f,info));
 }
 
+int fs_readdir_bulk_locked(
+	fsh*f,
+	fs_file_info*infos,
+	size_t cnt,
+	size_t*got,
+	fs_info_field fields
+){
+	int r=0;
+	if(!fsh_check(f))RET(EBADF);
+	if(!infos||!got||cnt<=0)RET(EINVAL);
+	const fsdrv*drv=f->driver,*use=drv;
+	while(use&&!use->readdir_bulk&&!use->readdir)use=use->base;
+	if(!use)RET(ENOSYS);
+	if(!fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(ENOTDIR);
+	if(use->readdir_bulk)RET(use->readdir_bulk(drv,f,infos,cnt,got,fields));
+	// one by one for drivers without bulk readdir, errors come again next call
+	for(*got=0;*got<cnt;(*got)++)
+		if((r=use->readdir(drv,f,&infos[*got]))!=0)break;
+	if(*got>0)RET(0);
+	RET(r);
+}
+
 int fs_read_locked(fsh*f,void*buffer,size_t btr,size_t*br){
 	if(!fsh_check(f))RET(EBADF);
 	if(!buffer||!br)RET(EINVAL);
@@ -256,6 +278,56 @@ int fs_write_locked(fsh*f,void*buffer,size_t btw,size_t*bw){
 	RET(use->write(drv,f,buffer,btw,bw));
 }
 
+// emulate positional vector io by seek, restore position after done
+static int vector_fallback(
+	fsh*f,
+	const struct iovec*iov,
+	int cnt,
+	size_t off,
+	size_t*bs,
+	bool write
+){
+	int r,x;
+	char*p;
+	size_t pos=0,b,d;
+	if((r=fs_tell_locked(f,&pos))!=0)return r;
+	if((r=fs_seek_locked(f,off,SEEK_SET))!=0)return r;
+	*bs=0;
+	for(int i=0;r==0&&i<cnt;i++)for(d=0;r==0&&d<iov[i].iov_len;d+=b){
+		p=(char*)iov[i].iov_base+d,b=0;
+		r=write?
+			fs_write_locked(f,p,iov[i].iov_len-d,&b):
+			fs_read_locked(f,p,iov[i].iov_len-d,&b);
+		if(r==0&&b==0)i=cnt;
+		*bs+=b;
+	}
+	x=fs_seek_locked(f,pos,SEEK_SET);
+	XRET(r,x);
+}
+
+int fs_preadv_locked(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*br){
+	if(!fsh_check(f))RET(EBADF);
+	if((!iov&&cnt>0)||cnt<0||!br)RET(EINVAL);
+	const fsdrv*drv=f->driver,*use=drv;
+	while(use&&!use->preadv)use=use->base;
+	if(!fs_has_flag(f->flags,FILE_FLAG_READ))RET(EPERM);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
+	if(!use||!use->preadv)RET(vector_fallback(f,iov,cnt,off,br,false));
+	RET(use->preadv(drv,f,iov,cnt,off,br));
+}
+
+int fs_pwritev_locked(fsh*f,const struct iovec*iov,int cnt,size_t off,size_t*bw){
+	if(!fsh_check(f))RET(EBADF);
+	if((!iov&&cnt>0)||cnt<0||!bw)RET(EINVAL);
+	const fsdrv*drv=f->driver,*use=drv;
+	while(use&&!use->pwritev)use=use->base;
+	if(drv->readonly_fs||(use&&use->readonly_fs))RET(EROFS);
+	if(!fs_has_flag(f->flags,FILE_FLAG_WRITE))RET(EPERM);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
+	if(!use||!use->pwritev)RET(vector_fallback(f,iov,cnt,off,bw,true));
+	RET(use->pwritev(drv,f,iov,cnt,off,bw));
+}
+
 int fs_wait_locked(
 	fsh**gots,
 	fsh**waits,
@@ -303,6 +375,27 @@ int fs_wait_locked(
 	RET(r);
 }
 
+int fs_get_fd_locked(fsh*f,int*fd){
+	if(!fsh_check(f))RET(EBADF);
+	if(!fd)RET(EINVAL);
+	const fsdrv*drv=f->driver,*use=drv;
+	while(use&&!use->get_fd)use=use->base;
+	if(!use||!use->get_fd)RET(ENOSYS);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
+	RET(use->get_fd(drv,f,fd));
+}
+
+int fs_transfer_locked(fsh*f,int fd,size_t size,size_t*sent){
+	if(!fsh_check(f)||fd<0)RET(EBADF);
+	if(!sent)RET(EINVAL);
+	const fsdrv*drv=f->driver,*use=drv;
+	while(use&&!use->transfer)use=use->base;
+	if(!use||!use->transfer)RET(ENOSYS);
+	if(!fs_has_flag(f->flags,FILE_FLAG_READ))RET(EPERM);
+	if(fs_has_flag(f->flags,FILE_FLAG_FOLDER))RET(EISDIR);
+	RET(use->transfer(drv,f,fd,size,sent));
+}
+
 int fs_seek_locked(fsh*f,size_t pos,int whence){
 	if(!fsh_check(f))RET(EBADF);
 	const fsdrv*drv=f->driver,*use=drv;
@@ -140,21 +140,59 @@ int fs_full_read_alloc_locked(fsh*f,void**buffer,size_t btr){
 	RET(r);
 }
 
-int fs_read_to_locked(
-	fsh*f,
-	fsh*t,
-	size_t size,
-	size_t*sent
-){
+static int write_to(fsh*t,int fd,void*buff,size_t len){
+	if(t)return fs_full_write_locked(t,buff,len);
+	if(full_write(fd,buff,len)!=(ssize_t)len)EXRET(EIO);
+	RET(0);
+}
+
+// map the source from start and write it out at once
+static int transfer_map(fsh*f,fsh*t,int fd,size_t size,size_t*sent){
 	int r;
-	char buff[FS_BUF_SIZE];
-	size_t br,rd=0,bs;
+	void*buff=NULL;
+	size_t pos=1,len=0;
+	fs_feature ft=0;
+	if(fs_get_features_locked(f,&ft)!=0)RET(ENOSYS);
+	if(!(ft&FS_FEATURE_HAVE_MAP))RET(ENOSYS);
+	if(fs_tell_locked(f,&pos)!=0||pos!=0)RET(ENOSYS);
+	if(fs_get_size_locked(f,&len)!=0||len==0)RET(ENOSYS);
+	if((len=MIN(len,size))>FS_MAP_MAX)RET(ENOSYS);
+	if(fs_map_locked(f,&buff,0,&len,FILE_FLAG_READ)!=0)RET(ENOSYS);
+	if((r=write_to(t,fd,buff,len))==0){
+		*sent=len;
+		fs_seek_locked(f,len,SEEK_SET);
+	}
+	fs_unmap_locked(f,buff,len);
+	RET(r);
+}
+
+// kernel copy when both ends have fd, then map, then a growing buffer
+static int transfer_to(fsh*f,fsh*t,int fd,size_t size,size_t*sent){
+	int r=0,out=fd;
+	char*buff=NULL,*b;
+	size_t br,bs=0,rd=0,next=FS_XFER_MIN;
 	if(!fsh_check(f))RET(EBADF);
-	if(!fsh_check(t))RET(EBADF);
-	do{
+	if(t?!fsh_check(t):fd<0)RET(EBADF);
+	if(t&&fs_get_fd_locked(t,&out)!=0)out=-1;
+	if(out>=0){
+		r=fs_transfer_locked(f,out,size,&rd);
+		if(r!=ENOSYS)goto done;
+	}
+	if(rd==0&&transfer_map(f,t,fd,size,&rd)==0){
+		r=0;
+		goto done;
+	}
+	r=0;
+	while(size>rd){
+		if(bs!=next){
+			if(!(b=realloc(buff,next))){
+				if(!buff)DONE(ENOMEM);
+				next=bs;
+			}else buff=b,bs=next;
+		}
 		errno=0,br=0;
-		bs=MAX(size-rd,sizeof(buff));
-		r=fs_read_locked(f,buff,bs,&br),rd+=br;
+		size_t want=MIN(size-rd,bs);
+		r=fs_read_locked(f,buff,want,&br);
 		if(r!=0){
 			if(r==EINTR)continue;
 			if(r==EAGAIN){
@@ -162,18 +200,31 @@ int fs_read_to_locked(
 					NULL,&f,1,-1,
 					FILE_WAIT_IO_READ,
 					false
-				))!=0)RET(r);
+				))!=0)break;
 				continue;
 			}
-			RET(r);
+			break;
 		}
-		if(br>0&&(r=fs_full_write_locked(
-			t,buff,br
-		))!=0)RET(r);
-		if(br==0||br!=bs)break;
-	}while(size>rd);
-	if(sent)*sent=br;
-	RET(0);
+		if(br>0&&(r=write_to(t,fd,buff,br))!=0)break;
+		rd+=br;
+		if(br==0||br!=want)break;
+		// source keeps filling the buffer, use a larger one
+		if(next<FS_XFER_MAX)next*=2;
+	}
+	done:
+	if(buff)free(buff);
+	if(sent)*sent=rd;
+	RET(r);
+}
+
+int fs_read_to_locked(
+	fsh*f,
+	fsh*t,
+	size_t size,
+	size_t*sent
+){
+	if(!fsh_check(t))RET(EBADF);
+	return transfer_to(f,t,-1,size,sent);
 }
 
 int fs_read_to_fd_locked(
@@ -182,32 +233,8 @@ int fs_read_to_fd_locked(
 	size_t size,
 	size_t*sent
 ){
-	int r=0;
-	char buff[FS_BUF_SIZE];
-	size_t br,rd=0,bs;
-	if(!fsh_check(f)||fd<0)RET(EBADF);
-	do{
-		errno=0,br=0,bs=MIN(size-rd,sizeof(buff));
-		r=fs_read_locked(f,buff,bs,&br),rd+=br;
-		if(r!=0){
-			if(r==EINTR)continue;
-			if(r==EAGAIN){
-				if((r=fs_wait_locked(
-					NULL,&f,1,-1,
-					FILE_WAIT_IO_READ,
-					false
-				))!=0)RET(r);
-				continue;
-			}
-			RET(r);
-		}
-		if(br>0&&full_write(
-			fd,buff,br
-		)!=(ssize_t)br)EXRET(EIO);
-		if(br==0||br!=bs)break;
-	}while(size>rd);
-	if(sent)*sent=br;
-	RET(r);
+	if(fd<0)RET(EBADF);
+	return transfer_to(f,NULL,fd,size,sent);
 }
 
 int fs_full_read_to_locked(fsh*f,fsh*t,size_t size){
@@ -237,7 +264,7 @@ int fs_read_all_to_locked(fsh*f,fsh*t,size_t*size){
 	}else while(true){
 		len=0;
 		r=fs_read_to_locked(
-			f,t,FS_BUF_SIZE,&len
+			f,t,FS_XFER_MAX,&len
 		);
 		if(size)(*size)+=len;
 		if(r!=0)break;
@@ -257,7 +284,7 @@ int fs_read_all_to_fd_locked(fsh*f,int fd,size_t*size){
 	}else while(true){
 		len=0;
 		r=fs_read_to_fd_locked(
-			f,fd,FS_BUF_SIZE,&len
+			f,fd,FS_XFER_MAX,&len
 		);
 		if(size)(*size)+=len;
 		if(r!=0)break;
@@ -10,8 +10,8 @@
 #include<linux/fs.h>
 #include<sys/ioctl.h>
 #include<sys/statfs.h>
-#include<libblkid/blkid.h>
 #include"system.h"
+#include"devd.h"
 #include"linux.h"
 #include"md5.h"
 #include"str.h"
@@ -28,34 +28,22 @@ void fill_from_mount_item(fsvol_private_info*info,struct mount_item*mnt){
 }
 
 void fill_from_block_path(fsvol_private_info*info,char*block){
-	char*value;
+	struct devd_probe probe;
 	struct fsvol_info_fs*fs=&info->info.fs;
 	struct fsvol_info_part*p=&info->info.part;
-	if((value=blkid_get_tag_value(NULL,"TYPE",block))){
-		strncpy(fs->type,value,sizeof(fs->type)-1);
-		free(value);
+	if(devd_probe(block,&probe)==0){
+		strncpy(fs->type,probe.type,sizeof(fs->type)-1);
+		strncpy(fs->uuid,probe.uuid,sizeof(fs->uuid)-1);
+		strncpy(fs->label,probe.label,sizeof(fs->label)-1);
+		strncpy(p->uuid,probe.partuuid,sizeof(p->uuid)-1);
+		strncpy(p->label,probe.partlabel,sizeof(p->label)-1);
 	}
-	if((value=blkid_get_tag_value(NULL,"UUID",block))){
-		strncpy(fs->uuid,value,sizeof(fs->uuid)-1);
-		free(value);
-	}
-	if((value=blkid_get_tag_value(NULL,"PARTUUID",block))){
-		strncpy(p->uuid,value,sizeof(p->uuid)-1);
-		free(value);
-	}
-	if((value=blkid_get_tag_value(NULL,"LABEL",block))){
-		strncpy(fs->label,value,sizeof(fs->label)-1);
-		free(value);
-	}
-	if((value=blkid_get_tag_value(NULL,"PARTLABEL",block))){
-		strncpy(p->label,value,sizeof(p->label)-1);
-		free(value);
-	}
-	int fd=open(block,O_RDONLY);
+	int fd=open(block,O_RDONLY|O_CLOEXEC);
 	if(fd>=0){
 		ioctl(fd,BLKGETSIZE64,&p->size);
 		ioctl(fd,BLKGETSIZE,&p->sector_count);
 		ioctl(fd,BLKSSZGET,&p->sector_size);
+		close(fd);
 	}
 }
 
@@ -13,11 +13,11 @@
 #include<stdlib.h>
 #include<stdbool.h>
 #include<sys/stat.h>
-#include<blkid/blkid.h>
 #include<libmount/libmount.h>
 #include"str.h"
 #include"gui.h"
 #include"logger.h"
+#include"devd.h"
 #include"system.h"
 #include"gui/tools.h"
 #include"gui/msgbox.h"
@@ -187,9 +187,7 @@ static void reload_type(struct add_mount*am){
 }
 
 static char*get_fs_type(const char*blk){
-	static blkid_cache cache=NULL;
-	if(!cache)blkid_get_cache(&cache,NULL);
-	return blkid_get_tag_value(cache,"TYPE",blk);
+	return devd_probe_tag(blk,"TYPE");
 }
 
 static bool focus_type(struct add_mount*am,char*type){
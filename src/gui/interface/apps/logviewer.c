@@ -58,14 +58,30 @@ static void calc_pages(struct log_viewer*v){
 	update_slider(v);
 }
 
+#ifdef ENABLE_UEFI
+static bool load_rec(struct log_rec*rec,void*data){
+	char*xb;
+	size_t s=rec->tag_len+rec->content_len+8;
+	struct log_viewer*v=data;
+	if(rec->tag_len<=0&&rec->content_len<=0)return true;
+	if(!(xb=malloc(s)))return false;
+	memset(xb,0,s);
+	if(rec->tag_len>0){
+		strlcat(xb,LOG_REC_TAG(rec),s-1);
+		strlcat(xb,": ",s-1);
+	}
+	if(rec->content_len>0)strlcat(xb,LOG_REC_CONTENT(rec),s-1);
+	if(list_obj_add_new(&v->file,xb)!=0)free(xb);
+	return true;
+}
+#endif
+
 static bool load_file(struct log_viewer*v){
-	#ifdef ENABLE_UEFI
-	list*l=NULL;
-	#else
+	#ifndef ENABLE_UEFI
 	FILE*f=NULL;
-	size_t bs=0,len;
+	size_t bs=0,len,s;
 	#endif
-	size_t xs=8192,s;
+	size_t xs=8192;
 	char*buff=NULL,*xb=NULL;
 	if(v->load)return true;
 	if(v->file){
@@ -74,31 +90,7 @@ static bool load_file(struct log_viewer*v){
 	}
 	if(!(xb=malloc(xs)))EDONE();
 	#ifdef ENABLE_UEFI
-	if((l=list_first(logbuffer)))do{
-		bool changed=false;
-		LIST_DATA_DECLARE(b,l,struct log_buff*);
-		if(!b||!b->tag||!b->content)continue;
-		s=8;
-		if(b->tag[0])s+=strlen(b->tag);
-		if(b->content[0])s+=strlen(b->content);
-		if(s>xs){
-			xs=s,free(xb);
-			if(!(xb=malloc(xs)))EDONE();
-		}
-		memset(xb,0,xs);
-		if(b->tag[0]){
-			strlcat(xb,b->tag,xs-1);
-			strlcat(xb,": ",xs-1);
-			changed=true;
-		}
-		if(b->content[0]){
-			strlcat(xb,b->content,xs-1);
-			changed=true;
-		}
-		if(changed)list_obj_add_new_strdup(
-			&v->file,xb
-		);
-	}while((l=l->next));
+	logger_buffer_foreach(0,load_rec,v);
 	#else
 	if(!(f=fopen(_PATH_DEV"/logger.log","r")))
 		EDONE(telog_warn("open logger.log failed"));
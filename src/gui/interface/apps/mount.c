@@ -9,10 +9,10 @@
 #ifdef ENABLE_GUI
 #include<stdlib.h>
 #include<sys/mount.h>
-#include<blkid/blkid.h>
 #include"str.h"
 #include"gui.h"
 #include"logger.h"
+#include"devd.h"
 #include"system.h"
 #include"language.h"
 #include"gui/tools.h"
@@ -20,7 +20,6 @@
 #include"gui/activity.h"
 #define TAG "mounts"
 
-static blkid_cache cache=NULL;
 static lv_obj_t*lst=NULL,*show_all;
 static lv_obj_t*info,*btn_mount,*btn_umount,*btn_refresh;
 struct mount_info{
@@ -118,14 +117,12 @@ static void mount_add_item(struct mount_info*k){
 	lv_obj_set_grid_cell(k->target,LV_GRID_ALIGN_START,0,1,LV_GRID_ALIGN_CENTER,1,1);
 
 	char*partlabel=NULL;
-	if(!cache)blkid_get_cache(&cache,NULL);
 	if(strncmp(
 		k->item->source,
 		_PATH_DEV,
 		strlen(_PATH_DEV)
-	)==0)partlabel=blkid_get_tag_value(
-		cache,"PARTLABEL",
-		k->item->source
+	)==0)partlabel=devd_probe_tag(
+		k->item->source,"PARTLABEL"
 	);
 	if(partlabel){
 		// part label
@@ -205,8 +202,7 @@ static void umount_click(lv_event_t*e __attribute__((unused))){
 
 static int do_cleanup(struct gui_activity*d __attribute__((unused))){
 	list_free_all(mounts,item_free);
-	if(cache)blkid_put_cache(cache);
-	info=NULL,mounts=NULL,cache=NULL;
+	info=NULL,mounts=NULL;
 	return 0;
 }
 
@@ -33,6 +33,8 @@
 #include"gui/tools.h"
 #include"gui/fileview.h"
 #define TAG "fileview"
+// entries read by one bulk readdir
+#define SCAN_BATCH 64
 
 static lv_label_long_mode_t lm;
 
@@ -519,8 +521,10 @@ static bool fileitem_sorter(list*a,list*b){
 static void scan_items(struct fileview*view){
 	list*l;
 	int r=0;
+	size_t got=0;
 	fsvol_info**vols;
 	struct fileitem item;
+	fs_file_info*infos=NULL;
 	if(!view->view)return;
 	clean_items(view);
 	if(view->url){
@@ -537,14 +541,19 @@ static void scan_items(struct fileview*view){
 				return;
 			}
 		}else fs_seek(view->folder,0,SEEK_SET);
-		memset(&item,0,sizeof(item));
-		while((r=fs_readdir(view->folder,&item.file))==0){
-			if(item.file.name[0]=='.'&&!view->hidden)continue;
+		if(!(infos=malloc(sizeof(fs_file_info)*SCAN_BATCH)))r=ENOMEM;
+		else while((r=fs_readdir_bulk(
+			view->folder,infos,SCAN_BATCH,
+			&got,FS_INFO_FIELD_ALL
+		))==0)for(size_t i=0;i<got;i++){
+			if(infos[i].name[0]=='.'&&!view->hidden)continue;
+			memset(&item,0,sizeof(item));
+			memcpy(&item.file,&infos[i],sizeof(fs_file_info));
 			item.view=view,item.type=item.file.type;
 			list_obj_add_new_dup(&view->items,&item,sizeof(item));
-			memset(&item,0,sizeof(item));
 			if(view->count>=256)tlog_warn("too many files, skip");
 		}
+		if(infos)free(infos);
 		list_sort(view->items,fileitem_sorter);
 		if((l=list_first(view->items)))do{
 			LIST_DATA_DECLARE(i,l,struct fileitem*);
@@ -12,10 +12,10 @@
 #include<stdlib.h>
 #include<string.h>
 #include<pthread.h>
-#include<blkid/blkid.h>
 #include"init.h"
 #include"confd.h"
 #include"logger.h"
+#include"devd.h"
 #include"system.h"
 #include"defines.h"
 
@@ -42,7 +42,7 @@ static int _setup_conffs(){
 	wait_block(conffs,10,TAG);
 
 	if(conffs[0]!='/'){
-		char*x=blkid_evaluate_tag(conffs,NULL,NULL);
+		char*x=devd_probe_evaluate(conffs);
 		free(conffs);
 		conffs=x;
 	}
@@ -51,15 +51,10 @@ static int _setup_conffs(){
 		return tlog_warn("conffs not found");
 	}
 
-	char*type=NULL;
-	blkid_cache cache=NULL;
-	blkid_get_cache(&cache,NULL);
-	if(!(type=blkid_get_tag_value(cache,"TYPE",conffs))){
-		telog_warn("cannot determine fstype in conffs %s",conffs);
-		type="vfat";
-		blkid_put_cache(cache);
-		cache=NULL;
-	}
+	char*type="vfat";
+	struct devd_probe probe;
+	if(devd_probe(conffs,&probe)==0&&probe.type[0])type=probe.type;
+	else telog_warn("cannot determine fstype in conffs %s",conffs);
 
 	char mod[64]={0};
 	snprintf(mod,63,"fs-%s",type);
@@ -76,10 +71,6 @@ static int _setup_conffs(){
 	e=confd_set_default_config(path);
 	confd_load_file(path);
 	ex:
-	if(cache){
-		if(type)free(type);
-		blkid_put_cache(cache);
-	}
 	if(conffile)free(conffile);
 	free(conffs);
 	return e;
@@ -26,6 +26,7 @@
 #include"service.h"
 #include"language.h"
 #include"proctitle.h"
+#include"trace.h"
 
 enum init_status status;
 enum init_action action;
@@ -33,8 +34,9 @@ union action_data actiondata;
 static int sfd=-1;
 
 static int system_boot(){
-	int r;
+	int r,t=trace_begin("boot","preinit");
 	if((r=preinit())!=0)return trlog_emerg(r,"preinit failed with %d",r);
+	trace_end(t);
 	tlog_info("init system start");
 	setproctitle("init");
 	chdir(_PATH_ROOT)==0?
@@ -125,7 +127,7 @@ static void init_console(){
 }
 
 int init_main(int argc __attribute__((unused)),char**argv){
-	int r;
+	int r,t;
 
 	// pre check
 	if(
@@ -135,14 +137,19 @@ int init_main(int argc __attribute__((unused)),char**argv){
 	)return invoke_internal_cmd_nofork_by_name("simple-init",argv);
 	status=INIT_BOOT;
 
+	// shared by all forked daemons
+	trace_init();
+
 	init_console();
 
 	// start loggerd
+	t=trace_begin("boot","start loggerd");
 	insmod("unix",true);// load unix socket for loggerd
 	if(start_loggerd(NULL)<0){
 		telog_emerg("start loggerd failed");
 		abort();
 	}
+	trace_end(t);
 	atexit(init_do_exit);
 	tlog_info("init started");
 
@@ -154,6 +161,7 @@ int init_main(int argc __attribute__((unused)),char**argv){
 	if((r=system_boot())!=0)return r;
 
 	// init service framework
+	t=trace_begin("boot","load services");
 	service_init();
 
 	// register all services
@@ -161,6 +169,7 @@ int init_main(int argc __attribute__((unused)),char**argv){
 
 	// load all services from config
 	svc_conf_parse_services("service.services");
+	trace_end(t);
 
 	// listen init control socket
 	if((sfd=listen_init_socket())<0){
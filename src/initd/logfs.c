@@ -12,11 +12,11 @@
 #include<stdlib.h>
 #include<string.h>
 #include<pthread.h>
-#include<blkid/blkid.h>
 #include"str.h"
 #include"init.h"
 #include"confd.h"
 #include"logger.h"
+#include"devd.h"
 #include"system.h"
 #include"defines.h"
 #include"cmdline.h"
@@ -44,7 +44,7 @@ static int _setup_logfs(){
 	wait_block(logfs,10,TAG);
 
 	if(logfs[0]!='/'){
-		char*x=blkid_evaluate_tag(logfs,NULL,NULL);
+		char*x=devd_probe_evaluate(logfs);
 		free(logfs);
 		logfs=x;
 	}
@@ -53,15 +53,10 @@ static int _setup_logfs(){
 		return tlog_warn("logfs not found");
 	}
 
-	char*type=NULL;
-	blkid_cache cache=NULL;
-	blkid_get_cache(&cache,NULL);
-	if(!(type=blkid_get_tag_value(cache,"TYPE",logfs))){
-		telog_warn("cannot determine fstype in logfs %s",logfs);
-		type="vfat";
-		blkid_put_cache(cache);
-		cache=NULL;
-	}
+	char*type="vfat";
+	struct devd_probe probe;
+	if(devd_probe(logfs,&probe)==0&&probe.type[0])type=probe.type;
+	else telog_warn("cannot determine fstype in logfs %s",logfs);
 
 	char mod[64]={0};
 	snprintf(mod,63,"fs-%s",type);
@@ -93,10 +88,6 @@ static int _setup_logfs(){
 	}
 	e=logger_open(path);
 	ex:
-	if(cache){
-		if(type)free(type);
-		blkid_put_cache(cache);
-	}
 	if(logfile)free(logfile);
 	free(logfs);
 	return e;
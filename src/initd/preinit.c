@@ -9,6 +9,7 @@
 #define _GNU_SOURCE
 #include<fcntl.h>
 #include<errno.h>
+#include<stdlib.h>
 #include<unistd.h>
 #include<string.h>
 #include<sys/stat.h>
@@ -23,6 +24,7 @@
 #include"pathnames.h"
 #include"language.h"
 #include"hardware.h"
+#include"trace.h"
 #define TAG "preinit"
 
 static bool need_extract_rootfs(){
@@ -43,6 +45,7 @@ static bool need_extract_rootfs(){
 }
 
 int preinit(){
+	int t;
 
 	// ensure important folder exists
 	mkdir(_PATH_PROC,755);
@@ -91,10 +94,12 @@ int preinit(){
 	chown(DEFAULT_LOGGER,0,0);
 
 	// start config daemon
+	t=trace_begin("boot","start confd");
 	if(start_confd(TAG,NULL)<0){
 		tlog_emerg("start config daemon failed");
 		abort();
 	}
+	trace_end(t);
 
 	// create config runtime root key
 	confd_add_key("runtime");
@@ -106,6 +111,33 @@ int preinit(){
 	// load cmdline
 	load_cmdline();
 
+	// resize loggerd log buffer
+	int64_t bs=confd_get_integer("logger.buffer_size",0);
+	if(bs>0)logger_set_buffer_size(bs);
+
+	// loggerd file output batching and rotation
+	char**fo=confd_ls("logger.file");
+	if(fo){
+		char key[64],val[64],*v;
+		for(size_t i=0;fo[i];i++){
+			snprintf(key,sizeof(key),"logger.file.%s",fo[i]);
+			switch(confd_get_type(key)){
+				case TYPE_INTEGER:
+					snprintf(val,sizeof(val),"%lld",(long long)confd_get_integer(key,0));
+					logger_set_file_option(fo[i],val);
+				break;
+				case TYPE_STRING:
+					if(!(v=confd_get_string(key,NULL)))break;
+					logger_set_file_option(fo[i],v);
+					free(v);
+				break;
+				default:;
+			}
+		}
+		if(fo[0])free(fo[0]);
+		free(fo);
+	}
+
 	// init /dev
 	if(xmount(false,"dev",_PATH_DEV,"devtmpfs","rw,nosuid,noexec,mode=755",false)!=0)switch(errno){
 		case EBUSY:tlog_info("devtmpfs already mounted.");break;
@@ -141,10 +173,14 @@ int preinit(){
 	xmount(false,"nfsd",_PATH_PROC"/fs/nfsd","nfsd",NULL,false);
 
 	// start devd daemon
+	t=trace_begin("boot","start devd");
 	start_devd(TAG,NULL);
+	trace_end(t);
 
 	// create all device nodes
+	t=trace_begin("boot","devd init");
 	devd_call_init();
+	trace_end(t);
 
 	// open active consoles
 	logger_open_console();
@@ -167,16 +203,24 @@ int preinit(){
 	chown(dev_logger,0,0);
 
 	// load modules from list config
+	t=trace_begin("boot","devd modload");
 	devd_call_modload();
+	trace_end(t);
 
 	// load all modules
+	t=trace_begin("boot","devd modalias");
 	devd_call_modalias();
+	trace_end(t);
 
 	// setup logfs and save log
+	t=trace_begin("boot","setup logfs");
 	setup_logfs();
+	trace_end(t);
 
 	// setup conffs and load conf
+	t=trace_begin("boot","setup conffs");
 	setup_conffs();
+	trace_end(t);
 
 	return 0;
 }
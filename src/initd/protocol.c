@@ -7,7 +7,9 @@
  */
 
 #define _GNU_SOURCE
+#include<fcntl.h>
 #include<stdlib.h>
+#include<unistd.h>
 #include<string.h>
 #include<stdbool.h>
 #include<sys/socket.h>
@@ -16,6 +18,7 @@
 #include"service.h"
 #include"logger.h"
 #include"defines.h"
+#include"trace.h"
 #include"language.h"
 #include"init_internal.h"
 #define TAG "init"
@@ -122,6 +125,28 @@ static void process_language(struct init_msg*msg,struct init_msg*res){
 	else tlog_info("set language to %s",msg->data.data);
 }
 
+static void process_trace(struct init_msg*msg,struct init_msg*res){
+	int fd;
+	trace_dump();
+	svc_dump_critical_path();
+	if(msg->data.data[0]==0)return;
+	if(msg->data.data[sizeof(msg->data.data)-1]!=0){
+		tlog_warn("stack overflow detected on request");
+		res->data.status.ret=errno=EFAULT;
+		return;
+	}
+	if((fd=open(msg->data.data,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644))<0){
+		res->action=ACTION_FAIL;
+		res->data.status.ret=errno;
+		return;
+	}
+	if(trace_export_chrome(fd)!=0){
+		res->action=ACTION_FAIL;
+		res->data.status.ret=errno;
+	}else tlog_info("export boot trace to %s",msg->data.data);
+	close(fd);
+}
+
 int init_process_data(struct init_client*clt,struct init_msg*msg){
 	char s[BUFSIZ];
 	struct init_msg res;
@@ -178,6 +203,7 @@ int init_process_data(struct init_client*clt,struct init_msg*msg){
 			res.data.status.ret=errno;
 		}break;
 		case ACTION_SVC_DUMP:svc_dump_services();break;
+		case ACTION_TRACE_DUMP:process_trace(msg,&res);break;
 		case ACTION_NONE:case ACTION_OK:case ACTION_FAIL:break;
 		default:res.action=ACTION_FAIL,res.data.status.ret=ENOSYS;
 	}
@@ -198,6 +224,7 @@ const char*action2string(enum init_action act){
 		case ACTION_SVC_RESTART:return "ReStart Service";
 		case ACTION_SVC_RELOAD:return "ReLoad Service";
 		case ACTION_SVC_DUMP:return "Dump All Service";
+		case ACTION_TRACE_DUMP:return "Dump Boot Trace";
 		case ACTION_SVC_STATUS:return "Get Service Status";
 		default:return "Unknown";
 	}
@@ -7,14 +7,25 @@
  */
 
 #define _GNU_SOURCE
+#include<time.h>
+#include<stdio.h>
+#include<dirent.h>
 #include<signal.h>
+#include<string.h>
 #include<unistd.h>
+#include"str.h"
 #include"service.h"
 #include"init_internal.h"
 #include"system.h"
 #include"logger.h"
+#include"pathnames.h"
 #define TAG "reboot"
 
+// time limits of process cleanup in milliseconds
+#define KILL_POLL_MS 20
+#define KILL_TERM_TIMEOUT 3000
+#define KILL_KILL_TIMEOUT 1000
+
 int call_reboot(enum reboot_cmd rb,char*cmd){
 	tlog_emerg("call kernel reboot.");
 	kill_all();
@@ -22,18 +33,56 @@ int call_reboot(enum reboot_cmd rb,char*cmd){
 	return 0;
 }
 
+// any process left except init, zombies and kernel threads
+static bool process_left(){
+	DIR*d;
+	pid_t pid,ppid,self=getpid();
+	bool r=false;
+	char buff[512],*p,state;
+	struct dirent*de;
+	if(!(d=opendir(_PATH_PROC)))return false;
+	while(!r&&(de=readdir(d))){
+		if((pid=parse_int(de->d_name,0))<=2||pid==self)continue;
+		if(read_file(buff,sizeof(buff),false,_PATH_PROC"/%d/stat",pid)<=0)continue;
+		if(!(p=strrchr(buff,')'))||sscanf(p+1," %c %d",&state,&ppid)!=2)continue;
+		if(state!='Z'&&ppid!=2)r=true;
+	}
+	closedir(d);
+	return r;
+}
+
+static long now_ms(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+static bool wait_all_exit(long timeout){
+	long end=now_ms()+timeout;
+	while(process_left()){
+		if(now_ms()>=end)return false;
+		usleep(KILL_POLL_MS*1000);
+	}
+	return true;
+}
+
 int kill_all(){
+	long begin=now_ms();
 	service_wait_all_stop();
-	xsleep(1);
-	kill(-1,SIGTERM);
-	tlog_alert("sending SIGTERM to all proceesses...");
+	bool clean=!process_left();
+	if(!clean){
+		kill(-1,SIGTERM);
+		tlog_alert("sending SIGTERM to all proceesses...");
+	}
 	sync();
-	xsleep(3);
+	if(!clean)clean=wait_all_exit(KILL_TERM_TIMEOUT);
 	init_do_exit();
-	xsleep(1);
-	kill(-1,SIGKILL);
-	tlog_alert("sending SIGKILL to all proceesses...");
-	sync();
-	xsleep(1);
+	if(!clean&&process_left()){
+		kill(-1,SIGKILL);
+		tlog_alert("sending SIGKILL to all proceesses...");
+		wait_all_exit(KILL_KILL_TIMEOUT);
+		sync();
+	}
+	tlog_info("all processes cleaned in %ldms",now_ms()-begin);
 	return 0;
 }
\ No newline at end of file
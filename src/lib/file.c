@@ -8,23 +8,32 @@
 
 #define _GNU_SOURCE
 #include<errno.h>
+#include<stdio.h>
 #include<string.h>
+#include<limits.h>
 #include<stdlib.h>
 #include<stdbool.h>
 #include<dirent.h>
 #include<libgen.h>
 #include<unistd.h>
+#include<poll.h>
 #include<sys/stat.h>
 #include<sys/ioctl.h>
+#include<sys/socket.h>
+#include<sys/timerfd.h>
 #include<sys/sysmacros.h>
 #include<linux/loop.h>
-#include<blkid/blkid.h>
+#include<linux/netlink.h>
 #include"str.h"
 #include"logger.h"
+#include"devd.h"
 #include"system.h"
 #include"defines.h"
 #include"pathnames.h"
 
+// delay of the second check after a block uevent in ms
+#define BLOCK_RECHECK_MS 200
+
 bool is_virt_dir(const struct dirent*d){
 	return
 		strcmp(d->d_name,".")==0||
@@ -157,41 +166,118 @@ int remove_folders(int dfd,int flags){
 }
 
 int has_block(char*block){
-	char*p=block;
-	if(
-		block[0]!='/'&&
-		!(p=blkid_evaluate_tag(block,NULL,NULL))
-	)return false;
+	int r=true;
 	struct stat st;
-	if(stat(p,&st)<0)return errno==ENOENT?false:-1;
-	if(!S_ISBLK(st.st_mode)){
-		errno=ENOTBLK;
+	char*p=devd_probe_evaluate(block);
+	if(!p)return false;
+	if(stat(p,&st)<0)r=errno==ENOENT?false:-1;
+	else if(!S_ISBLK(st.st_mode))errno=ENOTBLK,r=-1;
+	free(p);
+	return r;
+}
+
+// listen kernel uevents, the kernel assigns port id for each socket
+static int block_uevent_open(){
+	int fd;
+	struct sockaddr_nl n={.nl_family=AF_NETLINK,.nl_groups=1};
+	if((fd=socket(
+		AF_NETLINK,SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK,
+		NETLINK_KOBJECT_UEVENT
+	))<0)return -1;
+	if(bind(fd,(struct sockaddr*)&n,sizeof(n))<0){
+		close(fd);
 		return -1;
 	}
-	free(p);
-	return true;
+	return fd;
 }
 
-int wait_block(char*block,long time,char*tag){
-	bool msg=false;
+// drain uevents, return true if any block device was added or changed
+static bool block_uevent_read(int fd,bool tag){
+	ssize_t s;
+	uevent ev;
+	bool found=false;
+	char buff[8192],path[PATH_MAX];
+	struct devd_probe p;
+	while((s=recv(fd,buff,sizeof(buff)-1,MSG_DONTWAIT))!=0){
+		if(s<0){
+			if(errno==EINTR)continue;
+			// lost some events, check again anyway
+			if(errno==ENOBUFS)found=true;
+			break;
+		}
+		if(!uevent_parse_view(buff,s,&ev)||!ev.subsystem||!ev.devname)continue;
+		if(strcmp(ev.subsystem,"block")!=0)continue;
+		if(ev.action!=ACTION_ADD&&ev.action!=ACTION_CHANGE)continue;
+		// let devd probe it now, it may not have handled this event yet
+		snprintf(path,sizeof(path),_PATH_DEV"/%s",ev.devname);
+		if(tag)devd_probe(path,&p);
+		found=true;
+	}
+	return found;
+}
+
+static int wait_block_sleep(char*block,long time){
 	long t=0;
 	while(time==0||t++<time)switch(has_block(block)){
-		case false:
-			if(tag&&!msg){
-				char x[128]={0};
-				if(time!=0)snprintf(x,127," %ld seconds",time);
-				log_notice(tag,"wait for block %s%s",tag,x);
-				msg=true;
-			}
-			sleep(1);
-		continue;
+		case false:sleep(1);continue;
 		case true:return 0;
 		case -1:return -errno;
 	}
-	if(tag)log_error(tag,"wait for block %s timed out",tag);
 	ERET(ETIMEDOUT);
 }
 
+int wait_block(char*block,long time,char*tag){
+	int r,n,nfd,tfd=-1,recheck=-1;
+	struct pollfd fds[2];
+	struct itimerspec ts={.it_value.tv_sec=time};
+	if(!block)ERET(EINVAL);
+
+	// subscribe before first check, so nothing is missed between
+	nfd=block_uevent_open();
+	if((r=has_block(block))!=false){
+		if(nfd>=0)close(nfd);
+		return r==true?0:-errno;
+	}
+	if(tag){
+		char x[128]={0};
+		if(time!=0)snprintf(x,127," %ld seconds",time);
+		log_notice(tag,"wait for block %s%s",block,x);
+	}
+	if(nfd<0)r=wait_block_sleep(block,time);
+	else if(time!=0&&(
+		(tfd=timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC))<0||
+		timerfd_settime(tfd,0,&ts,NULL)<0
+	))r=wait_block_sleep(block,time);
+	else for(r=-ETIMEDOUT;;){
+		fds[0].fd=nfd,fds[0].events=POLLIN,fds[0].revents=0;
+		fds[1].fd=tfd,fds[1].events=POLLIN,fds[1].revents=0;
+		if((n=poll(fds,tfd>=0?2:1,recheck))<0){
+			if(errno==EINTR)continue;
+			r=-errno;
+			break;
+		}
+		// devd may still be creating or probing the node, check once more later
+		recheck=-1;
+		if(n==0||(fds[0].revents&&block_uevent_read(nfd,block[0]!='/'))){
+			if((r=has_block(block))==true){
+				r=0;
+				break;
+			}else if(r<0){
+				r=-errno;
+				break;
+			}
+			r=-ETIMEDOUT;
+			if(n>0)recheck=BLOCK_RECHECK_MS;
+		}
+		if(tfd>=0&&fds[1].revents)break;
+	}
+	if(tfd>=0)close(tfd);
+	if(nfd>=0)close(nfd);
+	if(r==-ETIMEDOUT&&tag)log_error(tag,"wait for block %s timed out",block);
+	if(r<0)errno=-r;
+	return r;
+}
+
 static ssize_t _fd_read_file(int at,char*buff,size_t len,bool lf,char*path,va_list va){
 	int fd;
 	char rpath[PATH_MAX]={0};
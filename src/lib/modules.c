@@ -8,9 +8,13 @@
 
 #include<errno.h>
 #include<stdio.h>
+#include<stdint.h>
+#include<stdlib.h>
 #include<string.h>
 #include<libkmod.h>
 #include<sys/utsname.h>
+#include"lock.h"
+#include"system.h"
 #include"logger.h"
 #include"defines.h"
 #include"pathnames.h"
@@ -18,6 +22,49 @@
 
 static char modsdir[PATH_MAX]={0};
 
+struct cache_slot{
+	char*key;
+	uint32_t hash;
+	int id;
+};
+
+struct cache_table{
+	struct cache_slot*slots;
+	size_t size,used;
+};
+
+// modules resolved from an alias, ids index the module bitmaps
+struct cache_alias{
+	struct kmod_list*list;
+	size_t cnt;
+	int ids[];
+};
+
+// alias cache, only alive between modules_cache_open and modules_cache_close
+static mutex_t cache_lock;
+static pthread_once_t cache_once=PTHREAD_ONCE_INIT;
+static unsigned long cache_gen=0;
+static struct{
+	struct kmod_ctx*ctx;
+	struct cache_table aliases,modules;
+	struct cache_alias**alias;
+	size_t alias_cnt,alias_cap;
+	// loaded or blacklisted modules, nothing to do for them
+	uint32_t*loaded;
+	// claimed by a thread that is probing it without cache_lock
+	uint32_t*probing;
+	// last probe error, retried after next modules_cache_open
+	int*errs;
+	size_t mod_cnt,mod_cap;
+}cache;
+
+#define BIT_TEST(map,i) ((map)[(i)/32]&(1u<<((i)%32)))
+#define BIT_SET(map,i) ((map)[(i)/32]|=(1u<<((i)%32)))
+#define BIT_CLEAR(map,i) ((map)[(i)/32]&=~(1u<<((i)%32)))
+
+static void cache_lock_init(void){MUTEX_INIT(cache_lock);}
+#define CACHE_LOCK() do{pthread_once(&cache_once,cache_lock_init);MUTEX_LOCK(cache_lock);}while(0)
+
 static struct kmod_ctx*_new_context(){
 	return kmod_new(modsdir[0]?modsdir:NULL,NULL);
 }
@@ -58,19 +105,13 @@ static struct kmod_ctx*_new_context_mods(bool log){
 	return ctx;
 }
 
-static bool _is_module_loaded(struct kmod_ctx*ctx,const char*name){
-	if(!ctx||!name)return false;
-	if(access(_PATH_PROC_MODULES,R_OK)!=0)return false;
-	bool used=false;
-	struct kmod_list*list,*itr;
-	kmod_module_new_from_loaded(ctx,&list);
-	kmod_list_foreach(itr,list){
-		struct kmod_module*mod=kmod_module_get_module(itr);
-		if(strcmp(name,kmod_module_get_name(mod))==0)used=true;
-		kmod_module_unref(mod);
+static bool _is_module_loaded(struct kmod_module*mod){
+	switch(kmod_module_get_initstate(mod)){
+		case KMOD_MODULE_LIVE:
+		case KMOD_MODULE_COMING:
+		case KMOD_MODULE_BUILTIN:return true;
+		default:return false;
 	}
-	kmod_module_unref_list(list);
-	return used;
 }
 
 static void _mod_load_err(bool log,int err,const char*name){
@@ -81,36 +122,420 @@ static void _mod_load_err(bool log,int err,const char*name){
 	}
 }
 
+static int _probe(struct kmod_module*mod,bool log){
+	int err;
+	const char*name=kmod_module_get_name(mod);
+	if(_is_module_loaded(mod))return 0;
+	if((err=kmod_module_probe_insert_module(
+		mod,
+		KMOD_PROBE_APPLY_BLACKLIST_ALIAS_ONLY,
+		NULL,
+		NULL,
+		NULL,
+		NULL
+	))<0)_mod_load_err(log,err,name);
+	return MIN(0,err);
+}
+
 static int _insmod(struct kmod_ctx*ctx,const char*alias,bool log){
 	struct kmod_list*l,*list=NULL;
-	int err,flags=0;
+	int err;
 	err=kmod_module_new_from_lookup(ctx,alias,&list);
 	if(!list||err<0)ERET(ENOENT);
-	flags|=KMOD_PROBE_APPLY_BLACKLIST_ALIAS_ONLY;
 	kmod_list_foreach(l,list){
 		struct kmod_module*mod=kmod_module_get_module(l);
-		const char*name=kmod_module_get_name(mod);
-		if(!_is_module_loaded(ctx,name)){
-			if((err=kmod_module_probe_insert_module(
-				mod,
-				flags,
-				NULL,
-				NULL,
-				NULL,
-				NULL
-			))<0)_mod_load_err(log,err,name);
-			err=MIN(0,err);
+		err=_probe(mod,log);
+		kmod_module_unref(mod);
+	}
+	kmod_module_unref_list(list);
+	return err;
+}
+
+static uint32_t cache_hash(const char*str){
+	uint32_t h=0x811C9DC5;
+	for(;*str;str++)h=(h^(unsigned char)*str)*0x01000193;
+	return h;
+}
+
+static int table_grow(struct cache_table*t){
+	size_t i,size=t->size?t->size*2:256;
+	struct cache_slot*slots;
+	if(!(slots=malloc(sizeof(struct cache_slot)*size)))ERET(ENOMEM);
+	memset(slots,0,sizeof(struct cache_slot)*size);
+	for(size_t x=0;x<t->size;x++)if(t->slots[x].key){
+		i=t->slots[x].hash&(size-1);
+		while(slots[i].key)i=(i+1)&(size-1);
+		slots[i]=t->slots[x];
+	}
+	if(t->slots)free(t->slots);
+	t->slots=slots,t->size=size;
+	return 0;
+}
+
+static int table_find(struct cache_table*t,const char*key,uint32_t hash){
+	if(t->size==0)return -1;
+	for(
+		size_t i=hash&(t->size-1);
+		t->slots[i].key;
+		i=(i+1)&(t->size-1)
+	)if(t->slots[i].hash==hash&&strcmp(t->slots[i].key,key)==0)
+		return t->slots[i].id;
+	return -1;
+}
+
+static int table_add(struct cache_table*t,const char*key,uint32_t hash,int id){
+	size_t i;
+	char*k;
+	if((t->used+1)*4>=t->size*3&&table_grow(t)!=0)return -1;
+	if(!(k=strdup(key)))ERET(ENOMEM);
+	for(i=hash&(t->size-1);t->slots[i].key;i=(i+1)&(t->size-1));
+	t->slots[i]=(struct cache_slot){.key=k,.hash=hash,.id=id};
+	t->used++;
+	return 0;
+}
+
+static void table_free(struct cache_table*t){
+	for(size_t i=0;i<t->size;i++)
+		if(t->slots[i].key)free(t->slots[i].key);
+	if(t->slots)free(t->slots);
+	memset(t,0,sizeof(struct cache_table));
+}
+
+// called with cache_lock held
+static void cache_clear(){
+	for(size_t i=0;i<cache.alias_cnt;i++){
+		kmod_module_unref_list(cache.alias[i]->list);
+		free(cache.alias[i]);
+	}
+	if(cache.alias)free(cache.alias);
+	if(cache.loaded)free(cache.loaded);
+	if(cache.probing)free(cache.probing);
+	if(cache.errs)free(cache.errs);
+	table_free(&cache.aliases);
+	table_free(&cache.modules);
+	if(cache.ctx)kmod_unref(cache.ctx);
+	memset(&cache,0,sizeof(cache));
+	cache_gen++;
+}
+
+// called with cache_lock held, get id of module for bitmaps
+static int cache_module(const char*name){
+	int id;
+	size_t cap;
+	uint32_t h=cache_hash(name),*l;
+	int*e;
+	if((id=table_find(&cache.modules,name,h))>=0)return id;
+	if(cache.mod_cnt>=cache.mod_cap){
+		cap=cache.mod_cap?cache.mod_cap*2:256;
+		if(!(l=realloc(cache.loaded,cap/32*sizeof(uint32_t))))ERET(ENOMEM);
+		cache.loaded=l;
+		memset(l+cache.mod_cap/32,0,(cap-cache.mod_cap)/32*sizeof(uint32_t));
+		if(!(l=realloc(cache.probing,cap/32*sizeof(uint32_t))))ERET(ENOMEM);
+		cache.probing=l;
+		memset(l+cache.mod_cap/32,0,(cap-cache.mod_cap)/32*sizeof(uint32_t));
+		if(!(e=realloc(cache.errs,cap*sizeof(int))))ERET(ENOMEM);
+		cache.errs=e;
+		memset(e+cache.mod_cap,0,(cap-cache.mod_cap)*sizeof(int));
+		cache.mod_cap=cap;
+	}
+	id=(int)cache.mod_cnt;
+	if(table_add(&cache.modules,name,h,id)!=0)return -1;
+	cache.mod_cnt++;
+	return id;
+}
+
+// called with cache_lock held, resolve alias once and keep the result
+static struct cache_alias*cache_resolve(const char*alias){
+	int id;
+	size_t cnt=0;
+	uint32_t h=cache_hash(alias);
+	struct kmod_list*l,*list=NULL;
+	struct cache_alias*a,**x;
+	if((id=table_find(&cache.aliases,alias,h))>=0)return cache.alias[id];
+	if(kmod_module_new_from_lookup(cache.ctx,alias,&list)<0)EPRET(ENOENT);
+	kmod_list_foreach(l,list)cnt++;
+	if(!(a=malloc(sizeof(struct cache_alias)+sizeof(int)*cnt)))goto fail;
+	a->list=list,a->cnt=0;
+	kmod_list_foreach(l,list){
+		struct kmod_module*mod=kmod_module_get_module(l);
+		id=cache_module(kmod_module_get_name(mod));
+		kmod_module_unref(mod);
+		if(id<0)goto fail;
+		a->ids[a->cnt++]=id;
+	}
+	if(cache.alias_cnt>=cache.alias_cap){
+		size_t cap=cache.alias_cap?cache.alias_cap*2:256;
+		if(!(x=realloc(cache.alias,sizeof(struct cache_alias*)*cap)))goto fail;
+		cache.alias=x,cache.alias_cap=cap;
+	}
+	if(table_add(&cache.aliases,alias,h,(int)cache.alias_cnt)!=0)goto fail;
+	cache.alias[cache.alias_cnt++]=a;
+	return a;
+	fail:
+	if(a)free(a);
+	kmod_module_unref_list(list);
+	EPRET(ENOMEM);
+}
+
+struct cache_claim{
+	char*name;
+	int id,err;
+};
+
+// called with cache_lock held, blacklist only applies to aliases
+static bool cache_allowed(struct kmod_list*filtered,struct kmod_module*mod){
+	bool allowed=false;
+	struct kmod_list*f;
+	kmod_list_foreach(f,filtered){
+		struct kmod_module*m=kmod_module_get_module(f);
+		allowed=m==mod;
+		kmod_module_unref(m);
+		if(allowed)break;
+	}
+	return allowed;
+}
+
+// called with cache_lock held and releases it, claim modules then probe them unlocked
+static int _insmod_cached(const char*alias,bool log){
+	int err=0,id;
+	unsigned long gen;
+	size_t i=0,n=0;
+	struct kmod_ctx*ctx=NULL;
+	struct kmod_module*mod;
+	struct kmod_list*l,*list=NULL;
+	struct cache_alias*a;
+	struct cache_claim*c;
+	if(!(a=cache_resolve(alias)))goto fail;
+	if(a->cnt==0){
+		MUTEX_UNLOCK(cache_lock);
+		ERET(ENOENT);
+	}
+	if(!(c=malloc(sizeof(struct cache_claim)*a->cnt))){
+		errno=ENOMEM;
+		goto fail;
+	}
+	if(kmod_module_apply_filter(cache.ctx,KMOD_FILTER_BLACKLIST,a->list,&list)<0){
+		free(c);
+		goto fail;
+	}
+	kmod_list_foreach(l,a->list){
+		if(i>=a->cnt)break;
+		id=a->ids[i++];
+		mod=kmod_module_get_module(l);
+		if(!cache_allowed(list,mod))BIT_SET(cache.loaded,id);
+		// already loaded, or another thread is loading it
+		if(BIT_TEST(cache.loaded,id)||BIT_TEST(cache.probing,id))err=0;
+		else if((err=cache.errs[id])==0&&(c[n].name=strdup(kmod_module_get_name(mod)))){
+			BIT_SET(cache.probing,id);
+			c[n].id=id,c[n++].err=1;
 		}
 		kmod_module_unref(mod);
 	}
 	kmod_module_unref_list(list);
+	gen=cache_gen;
+	MUTEX_UNLOCK(cache_lock);
+	// kmod context is not thread safe, probe with a private one like batch_worker
+	if(n>0&&(ctx=_new_context()))kmod_load_resources(ctx);
+	for(i=0;ctx&&i<n;i++){
+		if(kmod_module_new_from_name(ctx,c[i].name,&mod)<0){
+			c[i].err=-ENOENT;
+			continue;
+		}
+		c[i].err=_probe(mod,log);
+		kmod_module_unref(mod);
+	}
+	if(ctx)kmod_unref(ctx);
+	MUTEX_LOCK(cache_lock);
+	for(i=0;i<n;i++){
+		free(c[i].name);
+		// not probed when context creation failed, try again later
+		if((err=c[i].err)>0)err=-ENOMEM;
+		if(gen!=cache_gen)continue;
+		BIT_CLEAR(cache.probing,c[i].id);
+		if(c[i].err>0)continue;
+		if(err<0&&err!=-EEXIST)cache.errs[c[i].id]=err;
+		else BIT_SET(cache.loaded,c[i].id);
+	}
+	MUTEX_UNLOCK(cache_lock);
+	free(c);
 	return err;
+	fail:
+	MUTEX_UNLOCK(cache_lock);
+	return -1;
+}
+
+struct batch_work{
+	int id,err;
+	char*name;
+};
+
+struct batch{
+	struct batch_work*works;
+	size_t cnt,next;
+	bool log;
+};
+
+// kmod context is not thread safe, every worker has its own one
+static void*batch_worker(void*d){
+	size_t i;
+	struct batch*b=d;
+	struct kmod_ctx*ctx;
+	struct kmod_module*mod;
+	if(!(ctx=_new_context()))return NULL;
+	kmod_load_resources(ctx);
+	while((i=__atomic_fetch_add(&b->next,1,__ATOMIC_RELAXED))<b->cnt){
+		struct batch_work*w=&b->works[i];
+		if(kmod_module_new_from_name(ctx,w->name,&mod)<0){
+			w->err=-ENOENT;
+			continue;
+		}
+		w->err=_probe(mod,b->log);
+		kmod_module_unref(mod);
+	}
+	kmod_unref(ctx);
+	return NULL;
+}
+
+// called with cache_lock held, queue not loaded modules of an alias
+static void batch_collect(struct batch*b,uint32_t*queued,struct cache_alias*a){
+	size_t i=0;
+	struct kmod_list*l,*list=NULL;
+	// blacklist only applies to aliases, modules are probed by name later
+	if(kmod_module_apply_filter(cache.ctx,KMOD_FILTER_BLACKLIST,a->list,&list)<0)return;
+	kmod_list_foreach(l,a->list){
+		int id=a->ids[i++];
+		struct kmod_module*mod=kmod_module_get_module(l);
+		bool allowed=cache_allowed(list,mod);
+		if(!allowed)BIT_SET(cache.loaded,id);
+		if(
+			allowed&&
+			!BIT_TEST(queued,id)&&
+			!BIT_TEST(cache.loaded,id)&&
+			!BIT_TEST(cache.probing,id)&&
+			cache.errs[id]==0&&
+			(b->works[b->cnt].name=strdup(kmod_module_get_name(mod)))
+		){
+			BIT_SET(queued,id);
+			BIT_SET(cache.probing,id);
+			b->works[b->cnt].id=id;
+			b->works[b->cnt++].err=1;
+		}
+		kmod_module_unref(mod);
+		if(i>=a->cnt)break;
+	}
+	kmod_module_unref_list(list);
+}
+
+int insmod_batch(char**aliases,size_t cnt,int threads,bool log,struct insmod_stat*st){
+	unsigned long gen;
+	size_t i,n=0;
+	pthread_t*tids=NULL;
+	uint32_t*queued=NULL;
+	struct cache_alias*a;
+	struct batch b;
+	if(!aliases||threads<=0)ERET(EINVAL);
+	memset(&b,0,sizeof(b));
+	if(st)memset(st,0,sizeof(struct insmod_stat));
+	b.log=log;
+	CACHE_LOCK();
+	if(!cache.ctx){
+		MUTEX_UNLOCK(cache_lock);
+		for(i=0;i<cnt;i++){
+			int r=insmod(aliases[i],log);
+			if(!st||r==-ENOENT)continue;
+			else if(r<0)st->failed++;
+			else st->loaded++;
+		}
+		return 0;
+	}
+	for(i=0;i<cnt;i++)cache_resolve(aliases[i]);
+	if(
+		!(queued=malloc((cache.mod_cnt/32+1)*sizeof(uint32_t)))||
+		!(b.works=malloc((cache.mod_cnt+1)*sizeof(struct batch_work)))
+	){
+		MUTEX_UNLOCK(cache_lock);
+		if(queued)free(queued);
+		ERET(ENOMEM);
+	}
+	memset(queued,0,(cache.mod_cnt/32+1)*sizeof(uint32_t));
+	gen=cache_gen;
+	for(i=0;i<cnt;i++)
+		if((a=cache_resolve(aliases[i]))&&a->cnt>0)
+			batch_collect(&b,queued,a);
+	MUTEX_UNLOCK(cache_lock);
+	free(queued);
+
+	// probe in parallel, kernel serializes loading of a shared dependency
+	if(b.cnt>1&&(size_t)threads>1){
+		n=MIN(b.cnt,(size_t)threads)-1;
+		if((tids=malloc(sizeof(pthread_t)*n)))for(i=0;i<n;i++)
+			if(pthread_create(&tids[i],NULL,batch_worker,&b)!=0)break;
+		n=tids?i:0;
+	}
+	batch_worker(&b);
+	for(i=0;i<n;i++)pthread_join(tids[i],NULL);
+	if(tids)free(tids);
+
+	MUTEX_LOCK(cache_lock);
+	for(i=0;i<b.cnt;i++){
+		struct batch_work*w=&b.works[i];
+		bool ok=w->err==0||w->err==-EEXIST;
+		if(gen==cache_gen)BIT_CLEAR(cache.probing,w->id);
+		if(w->err>0)continue;
+		if(gen==cache_gen){
+			if(ok)BIT_SET(cache.loaded,w->id);
+			else cache.errs[w->id]=w->err;
+		}
+		if(st&&ok)st->loaded++;
+		else if(st)st->failed++;
+	}
+	MUTEX_UNLOCK(cache_lock);
+	for(i=0;i<b.cnt;i++)free(b.works[i].name);
+	if(st)st->aliases=cnt,st->modules=b.cnt;
+	free(b.works);
+	return 0;
+}
+
+int modules_cache_open(bool log){
+	int r=0;
+	CACHE_LOCK();
+	if(cache.ctx){
+		if(kmod_validate_resources(cache.ctx)!=KMOD_RESOURCES_OK){
+			tlog_debug("modules index changed, drop alias cache");
+			cache_clear();
+		}else if(cache.errs)memset(cache.errs,0,cache.mod_cap*sizeof(int));
+	}
+	if(!cache.ctx&&!(cache.ctx=_new_context_mods(log)))r=-1;
+	MUTEX_UNLOCK(cache_lock);
+	return r;
+}
+
+void modules_cache_forget(const char*name){
+	int id;
+	if(!name)return;
+	CACHE_LOCK();
+	if(cache.ctx&&(id=table_find(&cache.modules,name,cache_hash(name)))>=0){
+		BIT_CLEAR(cache.loaded,id);
+		cache.errs[id]=0;
+	}
+	MUTEX_UNLOCK(cache_lock);
+}
+
+void modules_cache_close(){
+	CACHE_LOCK();
+	cache_clear();
+	MUTEX_UNLOCK(cache_lock);
 }
 
 int insmod(const char*alias,bool log){
-	struct kmod_ctx*ctx=_new_context_mods(log);
-	if(!ctx)return -1;
-	int r=_insmod(ctx,alias,log);
+	int r;
+	struct kmod_ctx*ctx;
+	if(!alias)ERET(EINVAL);
+	CACHE_LOCK();
+	if(cache.ctx)return _insmod_cached(alias,log);
+	MUTEX_UNLOCK(cache_lock);
+	if(!(ctx=_new_context_mods(log)))return -1;
+	r=_insmod(ctx,alias,log);
 	kmod_unref(ctx);
 	return r;
 }
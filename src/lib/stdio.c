@@ -153,6 +153,7 @@ ssize_t full_write(int fd,void*data,size_t len){
 		errno=0;
 		sent=write(fd,rxd,rxl);
 		if(sent<0&&errno!=EAGAIN&&errno!=EINTR)return sent;
+		if(sent<0)continue;
 		rxl-=sent,rxd+=sent;
 	}while(rxl>0);
 	return (ssize_t)len;
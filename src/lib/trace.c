@@ -0,0 +1,181 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<time.h>
+#include<errno.h>
+#include<stdio.h>
+#include<stdarg.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include"trace.h"
+#include"logger.h"
+#include"defines.h"
+#define TAG "trace"
+
+struct trace_buffer*trace=NULL;
+
+uint64_t trace_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+int trace_init(){
+	void*m;
+	if(trace)return 0;
+	m=mmap(
+		NULL,sizeof(struct trace_buffer),
+		PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS,-1,0
+	);
+	if(m==MAP_FAILED)return terlog_warn(-1,"map trace buffer failed");
+	memset(m,0,sizeof(struct trace_buffer));
+	trace=m;
+	trace->base=trace_now();
+	return 0;
+}
+
+// lock free, a slot belongs to the only caller which got it
+static struct trace_event*trace_alloc(const char*cat,const char*fmt,va_list va,int*id){
+	uint32_t i;
+	struct trace_event*e;
+	if(!trace||!cat||!fmt)return NULL;
+	if((i=__atomic_fetch_add(&trace->count,1,__ATOMIC_RELAXED))>=TRACE_MAX){
+		__atomic_store_n(&trace->count,TRACE_MAX,__ATOMIC_RELAXED);
+		__atomic_fetch_add(&trace->dropped,1,__ATOMIC_RELAXED);
+		return NULL;
+	}
+	e=&trace->events[i];
+	e->pid=getpid();
+	strncpy(e->cat,cat,sizeof(e->cat)-1);
+	vsnprintf(e->name,sizeof(e->name),fmt,va);
+	if(id)*id=(int)i;
+	return e;
+}
+
+int trace_begin(const char*cat,const char*fmt,...){
+	int id=-1;
+	va_list va;
+	struct trace_event*e;
+	va_start(va,fmt);
+	if((e=trace_alloc(cat,fmt,va,&id)))
+		__atomic_store_n(&e->begin,trace_now(),__ATOMIC_RELEASE);
+	va_end(va);
+	return id;
+}
+
+void trace_end(int id){
+	if(!trace||id<0||id>=TRACE_MAX)return;
+	__atomic_store_n(&trace->events[id].end,trace_now(),__ATOMIC_RELEASE);
+}
+
+int trace_span(uint64_t begin,uint64_t end,const char*cat,const char*fmt,...){
+	int id=-1;
+	va_list va;
+	struct trace_event*e;
+	va_start(va,fmt);
+	if((e=trace_alloc(cat,fmt,va,&id))){
+		e->begin=begin;
+		__atomic_store_n(&e->end,end,__ATOMIC_RELEASE);
+	}
+	va_end(va);
+	return id;
+}
+
+static uint32_t trace_count(){
+	uint32_t c=__atomic_load_n(&trace->count,__ATOMIC_ACQUIRE);
+	return MIN(c,TRACE_MAX);
+}
+
+struct trace_event*trace_lookup(const char*cat,const char*name){
+	struct trace_event*e;
+	if(!trace||!cat||!name)return NULL;
+	for(uint32_t i=trace_count();i>0;i--){
+		e=&trace->events[i-1];
+		if(e->begin==0)continue;
+		if(strcmp(e->cat,cat)==0&&strcmp(e->name,name)==0)return e;
+	}
+	return NULL;
+}
+
+#define MS(t) (unsigned long long)((t)/1000000),(unsigned long long)((t)/1000%1000)
+
+void trace_dump(){
+	uint64_t b;
+	struct trace_event*e;
+	if(!trace){
+		tlog_info("boot trace is not enabled");
+		return;
+	}
+	tlog_info("boot timeline (%u spans, %u dropped):",trace_count(),trace->dropped);
+	for(uint32_t i=0;i<trace_count();i++){
+		e=&trace->events[i];
+		if((b=e->begin)==0)continue;
+		b-=MIN(b,trace->base);
+		if(e->end==0)tlog_info(
+			"  +%5llu.%03llums %-10s %s (pid %d, not finished)",
+			MS(b),e->cat,e->name,e->pid
+		);
+		else tlog_info(
+			"  +%5llu.%03llums %-10s %s (pid %d, %llu.%03llums)",
+			MS(b),e->cat,e->name,e->pid,
+			MS(e->end-e->begin)
+		);
+	}
+}
+
+static void json_string(FILE*f,const char*str){
+	fputc('"',f);
+	for(const char*p=str;*p;p++)switch(*p){
+		case '"':case '\\':fprintf(f,"\\%c",*p);break;
+		default:
+			if((unsigned char)*p<0x20)fprintf(f,"\\u%04x",*p);
+			else fputc(*p,f);
+	}
+	fputc('"',f);
+}
+
+int trace_export_chrome(int fd){
+	int r,d;
+	FILE*f;
+	bool first=true;
+	struct trace_event*e;
+	if(!trace)ERET(ENODATA);
+	if(fd<0)ERET(EINVAL);
+	if((d=dup(fd))<0)return -errno;
+	if(!(f=fdopen(d,"w"))){
+		r=-errno;
+		close(d);
+		return r;
+	}
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[",f);
+	for(uint32_t i=0;i<trace_count();i++){
+		e=&trace->events[i];
+		if(e->begin==0)continue;
+		fprintf(f,"%s\n{\"name\":",first?"":",");
+		json_string(f,e->name);
+		fputs(",\"cat\":",f);
+		json_string(f,e->cat);
+		fprintf(
+			f,",\"pid\":1,\"tid\":%d,\"ts\":%llu",e->pid,
+			(unsigned long long)(e->begin-MIN(e->begin,trace->base))/1000
+		);
+		if(e->end==0)fputs(",\"ph\":\"i\",\"s\":\"t\"}",f);
+		else fprintf(
+			f,",\"ph\":\"X\",\"dur\":%llu}",
+			(unsigned long long)(e->end-e->begin)/1000
+		);
+		first=false;
+	}
+	fputs("\n]}\n",f);
+	r=ferror(f)?-EIO:0;
+	if(fclose(f)!=0&&r==0)r=-errno;
+	return r;
+}
@@ -15,70 +15,192 @@
 #include<Library/BaseMemoryLib.h>
 #include<Library/MemoryAllocationLib.h>
 #endif
-#include"list.h"
+#include"lock.h"
+#include"defines.h"
 #include"logger_internal.h"
 
-list*logbuffer=NULL;
+#ifndef LOGGER_BUFFER_SIZE
+#define LOGGER_BUFFER_SIZE 0x40000
+#endif
+#define LOGGER_BUFFER_MIN 0x10000
+#define REC_ALIGN(s)(((s)+7)&~(size_t)7)
+#define REC_MAX REC_ALIGN(sizeof(struct log_rec)+sizeof(((struct log_item*)0)->tag)+sizeof(((struct log_item*)0)->content))
+#define BATCH_SIZE (REC_MAX*4)
 
-static int _buff_free(void*data){
-	if(!data)ERET(EINVAL);
-	struct log_buff*l=(struct log_buff*)data;
-	if(l->tag)free(l->tag);
-	if(l->content)free(l->content);
-	free(l);
-	return 0;
+// fixed size log ring, head and tail are positions that only grow,
+// records never wrap, the tail of arena is skipped when a record
+// does not fit, a record with seq 0 marks such padding,
+// gen changes when positions are reset by resize or clean
+struct log_ring{
+	char*arena;
+	size_t size;
+	uint64_t head,tail;
+	uint64_t first,next;
+	uint64_t gen;
+};
+
+static struct log_ring ring={
+	.arena=NULL,
+	.size=LOGGER_BUFFER_SIZE,
+	.head=0,.tail=0,
+	.first=1,.next=1,
+	.gen=0,
+};
+static mutex_t lock;
+#ifndef ENABLE_UEFI
+// any process may log before anything else, set lock up on first use
+static pthread_once_t lock_once=PTHREAD_ONCE_INIT;
+static void lock_init(void){MUTEX_INIT(lock);}
+#define RING_LOCK() do{pthread_once(&lock_once,lock_init);MUTEX_LOCK(lock);}while(0)
+#else
+#define RING_LOCK() MUTEX_LOCK(lock)
+#endif
+
+static struct log_rec*ring_at(struct log_ring*r,uint64_t pos){
+	return (struct log_rec*)(r->arena+pos%r->size);
 }
 
-struct log_buff*logger_internal_item2buff(struct log_item*log){
-	errno=EINVAL;
-	if(!log)return NULL;
-	size_t s=sizeof(struct log_buff);
-	struct log_buff*buff=malloc(s);
-	if(!buff)goto fail;
-	memset(buff,0,s);
-	buff->pid=log->pid;
-	buff->time=log->time;
-	buff->level=log->level;
-	buff->tag=strdup(log->tag);
-	buff->content=strdup(log->content);
-	if(!buff->tag||!buff->content)goto fail;
-	errno=0;
-	return buff;
-	fail:
-	if(buff){
-		if(buff->content)free(buff->content);
-		if(buff->tag)free(buff->tag);
-		free(buff);
+static uint64_t ring_skip(struct log_ring*r,uint64_t pos){
+	size_t off;
+	while(pos<r->head){
+		off=pos%r->size;
+		if(r->size-off>=sizeof(struct log_rec)&&ring_at(r,pos)->seq!=0)break;
+		pos+=r->size-off;
 	}
-	errno=ENOMEM;
-	return NULL;
+	return pos;
+}
+
+static void ring_drop(struct log_ring*r){
+	struct log_rec*rec=ring_at(r,r->tail);
+	r->first=rec->seq+1;
+	r->tail=ring_skip(r,r->tail+rec->size);
+}
+
+static void ring_put(
+	struct log_ring*r,
+	uint64_t seq,
+	enum log_level level,
+	pid_t pid,
+	time_t time,
+	const char*tag,size_t tl,
+	const char*content,size_t cl
+){
+	struct log_rec*rec;
+	size_t need=REC_ALIGN(sizeof(struct log_rec)+tl+cl+2);
+	size_t off=r->head%r->size,pad=r->size-off<need?r->size-off:0;
+	while(r->tail<r->head&&r->head+pad+need-r->tail>r->size)ring_drop(r);
+	if(r->tail>=r->head)r->head=r->tail=r->head+pad,pad=0;
+	else if(pad>=sizeof(struct log_rec))ring_at(r,r->head)->seq=0;
+	rec=ring_at(r,r->head+pad);
+	rec->seq=seq,rec->size=need;
+	rec->tag_len=tl,rec->content_len=cl;
+	rec->level=level,rec->pid=pid,rec->time=time;
+	memcpy(LOG_REC_TAG(rec),tag,tl);
+	LOG_REC_TAG(rec)[tl]=0;
+	memcpy(LOG_REC_CONTENT(rec),content,cl);
+	LOG_REC_CONTENT(rec)[cl]=0;
+	if(r->tail>=r->head)r->first=seq;
+	r->head+=pad+need,r->next=seq+1;
 }
 
-struct log_item*logger_internal_buff2item(struct log_buff*log){
-	errno=EINVAL;
-	if(!log)return NULL;
-	size_t s=sizeof(struct log_item);
-	struct log_item*item=malloc(s);
-	if(!item)return NULL;
-	memset(item,0,s);
-	item->pid=log->pid;
-	item->time=log->time;
-	item->level=log->level;
-	strncpy(item->tag,log->tag,sizeof(item->tag)-1);
-	strncpy(item->content,log->content,sizeof(item->content)-1);
-	errno=0;
-	return item;
+int logger_internal_buffer_add(
+	enum log_level level,
+	pid_t pid,
+	time_t time,
+	const char*tag,size_t tl,
+	const char*content,size_t cl
+){
+	if(!tag||!content)ERET(EINVAL);
+	RING_LOCK();
+	if(!ring.arena&&!(ring.arena=malloc(ring.size))){
+		MUTEX_UNLOCK(lock);
+		ERET(ENOMEM);
+	}
+	if(tl>=sizeof(((struct log_item*)0)->tag))
+		tl=sizeof(((struct log_item*)0)->tag)-1;
+	if(cl>=sizeof(((struct log_item*)0)->content))
+		cl=sizeof(((struct log_item*)0)->content)-1;
+	ring_put(&ring,ring.next,level,pid,time,tag,tl,content,cl);
+	MUTEX_UNLOCK(lock);
+	return 0;
 }
 
 int logger_internal_buffer_push(struct log_item*log){
-	struct log_buff*buff=logger_internal_item2buff(log);
-	if(!buff)return -errno;
-	if(list_obj_add_new(&logbuffer,buff)!=0)goto fail;
+	if(!log)ERET(EINVAL);
+	return logger_internal_buffer_add(
+		log->level,log->pid,log->time,
+		log->tag,strnlen(log->tag,sizeof(log->tag)-1),
+		log->content,strnlen(log->content,sizeof(log->content)-1)
+	);
+}
+
+// copy records out in batches, callbacks may block or log without the lock
+uint64_t logger_buffer_foreach(uint64_t seq,log_rec_cb*cb,void*data){
+	char*batch;
+	bool stop=false;
+	size_t len,off;
+	uint64_t pos=0,gen=0;
+	struct log_rec*rec;
+	if(!cb||!(batch=malloc(BATCH_SIZE)))return seq;
+	while(!stop){
+		RING_LOCK();
+		// positions from last batch are gone, search from tail by seq
+		if(gen!=ring.gen||pos<ring.tail||pos>ring.head)
+			pos=ring.tail,gen=ring.gen;
+		// last head may have become padding
+		else pos=ring_skip(&ring,pos);
+		for(len=0;ring.arena&&pos<ring.head;pos=ring_skip(&ring,pos+rec->size)){
+			rec=ring_at(&ring,pos);
+			if(rec->seq<seq)continue;
+			if(len+rec->size>BATCH_SIZE)break;
+			memcpy(batch+len,rec,rec->size);
+			len+=rec->size;
+		}
+		MUTEX_UNLOCK(lock);
+		if(len==0)break;
+		for(off=0;off<len&&!stop;off+=rec->size){
+			rec=(struct log_rec*)(batch+off);
+			seq=rec->seq+1;
+			stop=!cb(rec,data);
+		}
+	}
+	free(batch);
+	return seq;
+}
+
+int logger_buffer_set_size(size_t size){
+	uint64_t pos;
+	struct log_rec*rec;
+	struct log_ring n;
+	size=REC_ALIGN(MAX(size,LOGGER_BUFFER_MIN));
+	memset(&n,0,sizeof(n));
+	n.size=size;
+	RING_LOCK();
+	n.first=n.next=ring.next;
+	n.gen=ring.gen+1;
+	if(ring.arena){
+		if(!(n.arena=malloc(size))){
+			MUTEX_UNLOCK(lock);
+			ERET(ENOMEM);
+		}
+		for(
+			pos=ring.tail;
+			pos<ring.head;
+			pos=ring_skip(&ring,pos+rec->size)
+		){
+			rec=ring_at(&ring,pos);
+			ring_put(
+				&n,rec->seq,
+				rec->level,rec->pid,rec->time,
+				LOG_REC_TAG(rec),rec->tag_len,
+				LOG_REC_CONTENT(rec),rec->content_len
+			);
+		}
+		free(ring.arena);
+	}
+	ring=n;
+	MUTEX_UNLOCK(lock);
 	return 0;
-	fail:
-	if(errno==0)errno=ENOMEM;
-	_buff_free(buff);
-	return -(errno);
 }
 
 char*logger_oper2string(enum log_oper oper){
@@ -90,71 +212,77 @@ char*logger_oper2string(enum log_oper oper){
 		case LOG_CLEAR:return "Clear";
 		case LOG_KLOG:return "Klog";
 		case LOG_LISTEN:return "Listen";
+		case LOG_BUFSIZE:return "Buffer Size";
+		case LOG_FILEOPT:return "File Option";
 		case LOG_QUIT:return "Quit";
 		default:return "Unknown";
 	}
 }
 
-int logger_internal_free_buff(void*d){
-	struct log_buff*b=(struct log_buff*)d;
-	if(!b)return -1;
-	if(b->content)free(b->content);
-	if(b->tag)free(b->tag);
-	free(b);
-	return 0;
-}
-
 void clean_log_buffers(){
-	if(!logbuffer)return;
-	list_free_all(logbuffer,logger_internal_free_buff);
-	logbuffer=NULL;
+	RING_LOCK();
+	if(ring.arena)free(ring.arena);
+	ring.arena=NULL;
+	ring.head=ring.tail=0;
+	ring.first=ring.next;
+	ring.gen++;
+	MUTEX_UNLOCK(lock);
 }
 
 #ifdef ENABLE_UEFI
+struct flush_data{
+	char*str;
+	UINTN len;
+};
+
+static bool flush_rec(struct log_rec*rec,void*data){
+	struct flush_data*d=data;
+	UINTN xz=rec->tag_len+rec->content_len+8;
+	if(d->len<xz||!d->str){
+		if(d->str)FreePool(d->str);
+		if(!(d->str=AllocateZeroPool(xz)))return false;
+		d->len=xz;
+	}
+	AsciiSPrint(d->str,xz,"%a: %a",LOG_REC_TAG(rec),LOG_REC_CONTENT(rec));
+	logger_out_write(d->str);
+	return true;
+}
+
 void flush_buffer(){
-	if(!logbuffer)return;
-	char*str=NULL;
-	UINTN len=0,xz=0;
-	list*head,*cur,*next;
-	struct log_buff*buff;
-	if(!(head=list_first(logbuffer)))return;
-	cur=head;
-	do{
-		next=cur->next;
-		if(!(buff=LIST_DATA(cur,struct log_buff*)))continue;
-		xz=AsciiStrLen(buff->tag)+AsciiStrLen(buff->content)+8;
-		if(len<xz||!str){
-			if(str)FreePool(str);
-			if(!(str=AllocateZeroPool(xz)))return;
-			len=xz;
-		}
-		AsciiSPrint(str,xz,"%a: %a",buff->tag,buff->content);
-		logger_out_write(str);
-	}while((cur=next));
-	if(str)FreePool(str);
+	struct flush_data d={NULL,0};
+	logger_buffer_foreach(0,flush_rec,&d);
+	if(d.str)FreePool(d.str);
 }
 #else
+struct flush_data{
+	struct logger*log;
+	struct log_item*item;
+};
+
+static bool flush_rec(struct log_rec*rec,void*data){
+	struct flush_data*d=data;
+	struct log_item*item=d->item;
+	item->pid=rec->pid;
+	item->time=rec->time;
+	item->level=rec->level;
+	memcpy(item->tag,LOG_REC_TAG(rec),MIN(rec->tag_len+1,sizeof(item->tag)));
+	memcpy(item->content,LOG_REC_CONTENT(rec),MIN(rec->content_len+1,sizeof(item->content)));
+	d->log->logger(d->log->name,item);
+	return true;
+}
+
 void flush_buffer(struct logger*log){
+	struct flush_data d={log,NULL};
 	if(
 		!log||
 		!log->name||
 		!log->enabled||
 		!log->logger||
-		log->flushed||
-		!logbuffer
+		log->flushed
 	)return;
-	list*head,*cur,*next;
-	struct log_item*item;
-	struct log_buff*buff;
-	if(!(head=list_first(logbuffer)))return;
-	cur=head;
-	do{
-		next=cur->next;
-		if(!(buff=LIST_DATA(cur,struct log_buff*)))continue;
-		if(!(item=logger_internal_buff2item(buff)))continue;
-		log->logger(log->name,item);
-		free(item);
-	}while((cur=next));
+	if(!(d.item=malloc(sizeof(struct log_item))))return;
+	logger_buffer_foreach(0,flush_rec,&d);
+	free(d.item);
 	log->flushed=true;
 }
 #endif
@@ -10,6 +10,7 @@
 #include<ctype.h>
 #include<errno.h>
 #include<stdio.h>
+#include<limits.h>
 #include<stdarg.h>
 #include<stdlib.h>
 #include<string.h>
@@ -122,6 +123,23 @@ int logger_open_console(){
 	return logger_send_string(LOG_CONSOLE,NULL);
 }
 
+int logger_set_buffer_size(size_t size){
+	int r;
+	struct log_msg msg;
+	if(size<=0||size>INT_MAX)ERET(EINVAL);
+	if((r=logger_internal_send_code(logfd,LOG_BUFSIZE,(int)size))<0)return r;
+	do{if(logger_internal_read_msg(logfd,&msg)<0)return -1;}
+	while(msg.oper!=LOG_OK&&msg.oper!=LOG_FAIL);
+	return msg.data.code;
+}
+
+int logger_set_file_option(const char*key,const char*value){
+	char buff[256];
+	if(!key||!value)ERET(EINVAL);
+	if((size_t)snprintf(buff,sizeof(buff),"%s=%s",key,value)>=sizeof(buff))ERET(E2BIG);
+	return logger_send_string(LOG_FILEOPT,buff);
+}
+
 int start_loggerd(pid_t*p){
 	int fds[2],r;
 	if(logfd>=0)ERET(EEXIST);
@@ -229,6 +247,8 @@ void logger_init(){
 		"logger.use_console",
 		console_output
 	);
+	int64_t bs=confd_get_integer("logger.buffer_size",0);
+	if(bs>0)logger_buffer_set_size(bs);
 	switch((int)confd_get_type("logger.min_level")){
 		case -1:break;
 		case TYPE_INTEGER:logger_level=confd_get_integer(
@@ -257,30 +277,35 @@ void logger_set_level(enum log_level level){
 	logger_level=level;
 }
 
-int logger_write(struct log_item*log){
-	if(!log)ERET(EINVAL);
-	if(log->level<logger_level)return 0;
-	ssize_t s=strlen(log->content)-1;
-	while(s>=0)
-		if(!isspace(log->content[s]))break;
-		else log->content[s]=0,s--;
+static int logger_send(
+	enum log_level level,
+	pid_t pid,
+	time_t time,
+	const char*tag,size_t tl,
+	const char*content,size_t cl
+){
+	if(level<logger_level)return 0;
+	while(cl>0&&isspace(content[cl-1]))cl--;
 	#ifndef ENABLE_UEFI
-	static size_t xs=sizeof(struct log_msg);
+	int r;
+	struct log_msg msg;
 	if(logfd<0){
-		if(recovery_out_fd>=0)recovery_ui_printf("%s: %s",log->tag,log->content);
-		return fprintf(stderr,"%s: %s\n",log->tag,log->content);
+		if(recovery_out_fd>=0)recovery_ui_printf(
+			"%.*s: %.*s",(int)tl,tag,(int)cl,content
+		);
+		return fprintf(stderr,"%.*s: %.*s\n",(int)tl,tag,(int)cl,content);
 	}
-	struct log_msg msg;
-	logger_internal_init_msg(&msg,LOG_ADD);
-	memcpy(&msg.data.log,log,sizeof(struct log_item));
-	if(((size_t)write(logfd,&msg,xs))!=xs)return -1;
-	memset(&msg,0,sizeof(msg));
+	r=logger_internal_send_log(logfd,level,pid,time,tag,tl,content,cl);
+	if(r<0)return -1;
 	do{if(logger_internal_read_msg(logfd,&msg)<0)return -1;}
 	while(msg.oper!=LOG_OK&&msg.oper!=LOG_FAIL);
 	errno=msg.data.code;
-	return xs;
+	return r;
 	#else
-	AsciiSPrint(print_buff,sizeof(print_buff),"%a: %a",log->tag,log->content);
+	UINTN x=AsciiSPrint(print_buff,sizeof(print_buff),"%a: ",tag);
+	cl=MIN(cl,sizeof(print_buff)-x-1);
+	CopyMem(print_buff+x,content,cl);
+	print_buff[x+cl]=0;
 	DebugPrint(EFI_D_INFO,"%a",print_buff);
 	DebugPrint(EFI_D_INFO,"\n");
 	if(console_output){
@@ -292,23 +317,29 @@ int logger_write(struct log_item*log){
 	#endif
 }
 
+int logger_write(struct log_item*log){
+	if(!log)ERET(EINVAL);
+	return logger_send(
+		log->level,log->pid,log->time,
+		log->tag,strnlen(log->tag,sizeof(log->tag)-1),
+		log->content,strnlen(log->content,sizeof(log->content)-1)
+	);
+}
+
 int logger_print(enum log_level level,char*tag,char*content){
+	time_t t;
+	pid_t pid=0;
+	size_t tl,cl;
 	if(!tag||!content)ERET(EINVAL);
 	if(level<logger_level)return 0;
-	struct log_item*log=malloc(sizeof(struct log_item));
-	if(!log)ERET(ENOMEM);
-	memset(log,0,sizeof(struct log_item));
-	log->level=level;
-	strncpy(log->tag,tag,sizeof(log->tag)-1);
-	strncpy(log->content,content,sizeof(log->content)-1);
-	time(&log->time);
+	tl=strnlen(tag,sizeof(((struct log_item*)0)->tag)-1);
+	cl=strnlen(content,sizeof(((struct log_item*)0)->content)-1);
+	time(&t);
 	#ifndef ENABLE_UEFI
-	log->pid=getpid();
+	pid=getpid();
 	#endif
-	logger_internal_buffer_push(log);
-	int r=logger_write(log);
-	free(log);
-	return r;
+	logger_internal_buffer_add(level,pid,t,tag,tl,content,cl);
+	return logger_send(level,pid,t,tag,tl,content,cl);
 }
 
 static int logger_printf_x(enum log_level level,char*tag,const char*fmt,va_list ap){
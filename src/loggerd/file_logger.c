@@ -12,6 +12,8 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<stdint.h>
+#include<sys/stat.h>
 #include"logger_internal.h"
 #include"defines.h"
 #include"output.h"
@@ -20,39 +22,139 @@
 struct open_file{
 	char file[PATH_MAX];
 	int fd;
+	bool batch;
+	char*buff;
+	size_t len,cap;
+	size_t size;
+	uint64_t since;
+};
+
+// sync policy for batched log files
+enum file_sync{
+	SYNC_NONE,
+	SYNC_FLUSH,
+	SYNC_URGENT,
+};
+
+static struct file_opts{
+	size_t batch_size;
+	long flush_interval;
+	enum log_level flush_level;
+	enum file_sync sync;
+	size_t rotate_size;
+	int rotate_keep;
+}opts={
+	.batch_size=FILE_LOGGER_BATCH,
+	.flush_interval=FILE_LOGGER_INTERVAL,
+	.flush_level=LEVEL_WARNING,
+	.sync=SYNC_FLUSH,
+	.rotate_size=0,
+	.rotate_keep=3,
 };
 
 static struct open_file*files[128];
 
+static uint64_t now_ms(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+static int write_all(int fd,const char*buff,size_t len){
+	ssize_t s;
+	while(len>0){
+		if((s=write(fd,buff,len))<0){
+			if(errno==EINTR)continue;
+			return -1;
+		}
+		buff+=s,len-=s;
+	}
+	return 0;
+}
+
+static void write_banner(struct open_file*f,const char*act){
+	int r;
+	char tc[24]={0},line[PATH_MAX+64];
+	time_t t=time(NULL);
+	if(isatty(f->fd))return;
+	r=snprintf(
+		line,sizeof(line),
+		"-------- file %s %s at %s --------\n",
+		f->file,act,time2ndefstr(&t,tc,23)
+	);
+	if(r<=0)return;
+	if((size_t)r>=sizeof(line))r=sizeof(line)-1;
+	if(write_all(f->fd,line,r)==0)f->size+=r;
+}
+
+static int open_fd(struct open_file*f,int flags){
+	struct stat st;
+	if((f->fd=open(f->file,flags,0644))<0)return -1;
+	f->size=0,f->batch=false;
+	if(fstat(f->fd,&st)==0&&S_ISREG(st.st_mode))
+		f->size=st.st_size,f->batch=true;
+	write_banner(f,"opened");
+	return f->fd;
+}
+
+// called after a flush, keep at most rotate_keep old files
+static void rotate_log(struct open_file*f){
+	char from[PATH_MAX+16],to[PATH_MAX+16];
+	if(!f->batch||opts.rotate_size<=0||f->size<opts.rotate_size)return;
+	write_banner(f,"rotated");
+	close(f->fd);
+	f->fd=-1;
+	if(opts.rotate_keep<=0)unlink(f->file);
+	else for(int i=opts.rotate_keep;i>0;i--){
+		if(i==1)strncpy(from,f->file,sizeof(from)-1);
+		else snprintf(from,sizeof(from),"%s.%d",f->file,i-1);
+		snprintf(to,sizeof(to),"%s.%d",f->file,i);
+		if(rename(from,to)!=0&&errno!=ENOENT)
+			fprintf(stderr,"rotate log %s failed: %m\n",from);
+	}
+	if(open_fd(f,O_WRONLY|O_APPEND|O_CREAT|O_TRUNC)<0)
+		fprintf(stderr,"reopen log %s failed: %m\n",f->file);
+}
+
+static int flush_file(struct open_file*f,bool urgent){
+	int r=0;
+	if(f->fd<0||f->len<=0)return 0;
+	if((r=write_all(f->fd,f->buff,f->len))==0)f->size+=f->len;
+	f->len=0,f->since=0;
+	if(r==0&&(opts.sync==SYNC_FLUSH||(urgent&&opts.sync==SYNC_URGENT)))
+		fdatasync(f->fd);
+	rotate_log(f);
+	return r;
+}
+
+static struct open_file*lookup_file(const char*path){
+	for(int i=0;i<128;i++)
+		if(files[i]&&files[i]->fd>=0&&strcmp(path,files[i]->file)==0)
+			return files[i];
+	return NULL;
+}
+
 int open_log_file(char*path){
 	int i;
 	struct open_file*f=NULL;
-	char tc[24]={0};
-	time_t t=time(NULL);
 	errno=0;
-	for(i=0;(f=files[i]);i++)
-		if(strcmp(path,f->file)==0)
-			return f->fd;
+	if((f=lookup_file(path)))return f->fd;
 	for(i=0;i<128;i++){
 		f=files[i];
-		if(f&&f->fd>0)continue;
+		if(f&&f->fd>=0)continue;
+		if(f){
+			if(f->buff)free(f->buff);
+			free(f);
+			files[i]=NULL;
+		}
 		if(!(f=malloc(sizeof(struct open_file))))return -1;
 		memset(f,0,sizeof(struct open_file));
 		strncpy(f->file,path,sizeof(f->file)-1);
-		if((f->fd=open(
-			path,
-			O_WRONLY|O_SYNC|O_APPEND|O_CREAT,
-			0644
-		))<0){
+		if(open_fd(f,O_WRONLY|O_APPEND|O_CREAT)<0){
 			free(f);
 			return -1;
 		}
 		files[i]=f;
-		if(!isatty(f->fd))dprintf(
-			f->fd,
-			"-------- file %s opened at %s --------\n",
-			path,time2ndefstr(&t,tc,23)
-		);
 		errno=0;
 		return f->fd;
 	}
@@ -61,35 +163,85 @@ int open_log_file(char*path){
 }
 
 static void close_log(struct open_file*f){
-	if(f->fd<=0)return;
-	char tc[24]={0};
-	time_t t=time(NULL);
-	if(!isatty(f->fd))dprintf(
-		f->fd,
-		"-------- file %s closed at %s --------\n",
-		f->file,time2ndefstr(&t,tc,23)
-	);
+	if(f->fd<0)return;
+	flush_file(f,true);
+	if(f->fd<0)return;
+	write_banner(f,"closed");
 	close(f->fd);
 	f->fd=-1;
 }
+
 void close_log_file(char*path){
-	int i;
 	struct open_file*f=NULL;
-	for(i=0;(f=files[i]);i++)
-		if(strcmp(path,f->file)==0)
+	for(int i=0;i<128;i++)
+		if((f=files[i])&&strcmp(path,f->file)==0)
 			close_log(f);
 }
 
 void close_all_file(){
-	int i;
 	struct open_file*f=NULL;
-	for(i=0;(f=files[i]);i++){
+	for(int i=0;i<128;i++){
+		if(!(f=files[i]))continue;
 		close_log(f);
+		if(f->buff)free(f->buff);
 		free(f);
 		files[i]=NULL;
 	}
 }
 
+void flush_all_file(bool force){
+	struct open_file*f=NULL;
+	uint64_t now=force?0:now_ms();
+	for(int i=0;i<128;i++){
+		if(!(f=files[i])||f->len<=0)continue;
+		if(force||now>=f->since+opts.flush_interval)
+			flush_file(f,false);
+	}
+}
+
+int file_logger_timeout(void){
+	long t=-1,x;
+	struct open_file*f=NULL;
+	uint64_t now=now_ms();
+	for(int i=0;i<128;i++){
+		if(!(f=files[i])||f->len<=0)continue;
+		x=f->since+opts.flush_interval>now?(long)(f->since+opts.flush_interval-now):0;
+		if(t<0||x<t)t=x;
+	}
+	return (int)t;
+}
+
+int file_logger_option(char*opt){
+	long long v;
+	char*val,*end;
+	if(!opt||!(val=strchr(opt,'=')))ERET(EINVAL);
+	*val++=0;
+	if(strcmp(opt,"flush_level")==0){
+		enum log_level l=logger_parse_level(val);
+		if(l==0)ERET(EINVAL);
+		opts.flush_level=l;
+		return 0;
+	}
+	if(strcmp(opt,"sync")==0){
+		if(strcasecmp(val,"none")==0)opts.sync=SYNC_NONE;
+		else if(strcasecmp(val,"flush")==0)opts.sync=SYNC_FLUSH;
+		else if(strcasecmp(val,"urgent")==0)opts.sync=SYNC_URGENT;
+		else ERET(EINVAL);
+		return 0;
+	}
+	errno=0;
+	v=strtoll(val,&end,0);
+	if(errno!=0||end==val||*end||v<0)ERET(EINVAL);
+	if(strcmp(opt,"batch_size")==0){
+		flush_all_file(true);
+		opts.batch_size=v;
+	}else if(strcmp(opt,"flush_interval")==0)opts.flush_interval=v;
+	else if(strcmp(opt,"rotate_size")==0)opts.rotate_size=v;
+	else if(strcmp(opt,"rotate_keep")==0)opts.rotate_keep=v;
+	else ERET(ENOENT);
+	return 0;
+}
+
 static char*level2color(enum log_level level){
 	switch(level){
 		case LEVEL_VERBOSE: return "\033[37;1m";
@@ -105,27 +257,57 @@ static char*level2color(enum log_level level){
 	}
 }
 
-int file_logger(char*name,struct log_item*log){
-	char buff[24]={0},p[16]={0};
-	int fd=-1;
-	if(strncasecmp(name,"stderr",6)==0)fd=STDERR_FILENO;
-	else if(strncasecmp(name,"stdout",6)==0)fd=STDOUT_FILENO;
-	else fd=open_log_file(name);
-	if(fd<0)return -errno;
-	if(!log->time)ERET(EFAULT);
-	if(log->pid>0)snprintf(p,15,"[%d]",log->pid);
-	bool tty=isatty(fd);
+static int format_log(char*buff,size_t size,bool tty,struct log_item*log){
+	char tb[24]={0},p[16]={0};
 	char*time,*level,level_pad[16]={0},*end;
-	time=time2ndefstr(&log->time,buff,sizeof(buff));
+	if(log->pid>0)snprintf(p,15,"[%d]",log->pid);
+	time=time2ndefstr(&log->time,tb,sizeof(tb));
 	level=logger_level2string(log->level);
 	for(size_t i=0;i<(6-strlen(level));i++)level_pad[i]=' ';
 	end=tty?"\033[0m":"";
-	int r=dprintf(fd,
+	int r=snprintf(buff,size,
 		"%s[%s]%s %s<%s>%s%s %s%s%s%s: %s%s%s\n",
 		tty?"\r\033[36m":"",time,end,
 		tty?"\033[37;1;4m":"",level,end,level_pad,
 		tty?"\033[33m":"",log->tag,p,end,
 		tty?level2color(log->level):"",log->content,end
 	);
+	if(r>0&&(size_t)r>=size)r=size-1;
+	return r;
+}
+
+int file_logger(char*name,struct log_item*log){
+	int fd=-1,r;
+	size_t need;
+	struct open_file*f=NULL;
+	char line[sizeof(log->content)+FILE_LOGGER_LINE_EXTRA];
+	if(strncasecmp(name,"stderr",6)==0)fd=STDERR_FILENO;
+	else if(strncasecmp(name,"stdout",6)==0)fd=STDOUT_FILENO;
+	else if(!(f=lookup_file(name))&&open_log_file(name)>=0)f=lookup_file(name);
+	if(f)fd=f->fd;
+	if(fd<0)return -errno;
+	if(!log->time)ERET(EFAULT);
+	if(!f||!f->batch||opts.batch_size<=0){
+		direct:
+		if((r=format_log(line,sizeof(line),isatty(fd),log))<=0)return r;
+		if(write_all(fd,line,r)!=0)return -errno;
+		if(f)f->size+=r,rotate_log(f);
+		return r;
+	}
+	need=strnlen(log->content,sizeof(log->content))+FILE_LOGGER_LINE_EXTRA;
+	if(f->cap-f->len<need){
+		size_t cap=MAX(f->len+need,opts.batch_size+need);
+		char*b=realloc(f->buff,cap);
+		if(!b){
+			flush_file(f,false);
+			goto direct;
+		}
+		f->buff=b,f->cap=cap;
+	}
+	if((r=format_log(f->buff+f->len,f->cap-f->len,false,log))<=0)return r;
+	if(f->len==0)f->since=now_ms();
+	f->len+=r;
+	if(log->level>=opts.flush_level)flush_file(f,true);
+	else if(f->len>=opts.batch_size)flush_file(f,false);
 	return r;
 }
@@ -12,6 +12,8 @@
 #include<stdlib.h>
 #include<stdbool.h>
 #include<string.h>
+#include<poll.h>
+#include<sys/uio.h>
 #include"defines.h"
 #include"list.h"
 #include"logger_internal.h"
@@ -155,40 +157,153 @@ void logger_internal_init_msg(struct log_msg*msg,enum log_oper oper){
 	msg->oper=oper;
 }
 
-int logger_internal_send_code(int fd,enum log_oper oper,int code){
+static int logger_internal_writev(int fd,struct iovec*iov,int cnt){
+	ssize_t s;
+	size_t total=0;
+	if(fd<0)ERET(EINVAL);
+	while(cnt>0){
+		if((s=writev(fd,iov,cnt))<0){
+			if(errno==EINTR)continue;
+			return -1;
+		}
+		total+=s;
+		while(cnt>0&&(size_t)s>=iov->iov_len)s-=iov->iov_len,iov++,cnt--;
+		if(cnt>0)iov->iov_base=(char*)iov->iov_base+s,iov->iov_len-=s;
+	}
+	return (int)total;
+}
+
+static void logger_internal_init_v2(struct log_msg_v2*msg,enum log_oper oper){
+	memset(msg,0,sizeof(struct log_msg_v2));
+	msg->magic0=LOGD_MAGIC0;
+	msg->magic1=LOGD_MAGIC1_V2;
+	msg->oper=oper;
+}
+
+int logger_internal_send_log(
+	int fd,
+	enum log_level level,
+	pid_t pid,
+	time_t time,
+	const char*tag,size_t tl,
+	const char*content,size_t cl
+){
+	struct log_msg_v2 msg;
+	if(!tag||!content)ERET(EINVAL);
+	if(tl>=sizeof(((struct log_item*)0)->tag))
+		tl=sizeof(((struct log_item*)0)->tag)-1;
+	if(cl>=sizeof(((struct log_item*)0)->content))
+		cl=sizeof(((struct log_item*)0)->content)-1;
+	logger_internal_init_v2(&msg,LOG_ADD);
+	msg.tag_len=tl,msg.len=cl;
+	msg.level=level,msg.pid=pid,msg.time=time;
+	return logger_internal_writev(fd,(struct iovec[]){
+		{&msg,sizeof(msg)},
+		{(void*)tag,tl},
+		{(void*)content,cl},
+	},3);
+}
+
+int logger_internal_send_code_version(int fd,enum log_oper oper,int code,int version){
 	struct log_msg msg;
+	struct log_msg_v2 hdr;
 	size_t xs=sizeof(struct log_msg);
 	if(fd<0)ERET(EINVAL);
-	logger_internal_init_msg(&msg,oper);
-	msg.data.code=code;
-	return ((size_t)write(fd,&msg,xs))==xs?(int)xs:-1;
+	if(version==1){
+		logger_internal_init_msg(&msg,oper);
+		msg.data.code=code;
+		return ((size_t)write(fd,&msg,xs))==xs?(int)xs:-1;
+	}
+	logger_internal_init_v2(&hdr,oper);
+	hdr.code=code;
+	return logger_internal_writev(fd,(struct iovec[]){{&hdr,sizeof(hdr)}},1);
+}
+
+int logger_internal_send_code(int fd,enum log_oper oper,int code){
+	return logger_internal_send_code_version(fd,oper,code,2);
 }
 
 int logger_internal_send_string(int fd,enum log_oper oper,char*string){
-	struct log_msg msg;
-	size_t xs=sizeof(struct log_msg);
+	struct log_msg_v2 msg;
+	size_t len=string?strnlen(string,sizeof(((struct log_msg*)0)->data.string)-1):0;
 	if(fd<0)ERET(EINVAL);
-	logger_internal_init_msg(&msg,oper);
-	if(string)strncpy(msg.data.string,string,sizeof(msg.data.string)-1);
-	return ((size_t)write(fd,&msg,xs))==xs?(int)xs:-1;
+	logger_internal_init_v2(&msg,oper);
+	msg.len=len;
+	return logger_internal_writev(fd,(struct iovec[]){
+		{&msg,sizeof(msg)},
+		{string,len},
+	},2);
 }
 
-int logger_internal_read_msg(int fd,struct log_msg*buff){
-	if(!buff||fd<0)ERET(EINVAL);
-	size_t size=sizeof(struct log_msg),s;
-	memset(buff,0,size);
-	errno=0;
-	while(1){
-		errno=0;
-		s=read(fd,buff,size);
-		if(errno==0)break;
+// read exactly len bytes, once a packet started wait for the remaining part
+static int logger_internal_read_full(int fd,void*buff,size_t len,bool started){
+	ssize_t s;
+	size_t got=0;
+	struct pollfd p={.fd=fd,.events=POLLIN};
+	while(got<len){
+		if((s=read(fd,(char*)buff+got,len-got))>0){
+			got+=s,started=true;
+			continue;
+		}
+		if(s==0)return started?-2:EOF;
 		switch(errno){
 			case EINTR:continue;
-			case EAGAIN:return 0;
+			case EAGAIN:
+				if(!started)return 0;
+				if(poll(&p,1,LOGD_READ_TIMEOUT)>0)continue;
+			//fallthrough
 			default:return -2;
 		}
 	}
-	if(s==0)return EOF;
-	return (s!=size||!(logger_internal_check_magic(buff)))?-2:1;
+	return 1;
+}
+
+int logger_internal_read_frame(int fd,struct log_msg*buff,int*version){
+	int r;
+	struct log_msg_v2 hdr;
+	struct log_item*log;
+	if(!buff||fd<0)ERET(EINVAL);
+	if((r=logger_internal_read_full(fd,&hdr,2,false))!=1)return r;
+	if(hdr.magic0!=LOGD_MAGIC0)return -2;
+	switch(hdr.magic1){
+		case LOGD_MAGIC1:
+			// compatibility shim for fixed size packets
+			if(version)*version=1;
+			buff->magic0=hdr.magic0,buff->magic1=hdr.magic1;
+			return logger_internal_read_full(
+				fd,(char*)buff+2,
+				sizeof(struct log_msg)-2,true
+			);
+		case LOGD_MAGIC1_V2:break;
+		default:return -2;
+	}
+	if(version)*version=2;
+	r=logger_internal_read_full(fd,(char*)&hdr+2,sizeof(hdr)-2,true);
+	if(r!=1)return r;
+	buff->magic0=LOGD_MAGIC0,buff->magic1=LOGD_MAGIC1;
+	buff->oper=hdr.oper;
+	if(hdr.oper==LOG_ADD){
+		log=&buff->data.log;
+		if(hdr.tag_len>=sizeof(log->tag))return -2;
+		if(hdr.len>=sizeof(log->content))return -2;
+		log->level=hdr.level,log->pid=hdr.pid,log->time=hdr.time;
+		if(
+			logger_internal_read_full(fd,log->tag,hdr.tag_len,true)!=1||
+			logger_internal_read_full(fd,log->content,hdr.len,true)!=1
+		)return -2;
+		log->tag[hdr.tag_len]=0,log->content[hdr.len]=0;
+		return 1;
+	}
+	if(hdr.tag_len!=0||hdr.len>=sizeof(buff->data.string))return -2;
+	buff->data.code=hdr.code;
+	if(hdr.len>0){
+		r=logger_internal_read_full(fd,buff->data.string,hdr.len,true);
+		if(r!=1)return -2;
+		buff->data.string[hdr.len]=0;
+	}
+	return 1;
 }
 
+int logger_internal_read_msg(int fd,struct log_msg*buff){
+	return logger_internal_read_frame(fd,buff,NULL);
+}
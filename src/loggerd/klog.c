@@ -134,36 +134,23 @@ static int read_kmsg_thread(void*data __attribute__((unused))){
 
 int init_kmesg(){
 	struct log_item log;
-	struct log_buff*buff=NULL;
-	list*head=NULL,*conts=NULL,*item=NULL;
 
 	struct sysinfo info;
 	sysinfo(&info);
 	boot_time=time(NULL)-(time_t)(info.uptime/1000);
 
-	if(logbuffer&&!(head=list_first(logbuffer)))return -errno;
 	if((klogfd=open(_PATH_DEV_KMSG,O_RDONLY|O_NONBLOCK))<0)goto fail;
 	if(lseek(klogfd,0,SEEK_DATA)<0)goto fail;
 
 	while(read_kmsg_item(&log,klogfd,true)){
-		if(!(buff=logger_internal_item2buff(&log)))goto fail;
-		if(strncmp(buff->tag,"simple-init ",12)==0)continue;
-		if(!(item=list_new(buff)))goto fail;
-		if(conts)list_add(conts,item);
-		conts=item;
-		item=NULL,buff=NULL;
+		if(strncmp(log.tag,"simple-init ",12)==0)continue;
+		logger_internal_buffer_push(&log);
 	}
 
-	if(logbuffer)list_insert(head,conts);
-	else logbuffer=conts;
-	conts=NULL;
-
 	int x=fork_run("klog",false,NULL,NULL,read_kmsg_thread);
 	close(klogfd);
 	return x;
 	fail:
-	if(conts)list_free_all(conts,logger_internal_free_buff);
-	if(buff)free(buff);
 	if(klogfd>=0)close(klogfd);
 	return -errno;
 }
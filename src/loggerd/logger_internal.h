@@ -16,6 +16,19 @@
 // logger packet magic
 #define LOGD_MAGIC0 0xEF
 #define LOGD_MAGIC1 0x88
+#define LOGD_MAGIC1_V2 0x89
+
+// max time in ms to wait for the rest of a started packet
+#define LOGD_READ_TIMEOUT 1000
+
+// file logger batch size in bytes
+#define FILE_LOGGER_BATCH 0x4000
+
+// max time in ms a batched log line waits before written
+#define FILE_LOGGER_INTERVAL 500
+
+// max formatted log line overhead besides content
+#define FILE_LOGGER_LINE_EXTRA 256
 
 // logger operation
 enum log_oper{
@@ -30,6 +43,8 @@ enum log_oper{
 	LOG_KLOG     =0xAF08,
 	LOG_SYSLOG   =0xAF09,
 	LOG_CONSOLE  =0xAF0A,
+	LOG_BUFSIZE  =0xAF0B,
+	LOG_FILEOPT  =0xAF0C,
 };
 
 // logger message packet
@@ -43,6 +58,20 @@ struct log_msg{
 	}data;
 };
 
+// logger length-prefixed message header (v2)
+// followed by tag_len bytes tag and len bytes content,
+// or len bytes string for non LOG_ADD operations
+struct log_msg_v2{
+	unsigned char magic0,magic1;
+	uint16_t tag_len;
+	enum log_oper oper;
+	uint32_t len;
+	int32_t code;
+	enum log_level level;
+	pid_t pid;
+	time_t time;
+};
+
 // logger output handle
 typedef int on_log(char*,struct log_item*);
 
@@ -79,6 +108,15 @@ extern void close_log_file(char*path);
 // src/loggerd/file_logger.c: close all openned log file
 extern void close_all_file(void);
 
+// src/loggerd/file_logger.c: write out batched log lines, expired only if not force
+extern void flush_all_file(bool force);
+
+// src/loggerd/file_logger.c: time in ms until next batched flush, -1 for none
+extern int file_logger_timeout(void);
+
+// src/loggerd/file_logger.c: set a file logger option in key=value form
+extern int file_logger_option(char*opt);
+
 // src/loggerd/internal.c: free loggers
 extern void logger_internal_clean(void);
 
@@ -109,6 +147,22 @@ extern bool logger_internal_check_magic(struct log_msg*msg);
 // src/loggerd/internal.c: read a log packet
 extern int logger_internal_read_msg(int fd,struct log_msg*buff);
 
+// src/loggerd/internal.c: read a v1 or v2 log packet, report packet version
+extern int logger_internal_read_frame(int fd,struct log_msg*buff,int*version);
+
+// src/loggerd/internal.c: send a v2 log item packet
+extern int logger_internal_send_log(
+	int fd,
+	enum log_level level,
+	pid_t pid,
+	time_t time,
+	const char*tag,size_t tag_len,
+	const char*content,size_t content_len
+);
+
+// src/loggerd/internal.c: send a return code packet in specified version
+extern int logger_internal_send_code_version(int fd,enum log_oper oper,int code,int version);
+
 // src/loggerd/internal.c: send a return code packet
 extern int logger_internal_send_code(int fd,enum log_oper oper,int code);
 
@@ -118,17 +172,17 @@ extern int logger_internal_send_string(int fd,enum log_oper oper,char*string);
 // src/loggerd/buffer.c: convert operation to a readable string
 extern char*logger_oper2string(enum log_oper oper);
 
-// src/loggerd/buffer.c: convert log_item to log_buff
-extern struct log_buff*logger_internal_item2buff(struct log_item*log);
-
-// src/loggerd/buffer.c: convert log_buff to log_item
-extern struct log_item*logger_internal_buff2item(struct log_buff*log);
-
 // src/loggerd/buffer.c: add log to buffer
 extern int logger_internal_buffer_push(struct log_item*log);
 
-// src/loggerd/buffer.c: free log_buff
-extern int logger_internal_free_buff(void*d);
+// src/loggerd/buffer.c: add log fields to buffer
+extern int logger_internal_buffer_add(
+	enum log_level level,
+	pid_t pid,
+	time_t time,
+	const char*tag,size_t tag_len,
+	const char*content,size_t content_len
+);
 
 // src/loggerd/buffer.c: clean log buffers
 extern void clean_log_buffers(void);
@@ -177,8 +177,9 @@ int init_console(){
 static int loggerd_read(int fd){
 	if(fd<0)ERET(EINVAL);
 	errno=0;
+	int ver=2;
 	struct log_msg msg;
-	int e=logger_internal_read_msg(fd,&msg);
+	int e=logger_internal_read_frame(fd,&msg,&ver);
 	if(e<0)return e;
 	else if(e==0)return 0;
 	enum log_oper ret=LOG_OK;
@@ -240,6 +241,19 @@ static int loggerd_read(int fd){
 				ret=LOG_FAIL,retdata=errno;
 		break;
 
+		// resize log buffer
+		case LOG_BUFSIZE:
+			if(msg.data.code<=0)ret=LOG_FAIL,retdata=EINVAL;
+			else if(logger_buffer_set_size(msg.data.code)!=0)
+				ret=LOG_FAIL,retdata=errno;
+		break;
+
+		// set file logger option
+		case LOG_FILEOPT:
+			if(file_logger_option(msg.data.string)!=0)
+				ret=LOG_FAIL,retdata=errno;
+		break;
+
 		// clean log buffer
 		case LOG_CLEAR:
 			clean_log_buffers();
@@ -264,7 +278,7 @@ static int loggerd_read(int fd){
 				logger_oper2string(msg.oper)
 			);
 	}
-	logger_internal_send_code(fd,ret,retdata);
+	logger_internal_send_code_version(fd,ret,retdata,ver);
 	return e;
 }
 
@@ -314,7 +328,8 @@ int loggerd_thread(int fd){
 	memset(evs,0,es*64);
 	add_fd(fd,false,NULL);
 	while(1){
-		r=epoll_wait(efd,evs,64,-1);
+		r=epoll_wait(efd,evs,64,file_logger_timeout());
+		if(r>=0)flush_all_file(false);
 		if(r==-1){
 			if(errno==EINTR)continue;
 			logger_internal_printf(
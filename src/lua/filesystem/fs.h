@@ -32,4 +32,5 @@ extern struct lua_fs_meta_table lua_fs_info;
 extern bool lua_fs_get_type(lua_State*L,int idx,bool nil,fs_type*type);
 extern bool lua_fs_get_flag(lua_State*L,int idx,bool nil,fs_file_flag*flag);
 extern bool lua_fs_get_feature(lua_State*L,int idx,bool nil,fs_feature*type);
+extern bool lua_fs_get_info_field(lua_State*L,int idx,bool nil,fs_info_field*field);
 #endif
@@ -34,6 +34,30 @@ static int lua_fsh_readdir(lua_State*L){
 	return 3;
 }
 
+static int lua_fsh_readdir_bulk(lua_State*L){
+	int r;
+	size_t got=0;
+	fs_file_info*infos;
+	fs_info_field fields=FS_INFO_FIELD_ALL;
+	GET_HANDLER(L,1,f);
+	if(!f->f)return luaL_argerror(L,1,"invalid fsh");
+	int64_t cnt=luaL_optinteger(L,2,64);
+	if(cnt<=0||cnt>4096)return luaL_argerror(L,2,"invalid count");
+	if(!lua_fs_get_info_field(L,3,true,&fields))return 0;
+	if(!(infos=malloc(sizeof(fs_file_info)*cnt)))
+		return luaL_error(L,"allocate infos failed");
+	r=fs_readdir_bulk(f->f,infos,cnt,&got,fields);
+	lua_pushboolean(L,r==0);
+	lua_pushinteger(L,r);
+	lua_createtable(L,got,0);
+	for(size_t i=0;i<got;i++){
+		lua_fs_file_info_to_lua(L,&infos[i]);
+		lua_rawseti(L,-2,i+1);
+	}
+	free(infos);
+	return 3;
+}
+
 static int lua_fsh_read_all(lua_State*L){
 	int r;
 	size_t size=0;
@@ -317,6 +341,7 @@ struct lua_fs_meta_table lua_fsh={
 		{"open",        lua_fsh_open},
 		{"exists",      lua_fsh_exists},
 		{"readdir",     lua_fsh_readdir},
+		{"readdir_bulk",lua_fsh_readdir_bulk},
 		{"read",        lua_fsh_read},
 		{"read_all",    lua_fsh_read_all},
 		{"full_read",   lua_fsh_full_read},
@@ -89,6 +89,7 @@ bool lua_fs_get_feature(lua_State*L,int idx,bool nil,fs_feature*feature){
 			else if(strcasecmp(str,"have-path")==0)*feature=FS_FEATURE_HAVE_PATH;
 			else if(strcasecmp(str,"have-time")==0)*feature=FS_FEATURE_HAVE_TIME;
 			else if(strcasecmp(str,"have-folder")==0)*feature=FS_FEATURE_HAVE_FOLDER;
+			else if(strcasecmp(str,"have-map")==0)*feature=FS_FEATURE_HAVE_MAP;
 			else{
 				luaL_argerror(L,idx,"unknown feature");
 				return false;
@@ -99,3 +100,27 @@ bool lua_fs_get_feature(lua_State*L,int idx,bool nil,fs_feature*feature){
 	}
 	return true;
 }
+
+bool lua_fs_get_info_field(lua_State*L,int idx,bool nil,fs_info_field*field){
+	switch(lua_type(L,idx)){
+		case LUA_TNUMBER:*field=luaL_checkinteger(L,idx);break;
+		case LUA_TSTRING:{
+			const char*str=luaL_checkstring(L,idx);
+			if(strcasecmp(str,"none")==0)*field=FS_INFO_FIELD_NONE;
+			else if(strcasecmp(str,"type")==0)*field=FS_INFO_FIELD_TYPE;
+			else if(strcasecmp(str,"size")==0)*field=FS_INFO_FIELD_SIZE;
+			else if(strcasecmp(str,"time")==0)*field=FS_INFO_FIELD_TIME;
+			else if(strcasecmp(str,"mode")==0)*field=FS_INFO_FIELD_MODE;
+			else if(strcasecmp(str,"device")==0)*field=FS_INFO_FIELD_DEVICE;
+			else if(strcasecmp(str,"target")==0)*field=FS_INFO_FIELD_TARGET;
+			else if(strcasecmp(str,"all")==0)*field=FS_INFO_FIELD_ALL;
+			else{
+				luaL_argerror(L,idx,"unknown field");
+				return false;
+			}
+		}break;
+		case LUA_TNIL:case LUA_TNONE:if(nil)break;//fallthrough
+		default:luaL_argerror(L,idx,"unknown field");return false;
+	}
+	return true;
+}
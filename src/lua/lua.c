@@ -145,6 +145,7 @@ static void xlua_run_conf(lua_State*L,char*tag,char*path){
 
 void xlua_run_confd(lua_State*L,char*tag,const char*key,...){
 	char path[PATH_MAX],**ks;
+	struct confd_cache*c;
 	va_list va;
 	va_start(va,key);
 	memset(path,0,sizeof(path));
@@ -152,12 +153,15 @@ void xlua_run_confd(lua_State*L,char*tag,const char*key,...){
 	va_end(va);
 	switch(confd_get_type(path)){
 		case TYPE_KEY:
-			if(!(ks=confd_ls(path)))return;
-			for(size_t i=0;ks[i];i++)xlua_run_conf(
-				L,tag,confd_get_string_base(path,ks[i],NULL)
-			);
-			if(ks[0])free(ks[0]);
-			free(ks);
+			if(!(c=confd_fetch_subtree(path)))return;
+			if((ks=confd_cache_ls(c,""))){
+				for(size_t i=0;ks[i];i++)xlua_run_conf(
+					L,tag,confd_cache_get_string(c,ks[i],NULL)
+				);
+				if(ks[0])free(ks[0]);
+				free(ks);
+			}
+			confd_cache_free(c);
 		break;
 		case TYPE_STRING:xlua_run_conf(
 			L,tag,confd_get_string(path,NULL)
@@ -20,42 +20,42 @@
 #include"defines.h"
 #define TAG "service"
 
-static bool svc_conf_parse_exec_cmd(const char*key,struct svc_exec*exec){
+static bool svc_conf_parse_exec_cmd(struct confd_cache*c,const char*key,struct svc_exec*exec){
 	char**array=NULL,**t;
 	if(!key||!exec)return false;
 	if(exec->exec.cmd.path)free(exec->exec.cmd.path);
 	if(exec->exec.cmd.args)array_free(exec->exec.cmd.args);
 	if(exec->exec.cmd.environ)array_free(exec->exec.cmd.environ);
 	exec->exec.cmd.path=NULL,exec->exec.cmd.args=NULL,exec->exec.cmd.environ=NULL;
-	if(confd_get_type_base(key,"path")==TYPE_STRING){
-		exec->exec.cmd.path=confd_get_string_base(key,"path",NULL);
-		if((t=confd_ls_base(key,"args"))){
+	if(confd_cache_get_type_base(c,key,"path")==TYPE_STRING){
+		exec->exec.cmd.path=confd_cache_get_string_base(c,key,"path",NULL);
+		if((t=confd_cache_ls_base(c,key,"args"))){
 			size_t size=sizeof(char*);
 			for(size_t i=0;t[i];i++)size+=sizeof(char*);
 			if(!(array=malloc(size)))EDONE(tlog_warn("alloc cmd args failed"));
 			memset(array,0,size);
 			for(size_t i=0;t[i];i++)
-				array[i]=confd_get_string_dict(key,"args",t[i],NULL);
+				array[i]=confd_cache_get_string_dict(c,key,"args",t[i],NULL);
 			if(t[0])free(t[0]);
 			free(t);
 		}
 		if(!array)EDONE(tlog_warn("invalid command arguments"));
 		exec->exec.cmd.args=array;
-	}else if(confd_get_type_base(key,"command")==TYPE_STRING){
-		char*cmd=confd_get_string_base(key,"command",NULL);
+	}else if(confd_cache_get_type_base(c,key,"command")==TYPE_STRING){
+		char*cmd=confd_cache_get_string_base(c,key,"command",NULL);
 		if(!(array=args2array(cmd,0))||!array[0])EDONE();
 		if((exec->exec.cmd.path=strdup(array[0])))
 			exec->exec.cmd.args=array_dup(array);
 		free_args_array(array);
 		if(!exec->exec.cmd.args)EDONE();
 	}else EDONE(tlog_warn("no command specified"));
-	if((t=confd_ls_base(key,"environ"))){
+	if((t=confd_cache_ls_base(c,key,"environ"))){
 		size_t size=sizeof(char*);
 		for(size_t i=0;t[i];i++)size+=sizeof(char*);
 		memset(array,0,size);
 		if(!(array=malloc(size)))EDONE(tlog_warn("alloc environ failed"));
 		for(size_t i=0;t[i];i++){
-			char*val=confd_get_string_dict(key,"environ",t[i],NULL);
+			char*val=confd_cache_get_string_dict(c,key,"environ",t[i],NULL);
 			if(!val)continue;
 			size_t len=strlen(t[i])+strlen(val)+4;
 			if(!(array[i]=malloc(len))){
@@ -79,6 +79,7 @@ static bool svc_conf_parse_exec_cmd(const char*key,struct svc_exec*exec){
 }
 
 static struct svc_exec*svc_conf_parse_exec(
+	struct confd_cache*c,
 	const char*base,
 	const char*path,
 	struct svc_exec**e,
@@ -92,8 +93,9 @@ static struct svc_exec*svc_conf_parse_exec(
 	memset(key,0,sizeof(key));
 	if(!svc)strncpy(rn,name,sizeof(rn)-1);
 	else snprintf(rn,sizeof(rn)-1,"%s %s",svc->name,name);
-	snprintf(key,sizeof(key)-1,"%s.%s",base,path);
-	switch(confd_get_type(key)){
+	if(!base[0])strncpy(key,path,sizeof(key)-1);
+	else snprintf(key,sizeof(key)-1,"%s.%s",base,path);
+	switch(confd_cache_get_type(c,key)){
 		case TYPE_KEY:break;
 		case TYPE_STRING:
 		case TYPE_INTEGER:
@@ -104,11 +106,11 @@ static struct svc_exec*svc_conf_parse_exec(
 	}
 	if(!(exec=svc_new_exec(rn)))EPRET(ENOMEM);
 	exec->prop.svc=svc;
-	exec->prop.uid=confd_get_integer_base(key,"uid",exec->prop.uid);
-	exec->prop.gid=confd_get_integer_base(key,"gid",exec->prop.gid);
-	exec->prop.timeout=confd_get_integer_base(key,"timeout",exec->prop.timeout);
-	if((t=confd_get_string_base(
-		key,"type",
+	exec->prop.uid=confd_cache_get_integer_base(c,key,"uid",exec->prop.uid);
+	exec->prop.gid=confd_cache_get_integer_base(c,key,"gid",exec->prop.gid);
+	exec->prop.timeout=confd_cache_get_integer_base(c,key,"timeout",exec->prop.timeout);
+	if((t=confd_cache_get_string_base(
+		c,key,"type",
 		(char*)svc_exec_type_short_string(exec->prop.type)
 	))){
 		bool b=short_string_svc_exec_type(t,&exec->prop.type);
@@ -117,7 +119,7 @@ static struct svc_exec*svc_conf_parse_exec(
 	}
 	switch(exec->prop.type){
 		case TYPE_COMMAND:
-			if(!svc_conf_parse_exec_cmd(key,exec))goto done;
+			if(!svc_conf_parse_exec_cmd(c,key,exec))goto done;
 		break;
 		default:EDONE(tlog_warn("unimplement exec type in config"));
 	}
@@ -131,18 +133,16 @@ static struct svc_exec*svc_conf_parse_exec(
 	return NULL;
 }
 
-struct service*svc_conf_parse_service(
-	const char*base,
+static struct service*svc_conf_parse_service_cache(
+	struct confd_cache*c,
+	const char*key,
 	const char*name,
 	struct service*s
 ){
-	char*t,key[4096],**cs;
+	char*t,**cs;
 	struct service*svc=s,*x;
 	enum svc_work work=WORK_UNKNOWN;
-	if(!base||!name)EPRET(EINVAL);
-	memset(key,0,sizeof(key));
-	snprintf(key,sizeof(key)-1,"%s.%s",base,name);
-	if((t=confd_get_string_base(key,"work",NULL))){
+	if((t=confd_cache_get_string_base(c,key,"work",NULL))){
 		bool b=short_string_svc_work(t,&work);
 		free(t);
 		if(!b)EDONE(tlog_warn(
@@ -161,26 +161,28 @@ struct service*svc_conf_parse_service(
 		if(work!=WORK_UNKNOWN)svc->mode=work;
 		work=svc->mode;
 	}
-	if((t=confd_get_string_base(key,"desc",NULL))){
+	if((t=confd_cache_get_string_base(c,key,"desc",NULL))){
 		if(svc->description)free(svc->description);
 		svc->description=t;
 	}
-	if((t=confd_get_string_base(key,"pid_file",NULL))){
+	if((t=confd_cache_get_string_base(c,key,"pid_file",NULL))){
 		if(svc->pid_file)free(svc->pid_file);
 		svc->pid_file=t;
 	}
-	svc->terminal_output_signal=confd_get_boolean_base(key,"termout_signal",svc->terminal_output_signal);
-	svc->stop_on_shutdown=confd_get_boolean_base(key,"stop_on_shutdown",svc->stop_on_shutdown);
-	svc->ignore_failed=confd_get_boolean_base(key,"ignore_failed",svc->ignore_failed);
-	svc->restart_delay=confd_get_boolean_base(key,"restart_delay",svc->restart_delay);
-	svc->auto_restart=confd_get_boolean_base(key,"auto_restart",svc->auto_restart);
-	svc->stdio_syslog=confd_get_boolean_base(key,"stdio_syslog",svc->stdio_syslog);
-	svc->restart_max=confd_get_boolean_base(key,"restart_max",svc->restart_max);
+	svc->terminal_output_signal=confd_cache_get_boolean_base(c,key,"termout_signal",svc->terminal_output_signal);
+	svc->stop_on_shutdown=confd_cache_get_boolean_base(c,key,"stop_on_shutdown",svc->stop_on_shutdown);
+	svc->ignore_failed=confd_cache_get_boolean_base(c,key,"ignore_failed",svc->ignore_failed);
+	svc->restart_delay=confd_cache_get_boolean_base(c,key,"restart_delay",svc->restart_delay);
+	svc->auto_restart=confd_cache_get_boolean_base(c,key,"auto_restart",svc->auto_restart);
+	svc->stdio_syslog=confd_cache_get_boolean_base(c,key,"stdio_syslog",svc->stdio_syslog);
+	svc->restart_max=confd_cache_get_boolean_base(c,key,"restart_max",svc->restart_max);
+	svc->notify=confd_cache_get_boolean_base(c,key,"notify",svc->notify);
+	svc->ready_timeout=confd_cache_get_integer_base(c,key,"ready_timeout",svc->ready_timeout);
 	if(work!=WORK_FAKE){
-		svc_conf_parse_exec(key,"restart",&svc->restart,svc,"restart");
-		svc_conf_parse_exec(key,"reload",&svc->reload,svc,"reload");
-		svc_conf_parse_exec(key,"start",&svc->start,svc,"start");
-		svc_conf_parse_exec(key,"stop",&svc->stop,svc,"stop");
+		svc_conf_parse_exec(c,key,"restart",&svc->restart,svc,"restart");
+		svc_conf_parse_exec(c,key,"reload",&svc->reload,svc,"reload");
+		svc_conf_parse_exec(c,key,"start",&svc->start,svc,"start");
+		svc_conf_parse_exec(c,key,"stop",&svc->stop,svc,"stop");
 		if(!svc->start)EDONE(tlog_warn("no start execute set"))
 		if(!svc->stop)svc_set_stop_function(svc,svc_default_stop);
 		if(!svc->reload)svc_set_reload_function(svc,svc_default_reload);
@@ -188,9 +190,9 @@ struct service*svc_conf_parse_service(
 	}
 	time(&svc->last_update);
 	MUTEX_UNLOCK(svc->lock);
-	if((cs=confd_ls_base(key,"depends_on"))){
+	if((cs=confd_cache_ls_base(c,key,"depends_on"))){
 		for(size_t i=0;cs[i];i++){
-			if(!(t=confd_get_string_dict(key,"depends_on",cs[i],NULL)))continue;
+			if(!(t=confd_cache_get_string_dict(c,key,"depends_on",cs[i],NULL)))continue;
 			if(!(x=svc_lookup_by_name(t)))tlog_warn("service %s not found",t);
 			else if(svc_add_depend(svc,x)!=0)tlog_warn("add depend %s failed",t);
 			free(t);
@@ -198,9 +200,9 @@ struct service*svc_conf_parse_service(
 		if(cs[0])free(cs[0]);
 		free(cs);
 	}
-	if((cs=confd_ls_base(key,"depends_of"))){
+	if((cs=confd_cache_ls_base(c,key,"depends_of"))){
 		for(size_t i=0;cs[i];i++){
-			if(!(t=confd_get_string_dict(key,"depends_of",cs[i],NULL)))continue;
+			if(!(t=confd_cache_get_string_dict(c,key,"depends_of",cs[i],NULL)))continue;
 			if(!(x=svc_lookup_by_name(t)))tlog_warn("service %s not found",t);
 			else if(svc_add_depend(x,svc)!=0)tlog_warn("add depend %s failed",t);
 			free(t);
@@ -216,12 +218,32 @@ struct service*svc_conf_parse_service(
 	return NULL;
 }
 
+struct service*svc_conf_parse_service(
+	const char*base,
+	const char*name,
+	struct service*s
+){
+	char key[4096];
+	struct service*svc;
+	struct confd_cache*c;
+	if(!base||!name)EPRET(EINVAL);
+	memset(key,0,sizeof(key));
+	snprintf(key,sizeof(key)-1,"%s.%s",base,name);
+	if(!(c=confd_fetch_subtree(key)))return NULL;
+	svc=svc_conf_parse_service_cache(c,"",name,s);
+	confd_cache_free(c);
+	return svc;
+}
+
 void svc_conf_parse_services(const char*base){
-	char**ss=confd_ls(base);
-	if(ss){
+	char**ss;
+	struct confd_cache*c=confd_fetch_subtree(base);
+	if(!c)return;
+	if((ss=confd_cache_ls(c,""))){
 		for(size_t i=0;ss[i];i++)
-			svc_conf_parse_service(base,ss[i],NULL);
+			svc_conf_parse_service_cache(c,ss[i],ss[i],NULL);
 		if(ss[0])free(ss[0]);
 		free(ss);
 	}
+	confd_cache_free(c);
 }
@@ -11,6 +11,7 @@
 #include<errno.h>
 #include<signal.h>
 #include<string.h>
+#include<unistd.h>
 #include"system.h"
 #include"logger.h"
 #include"service.h"
@@ -19,6 +20,10 @@
 #include"pathnames.h"
 #define TAG "service"
 
+// status polling backoff of restart in microseconds
+#define RESTART_POLL_MIN 10000
+#define RESTART_POLL_MAX 500000
+
 static int _get_pid(struct service*svc,pid_t*pid){
 	pid_t p=0;
 	char*name=svc_get_desc(svc);
@@ -40,34 +45,46 @@ int svc_default_stop(struct service*svc){
 	pid_t p=0;
 	char*name=svc_get_desc(svc);
 	if(_get_pid(svc,&p)<0)return -errno;
-	kill(p,SIGTERM);
-	time_t t=svc->stop->prop.timeout/3*2;
+	// pin the process before signal it, so a reused pid is never killed
+	int fd=svc_pidfd_open(p);
+	if(fd<0&&errno==ESRCH)return 0;
+	svc_pidfd_kill(fd,p,SIGTERM);
+	long t=svc->stop->prop.timeout*2000/3;
 	tlog_notice("try to stopping %s",name);
-	for(int i=0;i<t;i++){
-		if(!is_file(_PATH_PROC"/%d/comm",p))return 0;
-		xsleep(1);
+	if(svc_pidfd_wait(fd,p,t)!=0){
+		tlog_notice("try to kill %s",name);
+		svc_pidfd_kill(fd,p,SIGKILL);
+		svc_pidfd_wait(fd,p,-1);
 	}
-	tlog_notice("try to kill %s",name);
-	kill(p,SIGKILL);
-	while(is_file(_PATH_PROC"/%d/comm",p))xsleep(1);
+	if(fd>=0)close(fd);
 	return 0;
 }
 
 int svc_default_restart(struct service*svc){
+	pid_t p=0;
+	int fd=-1;
+	useconds_t delay=RESTART_POLL_MIN;
 	open_socket_initfd(DEFAULT_INITD,true);
 	struct init_msg msg,response;
+	if(_get_pid(svc,&p)==0)fd=svc_pidfd_open(p);
 	tlog_notice("try to stopping service %s",svc_get_desc(svc));
 	init_initialize_msg(&msg,ACTION_SVC_STOP);
 	strcpy(msg.data.data,svc->name);
 	init_send(&msg,&response);
 	tlog_debug("wait service %s stopped",svc_get_desc(svc));
+	// status changes right after the process exits, poll only for the tail
+	if(fd>=0){
+		svc_pidfd_wait(fd,p,-1);
+		close(fd);
+	}
 	for(;;){
 		init_initialize_msg(&msg,ACTION_SVC_STATUS);
 		strcpy(msg.data.data,svc->name);
 		init_send(&msg,&response);
 		enum svc_status st=response.data.svc_status;
 		if(st==STATUS_STOPPED||st==STATUS_FAILED)break;
-		sleep(1);
+		usleep(delay);
+		delay=MIN(delay*2,RESTART_POLL_MAX);
 	}
 	tlog_notice("try to starting %s",svc_get_desc(svc));
 	init_initialize_msg(&msg,ACTION_SVC_START);
@@ -11,6 +11,7 @@
 #include"logger.h"
 #include"service.h"
 #include"defines.h"
+#include"trace.h"
 #define TAG "service"
 
 static int _svc_proc_status_dump(int ident,struct proc_status*status){
@@ -102,6 +103,9 @@ static int _svc_dump(int ident,struct service*svc){
 	tlog_debug("%s    auto restart:     %s",     prefix,BOOL2STR(svc->auto_restart));
 	tlog_debug("%s    ignore failed:    %s",     prefix,BOOL2STR(svc->ignore_failed));
 	tlog_debug("%s    stdio to syslog:  %s",     prefix,BOOL2STR(svc->stdio_syslog));
+	tlog_debug("%s    ready notify:     %s",     prefix,BOOL2STR(svc->notify));
+	if(svc->notify)tlog_debug("%s    ready timeout:    %ld",    prefix,svc->ready_timeout);
+	if(svc->notify_status)tlog_debug("%s    notify status:    %s",     prefix,svc->notify_status);
 	if(svc->restart_delay>0)tlog_debug("%s    restart delay:    %ld",    prefix,svc->restart_delay);
 	tlog_debug("%s    restart retry:    %d/%d",  prefix,svc->retry,svc->restart_max);
 	if(svc->pid_file)tlog_debug("%s    pid file:         %s",     prefix,svc->pid_file);
@@ -175,3 +179,59 @@ int svc_list_dump(list*svcs){
 int svc_dump_services(){
 	return svc_list_dump(services);
 }
+
+#define MS(t) (unsigned long long)((t)/1000000),(unsigned long long)((t)/1000%1000)
+#define PATH_MAX_DEPTH 64
+
+static struct trace_event*svc_span(struct service*svc){
+	struct trace_event*e=trace_lookup("service",svc->name);
+	return e&&e->end>0?e:NULL;
+}
+
+// the depend finished last is the one released svc
+static struct service*svc_critical_depend(struct service*svc,struct trace_event**span){
+	list*p;
+	struct service*r=NULL;
+	struct trace_event*e;
+	*span=NULL;
+	if((p=list_first(svc->depends_on)))do{
+		LIST_DATA_DECLARE(d,p,struct service*);
+		if(!d||!(e=svc_span(d)))continue;
+		if(!*span||e->end>(*span)->end)r=d,*span=e;
+	}while((p=p->next));
+	return r;
+}
+
+int svc_dump_critical_path(){
+	int n=0;
+	list*p;
+	uint64_t prev;
+	struct service*chain[PATH_MAX_DEPTH],*svc=NULL;
+	struct trace_event*spans[PATH_MAX_DEPTH],*e,*last=NULL;
+	if(!trace)ERET(ENODATA);
+	if((p=list_first(services)))do{
+		LIST_DATA_DECLARE(s,p,struct service*);
+		if(!s||!(e=svc_span(s)))continue;
+		if(!last||e->end>last->end)svc=s,last=e;
+	}while((p=p->next));
+	if(!svc){
+		tlog_info("no service in boot timeline");
+		ERET(ENOENT);
+	}
+	for(e=last;svc&&n<PATH_MAX_DEPTH;svc=svc_critical_depend(svc,&e))
+		chain[n]=svc,spans[n++]=e;
+	tlog_info(
+		"service critical path (%d services, ready at +%llu.%03llums):",
+		n,MS(last->end-MIN(last->end,trace->base))
+	);
+	for(prev=trace->base;n>0;prev=e->end){
+		e=spans[--n];
+		tlog_info(
+			"  %s: wait %llu.%03llums, start %llu.%03llums",
+			svc_get_desc(chain[n]),
+			MS(e->begin-MIN(e->begin,prev)),
+			MS(e->end-e->begin)
+		);
+	}
+	return 0;
+}
@@ -59,6 +59,25 @@ static bool init_stdio(struct svc_exec*exec){
 	return true;
 }
 
+// append NOTIFY_SOCKET for start of a readiness notify service
+static char**notify_environ(struct svc_exec*exec,char**env){
+	static char buff[256];
+	size_t i=0;
+	char**n;
+	struct service*svc=exec->prop.svc;
+	if(!svc->notify||exec!=svc->start)return env?:environ;
+	if(svc_notify_env(svc,buff,sizeof(buff))!=0)return env?:environ;
+	if(!env){
+		putenv(buff);
+		return environ;
+	}
+	while(env[i])i++;
+	if(!(n=malloc(sizeof(char*)*(i+2))))return env;
+	memcpy(n,env,sizeof(char*)*i);
+	n[i]=buff,n[i+1]=NULL;
+	return n;
+}
+
 static void _run_exec_child(struct svc_exec*exec,int fd){
 	int r=0;
 	close_all_fd((int[]){fd},1);
@@ -82,6 +101,7 @@ static void _run_exec_child(struct svc_exec*exec,int fd){
 			reset_signals();
 			set_confd_socket(-1);
 			open_socket_logfd_default();
+			notify_environ(exec,NULL);
 			r=exec->exec.func(exec->prop.svc);
 			MUTEX_DESTROY(services_lock);
 			svc_free_all_services(services);
@@ -96,7 +116,7 @@ static void _run_exec_child(struct svc_exec*exec,int fd){
 			execvpe(
 				exec->exec.cmd.path,
 				exec->exec.cmd.args,
-				exec->exec.cmd.environ?:environ
+				notify_environ(exec,exec->exec.cmd.environ)
 			);
 			fprintf(stderr,"execute %s failed",exec->exec.cmd.path);
 			fputs(errno==0?".\n":strerror(errno),stderr);
@@ -187,6 +207,21 @@ int svc_check_exec_timeout(struct svc_exec*exec){
 	return 0;
 }
 
+// the time svc_check_exec_timeout will act on exec, 0 for none
+time_t svc_exec_deadline(struct svc_exec*exec){
+	if(!exec||!exec->prop.svc)return 0;
+	struct service*svc=exec->prop.svc;
+	if(
+		exec->prop.timeout<=0||
+		!exec->status.running||
+		exec->status.pid<=0||(
+			svc->status!=STATUS_STOPPING&&
+			svc->status!=STATUS_STARTING
+		)
+	)return 0;
+	return exec->status.active+exec->prop.timeout;
+}
+
 int svc_check_all_exec_timeout(){
 	list*cur,*next=list_first(services);
 	if(next)do{
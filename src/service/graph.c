@@ -0,0 +1,240 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<errno.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<pthread.h>
+#include"lock.h"
+#include"pool.h"
+#include"list.h"
+#include"logger.h"
+#include"defines.h"
+#include"trace.h"
+#include"service.h"
+#include"service_scheduler.h"
+#define TAG "service"
+
+static mutex_t ready_lock;
+// services are never built for UEFI, so mutex_t is a pthread mutex for the cond
+static pthread_cond_t ready_cond=PTHREAD_COND_INITIALIZER;
+static pthread_once_t ready_once=PTHREAD_ONCE_INIT;
+static void ready_lock_init(void){MUTEX_INIT(ready_lock);}
+#define READY_LOCK() do{pthread_once(&ready_once,ready_lock_init);MUTEX_LOCK(ready_lock);}while(0)
+static unsigned long serial=0;
+
+bool svc_is_ready(struct service*svc){
+	if(!svc)return false;
+	switch(svc->status){
+		case STATUS_STARTED:
+		case STATUS_RUNNING:return true;
+		default:return false;
+	}
+}
+
+static void graph_loop(list*path,struct service*svc){
+	list*p;
+	size_t l=0;
+	char buff[512];
+	memset(buff,0,sizeof(buff));
+	if((p=list_lookup_data(list_first(path),svc)))do{
+		l+=snprintf(
+			buff+l,sizeof(buff)-l,"%s -> ",
+			svc_get_desc(LIST_DATA(p,struct service*))
+		);
+		if(l>=sizeof(buff))l=sizeof(buff)-1;
+	}while((p=p->next));
+	snprintf(buff+l,sizeof(buff)-l,"%s",svc_get_desc(svc));
+	tlog_error("Depends chain loop detect: %s",buff);
+}
+
+static int graph_walk(struct service*svc,list**path,list**done,list**order){
+	list*p;
+	if(list_lookup_data(list_first(*done),svc))return 0;
+	if(list_lookup_data(list_first(*path),svc)){
+		graph_loop(*path,svc);
+		ERET(ELOOP);
+	}
+	if(list_obj_add_new(path,svc)!=0)return -1;
+	if((p=list_first(svc->depends_on)))do{
+		if(!p->data)continue;
+		if(graph_walk(LIST_DATA(p,struct service*),path,done,order)!=0)return -1;
+	}while((p=p->next));
+	list_obj_del_data(path,svc,NULL);
+	if(list_obj_add_new(done,svc)!=0)return -1;
+	return list_obj_add_new(order,svc);
+}
+
+int svc_graph_order(struct service*svc,list**order){
+	int r;
+	list*path=NULL,*done=NULL;
+	if(!svc||!order)ERET(EINVAL);
+	*order=NULL;
+	r=graph_walk(svc,&path,&done,order);
+	if(r!=0&&*order){
+		list_free_all(*order,NULL);
+		*order=NULL;
+	}
+	if(path)list_free_all(path,NULL);
+	if(done)list_free_all(done,NULL);
+	return r;
+}
+
+// called with queue_lock held
+static struct scheduler_work*graph_lookup(struct service*svc){
+	list*p;
+	if((p=list_first(queue)))do{
+		LIST_DATA_DECLARE(w,p,struct scheduler_work*);
+		if(w&&w->service==svc)return w;
+	}while((p=p->next));
+	return NULL;
+}
+
+// called with queue_lock held
+void svc_graph_dispatch(struct scheduler_work*w){
+	if(!w||w->dispatched||w->pending>0)return;
+	w->dispatched=true,w->begin=trace_now();
+	if(pool_add(service_workers,scheduler_worker,w)!=0)
+		w->dispatched=false;
+}
+
+int svc_graph_start(struct service*svc){
+	list*order=NULL,*p,*d,*added=NULL;
+	struct scheduler_work*w,*dw;
+	if(!svc)ERET(EINVAL);
+	if(svc_graph_order(svc,&order)!=0)return -1;
+	MUTEX_LOCK(queue_lock);
+	if((p=list_first(order)))do{
+		LIST_DATA_DECLARE(s,p,struct service*);
+		if(graph_lookup(s)||svc_is_ready(s))continue;
+		if(!(w=malloc(sizeof(struct scheduler_work)))){
+			telog_error("failed to create work");
+			break;
+		}
+		memset(w,0,sizeof(struct scheduler_work));
+		w->service=s,w->action=SCHED_START;
+		switch(s->status){
+			// started elsewhere, only hold dependents until it is ready
+			case STATUS_STARTING:w->dispatched=w->waiting=true;break;
+			// start again once the stop finished
+			case STATUS_STOPPING:w->dispatched=w->waiting=w->restart=true;break;
+			default:;
+		}
+		if(list_obj_add_new_notnull(&queue,w)<0){
+			free(w);
+			telog_error("add work to queue failed");
+			break;
+		}
+		if((w->restart||!w->waiting)&&(d=list_first(s->depends_on)))do{
+			if(!d->data)continue;
+			dw=graph_lookup(LIST_DATA(d,struct service*));
+			if(!dw||dw==w||dw->action!=SCHED_START)continue;
+			if(list_obj_add_new(&dw->dependents,w)==0)w->pending++;
+		}while((d=d->next));
+		list_obj_add_new(&added,w);
+	}while((p=p->next));
+	if((p=list_first(added)))do{
+		svc_graph_dispatch(LIST_DATA(p,struct scheduler_work*));
+	}while((p=p->next));
+	MUTEX_UNLOCK(queue_lock);
+	if(added)list_free_all(added,NULL);
+	list_free_all(order,NULL);
+	return 0;
+}
+
+// called with queue_lock held, after the start of w finished
+void svc_graph_done(struct scheduler_work*w){
+	list*p;
+	bool failed;
+	if(!w)return;
+	failed=w->service->status==STATUS_FAILED;
+	// span from dispatch to ready, used by critical path
+	if(w->begin>0)trace_span(w->begin,trace_now(),"service","%s",w->service->name);
+	if((p=list_first(w->dependents)))do{
+		LIST_DATA_DECLARE(d,p,struct scheduler_work*);
+		if(!d)continue;
+		if(failed&&!d->failed_dep)d->failed_dep=w->service;
+		if(d->pending>0&&--d->pending==0)svc_graph_dispatch(d);
+	}while((p=p->next));
+	if(w->dependents)list_free_all(w->dependents,NULL);
+	w->dependents=NULL;
+}
+
+// release start works whose service left starting status
+void svc_graph_update(void){
+	list*cur,*next;
+	MUTEX_LOCK(queue_lock);
+	if((next=list_first(queue)))do{
+		cur=next,next=cur->next;
+		LIST_DATA_DECLARE(w,cur,struct scheduler_work*);
+		if(!w||!w->waiting)continue;
+		switch(w->service->status){
+			case STATUS_STARTING:continue;
+			case STATUS_STOPPING:if(w->restart)continue;break;
+			default:;
+		}
+		if(w->restart){
+			w->restart=w->waiting=w->dispatched=false;
+			svc_graph_dispatch(w);
+			continue;
+		}
+		svc_graph_done(w);
+		list_obj_del(&queue,cur,free_scheduler_work);
+	}while(next);
+	MUTEX_UNLOCK(queue_lock);
+	READY_LOCK();
+	serial++;
+	pthread_cond_broadcast(&ready_cond);
+	MUTEX_UNLOCK(ready_lock);
+}
+
+unsigned long svc_state_serial(void){
+	READY_LOCK();
+	unsigned long r=serial;
+	MUTEX_UNLOCK(ready_lock);
+	return r;
+}
+
+// wait until scheduler handled any event after serial was taken
+int svc_wait_state(unsigned long*since,struct timespec*deadline){
+	int r=0;
+	if(!since)ERET(EINVAL);
+	READY_LOCK();
+	while(r==0&&*since==serial)r=deadline?
+		pthread_cond_timedwait(&ready_cond,&ready_lock,deadline):
+		pthread_cond_wait(&ready_cond,&ready_lock);
+	*since=serial;
+	MUTEX_UNLOCK(ready_lock);
+	if(r!=0)ERET(r);
+	return 0;
+}
+
+int svc_wait_ready(struct service*svc){
+	unsigned long since;
+	enum svc_status st;
+	struct timespec ts;
+	if(!svc)ERET(EINVAL);
+	for(;;){
+		// take serial first, a change after reading status still wakes us
+		since=svc_state_serial();
+		MUTEX_LOCK(svc->lock);
+		st=svc->status;
+		MUTEX_UNLOCK(svc->lock);
+		if(st!=STATUS_STARTING)break;
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_sec++;
+		svc_wait_state(&since,&ts);
+	}
+	switch(st){
+		case STATUS_STARTED:
+		case STATUS_RUNNING:return 0;
+		default:ERET(st==STATUS_FAILED?EIO:ESRCH);
+	}
+}
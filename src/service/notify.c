@@ -0,0 +1,195 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<errno.h>
+#include<stdio.h>
+#include<stddef.h>
+#include<signal.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/un.h>
+#include<sys/socket.h>
+#include"str.h"
+#include"lock.h"
+#include"confd.h"
+#include"logger.h"
+#include"service.h"
+#include"system.h"
+#include"defines.h"
+#include"pathnames.h"
+#include"service_scheduler.h"
+#define TAG "service"
+
+// abstract socket name, NOTIFY_SOCKET uses a leading @ for the NUL
+static socklen_t notify_addr(struct service*svc,struct sockaddr_un*addr){
+	memset(addr,0,sizeof(struct sockaddr_un));
+	addr->sun_family=AF_UNIX;
+	int r=snprintf(
+		addr->sun_path+1,sizeof(addr->sun_path)-1,
+		"initd/notify/%s",svc->name
+	);
+	if(r<0||(size_t)r>=sizeof(addr->sun_path)-1)return 0;
+	return offsetof(struct sockaddr_un,sun_path)+1+r;
+}
+
+int svc_notify_env(struct service*svc,char*buff,size_t len){
+	struct sockaddr_un addr;
+	socklen_t l;
+	if(!svc||!buff||len<=0)ERET(EINVAL);
+	if(!(l=notify_addr(svc,&addr)))ERET(ENAMETOOLONG);
+	snprintf(buff,len,"NOTIFY_SOCKET=@%s",addr.sun_path+1);
+	return 0;
+}
+
+int svc_notify_open(struct service*svc){
+	int fd,on=1;
+	socklen_t l;
+	struct sockaddr_un addr;
+	if(!svc)ERET(EINVAL);
+	svc_notify_close(svc);
+	svc->ready=false;
+	svc->ready_deadline=0;
+	if(!(l=notify_addr(svc,&addr)))ERET(ENAMETOOLONG);
+	if((fd=socket(AF_UNIX,SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK,0))<0)
+		return terlog_warn(-errno,"create notify socket for %s failed",svc_get_desc(svc));
+	setsockopt(fd,SOL_SOCKET,SO_PASSCRED,&on,sizeof(on));
+	if(bind(fd,(struct sockaddr*)&addr,l)<0){
+		close(fd);
+		return terlog_warn(-errno,"bind notify socket for %s failed",svc_get_desc(svc));
+	}
+	if(svc->ready_timeout>0)svc->ready_deadline=time(NULL)+svc->ready_timeout;
+	svc->notify_fd=fd;
+	oper_scheduler(&(struct scheduler_msg){.action=SCHED_DONE});
+	return 0;
+}
+
+void svc_notify_close(struct service*svc){
+	if(!svc||svc->notify_fd<0)return;
+	close(svc->notify_fd);
+	svc->notify_fd=-1;
+}
+
+// called with svc->lock held
+static void notify_ready(struct service*svc){
+	svc->ready=true,svc->ready_deadline=0;
+	if(svc->status!=STATUS_STARTING)return;
+	if(svc->process.pid<=0||!svc->process.running)return;
+	svc->status=STATUS_RUNNING;
+	tlog_notice("Started service %s",svc_get_desc(svc));
+}
+
+// walk parents of pid, true if root is one of them
+static bool is_descendant(pid_t pid,pid_t root){
+	char buff[512],*p,state;
+	pid_t ppid=0;
+	if(root<=0)return false;
+	for(int i=0;i<64&&pid>1;i++,pid=ppid){
+		if(pid==root)return true;
+		if(read_file(buff,sizeof(buff),false,_PATH_PROC"/%d/stat",pid)<=0)return false;
+		if(!(p=strrchr(buff,')'))||sscanf(p+1," %c %d",&state,&ppid)!=2)return false;
+	}
+	return false;
+}
+
+// only root, the new main process itself or its service tree may set MAINPID
+static bool mainpid_allowed(struct service*svc,struct ucred*cred,pid_t pid){
+	if(cred->uid==0||cred->pid==pid)return true;
+	if(svc->process.running&&is_descendant(pid,svc->process.pid))return true;
+	if(svc->start&&is_descendant(pid,svc->start->status.pid))return true;
+	return false;
+}
+
+// called with svc->lock held
+static void notify_line(struct service*svc,struct ucred*cred,char*line){
+	char*val;
+	pid_t pid;
+	if(!(val=strchr(line,'=')))return;
+	*val++=0;
+	if(strcmp(line,"READY")==0&&strcmp(val,"1")==0)notify_ready(svc);
+	else if(strcmp(line,"STATUS")==0){
+		if(svc->notify_status)free(svc->notify_status);
+		svc->notify_status=strdup(val);
+		tlog_debug("service %s status: %s",svc_get_desc(svc),val);
+	}else if(strcmp(line,"MAINPID")==0&&(pid=parse_int(val,0))>0){
+		if(svc->process.pid==pid)return;
+		if(svc->start&&svc->start->status.pid==pid)return;
+		if(!mainpid_allowed(svc,cred,pid)){
+			tlog_warn(
+				"reject MAINPID %d of service %s from pid %d",
+				pid,svc_get_desc(svc),cred->pid
+			);
+			return;
+		}
+		if(svc_track_process(svc,pid)!=0){
+			tlog_warn("MAINPID %d of service %s not found",pid,svc_get_desc(svc));
+			return;
+		}
+		svc->process.pid=pid;
+		svc->process.running=true;
+		time(&svc->process.start);
+		svc->process.active=svc->process.start;
+		confd_set_integer_base("runtime.pid",svc->name,pid);
+		if(svc->ready)notify_ready(svc);
+	}
+}
+
+int svc_notify_read(struct service*svc){
+	ssize_t s;
+	char buff[4096],*p,*n;
+	char cmsg[CMSG_SPACE(sizeof(struct ucred))];
+	struct ucred*cred;
+	struct cmsghdr*c;
+	struct iovec iov={buff,sizeof(buff)-1};
+	struct msghdr msg={
+		.msg_iov=&iov,.msg_iovlen=1,
+		.msg_control=cmsg,.msg_controllen=sizeof(cmsg),
+	};
+	if(!svc||svc->notify_fd<0)ERET(EINVAL);
+	while((s=recvmsg(svc->notify_fd,&msg,MSG_DONTWAIT|MSG_CMSG_CLOEXEC))>=0){
+		cred=NULL;
+		for(c=CMSG_FIRSTHDR(&msg);c;c=CMSG_NXTHDR(&msg,c))
+			if(c->cmsg_level==SOL_SOCKET&&c->cmsg_type==SCM_CREDENTIALS)
+				cred=(struct ucred*)CMSG_DATA(c);
+		if(!cred||(cred->uid!=0&&(!svc->start||cred->uid!=svc->start->prop.uid))){
+			tlog_warn("drop notify message for %s from unknown sender",svc_get_desc(svc));
+		}else{
+			buff[s]=0;
+			MUTEX_LOCK(svc->lock);
+			for(p=buff;p&&*p;p=n){
+				if((n=strchr(p,'\n')))*n++=0;
+				notify_line(svc,cred,p);
+			}
+			MUTEX_UNLOCK(svc->lock);
+		}
+		msg.msg_controllen=sizeof(cmsg);
+	}
+	return errno==EAGAIN||errno==EWOULDBLOCK?0:-errno;
+}
+
+void svc_notify_check_timeout(struct service*svc){
+	time_t now;
+	if(!svc||svc->ready_deadline<=0)return;
+	MUTEX_LOCK(svc->lock);
+	if(svc->status!=STATUS_STARTING||svc->ready){
+		svc->ready_deadline=0;
+		MUTEX_UNLOCK(svc->lock);
+		return;
+	}
+	if(time(&now)<svc->ready_deadline){
+		MUTEX_UNLOCK(svc->lock);
+		return;
+	}
+	tlog_warn("Service %s ready timeout",svc_get_desc(svc));
+	svc->ready_deadline=0;
+	svc->status=STATUS_FAILED;
+	if(svc->process.running&&svc->process.pid>0)kill(svc->process.pid,SIGTERM);
+	else if(svc->start&&svc->start->status.running)kill(svc->start->status.pid,SIGTERM);
+	MUTEX_UNLOCK(svc->lock);
+}
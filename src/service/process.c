@@ -0,0 +1,86 @@
+/*
+ *
+ * Copyright (C) 2021 BigfootACA <bigfoot@classfun.cn>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ *
+ */
+
+#define _GNU_SOURCE
+#include<time.h>
+#include<poll.h>
+#include<limits.h>
+#include<errno.h>
+#include<signal.h>
+#include<unistd.h>
+#include<sys/syscall.h>
+#include"system.h"
+#include"logger.h"
+#include"service.h"
+#include"defines.h"
+#include"pathnames.h"
+#define TAG "service"
+
+// step of /proc polling when kernel has no pidfd
+#define PROC_POLL_MS 20
+
+static bool no_pidfd=false;
+
+int svc_pidfd_open(pid_t pid){
+	int fd=-1;
+	if(pid<=0)ERET(EINVAL);
+	if(no_pidfd)ERET(ENOSYS);
+	#ifdef SYS_pidfd_open
+	if((fd=syscall(SYS_pidfd_open,pid,0))<0&&errno==ENOSYS)no_pidfd=true;
+	#else
+	no_pidfd=true,errno=ENOSYS;
+	#endif
+	return fd;
+}
+
+int svc_pidfd_kill(int fd,pid_t pid,int sig){
+	#ifdef SYS_pidfd_send_signal
+	if(fd>=0)return syscall(SYS_pidfd_send_signal,fd,sig,NULL,0);
+	#endif
+	return kill(pid,sig);
+}
+
+static long now_ms(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+int svc_pidfd_wait(int fd,pid_t pid,long timeout){
+	int r;
+	long end=timeout<0?0:now_ms()+timeout,left=timeout;
+	struct pollfd p={.fd=fd,.events=POLLIN};
+	if(fd>=0)for(;;){
+		if((r=poll(&p,1,(int)MIN(left,(long)INT_MAX)))>0)return 0;
+		if(r<0&&errno!=EINTR)return -errno;
+		if(timeout>=0&&(left=end-now_ms())<=0)ERET(ETIMEDOUT);
+	}
+	while(is_file(_PATH_PROC"/%d/comm",pid)){
+		if(timeout>=0&&(left=end-now_ms())<=0)ERET(ETIMEDOUT);
+		usleep(MIN(left<0?PROC_POLL_MS:left,PROC_POLL_MS)*1000);
+	}
+	return 0;
+}
+
+int svc_track_process(struct service*svc,pid_t pid){
+	int fd;
+	if(!svc||pid<=0)ERET(EINVAL);
+	svc_untrack_process(svc);
+	if((fd=svc_pidfd_open(pid))>=0){
+		svc->pidfd=fd;
+		return 0;
+	}
+	if(errno==ENOSYS&&is_file(_PATH_PROC"/%d/comm",pid))return 0;
+	ERET(errno==ENOSYS?ESRCH:errno);
+}
+
+void svc_untrack_process(struct service*svc){
+	if(!svc||svc->pidfd<0)return;
+	close(svc->pidfd);
+	svc->pidfd=-1;
+}
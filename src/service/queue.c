@@ -8,6 +8,7 @@
 
 #include<errno.h>
 #include<stdlib.h>
+#include<string.h>
 #include<stdbool.h>
 #include"lock.h"
 #include"pool.h"
@@ -39,6 +40,7 @@ int add_queue(struct service*svc,enum scheduler_action act){
 		}break;
 		default:;
 	}
+	if(act==SCHED_START)return svc_graph_start(svc);
 	MUTEX_LOCK(queue_lock);
 	if(!(next=list_first(queue)))goto unlock;
 	else do{
@@ -55,6 +57,7 @@ int add_queue(struct service*svc,enum scheduler_action act){
 		telog_error("failed to create work");
 		goto unlock;
 	}
+	memset(work,0,sizeof(struct scheduler_work));
 	work->service=svc,work->action=act;
 	if(list_obj_add_new_notnull(&queue,work)<0){
 		free(work);
@@ -64,15 +67,6 @@ int add_queue(struct service*svc,enum scheduler_action act){
 	MUTEX_UNLOCK(queue_lock);
 	int e=0;
 	switch(work->action){
-		case SCHED_START:
-			if(!svc->depends_on||!(next=list_first(svc->depends_on)))break;
-			do{
-				cur=next;
-				if(!cur->data)continue;
-				LIST_DATA_DECLARE(s,cur,struct service*);
-				if(add_queue(s,act)!=0)e=errno;
-			}while((next=cur->next));
-		break;
 		case SCHED_STOP:
 			if(!svc->depends_of||!(next=list_first(svc->depends_of)))break;
 			do{
@@ -99,21 +93,7 @@ static bool task_can_run(struct scheduler_work*w){
 		default:;
 	}
 	switch(w->action){
-		case SCHED_START:
-			if(!w->service->depends_on)return true;
-			if(!(next=list_first(w->service->depends_on)))return false;
-			do{
-				cur=next;
-				if(!cur->data)continue;
-				switch(((struct service*)cur->data)->status){
-					case STATUS_STOPPED:
-					case STATUS_FAILED:
-					case STATUS_STOPPING:
-					case STATUS_STARTING:return false;
-					default:;
-				}
-			}while((next=cur->next));
-			break;
+		case SCHED_START:return w->pending==0;
 		case SCHED_STOP:
 			if(!w->service->depends_of)return true;
 			if(!(next=list_first(w->service->depends_of)))return false;
@@ -135,6 +115,7 @@ static bool task_can_run(struct scheduler_work*w){
 
 int run_queue(){
 	list*cur,*next;
+	svc_graph_update();
 	MUTEX_LOCK(queue_lock);
 	if(!(next=list_first(queue))){
 		MUTEX_UNLOCK(queue_lock);
@@ -142,7 +123,9 @@ int run_queue(){
 	}else do{
 		cur=next;
 		LIST_DATA_DECLARE(w,cur,struct scheduler_work*);
-		if(task_can_run(w))pool_add(service_workers,scheduler_worker,w);
+		if(!w||w->dispatched||!task_can_run(w))continue;
+		if(w->action==SCHED_START)svc_graph_dispatch(w);
+		else if(pool_add(service_workers,scheduler_worker,w)==0)w->dispatched=true;
 	}while((next=cur->next));
 	MUTEX_UNLOCK(queue_lock);
 	return 0;
@@ -157,8 +140,12 @@ int add_all_stop_queue(){
 	}else do{
 		cur=next,next=cur->next;
 		LIST_DATA_DECLARE(w,cur,struct scheduler_work*);
-		if(!w)continue;
-		if(w->action!=SCHED_STOP)list_obj_del(&queue,cur,free_scheduler_work);
+		if(!w||w->action==SCHED_STOP)continue;
+		if(w->dependents)list_free_all(w->dependents,NULL);
+		w->dependents=NULL;
+		// do not start again a service waiting for its stop
+		w->restart=false;
+		if(!w->dispatched)list_obj_del(&queue,cur,free_scheduler_work);
 	}while(next);
 	MUTEX_UNLOCK(queue_lock);
 	if((next=list_first(services)))do{
@@ -7,13 +7,18 @@
  */
 
 #define _GNU_SOURCE
+#include<errno.h>
+#include<fcntl.h>
 #include<signal.h>
 #include<stdlib.h>
 #include<string.h>
+#include<unistd.h>
 #include<pthread.h>
+#include<sys/wait.h>
 #include<sys/prctl.h>
+#include<sys/epoll.h>
 #include<sys/socket.h>
-#include<sys/select.h>
+#include<sys/timerfd.h>
 #include"pool.h"
 #include"lock.h"
 #include"list.h"
@@ -23,6 +28,25 @@
 #include"service_scheduler.h"
 #define TAG "service"
 #define NAME "Service Scheduler"
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+enum source_type{
+	SOURCE_COMMAND,
+	SOURCE_TIMER,
+	SOURCE_NOTIFY,
+	SOURCE_PROCESS,
+};
+
+// a file descriptor watched by scheduler epoll
+struct source{
+	enum source_type type;
+	int fd;
+	pid_t pid;
+	bool seen;
+	struct service*svc;
+};
 
 struct pool*service_workers=NULL;
 mutex_t queue_lock;
@@ -30,26 +54,26 @@ list*queue=NULL;
 static pthread_t scheduler;
 static mutex_t lock;
 static int fds[2];
+static int efd=-1;
+static time_t last_tick=0;
+static list*sources=NULL;
+static struct source command={.type=SOURCE_COMMAND,.fd=-1};
+static struct source timer={.type=SOURCE_TIMER,.fd=-1};
 
 int free_scheduler_work(void*d){
-	if(d)free((struct scheduler_work*)d);
+	struct scheduler_work*w=d;
+	if(!w)return 0;
+	if(w->dependents)list_free_all(w->dependents,NULL);
+	free(w);
 	return 0;
 }
 
 void*scheduler_worker(void*data){
 	if(!data)return NULL;
-	bool found=false;
-	list*cur,*next;
+	bool found;
 	struct scheduler_work*w=(struct scheduler_work*)data;
 	MUTEX_LOCK(queue_lock);
-	if((next=list_first(queue)))do{
-		cur=next,next=cur->next;
-		LIST_DATA_DECLARE(s,cur,struct scheduler_work*);
-		if(s==w){
-			list_obj_del(&queue,cur,NULL);
-			found=true;
-		}
-	}while(next);
+	found=list_lookup_data(queue,w)!=NULL;
 	MUTEX_UNLOCK(queue_lock);
 	if(!found)return NULL;
 	switch(w->action){
@@ -58,7 +82,19 @@ void*scheduler_worker(void*data){
 			case STATUS_STOPPING:
 			case STATUS_STARTED:
 			case STATUS_RUNNING:break;
-			default:svc_start_service_nodep(w->service);
+			default:
+				if(!w->failed_dep){
+					svc_start_service_nodep(w->service);
+					break;
+				}
+				tlog_error(
+					"Depend %s for %s start failed",
+					svc_get_desc(w->failed_dep),
+					svc_get_desc(w->service)
+				);
+				MUTEX_LOCK(w->service->lock);
+				w->service->status=STATUS_FAILED;
+				MUTEX_UNLOCK(w->service->lock);
 		}break;
 		case SCHED_STOP:switch(w->service->status){
 			case STATUS_STARTING:
@@ -71,7 +107,19 @@ void*scheduler_worker(void*data){
 		case SCHED_RESTART:svc_restart_service(w->service);break;
 		default:;
 	}
+	MUTEX_LOCK(queue_lock);
+	if(w->action==SCHED_START&&w->service->status==STATUS_STARTING){
+		// wait for readiness, released by svc_graph_update
+		w->waiting=true;
+		MUTEX_UNLOCK(queue_lock);
+		oper_scheduler(&(struct scheduler_msg){.action=SCHED_DONE});
+		return NULL;
+	}
+	if(w->action==SCHED_START)svc_graph_done(w);
+	list_obj_del_data(&queue,w,NULL);
+	MUTEX_UNLOCK(queue_lock);
 	free_scheduler_work(w);
+	oper_scheduler(&(struct scheduler_msg){.action=SCHED_DONE});
 	return NULL;
 }
 
@@ -83,6 +131,7 @@ static int seconds_handler(){
 		cur=next,next=cur->next;
 		LIST_DATA_DECLARE(s,cur,struct service*);
 		if(!s)continue;
+		svc_notify_check_timeout(s);
 		time_t finish_offset=cur_time-(s->process.finish);
 		time_t update_offset=cur_time-(s->last_update);
 		time_t reset_delay=MAX(1,s->restart_delay)*5;
@@ -109,6 +158,220 @@ static int seconds_handler(){
 	return 0;
 }
 
+static inline time_t earliest(time_t a,time_t b){
+	return a<=0?b:b<=0?a:MIN(a,b);
+}
+
+// the time seconds_handler will act on service, 0 for none
+static time_t service_deadline(struct service*s){
+	time_t dl=0;
+	if(s->ready_deadline>0&&s->status==STATUS_STARTING&&!s->ready)
+		dl=s->ready_deadline;
+	if(s->wait_restart&&s->restart_delay>0&&s->process.finish>0)
+		dl=earliest(dl,s->process.finish+s->restart_delay+1);
+	else if(s->retry>0&&s->last_update>0)
+		dl=earliest(dl,s->last_update+MAX(1,s->restart_delay)*5+1);
+	dl=earliest(dl,svc_exec_deadline(s->start));
+	dl=earliest(dl,svc_exec_deadline(s->stop));
+	dl=earliest(dl,svc_exec_deadline(s->restart));
+	dl=earliest(dl,svc_exec_deadline(s->reload));
+	return dl;
+}
+
+static struct source*source_lookup(enum source_type type,struct service*svc,pid_t pid){
+	list*p;
+	if((p=list_first(sources)))do{
+		LIST_DATA_DECLARE(x,p,struct source*);
+		if(!x||x->type!=type)continue;
+		if(type==SOURCE_PROCESS?x->pid==pid:x->svc==svc)return x;
+	}while((p=p->next));
+	return NULL;
+}
+
+static struct source*source_add(enum source_type type,struct service*svc,pid_t pid,int fd){
+	struct source*x;
+	if(!(x=malloc(sizeof(struct source))))return NULL;
+	memset(x,0,sizeof(struct source));
+	x->type=type,x->svc=svc,x->pid=pid,x->fd=fd;
+	if(list_obj_add_new(&sources,x)!=0){
+		free(x);
+		return NULL;
+	}
+	return x;
+}
+
+static int source_watch(struct source*x){
+	struct epoll_event ev={.events=EPOLLIN,.data.ptr=x};
+	if(x->fd<0)return 0;
+	if(epoll_ctl(efd,EPOLL_CTL_ADD,x->fd,&ev)==0||errno==EEXIST)return 0;
+	return terlog_warn(-errno,"watch fd %d failed",x->fd);
+}
+
+// notify socket may be reopened with the same number, add it every time
+static void watch_notify(struct service*svc){
+	struct source*x;
+	if(!(x=source_lookup(SOURCE_NOTIFY,svc,0))&&
+		!(x=source_add(SOURCE_NOTIFY,svc,0,-1))
+	)return;
+	x->fd=svc->notify_fd,x->seen=true;
+	source_watch(x);
+}
+
+// a process without pidfd is still cleaned by SIGCHLD from init
+static void watch_process(struct service*svc,pid_t pid){
+	int fd=-1;
+	struct source*x;
+	if(pid<=0)return;
+	if((x=source_lookup(SOURCE_PROCESS,NULL,pid))){
+		x->svc=svc,x->seen=true;
+		return;
+	}
+	// share the pidfd held since adoption, it can not refer to a reused pid
+	if(pid==svc->process.pid&&svc->pidfd>=0)
+		fd=fcntl(svc->pidfd,F_DUPFD_CLOEXEC,0);
+	if(fd<0)fd=svc_pidfd_open(pid);
+	if(!(x=source_add(SOURCE_PROCESS,svc,pid,fd))){
+		if(fd>=0)close(fd);
+		return;
+	}
+	x->seen=true;
+	source_watch(x);
+}
+
+static int source_free(void*d){
+	struct source*x=d;
+	if(!x)return 0;
+	if(x->type==SOURCE_PROCESS&&x->fd>=0)close(x->fd);
+	free(x);
+	return 0;
+}
+
+static void arm_timer(time_t dl){
+	struct itimerspec its;
+	memset(&its,0,sizeof(its));
+	// a deadline not cleared by the last tick must not spin the loop
+	if(dl>0&&dl<=last_tick)dl=last_tick+1;
+	its.it_value.tv_sec=dl;
+	if(timerfd_settime(
+		timer.fd,TFD_TIMER_ABSTIME|TFD_TIMER_CANCEL_ON_SET,&its,NULL
+	)<0)telog_warn("set scheduler timer failed");
+}
+
+// track sockets and processes of services, sleep until the nearest deadline
+static void scheduler_sync(){
+	time_t dl=0;
+	list*cur,*next;
+	if((cur=list_first(sources)))do{
+		LIST_DATA(cur,struct source*)->seen=false;
+	}while((cur=cur->next));
+	MUTEX_LOCK(services_lock);
+	if((next=list_first(services)))do{
+		cur=next,next=cur->next;
+		LIST_DATA_DECLARE(s,cur,struct service*);
+		if(!s)continue;
+		if(s->notify_fd>=0)watch_notify(s);
+		if(s->process.running)watch_process(s,s->process.pid);
+		if(s->start&&s->start->status.running)watch_process(s,s->start->status.pid);
+		if(s->stop&&s->stop->status.running)watch_process(s,s->stop->status.pid);
+		if(s->restart&&s->restart->status.running)watch_process(s,s->restart->status.pid);
+		if(s->reload&&s->reload->status.running)watch_process(s,s->reload->status.pid);
+		dl=earliest(dl,service_deadline(s));
+	}while(next);
+	MUTEX_UNLOCK(services_lock);
+	if((next=list_first(sources)))do{
+		cur=next,next=cur->next;
+		LIST_DATA_DECLARE(x,cur,struct source*);
+		if(!x->seen)list_obj_del(&sources,cur,source_free);
+	}while(next);
+	arm_timer(dl);
+}
+
+static void scheduler_tick(){
+	uint64_t v;
+	// ECANCELED when clock changed, recheck deadlines anyway
+	if(read(timer.fd,&v,sizeof(v))<0&&errno==EAGAIN)return;
+	seconds_handler();
+	svc_check_all_exec_timeout();
+	time(&last_tick);
+}
+
+// reap process right away, or leave it to SIGCHLD if init got it first
+static void scheduler_process(struct source*x){
+	int st;
+	siginfo_t si;
+	memset(&si,0,sizeof(si));
+	if(x->fd<0)return;
+	epoll_ctl(efd,EPOLL_CTL_DEL,x->fd,NULL);
+	if(waitid((idtype_t)P_PIDFD,x->fd,&si,WEXITED|WNOHANG)==0&&si.si_pid==x->pid){
+		switch(si.si_code){
+			case CLD_EXITED:st=W_EXITCODE(si.si_status,0);break;
+			case CLD_KILLED:st=W_EXITCODE(0,si.si_status);break;
+			case CLD_DUMPED:st=W_EXITCODE(0,si.si_status)|WCOREFLAG;break;
+			default:st=-1;
+		}
+		if(st!=-1){
+			tlog_debug("clean process pid %d",x->pid);
+			svc_on_sigchld(x->pid,st);
+		}
+	}
+	close(x->fd);
+	x->fd=-1;
+}
+
+static bool scheduler_command(){
+	ssize_t s;
+	struct scheduler_msg msg;
+	for(;;){
+		memset(&msg,0,sizeof(struct scheduler_msg));
+		errno=0;
+		s=read(fds[0],&msg,sizeof(msg));
+		if(s<0&&errno==EINTR)continue;
+		if(s<0&&(errno==EAGAIN||errno==EWOULDBLOCK))return true;
+		if(s<=0)return false;
+		if(s!=sizeof(msg))continue;
+		switch(msg.action){
+			case SCHED_EXIT:return false;
+			case SCHED_UNKNOWN:
+			case SCHED_DONE:break;
+			case SCHED_CHILD:svc_on_sigchld(msg.data.exit.pid,msg.data.exit.stat);break;
+			case SCHED_START:
+			case SCHED_STOP:
+			case SCHED_RELOAD:
+			case SCHED_RESTART:add_queue(msg.data.service,msg.action);break;
+			case SCHED_STOP_ALL:add_all_stop_queue();
+			default:;
+		}
+		run_queue();
+	}
+}
+
+static int init_epoll(){
+	if((efd=epoll_create1(EPOLL_CLOEXEC))<0)
+		return terlog_crit(-1,"failed to create scheduler epoll");
+	if((timer.fd=timerfd_create(CLOCK_REALTIME,TFD_CLOEXEC|TFD_NONBLOCK))<0){
+		telog_crit("failed to create scheduler timer");
+		close(efd);
+		efd=-1;
+		return -1;
+	}
+	command.fd=fds[0];
+	if(source_watch(&command)<0||source_watch(&timer)<0){
+		close(timer.fd);
+		close(efd);
+		timer.fd=efd=-1;
+		return -1;
+	}
+	return 0;
+}
+
+static void clean_epoll(){
+	if(sources)list_free_all(sources,source_free);
+	sources=NULL;
+	if(timer.fd>=0)close(timer.fd);
+	if(efd>=0)close(efd);
+	timer.fd=efd=-1;
+}
+
 static int scheduler_main(){
 	open_socket_logfd_default();
 	prctl(PR_SET_NAME,NAME);
@@ -122,46 +385,39 @@ static int scheduler_main(){
 		service_workers=NULL;
 		return -1;
 	}
+	if(init_epoll()<0){
+		pool_destroy(service_workers);
+		service_workers=NULL;
+		return -1;
+	}
 	MUTEX_INIT(queue_lock);
-	fd_set fs;
-	struct timeval tv;
-	struct scheduler_msg msg;
+	int r;
 	bool run=true;
+	struct epoll_event evs[32];
 	while(run){
-		FD_ZERO(&fs);
-		FD_SET(fds[0],&fs);
-		tv.tv_sec=1,tv.tv_usec=0;
-		if(select(FD_SETSIZE,&fs,NULL,NULL,&tv)<0){
+		scheduler_sync();
+		if((r=epoll_wait(efd,evs,sizeof(evs)/sizeof(struct epoll_event),-1))<0){
 			if(errno==EINTR)continue;
-			perror("select");
+			telog_error("scheduler epoll failed");
 			break;
 		}
-		seconds_handler();
-		run_queue();
-		if(!FD_ISSET(fds[0],&fs))continue;
-		errno=0;
-		ssize_t s=read(fds[0],&msg,sizeof(msg));
-		if(errno==EAGAIN)continue;
-		if(s<0&&errno!=EINTR)break;
-		if(s!=sizeof(msg))continue;
-		switch(msg.action){
-			case SCHED_EXIT:run=false;
-			case SCHED_UNKNOWN:break;
-			case SCHED_CHILD:svc_on_sigchld(msg.data.exit.pid,msg.data.exit.stat);break;
-			case SCHED_START:
-			case SCHED_STOP:
-			case SCHED_RELOAD:
-			case SCHED_RESTART:add_queue(msg.data.service,msg.action);break;
-			case SCHED_STOP_ALL:add_all_stop_queue();
-			default:;
+		for(int i=0;i<r&&run;i++){
+			struct source*x=evs[i].data.ptr;
+			if(!x)continue;
+			switch(x->type){
+				case SOURCE_COMMAND:run=scheduler_command();break;
+				case SOURCE_TIMER:scheduler_tick();break;
+				case SOURCE_NOTIFY:svc_notify_read(x->svc);break;
+				case SOURCE_PROCESS:scheduler_process(x);break;
+			}
 		}
 		run_queue();
-		memset(&msg,0,sizeof(struct scheduler_msg));
 	}
 	if(!run){
 		close(fds[0]);
 		close(fds[1]);
 	}
+	clean_epoll();
 	tlog_info("scheduler exit");
 	MUTEX_DESTROY(queue_lock);
 	return run?0:1;
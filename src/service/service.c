@@ -7,6 +7,8 @@
  */
 
 #define _GNU_SOURCE
+#include<time.h>
+#include<errno.h>
 #include<string.h>
 #include<stdlib.h>
 #include"lock.h"
@@ -16,6 +18,9 @@
 #include"defines.h"
 #define TAG "service"
 
+// extra time over the longest stop timeout before give up waiting
+#define SHUTDOWN_MARGIN 5
+
 bool auto_restart=false;
 struct service*svc_default,*svc_system,*svc_network;
 
@@ -98,34 +103,68 @@ int svc_set_name(struct service*svc,char*name){
 	else return 0;
 }
 
+static long elapsed_ms(struct timespec*since){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (ts.tv_sec-since->tv_sec)*1000+(ts.tv_nsec-since->tv_nsec)/1000000;
+}
+
+static bool svc_is_down(struct service*svc){
+	switch(svc->status){
+		case STATUS_UNKNOWN:
+		case STATUS_STOPPED:
+		case STATUS_FAILED:return true;
+		default:return false;
+	}
+}
+
 int service_wait_all_stop(){
+	list*cur,*next,*wait=NULL;
+	time_t timeout=0;
+	struct timespec begin,deadline;
 	auto_restart=false;
+	if(!services||!list_first(services))return 0;
+	unsigned long serial=svc_state_serial();
+	clock_gettime(CLOCK_MONOTONIC,&begin);
 	service_stop_all();
-	list*cur,*next,*first;
-	if(!services||!(first=list_first(services)))return 0;
-	bool complete=false,show=false;
-	while(!complete){
-		next=first,complete=true;
-		do{
+	if((next=list_first(services)))do{
+		cur=next,next=cur->next;
+		LIST_DATA_DECLARE(s,cur,struct service*);
+		if(!s||svc_is_down(s))continue;
+		if(list_obj_add_new(&wait,s)!=0)continue;
+		if(s->stop)timeout=MAX(timeout,s->stop->prop.timeout);
+		// not queued by stop all, stop it alone
+		if(!s->stop_on_shutdown&&s->status!=STATUS_STOPPING)service_stop(s);
+	}while(next);
+	if(!wait){
+		tlog_info("all services stopped");
+		return 0;
+	}
+	tlog_notice("wait %d services stop",list_count(wait));
+	clock_gettime(CLOCK_REALTIME,&deadline);
+	deadline.tv_sec+=timeout+SHUTDOWN_MARGIN;
+	for(;;){
+		if((next=list_first(wait)))do{
 			cur=next,next=cur->next;
 			LIST_DATA_DECLARE(s,cur,struct service*);
-			if(!s)continue;
-			switch(s->status){
-				case STATUS_UNKNOWN:
-				case STATUS_STOPPED:
-				case STATUS_FAILED:break;
-				case STATUS_STARTED:
-				case STATUS_RUNNING:service_stop(s);//fallthrough
-				case STATUS_STARTING:
-				case STATUS_STOPPING:complete=false;
-			}
+			if(!svc_is_down(s))continue;
+			tlog_info(
+				"Service %s stopped in %ldms",svc_get_desc(s),
+				elapsed_ms(s->stop_begin.tv_sec>0?&s->stop_begin:&begin)
+			);
+			list_obj_del(&wait,cur,NULL);
 		}while(next);
-		if(!complete){
-			if(!show)tlog_notice("wait all services stop");
-			show=true;
-			xsleep(1);
-		}else tlog_info("all services stopped");
+		if(!wait)break;
+		if(svc_wait_state(&serial,&deadline)!=0&&errno==ETIMEDOUT){
+			if((next=list_first(wait)))do{
+				LIST_DATA_DECLARE(s,next,struct service*);
+				tlog_warn("Service %s does not stop in time",svc_get_desc(s));
+			}while((next=next->next));
+			list_free_all(wait,NULL);
+			ERET(ETIMEDOUT);
+		}
 	}
+	tlog_info("all services stopped in %ldms",elapsed_ms(&begin));
 	return 0;
 }
 
@@ -19,6 +19,7 @@
 #include"logger.h"
 #include"defines.h"
 #include"service.h"
+#include"trace.h"
 #define TAG "service"
 
 static int svc_on_exit_main(struct service*svc,bool fail){
@@ -32,12 +33,19 @@ static int svc_on_exit_main(struct service*svc,bool fail){
 		break;
 		case WORK_DAEMON:
 		case WORK_FOREGROUND:
-			if(
+			svc_notify_close(svc);
+			svc_untrack_process(svc);
+			if(svc->status==STATUS_STARTING&&svc->notify){
+				tlog_warn("service %s exited before ready",name);
+				memset(&svc->process,0,sizeof(struct proc_status));
+				fail=true;
+			}else if(
 				svc->status!=STATUS_RUNNING&&
 				svc->status!=STATUS_STOPPING
 			){
 				tlog_warn("service %s does not running %s",name,svc_status_string(svc->status));
 				memset(&svc->process,0,sizeof(struct proc_status));
+				if(svc->status==STATUS_FAILED)fail=true;
 			}else{
 				confd_delete_base("runtime.pid",svc->name);
 				tlog_notice(fail?"Service %s failed":"Stopped service %s",name);
@@ -79,7 +87,11 @@ static int svc_on_exit_start(struct svc_exec*exec,struct service*svc,bool fail){
 	}
 	switch(svc->mode){
 		case WORK_DAEMON:
-			if(svc_daemon_get_pid(svc)<0)return -1;
+			if(svc_daemon_get_pid(svc)<0){
+				svc_notify_close(svc);
+				return -1;
+			}
+			if(svc->status==STATUS_STARTING)return 0;
 			break;
 		case WORK_ONCE:
 			svc->status=fail?STATUS_FAILED:STATUS_STARTED;
@@ -109,6 +121,10 @@ static int svc_on_exit_stop(struct svc_exec*exec,struct service*svc){
 		(svc->start&&!svc->start->status.running)
 	)svc->status=STATUS_STOPPED;
 	if(stat!=STATUS_STOPPED)tlog_notice("Stopped service %s",name);
+	if(stat!=STATUS_STOPPED&&svc->stop_begin.tv_sec>0)trace_span(
+		(uint64_t)svc->stop_begin.tv_sec*1000000000+svc->stop_begin.tv_nsec,
+		trace_now(),"stop","%s",svc->name
+	);
 	return 0;
 }
 
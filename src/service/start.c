@@ -63,14 +63,14 @@ int svc_daemon_get_pid(struct service*svc){
 		svc->status=STATUS_FAILED;
 		return -1;
 	}
-	if(!is_file(_PATH_PROC"/%d/comm",p)){
+	if(svc_track_process(svc,p)!=0){
 		tlog_warn("PID %d of service %s not found",p,name);
 		memset(&svc->process,0,sizeof(struct proc_status));
 		svc->status=STATUS_STOPPED;
 		return -1;
 	}
 	confd_set_integer_base("runtime.pid",svc->name,p);
-	svc->status=STATUS_RUNNING;
+	svc->status=svc->notify&&!svc->ready?STATUS_STARTING:STATUS_RUNNING;
 	svc->process.pid=p;
 	svc->process.running=true;
 	svc->process.start=svc->start->status.start;
@@ -91,6 +91,7 @@ int svc_start_service_nodep(struct service*svc){
 		tlog_warn("service %s has no start operation",name);
 		goto failed;
 	}
+	if(svc->notify&&svc_notify_open(svc)!=0)goto failed;
 	if(svc_run_exec(svc->start)!=0)goto failed;
 	if(svc->start->status.exit_code>0)goto failed;
 	if(svc->start->status.exit_signal>0)goto failed;
@@ -100,6 +101,7 @@ int svc_start_service_nodep(struct service*svc){
 			if(run){
 				memcpy(&svc->process,&svc->start->status,sizeof(struct proc_status));
 				memset(&svc->start->status,0,sizeof(struct proc_status));
+				svc_track_process(svc,svc->process.pid);
 				confd_set_integer_base("runtime.pid",svc->name,svc->process.pid);
 				goto running;
 			}else goto stopped;
@@ -113,6 +115,11 @@ int svc_start_service_nodep(struct service*svc){
 	}
 	errno=0;
 	running:
+	if(svc->notify&&!svc->ready){
+		tlog_info("Waiting service %s ready",name);
+		svc->status=STATUS_STARTING,errno=0;
+		goto done;
+	}
 	tlog_notice("Started service %s",name);
 	svc->status=STATUS_RUNNING,errno=0;
 	goto done;
@@ -126,56 +133,47 @@ int svc_start_service_nodep(struct service*svc){
 	goto done;
 	failed:
 	telog_warn("Start service %s failed",name);
+	svc_notify_close(svc);
 	svc->status=STATUS_FAILED;
 	done:
 	MUTEX_UNLOCK(svc->lock);
 	return errno;
 }
 
-static int _svc_start_service(struct service*svc,list*chain){
-	if(check_start_service(svc)!=0)return -errno;
-	if(svc->depends_on){
-		list*cur,*next;
-		if((next=list_first(chain)))do{
-			cur=next;
-			LIST_DATA_DECLARE(s,cur,struct service*);
-			if(s!=svc)continue;
-			tlog_error(
-				"Depends chain loop detect on %s",
-				svc_get_desc(svc)
-			);
-			ERET(ELOOP);
-		}while((next=cur->next));
-		if(list_push_new(chain,svc)!=0)return -errno;
-		int e=0;
-		if((next=list_first(svc->depends_on)))do{
-			cur=next;
-			if(!cur->data)continue;
-			LIST_DATA_DECLARE(s,cur,struct service*);
-			if(check_start_service(s)!=0)continue;
-			errno=0;
-			if(_svc_start_service(s,chain)<0){
-				e=errno;
-				telog_error(
-					"Depend %s for %s start failed",
-					svc_get_desc(s),
-					svc_get_desc(svc)
-				);
-			}
-		}while((next=cur->next));
-		if(e!=0)return -(errno=e);
-	}
-	errno=0;
-	return svc_start_service_nodep(svc);
+static struct service*failed_depend(struct service*svc){
+	list*p;
+	if((p=list_first(svc->depends_on)))do{
+		LIST_DATA_DECLARE(s,p,struct service*);
+		if(s&&s->status==STATUS_FAILED)return s;
+	}while((p=p->next));
+	return NULL;
 }
 
 int svc_start_service(struct service*svc){
-	list*l=list_new(NULL);
-	if(!l)return -errno;
-	_svc_start_service(svc,l);
-	int r=errno;
-	list_free_all(l,NULL);
-	return -(errno=r);
+	int e=0;
+	list*order=NULL,*p;
+	struct service*f;
+	if(check_start_service(svc)!=0)return -errno;
+	if(svc_graph_order(svc,&order)!=0)return -errno;
+	if((p=list_first(order)))do{
+		LIST_DATA_DECLARE(s,p,struct service*);
+		if(s!=svc&&check_start_service(s)!=0)continue;
+		if((f=failed_depend(s))){
+			tlog_error(
+				"Depend %s for %s start failed",
+				svc_get_desc(f),
+				svc_get_desc(s)
+			);
+			s->status=STATUS_FAILED;
+			if(e==0)e=EIO;
+			continue;
+		}
+		errno=0;
+		if(svc_start_service_nodep(s)!=0&&e==0)e=errno;
+		else if(s->status==STATUS_STARTING&&svc_wait_ready(s)!=0&&e==0)e=errno;
+	}while((p=p->next));
+	list_free_all(order,NULL);
+	return -(errno=e);
 }
 
 int svc_start_service_by_name(char*name){
@@ -6,6 +6,7 @@
  *
  */
 
+#include<time.h>
 #include<pthread.h>
 #include"service.h"
 #include"defines.h"
@@ -46,6 +47,7 @@ int svc_stop_service_nodep(struct service*svc){
 	tlog_notice("Stopping service %s",name);
 	enum svc_status old=svc->status;
 	svc->status=STATUS_STOPPING;
+	clock_gettime(CLOCK_MONOTONIC,&svc->stop_begin);
 	if(svc->mode==WORK_FAKE)goto stopped;
 	if(!svc->stop){
 		if(svc->mode==WORK_ONCE)goto stopped;
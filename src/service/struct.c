@@ -46,6 +46,9 @@ struct service*svc_new_service(char*name,enum svc_work mode){
 	svc->status=STATUS_STOPPED;
 	svc->stdio_syslog=true;
 	svc->stop_on_shutdown=true;
+	svc->notify_fd=-1;
+	svc->pidfd=-1;
+	svc->ready_timeout=30;
 	return svc;
 	fail:
 	svc_free_service(svc);
@@ -92,8 +95,11 @@ void svc_free_exec(struct svc_exec*exec){
 void svc_free_service(struct service*svc){
 	if(!svc)return;
 	MUTEX_DESTROY(svc->lock);
+	svc_notify_close(svc);
+	svc_untrack_process(svc);
 	_xfree(svc->name);
 	_xfree(svc->description);
+	_xfree(svc->notify_status);
 	list_free_all(svc->depends_on,NULL);
 	list_free_all(svc->depends_of,NULL);
 	svc_free_exec(svc->start);
@@ -14,6 +14,7 @@ DECLARE_MAIN(benchmark);
 DECLARE_MAIN(bootmenu);
 DECLARE_MAIN(cd);
 DECLARE_MAIN(cat);
+DECLARE_MAIN(confbench);
 DECLARE_MAIN(confctl);
 DECLARE_MAIN(confget);
 DECLARE_MAIN(confset);
@@ -33,6 +34,7 @@ DECLARE_MAIN(logdumpenv);
 DECLARE_MAIN(exit);
 DECLARE_MAIN(dumpinput);
 DECLARE_MAIN(findfs);
+DECLARE_MAIN(fsbench);
 DECLARE_MAIN(guiapp);
 DECLARE_MAIN(help);
 DECLARE_MAIN(hotplug);
@@ -78,6 +80,7 @@ const struct shell_command*shell_cmds[]={
 	DECLARE_CMD(true,  modprobe,    "Add and remove modules from the Linux Kernel")
 	DECLARE_CMD(true,  rmmod,       "Remove a module from the Linux Kernel")
 	DECLARE_CMD(true,  findfs,      "Find a filesystem by label or UUID")
+	DECLARE_CMD(true,  fsbench,     "File system transfer benchmark")
 	#ifdef ENABLE_GUI
 	DECLARE_CMD(true,  benchmark,   "GUI Benchmark")
 	DECLARE_CMD(true,  guiapp,      "GUI Application")
@@ -91,6 +94,7 @@ const struct shell_command*shell_cmds[]={
 	DECLARE_CMD(true,  confset,     "Set config item")
 	DECLARE_CMD(true,  confdel,     "Delete config item")
 	DECLARE_CMD(true,  confdump,    "Dump config store")
+	DECLARE_CMD(true,  confbench,   "Config daemon get and set benchmark")
 	DECLARE_CMD(true,  cat,         "Concatenate FILE(s) to standard output.")
 	DECLARE_CMD(false, close,       "Close a file descriptor")
 	DECLARE_CMD(false, cd,          "Change directory")